@@ -26,7 +26,9 @@
 #import "AudioScrobbler.h"
 #import "iScrobbler.h"
 #import "AudioStream.h"
+#import "AlbumArtCache.h"
 #import "AudioMetadataWriter.h"
+#import "AudioMetadataWriteQueue.h"
 #import "PreferencesController.h"
 #import "PTHotKey.h"
 #import "PTHotKeyCenter.h"
@@ -184,6 +186,10 @@
 												 name:AudioStreamsDidChangeNotification
 											   object:nil];
 
+	// Send any Last.fm commands left over from the last session
+	if([[NSUserDefaults standardUserDefaults] boolForKey:@"enableAudioScrobbler"] && [AudioScrobbler hasUnsubmittedCommands])
+		[self audioScrobbler];
+
 	// Check for and send crash reports
 	[SFBCrashReporter checkForNewCrashes];
 }
@@ -197,6 +203,9 @@
 //	if([[NSUserDefaults standardUserDefaults] boolForKey:@"enableiScrobbler"])
 //		[[self iScrobbler] shutdown];
 
+	// Don't lose tag edits still waiting to be written
+	[[AudioMetadataWriteQueue sharedQueue] waitUntilAllWritesAreFinished];
+
 	// Just unregister for all notifications
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	
@@ -212,6 +221,9 @@
 	
 	// Save player state
 	[[AudioLibrary library] saveStateToDefaults];
+
+	// Write the library snapshot so the next launch does not need to read every stream from the database
+	[[[CollectionManager manager] streamManager] writeSnapshot];
 }
 
 - (BOOL) applicationShouldTerminateAfterLastWindowClosed:(NSApplication *)theApplication
@@ -398,11 +410,12 @@
 
 		NSString *notificationTitle			= (nil == title ? @"" : title);
 		NSString *notificationDescription	= (nil == artist ? @"" : artist);
+		NSImage *albumArt					= [[AlbumArtCache sharedCache] thumbnailForStream:stream size:128];
 				
 		[GrowlApplicationBridge notifyWithTitle:notificationTitle
 									description:notificationDescription
 							   notificationName:@"Track Playback Started" 
-									   iconData:nil/*[stream valueForKey:@"albumArt"]*/
+									   iconData:(nil == albumArt ? nil : [albumArt TIFFRepresentation])
 									   priority:0 
 									   isSticky:NO 
 								   clickContext:[stream valueForKey:ObjectIDKey]];
@@ -0,0 +1,176 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AudioEventQueue.h"
+
+#include <stdlib.h>
+
+#if defined(__APPLE__)
+#  include <libkern/OSAtomic.h>
+#  include <mach/mach_time.h>
+#  define event_memory_barrier()						OSMemoryBarrier()
+#  define event_compare_and_swap(old, new, address)	OSAtomicCompareAndSwap32Barrier((int32_t)(old), (int32_t)(new), (volatile int32_t *)(address))
+#  define event_increment(address)						OSAtomicIncrement32Barrier((volatile int32_t *)(address))
+#else
+#  include <time.h>
+#  define event_memory_barrier()						__sync_synchronize()
+#  define event_compare_and_swap(old, new, address)	__sync_bool_compare_and_swap((address), (old), (new))
+#  define event_increment(address)						__sync_fetch_and_add((address), 1)
+#endif
+
+// Each cell's sequence number says whose turn it is: it equals the enqueue position
+// when the cell is free and the position plus one once an event has been written
+typedef struct {
+	volatile uint32_t	sequence;
+	AudioEvent			event;
+} AudioEventQueueCell;
+
+struct AudioEventQueue {
+	AudioEventQueueCell		*cells;
+	uint32_t				mask;
+	
+	volatile uint32_t		enqueuePosition;
+	uint32_t				dequeuePosition;
+	
+	volatile uint32_t		droppedCount;
+};
+
+AudioEventQueue *
+audio_event_queue_create(unsigned capacity)
+{
+	AudioEventQueue		*queue		= calloc(1, sizeof(AudioEventQueue));
+	uint32_t			size		= 2;
+	uint32_t			i;
+	
+	if(NULL == queue)
+		return NULL;
+	
+	while(size < capacity)
+		size <<= 1;
+	
+	queue->cells = calloc(size, sizeof(AudioEventQueueCell));
+	if(NULL == queue->cells) {
+		free(queue);
+		return NULL;
+	}
+	
+	queue->mask = size - 1;
+	
+	for(i = 0; i < size; ++i)
+		queue->cells[i].sequence = i;
+	
+	return queue;
+}
+
+void
+audio_event_queue_destroy(AudioEventQueue *queue)
+{
+	if(NULL == queue)
+		return;
+	
+	free(queue->cells);
+	free(queue);
+}
+
+int
+audio_event_queue_push(AudioEventQueue *queue, uint32_t type, void *object, int64_t frame)
+{
+	AudioEventQueueCell		*cell;
+	uint32_t				position	= queue->enqueuePosition;
+	
+	// Claim a cell by advancing the enqueue position past it
+	for(;;) {
+		cell = queue->cells + (position & queue->mask);
+		
+		uint32_t	sequence		= cell->sequence;
+		int32_t		difference		= (int32_t)(sequence - position);
+		
+		event_memory_barrier();
+		
+		if(0 == difference) {
+			if(event_compare_and_swap(position, position + 1, &queue->enqueuePosition))
+				break;
+		}
+		else if(0 > difference) {
+			event_increment(&queue->droppedCount);
+			return 0;
+		}
+		
+		position = queue->enqueuePosition;
+	}
+	
+	cell->event.type		= type;
+	cell->event.object		= object;
+	cell->event.frame		= frame;
+	cell->event.timestamp	= audio_event_current_time();
+	
+	// Publish the event
+	event_memory_barrier();
+	cell->sequence = position + 1;
+	
+	return 1;
+}
+
+int
+audio_event_queue_pop(AudioEventQueue *queue, AudioEvent *event)
+{
+	uint32_t				position	= queue->dequeuePosition;
+	AudioEventQueueCell		*cell		= queue->cells + (position & queue->mask);
+	
+	if(0 > (int32_t)(cell->sequence - (position + 1)))
+		return 0;
+	
+	event_memory_barrier();
+	*event = cell->event;
+	
+	// Hand the cell back to the producers for the next lap around the ring
+	event_memory_barrier();
+	cell->sequence			= position + queue->mask + 1;
+	queue->dequeuePosition	= position + 1;
+	
+	return 1;
+}
+
+uint32_t
+audio_event_queue_dropped_count(AudioEventQueue *queue)
+{
+	return queue->droppedCount;
+}
+
+double
+audio_event_current_time(void)
+{
+#if defined(__APPLE__)
+	static double secondsPerTick = 0;
+	
+	// Initialization is idempotent, so a race here is harmless
+	if(0 == secondsPerTick) {
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		secondsPerTick = (double)timebase.numer / timebase.denom / 1000000000.0;
+	}
+	
+	return mach_absolute_time() * secondsPerTick;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+#endif
+}
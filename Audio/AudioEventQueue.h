@@ -0,0 +1,66 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AUDIOEVENTQUEUE_H
+#define AUDIOEVENTQUEUE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// A bounded queue of timestamped events, written by any number of threads and
+// read by one consumer
+// Pushing never allocates memory or takes locks, so events may be posted from a
+// render callback; if the queue is full the event is dropped and counted
+// ========================================
+
+typedef struct {
+	uint32_t		type;
+	void			*object;				// Not retained
+	int64_t			frame;
+	double			timestamp;				// Seconds, from audio_event_current_time()
+} AudioEvent;
+
+typedef struct AudioEventQueue AudioEventQueue;
+
+// capacity is rounded up to a power of two
+AudioEventQueue * audio_event_queue_create(unsigned capacity);
+void audio_event_queue_destroy(AudioEventQueue *queue);
+
+// May be called from any thread; returns 0 if the event was dropped
+int audio_event_queue_push(AudioEventQueue *queue, uint32_t type, void *object, int64_t frame);
+
+// Must only be called from the consumer thread; returns 0 if the queue is empty
+int audio_event_queue_pop(AudioEventQueue *queue, AudioEvent *event);
+
+// The number of events dropped because the queue was full
+uint32_t audio_event_queue_dropped_count(AudioEventQueue *queue);
+
+// A monotonic clock, in seconds
+double audio_event_current_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUDIOEVENTQUEUE_H */
@@ -0,0 +1,115 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AudioHistogram.h"
+
+#include <string.h>
+
+#define SUB_BUCKET_COUNT		(1 << AUDIO_HISTOGRAM_SUB_BUCKET_BITS)
+
+// Values below twice the sub-bucket count are recorded exactly; above that each power of
+// two is split into SUB_BUCKET_COUNT equal buckets
+static unsigned
+bucket_index_for_value(uint64_t value)
+{
+	unsigned msb = 0;
+	
+	if(value < (2 * SUB_BUCKET_COUNT))
+		return (unsigned)value;
+	
+	while(63 > msb && (value >> (msb + 1)))
+		++msb;
+	
+	unsigned shift = msb - AUDIO_HISTOGRAM_SUB_BUCKET_BITS;
+	return (2 * SUB_BUCKET_COUNT) + ((msb - AUDIO_HISTOGRAM_SUB_BUCKET_BITS - 1) * SUB_BUCKET_COUNT) + (unsigned)((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+static uint64_t
+highest_value_in_bucket(unsigned index)
+{
+	if(index < (2 * SUB_BUCKET_COUNT))
+		return index;
+	
+	unsigned	offset		= index - (2 * SUB_BUCKET_COUNT);
+	unsigned	msb			= (offset / SUB_BUCKET_COUNT) + AUDIO_HISTOGRAM_SUB_BUCKET_BITS + 1;
+	uint64_t	top			= SUB_BUCKET_COUNT + (offset % SUB_BUCKET_COUNT);
+	unsigned	shift		= msb - AUDIO_HISTOGRAM_SUB_BUCKET_BITS;
+	
+	return ((top + 1) << shift) - 1;
+}
+
+void
+audio_histogram_reset(AudioHistogram *histogram)
+{
+	memset((void *)histogram, 0, sizeof(AudioHistogram));
+	histogram->minimum = UINT64_MAX;
+}
+
+void
+audio_histogram_record(AudioHistogram *histogram, uint64_t value)
+{
+	++histogram->counts[bucket_index_for_value(value)];
+	++histogram->totalCount;
+	
+	histogram->sum += value;
+	
+	if(value < histogram->minimum)
+		histogram->minimum = value;
+	if(value > histogram->maximum)
+		histogram->maximum = value;
+}
+
+uint64_t
+audio_histogram_value_at_percentile(const AudioHistogram *histogram, double percentile)
+{
+	uint32_t	totalCount		= histogram->totalCount;
+	uint64_t	countToReach	= (uint64_t)((percentile / 100.0) * totalCount + 0.5);
+	uint64_t	count			= 0;
+	unsigned	i;
+	
+	if(0 == totalCount)
+		return 0;
+	
+	if(0 == countToReach)
+		countToReach = 1;
+	
+	for(i = 0; i < AUDIO_HISTOGRAM_BUCKET_COUNT; ++i) {
+		count += histogram->counts[i];
+		if(count >= countToReach) {
+			uint64_t value = highest_value_in_bucket(i);
+			return (value < histogram->maximum ? value : histogram->maximum);
+		}
+	}
+	
+	return histogram->maximum;
+}
+
+void
+audio_histogram_get_summary(const AudioHistogram *histogram, AudioHistogramSummary *summary)
+{
+	summary->count			= histogram->totalCount;
+	summary->minimum		= (0 < summary->count ? histogram->minimum : 0);
+	summary->maximum		= histogram->maximum;
+	summary->mean			= (0 < summary->count ? histogram->sum / summary->count : 0);
+	summary->median			= audio_histogram_value_at_percentile(histogram, 50);
+	summary->percentile90	= audio_histogram_value_at_percentile(histogram, 90);
+	summary->percentile99	= audio_histogram_value_at_percentile(histogram, 99);
+	summary->percentile999	= audio_histogram_value_at_percentile(histogram, 99.9);
+}
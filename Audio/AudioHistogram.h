@@ -0,0 +1,71 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AUDIOHISTOGRAM_H
+#define AUDIOHISTOGRAM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// A log-linear histogram of unsigned values (HDR style) with roughly 6% precision
+// over the full 64-bit range
+// Recording never allocates memory or takes locks; each histogram must have a
+// single writer, but may be read from any thread while values are recorded
+// ========================================
+
+#define AUDIO_HISTOGRAM_SUB_BUCKET_BITS		4
+#define AUDIO_HISTOGRAM_BUCKET_COUNT		((2 << AUDIO_HISTOGRAM_SUB_BUCKET_BITS) + ((64 - AUDIO_HISTOGRAM_SUB_BUCKET_BITS - 1) << AUDIO_HISTOGRAM_SUB_BUCKET_BITS))
+
+typedef struct {
+	volatile uint32_t		counts [AUDIO_HISTOGRAM_BUCKET_COUNT];
+	volatile uint32_t		totalCount;
+	volatile uint64_t		minimum;
+	volatile uint64_t		maximum;
+	volatile double			sum;
+} AudioHistogram;
+
+typedef struct {
+	uint32_t		count;
+	uint64_t		minimum;
+	uint64_t		maximum;
+	double			mean;
+	uint64_t		median;
+	uint64_t		percentile90;
+	uint64_t		percentile99;
+	uint64_t		percentile999;
+} AudioHistogramSummary;
+
+void audio_histogram_reset(AudioHistogram *histogram);
+void audio_histogram_record(AudioHistogram *histogram, uint64_t value);
+
+// percentile is in [0, 100]; the result is the upper bound of the bucket containing it
+uint64_t audio_histogram_value_at_percentile(const AudioHistogram *histogram, double percentile);
+
+void audio_histogram_get_summary(const AudioHistogram *histogram, AudioHistogramSummary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUDIOHISTOGRAM_H */
@@ -69,6 +69,7 @@ enum {
 	SInt64					_playingFrame;
 	SInt64					_totalFrames;
 	SInt64					_regionStartingFrame;
+	SInt64					_pregapFrameCount;			// Frames played before the current track's INDEX 01
 	
 	NSTimer					*_timer;
 	AUEventListenerRef		_auEventListener;
@@ -81,6 +82,8 @@ enum {
 	float					_preAmplification;
 		
 	BOOL					_playing;
+	BOOL					_requestedNextStream;
+	BOOL					_seeking;
 
 	AudioLibrary			*_owner;
 	NSRunLoop				*_runLoop;
@@ -23,6 +23,12 @@
 #import "ScheduledAudioRegion.h"
 #import "AudioLibrary.h"
 #import "AudioStream.h"
+#import "CollectionManager.h"
+#import "AudioStreamManager.h"
+#import "FLACDecoder.h"
+#import "ResamplingDecoder.h"
+#import "ChannelMixingDecoder.h"
+#import "ScheduledSoundPlayerOutput.h"
 
 #include <CoreServices/CoreServices.h>
 #include <CoreAudio/CoreAudio.h>
@@ -111,6 +117,7 @@ NSString *const		AudioPlayerErrorDomain					= @"org.sbooth.Play.ErrorDomain.Audi
 
 - (SInt64) playingFrame;
 - (void) setPlayingFrame:(SInt64)playingFrame;
+- (void) seekByRestartingSchedulerToFrame:(SInt64)currentFrame;
 
 - (void) setOutputDeviceUID:(NSString *)deviceUID;
 - (OSStatus) setOutputDeviceSampleRate:(Float64)sampleRate;
@@ -127,10 +134,19 @@ NSString *const		AudioPlayerErrorDomain					= @"org.sbooth.Play.ErrorDomain.Audi
 - (void) setReplayGain:(float)replayGain;
 
 - (void) prepareToPlayStream:(AudioStream *)stream;
-- (NSNumber *) setReplayGainForStream:(AudioStream *)stream;
+- (BOOL) getReplayGain:(float *)replayGain preAmplification:(float *)preAmplification forStream:(AudioStream *)stream;
+- (float) gainForStream:(AudioStream *)stream;
+- (ScheduledAudioRegion *) scheduledAudioRegionForStream:(AudioStream *)stream decoder:(id <AudioDecoderMethods>)decoder;
+
+- (void) updateDSPParametersFromDefaults;
 
 - (void) setFormat:(AudioStreamBasicDescription)format;
 - (void) setChannelLayout:(AudioChannelLayout)channelLayout;
+
+- (void) saveSeekIndexFromDecoder:(id <AudioDecoderMethods>)decoder forStream:(AudioStream *)stream;
+
+- (id <AudioDecoderMethods>) decoder:(id <AudioDecoderMethods>)decoder convertedToSampleRate:(Float64)sampleRate;
+- (id <AudioDecoderMethods>) decoder:(id <AudioDecoderMethods>)decoder mixedToChannelLayout:(AudioChannelLayout)channelLayout channelCount:(UInt32)channelCount;
 @end
 
 // ========================================
@@ -204,8 +220,12 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 		[self setupAUGraph];
 
 		_scheduler = [[AudioScheduler alloc] init];
-		[_scheduler setAudioUnit:_generatorUnit];
+		[_scheduler setOutput:[ScheduledSoundPlayerOutput outputWithAudioUnit:_generatorUnit]];
 		[_scheduler setDelegate:self];
+		[_scheduler setCrossfadeDuration:[[NSUserDefaults standardUserDefaults] doubleForKey:@"crossfadeDuration"]];
+		[_scheduler setCrossfadeCurve:[[NSUserDefaults standardUserDefaults] integerForKey:@"crossfadeCurve"]];
+		[_scheduler setStatisticsLogInterval:[[NSUserDefaults standardUserDefaults] doubleForKey:@"schedulerStatisticsLogInterval"]];
+		[self updateDSPParametersFromDefaults];
 		
 		// Set up a timer to update the UI 4 times per second
 		_timer = [NSTimer timerWithTimeInterval:0.25 target:self selector:@selector(uiTimerFireMethod:) userInfo:nil repeats:YES];
@@ -223,6 +243,22 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 																  forKeyPath:@"values.outputAudioDeviceUID"
 																	 options:0
 																	 context:NULL];		
+
+		// Listen for changes to the crossfade settings
+		[[NSUserDefaultsController sharedUserDefaultsController] addObserver:self 
+																  forKeyPath:@"values.crossfadeDuration"
+																	 options:0
+																	 context:NULL];		
+		[[NSUserDefaultsController sharedUserDefaultsController] addObserver:self 
+																  forKeyPath:@"values.crossfadeCurve"
+																	 options:0
+																	 context:NULL];		
+
+		// Listen for changes to the equalizer
+		[[NSUserDefaultsController sharedUserDefaultsController] addObserver:self 
+																  forKeyPath:@"values.equalizerBands"
+																	 options:0
+																	 context:NULL];		
 	}
 	return self;
 }
@@ -243,6 +279,12 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 
 	[[NSUserDefaultsController sharedUserDefaultsController] removeObserver:self 
 																 forKeyPath:@"values.outputAudioDeviceUID"];
+	[[NSUserDefaultsController sharedUserDefaultsController] removeObserver:self 
+																 forKeyPath:@"values.crossfadeDuration"];
+	[[NSUserDefaultsController sharedUserDefaultsController] removeObserver:self 
+																 forKeyPath:@"values.crossfadeCurve"];
+	[[NSUserDefaultsController sharedUserDefaultsController] removeObserver:self 
+																 forKeyPath:@"values.equalizerBands"];
 		
 	[_runLoop release], _runLoop = nil;
 	[_scheduler release], _scheduler = nil;
@@ -257,6 +299,12 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 {
 	if(object == [NSUserDefaultsController sharedUserDefaultsController] && [keyPath isEqualToString:@"values.outputAudioDeviceUID"])
 		[self setOutputDeviceUID:[[NSUserDefaults standardUserDefaults] objectForKey:@"outputAudioDeviceUID"]];
+	else if(object == [NSUserDefaultsController sharedUserDefaultsController] && [keyPath isEqualToString:@"values.crossfadeDuration"])
+		[[self scheduler] setCrossfadeDuration:[[NSUserDefaults standardUserDefaults] doubleForKey:@"crossfadeDuration"]];
+	else if(object == [NSUserDefaultsController sharedUserDefaultsController] && [keyPath isEqualToString:@"values.crossfadeCurve"])
+		[[self scheduler] setCrossfadeCurve:[[NSUserDefaults standardUserDefaults] integerForKey:@"crossfadeCurve"]];
+	else if(object == [NSUserDefaultsController sharedUserDefaultsController] && [keyPath isEqualToString:@"values.equalizerBands"])
+		[self updateDSPParametersFromDefaults];
 }
 
 #pragma mark Stream Management
@@ -272,15 +320,23 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	[self setPlaying:NO];
 	
 	_regionStartingFrame = 0;		
+	_pregapFrameCount = 0;
+	_requestedNextStream = NO;
+	_seeking = NO;
 
 	OSStatus err = [self resetAUGraph];
 	if(noErr != err)
 		NSLog(@"AudioPlayer error: Unable to reset AUGraph AudioUnits: %i", err);
 	
-	id <AudioDecoderMethods> decoder = [stream decoder:error];
+	id <AudioDecoderMethods> decoder = [stream playbackDecoder:error];
 	if(nil == decoder)
 		return NO;
 
+	// If a fixed output sample rate is set, convert to it so the AUGraph and device never need to change rates
+	Float64 outputSampleRate = [[NSUserDefaults standardUserDefaults] doubleForKey:@"outputSampleRate"];
+	if(0 < outputSampleRate)
+		decoder = [self decoder:decoder convertedToSampleRate:outputSampleRate];
+
 	AudioStreamBasicDescription		format				= [self format];
 	AudioStreamBasicDescription		newFormat			= [decoder format];
 	
@@ -338,7 +394,10 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	}
 	
 	// Schedule the region for playback, and start scheduling audio slices
-	[[self scheduler] scheduleAudioRegion:[ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder]];
+	ScheduledAudioRegion *region = [self scheduledAudioRegionForStream:stream decoder:decoder];
+	_pregapFrameCount = [region pregapFrameCount];
+	
+	[[self scheduler] scheduleAudioRegion:region];
 	[[self scheduler] startScheduling];
 
 	[self prepareToPlayStream:stream];
@@ -353,7 +412,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	if(NO == [self isPlaying] || NO == [[self scheduler] isScheduling])
 		return NO;
 
-	id <AudioDecoderMethods> decoder = [stream decoder:error];
+	id <AudioDecoderMethods> decoder = [stream playbackDecoder:error];
 	if(nil == decoder)
 		return NO;
 
@@ -363,6 +422,22 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	AudioChannelLayout				channelLayout		= [self channelLayout];
 	AudioChannelLayout				nextChannelLayout	= [decoder channelLayout];
 	
+	// Nor does a differing channel layout- remix the next file to the current layout
+	if(nextFormat.mChannelsPerFrame != format.mChannelsPerFrame || NO == channelLayoutsAreEqual(&nextChannelLayout, &channelLayout)) {
+		id <AudioDecoderMethods> mixingDecoder = [self decoder:decoder mixedToChannelLayout:channelLayout channelCount:format.mChannelsPerFrame];
+		if(nil != mixingDecoder) {
+			decoder				= mixingDecoder;
+			nextFormat			= [decoder format];
+			nextChannelLayout	= channelLayout;
+		}
+	}
+	
+	// A differing sample rate alone doesn't prevent joining the two files- convert the next one to the current rate
+	if(nextFormat.mSampleRate != format.mSampleRate && nextFormat.mChannelsPerFrame == format.mChannelsPerFrame && channelLayoutsAreEqual(&nextChannelLayout, &channelLayout)) {
+		decoder		= [self decoder:decoder convertedToSampleRate:format.mSampleRate];
+		nextFormat	= [decoder format];
+	}
+	
 	BOOL	formatsMatch			= (nextFormat.mSampleRate == format.mSampleRate && nextFormat.mChannelsPerFrame == format.mChannelsPerFrame);
 	BOOL	channelLayoutsMatch		= channelLayoutsAreEqual(&nextChannelLayout, &channelLayout);
 	
@@ -371,7 +446,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 		return NO;
 
 	// The formats and channel layouts match, so schedule the region for playback
-	[[self scheduler] scheduleAudioRegion:[ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder]];
+	[[self scheduler] scheduleAudioRegion:[self scheduledAudioRegionForStream:stream decoder:decoder]];
 
 	return YES;
 }
@@ -395,6 +470,8 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	[self didChangeValueForKey:@"currentFrame"];
 
 	_regionStartingFrame = 0;
+	_pregapFrameCount = 0;
+	_seeking = NO;
 }
 
 - (BOOL) hasValidStream
@@ -502,7 +579,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 		if(totalFrames < desiredFrame)
 			desiredFrame = totalFrames;
 		
-		[self setCurrentFrame:desiredFrame];
+		[self setCurrentFrame:desiredFrame - [currentRegion pregapFrameCount]];
 	}	
 }
 
@@ -517,7 +594,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 		if(0 > desiredFrame)
 			desiredFrame = 0;
 		
-		[self setCurrentFrame:desiredFrame];
+		[self setCurrentFrame:desiredFrame - [currentRegion pregapFrameCount]];
 	}
 }
 
@@ -527,7 +604,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	
 	if(nil != currentRegion && [[currentRegion decoder] supportsSeeking]) {
 		SInt64 totalFrames = [[currentRegion decoder] totalFrames];		
-		[self setCurrentFrame:totalFrames - 1];
+		[self setCurrentFrame:totalFrames - [currentRegion pregapFrameCount] - 1];
 	}
 }
 
@@ -536,7 +613,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	ScheduledAudioRegion *currentRegion = [[self scheduler] regionBeingScheduled];
 	
 	if(nil != currentRegion && [[currentRegion decoder] supportsSeeking])
-		[self setCurrentFrame:0];
+		[self setCurrentFrame:-[currentRegion pregapFrameCount]];
 }
 
 - (BOOL) isPlaying
@@ -604,9 +681,10 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 
 - (SInt64)			totalFrames								{ return _totalFrames; }
 
+// Positions are counted from the track's INDEX 01, so its pregap plays at negative frames
 - (SInt64) currentFrame
 {
-	return [self startingFrame] + [self playingFrame] - _regionStartingFrame;
+	return [self startingFrame] + [self playingFrame] - _regionStartingFrame - _pregapFrameCount;
 }
 
 - (void) setCurrentFrame:(SInt64)currentFrame
@@ -617,52 +695,29 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	else if([self totalFrames] <= currentFrame)
 		currentFrame = [self totalFrames ] - 1;*/
 
-	BOOL resume = NO;
-
-	[[self scheduler] stopScheduling];
-	[[self scheduler] reset];
-
-	if([self isPlaying]) {
-		[self setPlaying:NO];
-		_regionStartingFrame = 0;		
-		resume = YES;
-	}
-	
-	OSStatus err = [self resetAUGraph];
-	if(noErr != err)
-		NSLog(@"AudioPlayer error: Unable to reset AUGraph AudioUnits: %i", err);
-
-	Float64 graphLatency;
-	err = [self getAUGraphLatency:&graphLatency];
-	if(noErr != err)
-		NSLog(@"AudioPlayer error: Unable to determine AUGraph latency: %i", err);
-	
-	UInt32 graphLatencyFrames = graphLatency * [self format].mSampleRate;
+	// Convert to a frame in the decoder, which includes the pregap
+	currentFrame += _pregapFrameCount;
 
-	currentFrame -= graphLatencyFrames;
+	// While playing a single region, let the scheduler seek without tearing down the AUGraph
+	if([self isPlaying] && [[self scheduler] isScheduling] && nil != [[self scheduler] regionBeingScheduled] && [[self scheduler] regionBeingScheduled] == [[self scheduler] regionBeingRendered]) {
+		if(0 > currentFrame)
+			currentFrame = 0;
+		else if(_pregapFrameCount + [self totalFrames] <= currentFrame)
+			currentFrame = _pregapFrameCount + [self totalFrames] - 1;
 		
-	if(0 > currentFrame)
-		currentFrame = 0;
-	else if([self totalFrames] <= currentFrame)
-		currentFrame = [self totalFrames ] - 1;
-	
-	[self setStartingFrame:[[[[self scheduler] regionBeingScheduled] decoder] seekToFrame:currentFrame + _regionStartingFrame]];
-	[self setPlayingFrame:0];
+		// Hold the displayed position until the scheduler reports where playback resumed
+		_seeking				= YES;
+		_regionStartingFrame	= 0;
+		
+		[self setStartingFrame:currentFrame];
+		[self setPlayingFrame:0];
 
-	AudioTimeStamp timeStamp = [[self scheduler] scheduledStartTime];
-	timeStamp.mSampleTime -= graphLatencyFrames;
-	
-	[[self scheduler] setScheduledStartTime:timeStamp];
-	
-#if DEBUG
-	if([self startingFrame] != currentFrame)
-		NSLog(@"Seek failed: requested frame %qi, got %qi", currentFrame, [self startingFrame]);
-#endif
+		[[self scheduler] seekRegionBeingScheduledToFrame:currentFrame];
 		
-	[[self scheduler] startScheduling];
+		return;
+	}
 	
-	if(resume)
-		[self play];
+	[self seekByRestartingSchedulerToFrame:currentFrame];
 }
 
 - (SInt64) framesRemaining
@@ -696,8 +751,44 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	NSLog(@"-audioSchedulerFinishedSchedulingRegion: %@", region);
 #endif
 
-	// Request the next stream from the library, to keep playback going
-	[_owner requestNextStream];
+	// Request the next stream from the library, to keep playback going, unless it was already requested for a crossfade
+	if(NO == _requestedNextStream)
+		[_owner requestNextStream];
+	
+	_requestedNextStream = NO;
+}
+
+- (void) audioSchedulerSeekedRegion:(NSDictionary *)schedulerAndRegion
+{
+	NSParameterAssert(nil != schedulerAndRegion);
+	
+	SInt64 frame = [[schedulerAndRegion valueForKey:ScheduledAudioRegionFrameKey] longLongValue];
+	
+	// The scheduler couldn't seek in place, so fall back to restarting it at the requested frame
+	if(-1 == frame) {
+		[self willChangeValueForKey:@"currentFrame"];
+		[self seekByRestartingSchedulerToFrame:[self startingFrame]];
+		[self didChangeValueForKey:@"currentFrame"];
+		return;
+	}
+	
+	[self willChangeValueForKey:@"currentFrame"];
+	[self setStartingFrame:frame];
+	[self setPlayingFrame:0];
+	[self didChangeValueForKey:@"currentFrame"];
+	
+	_seeking = NO;
+}
+
+- (void) audioSchedulerApproachingEndOfRegion:(NSDictionary *)schedulerAndRegion
+{
+	NSParameterAssert(nil != schedulerAndRegion);
+	
+	// Queue the next stream now so the scheduler can overlap it with the end of this one
+	if(NO == _requestedNextStream) {
+		_requestedNextStream = YES;
+		[_owner requestNextStream];
+	}
 }
 
 - (void) audioSchedulerStartedRenderingRegion:(NSDictionary *)schedulerAndRegion
@@ -710,13 +801,16 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	NSLog(@"-audioSchedulerStartedRenderingRegion: %@", region);
 #endif
 	
-	[self setTotalFrames:[[region decoder] totalFrames]];
+	// The pregap isn't counted in the track's length
+	_pregapFrameCount = [region pregapFrameCount];
+	[self setTotalFrames:[[region decoder] totalFrames] - _pregapFrameCount];
 	
 	[self willChangeValueForKey:@"hasValidStream"];
 	[self didChangeValueForKey:@"hasValidStream"];	
 
+	// If this region was crossfaded, its first frames were already played over the end of the previous one
 	[self willChangeValueForKey:@"currentFrame"];
-	[self setStartingFrame:0];
+	[self setStartingFrame:[region leadInFrames]];
 	[self setPlayingFrame:0];
 	[self didChangeValueForKey:@"currentFrame"];
 	
@@ -736,12 +830,16 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	NSLog(@"-audioSchedulerFinishedRenderingRegion: %@", region);
 #endif
 	
+	// Preserve any frame index built while decoding so future seeks in this stream are fast
+	[self saveSeekIndexFromDecoder:[region decoder] forStream:[_owner nowPlaying]];
+	
 	// If nothing is coming up right away, stop ourselves from playing
 	if(nil == [[self scheduler] regionBeingScheduled]) {
 		[self stopAUGraph];
 		[self setPlaying:NO];
 
 		_regionStartingFrame = 0;
+		_pregapFrameCount = 0;
 		
 		[self willChangeValueForKey:@"hasValidStream"];
 		[self didChangeValueForKey:@"hasValidStream"];	
@@ -844,6 +942,12 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	if(noErr != err)
 		return err;
 	
+	// Gain and limiting are performed by the scheduler's DSP chain; the node remains as the head of the effects chain
+	UInt32 bypass = 1;
+	err = AudioUnitSetProperty(_limiterUnit, kAudioUnitProperty_BypassEffect, kAudioUnitScope_Global, 0, &bypass, sizeof(bypass));
+	if(noErr != err)
+		return err;
+	
 	err = AUGraphNodeInfo([self auGraph], _outputNode, NULL, &_outputUnit);
 	if(noErr != err)
 		return err;
@@ -1734,7 +1838,7 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 
 - (void) uiTimerFireMethod:(NSTimer *)theTimer
 {
-	if(NO == [[self scheduler] isScheduling] || NO == [self isPlaying])
+	if(NO == [[self scheduler] isScheduling] || NO == [self isPlaying] || _seeking)
 		return;
 
 /*	Float32 averageCPULoad;
@@ -1783,6 +1887,59 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	_playingFrame = playingFrame;
 }
 
+- (void) seekByRestartingSchedulerToFrame:(SInt64)currentFrame
+{
+	BOOL resume = NO;
+
+	[[self scheduler] stopScheduling];
+	[[self scheduler] reset];
+	
+	_seeking = NO;
+
+	if([self isPlaying]) {
+		[self setPlaying:NO];
+		_regionStartingFrame = 0;		
+		resume = YES;
+	}
+	
+	OSStatus err = [self resetAUGraph];
+	if(noErr != err)
+		NSLog(@"AudioPlayer error: Unable to reset AUGraph AudioUnits: %i", err);
+
+	Float64 graphLatency;
+	err = [self getAUGraphLatency:&graphLatency];
+	if(noErr != err)
+		NSLog(@"AudioPlayer error: Unable to determine AUGraph latency: %i", err);
+	
+	UInt32 graphLatencyFrames = graphLatency * [self format].mSampleRate;
+
+	currentFrame -= graphLatencyFrames;
+		
+	if(0 > currentFrame)
+		currentFrame = 0;
+	else if(_pregapFrameCount + [self totalFrames] <= currentFrame)
+		currentFrame = _pregapFrameCount + [self totalFrames] - 1;
+	
+	[self setStartingFrame:[[[[self scheduler] regionBeingScheduled] decoder] seekToFrame:currentFrame + _regionStartingFrame]];
+	[self setPlayingFrame:0];
+
+	AudioTimeStamp timeStamp = [[self scheduler] scheduledStartTime];
+	timeStamp.mSampleTime -= graphLatencyFrames;
+	
+	[[self scheduler] setScheduledStartTime:timeStamp];
+	
+#if DEBUG
+	if([self startingFrame] != currentFrame)
+		NSLog(@"Seek failed: requested frame %qi, got %qi", currentFrame, [self startingFrame]);
+#endif
+		
+	[[self scheduler] startScheduling];
+	
+	if(resume)
+		[self play];
+}
+
+
 - (void) setOutputDeviceUID:(NSString *)deviceUID
 {
 	AudioDeviceID		deviceID		= kAudioDeviceUnknown;
@@ -2087,16 +2244,71 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 {
 	NSParameterAssert(nil != stream);
 	
-	// Reset preamp to user-specified value
-	[self setPreAmplification:[[NSUserDefaults standardUserDefaults] floatForKey:@"preAmplification"]];
+	float	replayGain;
+	float	preAmplification;
+	BOOL	hasReplayGain		= [self getReplayGain:&replayGain preAmplification:&preAmplification forStream:stream];
+	
+	// The gain itself was applied when the stream's region was scheduled
+	[self setReplayGain:replayGain];
+	[self setHasReplayGain:hasReplayGain];
+	[self setPreAmplification:preAmplification];
+}
 
-	// Set our ReplayGain to the appropriate value and grab the appropriate peak
-	NSNumber *peak = [self setReplayGainForStream:stream];
+- (BOOL) getReplayGain:(float *)replayGain preAmplification:(float *)preAmplification forStream:(AudioStream *)stream
+{
+	NSParameterAssert(NULL != replayGain);
+	NSParameterAssert(NULL != preAmplification);
+	NSParameterAssert(nil != stream);
+	
+	int				replayGainMode	= [[NSUserDefaults standardUserDefaults] integerForKey:@"replayGain"];
+	NSNumber		*trackGain		= [stream valueForKey:ReplayGainTrackGainKey];
+	NSNumber		*albumGain		= [stream valueForKey:ReplayGainAlbumGainKey];
+	NSNumber		*gain			= nil;
+	NSNumber		*peak			= nil;
+	NSNumber		*truePeak		= nil;
+	
+	// Start with the user-specified preamp
+	*preAmplification = [[NSUserDefaults standardUserDefaults] floatForKey:@"preAmplification"];
+	
+	// Try to use the RG the user wants
+	if(ReplayGainTrackGain == replayGainMode && nil != trackGain) {
+		gain		= trackGain;
+		peak		= [stream valueForKey:ReplayGainTrackPeakKey];
+		truePeak	= [stream valueForKey:ReplayGainTrackTruePeakKey];
+	}
+	else if(ReplayGainAlbumGain == replayGainMode && nil != albumGain) {
+		gain		= albumGain;
+		peak		= [stream valueForKey:ReplayGainAlbumPeakKey];
+		truePeak	= [stream valueForKey:ReplayGainAlbumTruePeakKey];
+	}
+	// Fall back to any gain if present
+	else if(ReplayGainNone != replayGainMode && nil != trackGain) {
+		gain		= trackGain;
+		peak		= [stream valueForKey:ReplayGainTrackPeakKey];
+		truePeak	= [stream valueForKey:ReplayGainTrackTruePeakKey];
+	}
+	else if(ReplayGainNone != replayGainMode && nil != albumGain) {
+		gain		= albumGain;
+		peak		= [stream valueForKey:ReplayGainAlbumPeakKey];
+		truePeak	= [stream valueForKey:ReplayGainAlbumTruePeakKey];
+	}
+	
+	// The true peak catches inter-sample overs the sample peak misses, so prefer it when it has been measured
+	if(nil != truePeak)
+		peak = truePeak;
+	
+	// No dice, or RG set to off
+	if(nil == gain) {
+		*replayGain = 0;
+		return NO;
+	}
+	
+	*replayGain = [gain floatValue];
 
 	// Reduce pre-amp gain, if user specified and signal would clip
-	if([self hasReplayGain] && nil != peak && ReducePreAmpGain == [[NSUserDefaults standardUserDefaults] integerForKey:@"clippingPrevention"]) {
-
-		float adjustment = [self preAmplification] + [self replayGain];
+	if(nil != peak && ReducePreAmpGain == [[NSUserDefaults standardUserDefaults] integerForKey:@"clippingPrevention"]) {
+		
+		float adjustment = *preAmplification + *replayGain;
 		
 		if(0 != adjustment) {
 			float	peakSample	= [peak floatValue];
@@ -2106,62 +2318,60 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 			
 			// If clipping will occur, reduce the preamp gain so the peak will be +/- 1.0
 			if(1.0 < magnitude)
-				[self setPreAmplification:(20 * log10f(1.0 / peakSample)) - [self replayGain]];
+				*preAmplification = (20 * log10f(1.0 / peakSample)) - *replayGain;
 		}
 	}
+	
+	return YES;
+}
 
-	// Set the pre-gain on the peak limiter
-	float preGain = 0;
-	if([self hasReplayGain])
-		preGain = [self preAmplification] + [self replayGain];
+- (float) gainForStream:(AudioStream *)stream
+{
+	float	replayGain;
+	float	preAmplification;
 	
-	AudioUnitParameter auParameter;
+	if(NO == [self getReplayGain:&replayGain preAmplification:&preAmplification forStream:stream])
+		return 0;
 	
-	auParameter.mAudioUnit		= _limiterUnit;
-	auParameter.mParameterID	= kLimiterParam_PreGain;
-	auParameter.mScope			= kAudioUnitScope_Global;
-	auParameter.mElement		= 0;
+	return preAmplification + replayGain;
+}
+
+- (ScheduledAudioRegion *) scheduledAudioRegionForStream:(AudioStream *)stream decoder:(id <AudioDecoderMethods>)decoder
+{
+	ScheduledAudioRegion *region = [ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder];
+	[region setGain:[self gainForStream:stream]];
 	
-	OSStatus err = AUParameterSet(NULL, NULL, &auParameter, preGain, 0);
-	if(noErr != err)
-		NSLog(@"AudioPlayer error: Unable to set ReplayGain: %i", err);
+	// The decoder may have been converted to another sample rate
+	Float64 sampleRate = [[stream valueForKey:PropertiesSampleRateKey] doubleValue];
+	if(0 < sampleRate)
+		[region setPregapFrameCount:(SInt64)([stream playablePregapFrameCount] * [decoder format].mSampleRate / sampleRate)];
+	
+	return region;
 }
 
-- (NSNumber *) setReplayGainForStream:(AudioStream *)stream
+- (void) updateDSPParametersFromDefaults
 {
-	NSParameterAssert(nil != stream);
+	DSPChainParameters	parameters;
+	NSArray				*bands		= [[NSUserDefaults standardUserDefaults] arrayForKey:@"equalizerBands"];
+	unsigned			i;
 	
-	int				replayGain		= [[NSUserDefaults standardUserDefaults] integerForKey:@"replayGain"];
-	NSNumber		*trackGain		= [stream valueForKey:ReplayGainTrackGainKey];
-	NSNumber		*albumGain		= [stream valueForKey:ReplayGainAlbumGainKey];
+	[[self scheduler] getDSPParameters:&parameters];
 	
-	// Try to use the RG the user wants
-	if(ReplayGainTrackGain == replayGain && nil != trackGain) {
-		[self setReplayGain:[trackGain floatValue]];
-		[self setHasReplayGain:YES];
-		return [stream valueForKey:ReplayGainTrackPeakKey];
-	}
-	else if(ReplayGainAlbumGain == replayGain && nil != albumGain) {
-		[self setReplayGain:[albumGain floatValue]];
-		[self setHasReplayGain:YES];
-		return [stream valueForKey:ReplayGainAlbumPeakKey];
-	}
-	// Fall back to any gain if present
-	else if(ReplayGainNone != replayGain && nil != trackGain) {
-		[self setReplayGain:[trackGain floatValue]];
-		[self setHasReplayGain:YES];
-		return [stream valueForKey:ReplayGainTrackPeakKey];
-	}
-	else if(ReplayGainNone != replayGain && nil != albumGain) {
-		[self setReplayGain:[albumGain floatValue]];
-		[self setHasReplayGain:YES];
-		return [stream valueForKey:ReplayGainAlbumPeakKey];
+	parameters.equalizerBandCount = 0;
+	for(i = 0; i < [bands count] && i < DSP_CHAIN_MAXIMUM_EQUALIZER_BANDS; ++i) {
+		NSDictionary		*band			= [bands objectAtIndex:i];
+		DSPEqualizerBand	*equalizerBand	= &parameters.equalizerBands[parameters.equalizerBandCount];
+		
+		equalizerBand->type			= [[band valueForKey:@"type"] intValue];
+		equalizerBand->frequency	= [[band valueForKey:@"frequency"] floatValue];
+		equalizerBand->gain			= [[band valueForKey:@"gain"] floatValue];
+		equalizerBand->q			= [[band valueForKey:@"q"] floatValue];
+		
+		if(0 < equalizerBand->frequency)
+			++parameters.equalizerBandCount;
 	}
-
-	// No dice, or RG set to off
-	[self setReplayGain:0];
-	[self setHasReplayGain:NO];
-	return nil;
+	
+	[[self scheduler] setDSPParameters:&parameters];
 }
 
 - (void) setFormat:(AudioStreamBasicDescription)format
@@ -2174,4 +2384,46 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	_channelLayout = channelLayout;
 }
 
+- (void) saveSeekIndexFromDecoder:(id <AudioDecoderMethods>)decoder forStream:(AudioStream *)stream
+{
+	if([(NSObject *)decoder isKindOfClass:[ResamplingDecoder class]])
+		decoder = [(ResamplingDecoder *)decoder decoder];
+	if([(NSObject *)decoder isKindOfClass:[ChannelMixingDecoder class]])
+		decoder = [(ChannelMixingDecoder *)decoder decoder];
+	
+	if(nil == stream || NO == [(NSObject *)decoder isKindOfClass:[FLACDecoder class]] || NO == [(FLACDecoder *)decoder seekIndexChanged])
+		return;
+	
+	// A nil index means the stored one was found to be stale and is cleared
+	if([[(FLACDecoder *)decoder URL] isEqual:[stream valueForKey:StreamURLKey]])
+		[[[CollectionManager manager] streamManager] saveSeekIndex:[(FLACDecoder *)decoder seekIndex] forStream:stream];
+}
+
+- (id <AudioDecoderMethods>) decoder:(id <AudioDecoderMethods>)decoder convertedToSampleRate:(Float64)sampleRate
+{
+	NSParameterAssert(nil != decoder);
+	
+	if([decoder format].mSampleRate == sampleRate)
+		return decoder;
+	
+	// Fall back to the unconverted decoder if the rates can't be related by a usable ratio
+	id <AudioDecoderMethods> resamplingDecoder = [ResamplingDecoder decoderWithDecoder:decoder sampleRate:sampleRate];
+	return (nil != resamplingDecoder ? resamplingDecoder : decoder);
+}
+
+- (id <AudioDecoderMethods>) decoder:(id <AudioDecoderMethods>)decoder mixedToChannelLayout:(AudioChannelLayout)channelLayout channelCount:(UInt32)channelCount
+{
+	NSParameterAssert(nil != decoder);
+	
+	// Decoders that don't specify a layout use the default one for their channel count
+	if(0 == channelLayout.mChannelLayoutTag)
+		channelLayout = [ChannelMixingDecoder defaultChannelLayoutForChannelCount:channelCount];
+	
+	id <AudioDecoderMethods> mixingDecoder = [ChannelMixingDecoder decoderWithDecoder:decoder channelLayout:channelLayout];
+	if(nil == mixingDecoder || [mixingDecoder format].mChannelsPerFrame != channelCount)
+		return nil;
+	
+	return mixingDecoder;
+}
+
 @end
@@ -23,11 +23,42 @@
 #include <AudioToolbox/AudioToolbox.h>
 #include <mach/mach.h>
 
+#include "DSPChain.h"
+#include "AudioEventQueue.h"
+#include "AudioHistogram.h"
+
+#import "AudioOutputMethods.h"
+
 // ========================================
 // Dictionary Keys
 // ========================================
 extern NSString * const		AudioSchedulerObjectKey;			// AudioScheduler
 extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
+extern NSString * const		ScheduledAudioRegionFrameKey;		// NSNumber
+extern NSString * const		AudioSchedulerEventTimeKey;			// NSNumber (seconds, monotonic clock)
+
+// ========================================
+// Crossfade curves
+// ========================================
+enum {
+	AudioSchedulerCrossfadeCurveLinear			= 0,
+	AudioSchedulerCrossfadeCurveEqualPower		= 1,
+	AudioSchedulerCrossfadeCurveSCurve			= 2
+};
+
+// ========================================
+// Scheduler statistics
+// ========================================
+typedef struct {
+	uint32_t				slicesScheduled;
+	uint32_t				slicesRendered;
+	uint32_t				lateSlices;					// Began rendering after their scheduled time
+	uint32_t				underruns;					// The output ran out of audio while more remained to be scheduled
+	AudioHistogramSummary	decodeTime;					// Microseconds per readAudioInSlice:
+	AudioHistogramSummary	bufferFill;					// Frames scheduled but not yet rendered, sampled as each slice is scheduled
+	AudioHistogramSummary	regionTransitionTime;		// Microseconds between the last slice of one region completing and the first of the next
+	AudioHistogramSummary	seekLatency;				// Microseconds from an in-place seek request to the first slice after it completing
+} AudioSchedulerStatistics;
 
 @class ScheduledAudioRegion;
 
@@ -36,7 +67,7 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 	unsigned				_numberSlices;
 	unsigned				_framesPerSlice;
 	
-	AudioUnit				_audioUnit;
+	id <AudioOutputMethods>	_output;
 	
 	AudioTimeStamp			_scheduledStartTime;
 
@@ -46,22 +77,71 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 	NSMutableArray			*_scheduledAudioRegions;
 
 	ScheduledAudioRegion	*_regionBeingScheduled;
-	ScheduledAudioRegion	*_regionBeingRendered;
+	ScheduledAudioRegion	*_regionBeingRendered;		// Not retained
+	NSMutableArray			*_regionsBeingRendered;
+	BOOL					_releaseRegionsNotRendering;
 
 	BOOL					_keepScheduling;
 	BOOL					_scheduling;
 	semaphore_t				_semaphore;
 	
+	NSTimeInterval			_crossfadeDuration;
+	int						_crossfadeCurve;
+	float					*_crossfadeTable;
+	float					*_crossfadeIndices;
+	float					*_crossfadeGainIn;
+	float					*_crossfadeGainOut;
+	
+	ScheduledAudioRegion	*_regionBeingMixed;
+	SInt64					_crossfadeStartFrame;
+	SInt64					_crossfadeFrameCount;
+	BOOL					_notifiedDelegateOfApproachingEnd;
+	
+	DSPChain				*_dspChain;
+	
+	AudioEventQueue			*_eventQueue;
+	NSTimer					*_eventTimer;
+	
+	volatile uint32_t		_slicesScheduledCount;
+	volatile uint32_t		_slicesRenderedCount;
+	volatile uint32_t		_lateSliceCount;
+	volatile uint32_t		_underrunCount;
+	AudioHistogram			*_decodeTimeHistogram;
+	AudioHistogram			*_bufferFillHistogram;
+	AudioHistogram			*_regionTransitionHistogram;
+	AudioHistogram			*_seekLatencyHistogram;
+	double					_regionFinishedRenderingTime;
+	
+	NSTimeInterval			_statisticsLogInterval;
+	NSTimer					*_statisticsTimer;
+	
+	ScheduledAudioRegion	*_regionToSeek;
+	SInt64					_seekFrame;
+	BOOL					_seekPending;
+	SInt64					_fadeInFrameCount;
+	SInt64					_fadeInFramesRemaining;
+	volatile int32_t		_discardingRenderedSlices;	// Set while a seek resets the output
+	volatile int32_t		_completionProcsActive;
+	double					_seekRequestTime;
+	volatile int32_t		_measuringSeekLatency;		// Set once a seek's audio is scheduled, until its first slice completes
+	
+#if DEBUG
+	uint32_t				_eventsDropped;
+#endif
+	
 	id						_delegate;
 }
 
+// The buffer size and period are read from the user defaults by init
+- (id) initWithNumberOfSlices:(unsigned)numberOfSlices framesPerSlice:(unsigned)framesPerSlice;
+
 // Buffer size information (set at object creation)
 - (unsigned) numberOfSlicesInBuffer;
 - (unsigned) numberOfFramesPerSlice;
 
-// The ScheduledSoundPlayer AudioUnit on which to schedule audio slices
-- (AudioUnit) audioUnit;
-- (void) setAudioUnit:(AudioUnit)audioUnit;
+// The output on which to schedule audio slices
+- (id <AudioOutputMethods>) output;
+- (void) setOutput:(id <AudioOutputMethods>)output;
 
 // An optional delegate to receive notifications
 - (id) delegate;
@@ -71,10 +151,35 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 - (AudioTimeStamp) scheduledStartTime;
 - (void) setScheduledStartTime:(AudioTimeStamp)scheduledStartTime;
 
+// The length of the overlap between consecutive regions, in seconds (0 disables crossfading)
+- (NSTimeInterval) crossfadeDuration;
+- (void) setCrossfadeDuration:(NSTimeInterval)crossfadeDuration;
+
+// The gain curve used to fade the outgoing region out and the incoming region in
+- (int) crossfadeCurve;
+- (void) setCrossfadeCurve:(int)crossfadeCurve;
+
+// Parameters for the DSP (equalizer and limiter) applied to all scheduled audio
+- (void) getDSPParameters:(DSPChainParameters *)parameters;
+- (void) setDSPParameters:(const DSPChainParameters *)parameters;
+
+// Counters and histograms describing how well scheduling is keeping up with rendering
+// They are updated without locks, so a snapshot taken while scheduling may be slightly inconsistent
+- (void) getStatistics:(AudioSchedulerStatistics *)statistics;
+- (void) resetStatistics;
+
+// How often to log the statistics while scheduling, in seconds (0 disables logging)
+- (NSTimeInterval) statisticsLogInterval;
+- (void) setStatisticsLogInterval:(NSTimeInterval)statisticsLogInterval;
+
 // Add or remove a ScheduledAudioRegion to be played
 - (void) scheduleAudioRegion:(ScheduledAudioRegion *)scheduledAudioRegion;
 - (void) unscheduleAudioRegion:(ScheduledAudioRegion *)scheduledAudioRegion;
 
+// Seek in the region being scheduled without stopping, discarding only the audio already scheduled
+// The seek happens asynchronously on the scheduling thread, and the delegate is notified when it completes
+- (void) seekRegionBeingScheduledToFrame:(SInt64)frame;
+
 // The current ScheduledAudioRegion being rendered
 - (ScheduledAudioRegion *) regionBeingScheduled;
 - (ScheduledAudioRegion *) regionBeingRendered;
@@ -106,7 +211,8 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 
 @end
 
-// Delegate methods
+// Delegate methods, called on the thread that called startScheduling
+// The NSDictionary variants also carry ScheduledAudioRegionFrameKey and AudioSchedulerEventTimeKey
 @interface NSObject (AudioSchedulerDelegateMethods)
 - (void) audioSchedulerStartedScheduling:(AudioScheduler *)scheduler;
 - (void) audioSchedulerStoppedScheduling:(AudioScheduler *)scheduler;
@@ -114,6 +220,12 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 - (void) audioSchedulerStartedSchedulingRegion:(NSDictionary *)schedulerAndRegion;
 - (void) audioSchedulerFinishedSchedulingRegion:(NSDictionary *)schedulerAndRegion;
 
+// Sent when a seek requested with seekRegionBeingScheduledToFrame: completes
+- (void) audioSchedulerSeekedRegion:(NSDictionary *)schedulerAndRegion;
+
+// Sent when crossfading, early enough that a region scheduled in response can be overlapped with this one
+- (void) audioSchedulerApproachingEndOfRegion:(NSDictionary *)schedulerAndRegion;
+
 - (void) audioSchedulerStartedRenderingRegion:(NSDictionary *)schedulerAndRegion;
 - (void) audioSchedulerFinishedRenderingRegion:(NSDictionary *)schedulerAndRegion;
 @end
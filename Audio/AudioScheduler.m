@@ -21,17 +21,54 @@
 #import "AudioScheduler.h"
 #import "ScheduledAudioRegion.h"
 
+#include <Accelerate/Accelerate.h>
+#include <libkern/OSAtomic.h>
+#include <sched.h>
+
 // ========================================
 // Dictionary keys
 // ========================================
 NSString * const	AudioSchedulerObjectKey				= @"org.sbooth.Play.AudioScheduler";
 NSString * const	ScheduledAudioRegionObjectKey		= @"org.sbooth.Play.ScheduledAudioRegion";
+NSString * const	ScheduledAudioRegionFrameKey		= @"org.sbooth.Play.ScheduledAudioRegion.Frame";
+NSString * const	AudioSchedulerEventTimeKey			= @"org.sbooth.Play.AudioScheduler.EventTime";
 
 // ========================================
 // Symbolic Constants
 // ========================================
 NSString * const	AudioSchedulerRunLoopMode			= @"org.sbooth.Play.AudioScheduler.RunLoopMode";
 
+// Resolution of the crossfade gain curve; gains between points are interpolated
+#define CROSSFADE_TABLE_SIZE			1024
+
+// How far ahead of the overlap the delegate is asked for the next region, in seconds
+#define CROSSFADE_LOOKAHEAD				5.0
+
+// Audio scheduled after a seek before playback restarts, and the length of the fade in, in seconds
+#define SEEK_PREROLL_SLICES				2
+#define SEEK_FADE_DURATION				0.005
+
+// Events pending delivery to the delegate, and how often they are delivered, in seconds
+#define EVENT_QUEUE_CAPACITY			256
+#define EVENT_DELIVERY_INTERVAL			0.02
+
+// ========================================
+// Events posted by the scheduling and render threads
+// ========================================
+enum {
+	AudioSchedulerEventStartedScheduling				= 0,
+	AudioSchedulerEventStoppedScheduling				= 1,
+	AudioSchedulerEventStartedSchedulingRegion			= 2,
+	AudioSchedulerEventFinishedSchedulingRegion			= 3,
+	AudioSchedulerEventSeekedRegion						= 4,
+	AudioSchedulerEventApproachingEndOfRegion			= 5,
+	
+	// Events from the render thread don't retain their region
+	AudioSchedulerEventStartedRenderingRegion			= 6,
+	AudioSchedulerEventFinishedRenderingRegion			= 7,
+	AudioSchedulerEventRenderedLate						= 8
+};
+
 // ========================================
 // Private methods
 // ========================================
@@ -45,73 +82,59 @@ NSString * const	AudioSchedulerRunLoopMode			= @"org.sbooth.Play.AudioScheduler.
 
 - (BOOL) keepScheduling;
 
+- (void) postEvent:(uint32_t)type region:(ScheduledAudioRegion *)region frame:(SInt64)frame;
+- (void) deliverEvents:(NSTimer *)timer;
+- (void) logStatistics:(NSTimer *)timer;
+- (void) startStatisticsTimer;
+- (void) stopStatisticsTimer;
+- (void) notifyDelegate:(SEL)selector withObject:(id)object;
+
+- (void) retainRegionUntilRendered:(ScheduledAudioRegion *)region;
+- (void) renderedSlice:(ScheduledAudioSlice *)slice fromRegion:(ScheduledAudioRegion *)region;
+
 - (void) scheduledAdditionalFrames:(UInt32)frameCount;
 - (void) renderedAdditionalFrames:(UInt32)frameCount;
 
+- (void) fillCrossfadeTable;
+- (void) mixNextRegionIntoSlice:(ScheduledAudioSlice *)slice startingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount;
+- (void) abandonCrossfade;
+
+- (void) applyFadeInToSlice:(ScheduledAudioSlice *)slice frameCount:(UInt32)frameCount;
+- (UInt32) drainDSPChainIntoSlice:(ScheduledAudioSlice *)slice;
+- (BOOL) scheduleSliceAtIndex:(unsigned)sliceIndex;
+- (void) performPendingSeek;
+
 - (void) processSlicesInThread:(id)dummy;
 - (void) setThreadPolicy;
 @end
 
 // ========================================
-// AudioUnit callbacks
+// Output callbacks
 // ========================================
+// This is called on the render thread, so nothing here may allocate memory or take a lock
 static void
 scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 {
 	NSCParameterAssert(NULL != userData);
 	NSCParameterAssert(NULL != slice);
 	
-	NSAutoreleasePool		*pool		= [[NSAutoreleasePool alloc] init];
-	NSArray					*dataArray	= (NSArray *)userData;
-	AudioScheduler			*scheduler	= (AudioScheduler *)[dataArray objectAtIndex:0];
-	ScheduledAudioRegion	*region		= (ScheduledAudioRegion *)[dataArray objectAtIndex:1];
-
-#if DEBUG
-	if(kScheduledAudioSliceFlag_BeganToRenderLate & slice->mFlags)
-		NSLog(@"AudioScheduler error: kScheduledAudioSliceFlag_BeganToRenderLate (starting sample %qi)", (SInt64)slice->mTimeStamp.mSampleTime);
-#endif
-
-	// Determine if this render represents a  new region
-	if(/*(kScheduledAudioSliceFlag_BeganToRender & slice->mFlags) &&*/ nil == [scheduler regionBeingRendered]) {
-
-		// Update the scheduler
-		[scheduler setRegionBeingRendered:region];
-
-		// Notify the delegate
-		if(nil != [scheduler delegate] && [[scheduler delegate] respondsToSelector:@selector(audioSchedulerStartedRenderingRegion:)])
-			[[scheduler delegate] performSelectorOnMainThread:@selector(audioSchedulerStartedRenderingRegion:)
-												   withObject:[NSDictionary dictionaryWithObjectsAndKeys:scheduler, AudioSchedulerObjectKey, [scheduler regionBeingRendered], ScheduledAudioRegionObjectKey, nil]
-												waitUntilDone:NO];
-	}
-
-	// Record the number of frames rendered
-//	if(kScheduledAudioSliceFlag_BeganToRender & slice->mFlags)
-		[scheduler renderedAdditionalFrames:slice->mNumberFrames];
-
-	// Signal the scheduling thread that a slice is available for filling
-	semaphore_signal([scheduler semaphore]);
-
-	// Determine if region rendering is complete
-	if([[scheduler regionBeingRendered] atEnd] && [[scheduler regionBeingRendered] framesRendered] == [[scheduler regionBeingRendered] framesScheduled]) {
-
-		// Notify the delegate
-		if(nil != [scheduler delegate] && [[scheduler delegate] respondsToSelector:@selector(audioSchedulerFinishedRenderingRegion:)])
-			[[scheduler delegate] performSelectorOnMainThread:@selector(audioSchedulerFinishedRenderingRegion:)
-												   withObject:[NSDictionary dictionaryWithObjectsAndKeys:scheduler, AudioSchedulerObjectKey, [scheduler regionBeingRendered], ScheduledAudioRegionObjectKey, nil]
-												waitUntilDone:NO];
-
-		// Update the scheduler
-		[scheduler setRegionBeingRendered:nil];
-	}
-
-	[dataArray release];
-	[pool release];
+	ScheduledAudioRegion *region = (ScheduledAudioRegion *)userData;
+	[[region scheduler] renderedSlice:slice fromRegion:region];
 }
 
 @implementation AudioScheduler
 
 - (id) init
-{	
+{
+	return [self initWithNumberOfSlices:[[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioSlicesInBuffer"]
+						 framesPerSlice:[[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioFramesPerSlice"]];
+}
+
+- (id) initWithNumberOfSlices:(unsigned)numberOfSlices framesPerSlice:(unsigned)framesPerSlice
+{
+	NSParameterAssert(0 < numberOfSlices);
+	NSParameterAssert(0 < framesPerSlice);
+	
 	if((self = [super init])) {
 		kern_return_t result = semaphore_create(mach_task_self(), &_semaphore, SYNC_POLICY_FIFO, 0);		
 		if(KERN_SUCCESS != result) {
@@ -123,8 +146,34 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		_scheduledStartTime.mFlags		= kAudioTimeStampSampleTimeValid;
 		_scheduledStartTime.mSampleTime	= 0;
 		
-		_numberSlices		= [[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioSlicesInBuffer"];
-		_framesPerSlice		= [[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioFramesPerSlice"];
+		_numberSlices		= numberOfSlices;
+		_framesPerSlice		= framesPerSlice;
+		
+		// The crossfade mixer works entirely in these buffers, so nothing is allocated while scheduling
+		_crossfadeTable		= calloc(CROSSFADE_TABLE_SIZE + 2, sizeof(float));
+		_crossfadeIndices	= calloc(_framesPerSlice, sizeof(float));
+		_crossfadeGainIn	= calloc(_framesPerSlice, sizeof(float));
+		_crossfadeGainOut	= calloc(_framesPerSlice, sizeof(float));
+		NSAssert(NULL != _crossfadeTable && NULL != _crossfadeIndices && NULL != _crossfadeGainIn && NULL != _crossfadeGainOut, @"Unable to allocate memory");
+		
+		[self setCrossfadeCurve:AudioSchedulerCrossfadeCurveEqualPower];
+		
+		// The sample rate is updated as each region is scheduled
+		_dspChain = dsp_chain_create(44100, _framesPerSlice);
+		NSAssert(NULL != _dspChain, @"Unable to allocate memory");
+		
+		_eventQueue = audio_event_queue_create(EVENT_QUEUE_CAPACITY);
+		NSAssert(NULL != _eventQueue, @"Unable to allocate memory");
+		
+		_regionsBeingRendered = [[NSMutableArray alloc] init];
+		
+		_decodeTimeHistogram		= calloc(1, sizeof(AudioHistogram));
+		_bufferFillHistogram		= calloc(1, sizeof(AudioHistogram));
+		_regionTransitionHistogram	= calloc(1, sizeof(AudioHistogram));
+		_seekLatencyHistogram		= calloc(1, sizeof(AudioHistogram));
+		NSAssert(NULL != _decodeTimeHistogram && NULL != _bufferFillHistogram && NULL != _regionTransitionHistogram && NULL != _seekLatencyHistogram, @"Unable to allocate memory");
+		
+		[self resetStatistics];
 	}
 	return self;
 }
@@ -135,9 +184,34 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		[self stopScheduling];
 
 	[_regionBeingScheduled release], _regionBeingScheduled = nil;
-	[_regionBeingRendered release], _regionBeingRendered = nil;
+	_regionBeingRendered = nil;
+	[_regionBeingMixed release], _regionBeingMixed = nil;
+	[_regionToSeek release], _regionToSeek = nil;
+
+	free(_crossfadeTable), _crossfadeTable = NULL;
+	free(_crossfadeIndices), _crossfadeIndices = NULL;
+	free(_crossfadeGainIn), _crossfadeGainIn = NULL;
+	free(_crossfadeGainOut), _crossfadeGainOut = NULL;
+	
+	dsp_chain_destroy(_dspChain), _dspChain = NULL;
+	
+	// Release the regions held by undelivered events
+	AudioEvent event;
+	while(audio_event_queue_pop(_eventQueue, &event)) {
+		if(AudioSchedulerEventStartedRenderingRegion > event.type)
+			[(ScheduledAudioRegion *)event.object release];
+	}
+	audio_event_queue_destroy(_eventQueue), _eventQueue = NULL;
+	
+	[_regionsBeingRendered release], _regionsBeingRendered = nil;
+	
+	free(_decodeTimeHistogram), _decodeTimeHistogram = NULL;
+	free(_bufferFillHistogram), _bufferFillHistogram = NULL;
+	free(_regionTransitionHistogram), _regionTransitionHistogram = NULL;
+	free(_seekLatencyHistogram), _seekLatencyHistogram = NULL;
 
 	[_scheduledAudioRegions release], _scheduledAudioRegions = nil;
+	[(NSObject *)_output release], _output = nil;
 	_delegate = nil;
 
 	[super dealloc];
@@ -153,30 +227,21 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	return _framesPerSlice;
 }
 
-- (AudioUnit) audioUnit
+- (id <AudioOutputMethods>) output
 {
-	return _audioUnit;
+	return [[(NSObject *)_output retain] autorelease];
 }
 
-- (void) setAudioUnit:(AudioUnit)audioUnit
+- (void) setOutput:(id <AudioOutputMethods>)output
 {
-	NSParameterAssert(NULL != audioUnit);
-
-	// Ensure the audio unit is a ScheduledSoundPlayer
-	ComponentDescription componentDescription;
-	ComponentResult err = GetComponentInfo((Component)audioUnit,
-										   &componentDescription,
-										   NULL,
-										   NULL,
-										   NULL);
-	if(noErr != err || 
-	   kAudioUnitType_Generator != componentDescription.componentType || 
-	   kAudioUnitSubType_ScheduledSoundPlayer != componentDescription.componentSubType) {
-		NSLog(@"Illegal audio unit passed to setAudioUnit");
+	NSParameterAssert(nil != output);
+	
+	if([self isScheduling]) {
+		NSLog(@"Cannot change the output while scheduling audio slices");
 		return;
 	}
-
-	_audioUnit = audioUnit;
+	
+	[(NSObject *)_output release], _output = [(NSObject *)output retain];
 }
 
 - (id) delegate
@@ -200,10 +265,108 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	_scheduledStartTime = scheduledStartTime;
 }
 
+- (NSTimeInterval) crossfadeDuration
+{
+	return _crossfadeDuration;
+}
+
+- (void) setCrossfadeDuration:(NSTimeInterval)crossfadeDuration
+{
+	NSParameterAssert(0 <= crossfadeDuration);
+	_crossfadeDuration = crossfadeDuration;
+}
+
+- (int) crossfadeCurve
+{
+	return _crossfadeCurve;
+}
+
+- (void) setCrossfadeCurve:(int)crossfadeCurve
+{
+	NSParameterAssert(AudioSchedulerCrossfadeCurveLinear <= crossfadeCurve && AudioSchedulerCrossfadeCurveSCurve >= crossfadeCurve);
+	_crossfadeCurve = crossfadeCurve;
+	[self fillCrossfadeTable];
+}
+
+- (void) getDSPParameters:(DSPChainParameters *)parameters
+{
+	NSParameterAssert(NULL != parameters);
+	dsp_chain_get_parameters(_dspChain, parameters);
+}
+
+- (void) setDSPParameters:(const DSPChainParameters *)parameters
+{
+	NSParameterAssert(NULL != parameters);
+	dsp_chain_set_parameters(_dspChain, parameters);
+}
+
+- (void) getStatistics:(AudioSchedulerStatistics *)statistics
+{
+	NSParameterAssert(NULL != statistics);
+	
+	statistics->slicesScheduled		= _slicesScheduledCount;
+	statistics->slicesRendered		= _slicesRenderedCount;
+	statistics->lateSlices			= _lateSliceCount;
+	statistics->underruns			= _underrunCount;
+	
+	audio_histogram_get_summary(_decodeTimeHistogram, &statistics->decodeTime);
+	audio_histogram_get_summary(_bufferFillHistogram, &statistics->bufferFill);
+	audio_histogram_get_summary(_regionTransitionHistogram, &statistics->regionTransitionTime);
+	audio_histogram_get_summary(_seekLatencyHistogram, &statistics->seekLatency);
+}
+
+- (void) resetStatistics
+{
+	_slicesScheduledCount		= 0;
+	_slicesRenderedCount		= 0;
+	_lateSliceCount				= 0;
+	_underrunCount				= 0;
+	
+	audio_histogram_reset(_decodeTimeHistogram);
+	audio_histogram_reset(_bufferFillHistogram);
+	audio_histogram_reset(_regionTransitionHistogram);
+	audio_histogram_reset(_seekLatencyHistogram);
+}
+
+- (NSTimeInterval) statisticsLogInterval
+{
+	return _statisticsLogInterval;
+}
+
+- (void) setStatisticsLogInterval:(NSTimeInterval)statisticsLogInterval
+{
+	NSParameterAssert(0 <= statisticsLogInterval);
+	
+	_statisticsLogInterval = statisticsLogInterval;
+	
+	if([self isScheduling])
+		[self startStatisticsTimer];
+}
+
+- (void) seekRegionBeingScheduledToFrame:(SInt64)frame
+{
+	NSParameterAssert(0 <= frame);
+	
+	@synchronized(self) {
+		[_regionToSeek release];
+		_regionToSeek	= [[self regionBeingScheduled] retain];
+		_seekFrame		= frame;
+		_seekPending	= YES;
+		
+		// A seek that is superseded before its audio is rendered isn't measured
+		_seekRequestTime		= audio_event_current_time();
+		_measuringSeekLatency	= 0;
+	}
+	
+	semaphore_signal([self semaphore]);
+}
+
 - (void) scheduleAudioRegion:(ScheduledAudioRegion *)scheduledAudioRegion
 {
 	NSParameterAssert(nil != scheduledAudioRegion);
 	
+	[scheduledAudioRegion setScheduler:self];
+	
 	// Setup the buffers inside the region we will be using
 	[scheduledAudioRegion allocateBuffersWithSliceCount:[self numberOfSlicesInBuffer] frameCount:[self numberOfFramesPerSlice]];
 	
@@ -228,6 +391,15 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		return;
 	}
 	
+	if(_regionBeingMixed == scheduledAudioRegion) {
+		if([self isScheduling])
+			NSLog(@"Cannot unschedule a ScheduledAudioRegion while it is being crossfaded");
+		else
+			[self abandonCrossfade];
+		
+		return;
+	}
+	
 	@synchronized([self scheduledAudioRegions]) {
 		[[self scheduledAudioRegions] removeObjectIdenticalTo:scheduledAudioRegion];
 	}
@@ -245,7 +417,7 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 
 - (void) startScheduling
 {
-	if(NULL == [self audioUnit] || [self isScheduling])
+	if(nil == [self output] || [self isScheduling])
 		return;
 
 	_framesScheduled		= 0;
@@ -260,6 +432,14 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	[[self regionBeingRendered] clearFramesScheduled];
 	[[self regionBeingRendered] clearFramesRendered];
 
+	// Notifications from the scheduling and render threads are delivered on this thread
+	if(nil == _eventTimer) {
+		_eventTimer = [NSTimer timerWithTimeInterval:EVENT_DELIVERY_INTERVAL target:self selector:@selector(deliverEvents:) userInfo:nil repeats:YES];
+		[[NSRunLoop currentRunLoop] addTimer:_eventTimer forMode:NSRunLoopCommonModes];
+	}
+	
+	[self startStatisticsTimer];
+	
 	[NSThread detachNewThreadSelector:@selector(processSlicesInThread:) toTarget:self withObject:nil];
 }
 
@@ -275,6 +455,9 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	// Wait for the thread to terminate
 	while([self isScheduling])
 		[[NSRunLoop currentRunLoop] runMode:AudioSchedulerRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+	
+	// The timer retains the scheduler
+	[self stopStatisticsTimer];
 }
 
 - (void) reset
@@ -282,18 +465,31 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	if([self isScheduling])
 		return;
 	
-	// Remove any scheduled slices by resetting the AUScheduledSoundPlayer
-	ComponentResult result = AudioUnitReset([self audioUnit],
-											kAudioUnitScope_Global, 
-											0);
+	// Remove any scheduled slices by resetting the output
+	OSStatus result = [[self output] reset];
 	if(noErr != result)
-		NSLog(@"AudioUnitReset failed");
+		NSLog(@"AudioScheduler: Unable to reset output: %i", result);
 
 	if(nil != [self regionBeingScheduled])
 		[[self regionBeingScheduled] clearSliceBuffer];
 	if(nil != [self regionBeingRendered])
 		[[self regionBeingRendered] clearSliceBuffer];
 	
+	// Any overlap in progress will be rescheduled from the start of the next region
+	[self abandonCrossfade];
+	
+	// Pending seeks are superseded by whatever caused the reset
+	@synchronized(self) {
+		[_regionToSeek release], _regionToSeek = nil;
+		_seekPending = NO;
+	}
+	_fadeInFramesRemaining = 0;
+	
+	dsp_chain_reset(_dspChain);
+	
+	// Discarded slices will never be rendered, so the regions they came from may be let go once their events are delivered
+	_releaseRegionsNotRendering = YES;
+	
 	_scheduledStartTime.mFlags			= kAudioTimeStampSampleTimeValid;
 	_scheduledStartTime.mSampleTime		= 0;
 }
@@ -326,19 +522,7 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 - (AudioTimeStamp) currentPlayTime
 {
 	// Determine the last sample that was rendered
-	AudioTimeStamp		timeStamp	= { 0 };
-	UInt32				dataSize	= sizeof(AudioTimeStamp);
-	ComponentResult		result		= AudioUnitGetProperty([self audioUnit],
-														   kAudioUnitProperty_CurrentPlayTime,
-														   kAudioUnitScope_Global,
-														   0,
-														   &timeStamp,
-														   &dataSize);
-
-	if(noErr != result)
-		NSLog(@"Unable to query kAudioUnitProperty_CurrentPlayTime");
-	
-	return timeStamp;
+	return [[self output] currentPlayTime];
 }
 
 - (SInt64)			framesScheduled					{ return _framesScheduled; }
@@ -362,13 +546,213 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	[_regionBeingScheduled release], _regionBeingScheduled = [region retain];
 }
 
+// The region is kept alive by _regionsBeingRendered, since the render thread can't retain or release
 - (void) setRegionBeingRendered:(ScheduledAudioRegion *)region
 {
-	[_regionBeingRendered release], _regionBeingRendered = [region retain];
+	_regionBeingRendered = region;
 }
 
 - (BOOL)			keepScheduling					{ return _keepScheduling; }
 
+// Events posted from threads other than the render thread hold a reference to their region until delivered
+- (void) postEvent:(uint32_t)type region:(ScheduledAudioRegion *)region frame:(SInt64)frame
+{
+	[region retain];
+	if(0 == audio_event_queue_push(_eventQueue, type, region, frame)) {
+		NSLog(@"AudioScheduler: Event queue full, dropped event %u", type);
+		[region release];
+	}
+}
+
+- (void) deliverEvents:(NSTimer *)timer
+{
+	AudioEvent		event;
+	BOOL			scheduling		= [self isScheduling];
+	
+	while(audio_event_queue_pop(_eventQueue, &event)) {
+		NSAutoreleasePool		*pool		= [[NSAutoreleasePool alloc] init];
+		ScheduledAudioRegion	*region		= (ScheduledAudioRegion *)event.object;
+		NSMutableDictionary		*userInfo	= [NSMutableDictionary dictionaryWithObjectsAndKeys:
+			self, AudioSchedulerObjectKey, 
+			[NSNumber numberWithLongLong:event.frame], ScheduledAudioRegionFrameKey, 
+			[NSNumber numberWithDouble:event.timestamp], AudioSchedulerEventTimeKey, 
+			nil];
+		
+		if(nil != region)
+			[userInfo setObject:region forKey:ScheduledAudioRegionObjectKey];
+		
+		switch(event.type) {
+			case AudioSchedulerEventStartedScheduling:
+				[self notifyDelegate:@selector(audioSchedulerStartedScheduling:) withObject:self];
+				break;
+			case AudioSchedulerEventStoppedScheduling:
+				[self notifyDelegate:@selector(audioSchedulerStoppedScheduling:) withObject:self];
+				break;
+			case AudioSchedulerEventStartedSchedulingRegion:
+				[self notifyDelegate:@selector(audioSchedulerStartedSchedulingRegion:) withObject:userInfo];
+				break;
+			case AudioSchedulerEventFinishedSchedulingRegion:
+				[self notifyDelegate:@selector(audioSchedulerFinishedSchedulingRegion:) withObject:userInfo];
+				break;
+			case AudioSchedulerEventSeekedRegion:
+				[self notifyDelegate:@selector(audioSchedulerSeekedRegion:) withObject:userInfo];
+				break;
+			case AudioSchedulerEventApproachingEndOfRegion:
+				[self notifyDelegate:@selector(audioSchedulerApproachingEndOfRegion:) withObject:userInfo];
+				break;
+			case AudioSchedulerEventStartedRenderingRegion:
+				[self notifyDelegate:@selector(audioSchedulerStartedRenderingRegion:) withObject:userInfo];
+				break;
+			case AudioSchedulerEventFinishedRenderingRegion:
+				[self notifyDelegate:@selector(audioSchedulerFinishedRenderingRegion:) withObject:userInfo];
+				
+				// No more of this region's audio is outstanding
+				@synchronized(_regionsBeingRendered) {
+					[_regionsBeingRendered removeObjectIdenticalTo:region];
+				}
+				break;
+				
+#if DEBUG
+			case AudioSchedulerEventRenderedLate:
+				NSLog(@"AudioScheduler error: kScheduledAudioSliceFlag_BeganToRenderLate (starting sample %qi)", event.frame);
+				break;
+#endif
+		}
+		
+		if(AudioSchedulerEventStartedRenderingRegion > event.type)
+			[region release];
+		
+		[pool release];
+	}
+	
+#if DEBUG
+	if(_eventsDropped != audio_event_queue_dropped_count(_eventQueue)) {
+		_eventsDropped = audio_event_queue_dropped_count(_eventQueue);
+		NSLog(@"AudioScheduler: %u events dropped", _eventsDropped);
+	}
+#endif
+	
+	// Every event referring to a discarded region has now been delivered
+	@synchronized(_regionsBeingRendered) {
+		if(_releaseRegionsNotRendering && NO == scheduling) {
+			_releaseRegionsNotRendering = NO;
+			
+			unsigned i = [_regionsBeingRendered count];
+			while(0 < i--) {
+				ScheduledAudioRegion *region = [_regionsBeingRendered objectAtIndex:i];
+				if(region != _regionBeingScheduled && region != _regionBeingRendered)
+					[_regionsBeingRendered removeObjectAtIndex:i];
+			}
+		}
+		
+		// Stop polling once there's nothing left to report
+		if(NO == scheduling && 0 == [_regionsBeingRendered count]) {
+			[_eventTimer invalidate], _eventTimer = nil;
+			[self stopStatisticsTimer];
+		}
+	}
+}
+
+- (void) logStatistics:(NSTimer *)timer
+{
+	AudioSchedulerStatistics statistics;
+	[self getStatistics:&statistics];
+	
+	NSLog(@"AudioScheduler: %u slices scheduled, %u rendered, %u late, %u underruns", statistics.slicesScheduled, statistics.slicesRendered, statistics.lateSlices, statistics.underruns);
+	NSLog(@"AudioScheduler: Decode time (us) median %qu, 99%% %qu, max %qu; buffer fill (frames) min %qu, median %qu; region transition (us) median %qu, max %qu; seek latency (us) median %qu, max %qu",
+		  statistics.decodeTime.median, statistics.decodeTime.percentile99, statistics.decodeTime.maximum,
+		  statistics.bufferFill.minimum, statistics.bufferFill.median,
+		  statistics.regionTransitionTime.median, statistics.regionTransitionTime.maximum,
+		  statistics.seekLatency.median, statistics.seekLatency.maximum);
+}
+
+// Repeating timers retain their target, so the timer only runs while scheduling
+- (void) startStatisticsTimer
+{
+	[self stopStatisticsTimer];
+	
+	if(0 < [self statisticsLogInterval]) {
+		_statisticsTimer = [NSTimer timerWithTimeInterval:[self statisticsLogInterval] target:self selector:@selector(logStatistics:) userInfo:nil repeats:YES];
+		[[NSRunLoop currentRunLoop] addTimer:_statisticsTimer forMode:NSRunLoopCommonModes];
+	}
+}
+
+- (void) stopStatisticsTimer
+{
+	[_statisticsTimer invalidate], _statisticsTimer = nil;
+}
+
+- (void) notifyDelegate:(SEL)selector withObject:(id)object
+{
+	if(nil != [self delegate] && [[self delegate] respondsToSelector:selector])
+		[[self delegate] performSelector:selector withObject:object];
+}
+
+- (void) retainRegionUntilRendered:(ScheduledAudioRegion *)region
+{
+	@synchronized(_regionsBeingRendered) {
+		if(NSNotFound == [_regionsBeingRendered indexOfObjectIdenticalTo:region])
+			[_regionsBeingRendered addObject:region];
+	}
+}
+
+- (void) renderedSlice:(ScheduledAudioSlice *)slice fromRegion:(ScheduledAudioRegion *)region
+{
+	// Let a seek wait for this method to return before it resets the frame counters
+	OSAtomicIncrement32Barrier(&_completionProcsActive);
+	
+	// Slices flushed by a seek don't count as rendered
+	if(0 != _discardingRenderedSlices) {
+		OSAtomicDecrement32Barrier(&_completionProcsActive);
+		return;
+	}
+	
+	++_slicesRenderedCount;
+	
+	if(kScheduledAudioSliceFlag_BeganToRenderLate & slice->mFlags) {
+		++_lateSliceCount;
+#if DEBUG
+		audio_event_queue_push(_eventQueue, AudioSchedulerEventRenderedLate, NULL, (SInt64)slice->mTimeStamp.mSampleTime);
+#endif
+	}
+	
+	// Determine if this render represents a new region
+	if(nil == _regionBeingRendered) {
+		_regionBeingRendered = region;
+		audio_event_queue_push(_eventQueue, AudioSchedulerEventStartedRenderingRegion, region, _framesRendered);
+		
+		if(0 != _regionFinishedRenderingTime) {
+			audio_histogram_record(_regionTransitionHistogram, (uint64_t)((audio_event_current_time() - _regionFinishedRenderingTime) * 1000000));
+			_regionFinishedRenderingTime = 0;
+		}
+	}
+	
+	// The first slice completed after a seek ends its latency measurement
+	if(0 != _measuringSeekLatency) {
+		_measuringSeekLatency = 0;
+		audio_histogram_record(_seekLatencyHistogram, (uint64_t)((audio_event_current_time() - _seekRequestTime) * 1000000));
+	}
+	
+	// Record the number of frames rendered
+	[self renderedAdditionalFrames:slice->mNumberFrames];
+	
+	// The output has nothing left to render, but the scheduler isn't finished
+	if(_framesRendered >= _framesScheduled && _keepScheduling && nil != _regionBeingScheduled)
+		++_underrunCount;
+	
+	// Signal the scheduling thread that a slice is available for filling
+	semaphore_signal(_semaphore);
+	
+	// Determine if region rendering is complete
+	if([_regionBeingRendered atEnd] && [_regionBeingRendered framesRendered] == [_regionBeingRendered framesScheduled]) {
+		audio_event_queue_push(_eventQueue, AudioSchedulerEventFinishedRenderingRegion, _regionBeingRendered, [_regionBeingRendered framesRendered]);
+		_regionBeingRendered			= nil;
+		_regionFinishedRenderingTime	= audio_event_current_time();
+	}
+	
+	OSAtomicDecrement32Barrier(&_completionProcsActive);
+}
+
 - (void) scheduledAdditionalFrames:(UInt32)frameCount
 {
 	_framesScheduled += frameCount;
@@ -378,7 +762,329 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 - (void) renderedAdditionalFrames:(UInt32)frameCount
 {
 	_framesRendered += frameCount;
-	[[self regionBeingRendered] renderedAdditionalFrames:frameCount];
+	[_regionBeingRendered renderedAdditionalFrames:frameCount];
+}
+
+- (void) fillCrossfadeTable
+{
+	unsigned i;
+	for(i = 0; i <= CROSSFADE_TABLE_SIZE; ++i) {
+		double x = (double)i / CROSSFADE_TABLE_SIZE;
+		
+		// Each curve is the fade-in gain; the fade-out gain is the same curve reversed
+		switch([self crossfadeCurve]) {
+			case AudioSchedulerCrossfadeCurveLinear:		_crossfadeTable[i] = x;								break;
+			case AudioSchedulerCrossfadeCurveEqualPower:	_crossfadeTable[i] = sin(x * M_PI_2);				break;
+			case AudioSchedulerCrossfadeCurveSCurve:		_crossfadeTable[i] = (1.0 - cos(x * M_PI)) / 2.0;	break;
+		}
+	}
+	
+	// vDSP_vlint reads one element past the integral part of the index
+	_crossfadeTable[CROSSFADE_TABLE_SIZE + 1] = _crossfadeTable[CROSSFADE_TABLE_SIZE];
+}
+
+- (void) mixNextRegionIntoSlice:(ScheduledAudioSlice *)slice startingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount
+{
+	ScheduledAudioRegion			*region			= [self regionBeingScheduled];
+	id <AudioDecoderMethods>		decoder			= [region decoder];
+	AudioStreamBasicDescription		format			= [decoder format];
+	SInt64							totalFrames		= [decoder totalFrames];
+	
+	// The overlap can only be placed if the region's length is known
+	if(0 >= totalFrames)
+		return;
+	
+	// Give the delegate a chance to schedule the next region before the overlap begins
+	if(NO == _notifiedDelegateOfApproachingEnd && totalFrames - startingFrame <= (SInt64)(([self crossfadeDuration] + CROSSFADE_LOOKAHEAD) * format.mSampleRate)) {
+		_notifiedDelegateOfApproachingEnd = YES;
+		
+		[self postEvent:AudioSchedulerEventApproachingEndOfRegion region:region frame:startingFrame];
+	}
+	
+	// Fix the region to be mixed and the length of the overlap when the overlap begins
+	if(nil == _regionBeingMixed) {
+		ScheduledAudioRegion *nextRegion = nil;
+		
+		@synchronized([self scheduledAudioRegions]) {
+			nextRegion = [[[[self scheduledAudioRegions] lastObject] retain] autorelease];
+		}
+		
+		if(nil == nextRegion)
+			return;
+		
+		AudioStreamBasicDescription		nextFormat			= [[nextRegion decoder] format];
+		SInt64							nextTotalFrames		= [[nextRegion decoder] totalFrames];
+		
+		if(nextFormat.mSampleRate != format.mSampleRate || nextFormat.mChannelsPerFrame != format.mChannelsPerFrame || 0 >= nextTotalFrames)
+			return;
+		
+		// Very short regions are overlapped for no more than half their length
+		SInt64 crossfadeFrames = (SInt64)([self crossfadeDuration] * format.mSampleRate);
+		if(crossfadeFrames > totalFrames / 2)
+			crossfadeFrames = totalFrames / 2;
+		if(crossfadeFrames > nextTotalFrames / 2)
+			crossfadeFrames = nextTotalFrames / 2;
+
+		if(0 >= crossfadeFrames || startingFrame + frameCount <= totalFrames - crossfadeFrames)
+			return;
+
+		_regionBeingMixed		= [nextRegion retain];
+		_crossfadeFrameCount	= crossfadeFrames;
+		_crossfadeStartFrame	= totalFrames - crossfadeFrames;
+	}
+	
+	UInt32 offset = (startingFrame < _crossfadeStartFrame ? (UInt32)(_crossfadeStartFrame - startingFrame) : 0);
+	if(offset >= frameCount)
+		return;
+	
+	UInt32 framesToMix = [_regionBeingMixed readLeadInAudioInSlice:0 frameCount:frameCount - offset];
+	if(0 == framesToMix)
+		return;
+	
+	// Generate the gain ramps by interpolating the curve, forwards for the incoming region and backwards for the outgoing one
+	float	step			= (float)CROSSFADE_TABLE_SIZE / _crossfadeFrameCount;
+	float	start			= (startingFrame + offset - _crossfadeStartFrame) * step;
+	float	lowerBound		= 0;
+	float	upperBound		= CROSSFADE_TABLE_SIZE;
+	float	negativeOne		= -1;
+	
+	vDSP_vramp(&start, &step, _crossfadeIndices, 1, framesToMix);
+	vDSP_vclip(_crossfadeIndices, 1, &lowerBound, &upperBound, _crossfadeIndices, 1, framesToMix);
+	vDSP_vlint(_crossfadeTable, _crossfadeIndices, 1, _crossfadeGainIn, 1, framesToMix, CROSSFADE_TABLE_SIZE + 2);
+	
+	// The DSP chain applies the outgoing region's gain to the mix, so compensate the incoming audio for its own
+	float gainAdjustment = powf(10, ([_regionBeingMixed gain] - [region gain]) / 20);
+	if(1.0f != gainAdjustment)
+		vDSP_vsmul(_crossfadeGainIn, 1, &gainAdjustment, _crossfadeGainIn, 1, framesToMix);
+	
+	vDSP_vsmsa(_crossfadeIndices, 1, &negativeOne, &upperBound, _crossfadeIndices, 1, framesToMix);
+	vDSP_vlint(_crossfadeTable, _crossfadeIndices, 1, _crossfadeGainOut, 1, framesToMix, CROSSFADE_TABLE_SIZE + 2);
+	
+	AudioBufferList		*bufferList			= slice->mBufferList;
+	AudioBufferList		*nextBufferList		= [_regionBeingMixed sliceAtIndex:0]->mBufferList;
+	unsigned			channel;
+	
+	for(channel = 0; channel < bufferList->mNumberBuffers; ++channel) {
+		float *outgoing		= (float *)bufferList->mBuffers[channel].mData + offset;
+		float *incoming		= (float *)nextBufferList->mBuffers[channel].mData;
+		
+		vDSP_vmul(incoming, 1, _crossfadeGainIn, 1, incoming, 1, framesToMix);
+		vDSP_vma(outgoing, 1, _crossfadeGainOut, 1, incoming, 1, outgoing, 1, framesToMix);
+	}
+}
+
+- (void) abandonCrossfade
+{
+	[_regionBeingMixed rewindLeadIn];
+	[_regionBeingMixed release], _regionBeingMixed = nil;
+	
+	_crossfadeFrameCount = 0;
+}
+
+- (void) applyFadeInToSlice:(ScheduledAudioSlice *)slice frameCount:(UInt32)frameCount
+{
+	UInt32		framesToFade	= (frameCount < _fadeInFramesRemaining ? frameCount : (UInt32)_fadeInFramesRemaining);
+	float		step			= 1.0f / _fadeInFrameCount;
+	float		start			= (_fadeInFrameCount - _fadeInFramesRemaining) * step;
+	unsigned	channel;
+	
+	// The crossfade gain buffer is free here since any mixing into this slice is already done
+	vDSP_vramp(&start, &step, _crossfadeGainIn, 1, framesToFade);
+	
+	for(channel = 0; channel < slice->mBufferList->mNumberBuffers; ++channel) {
+		float *buffer = (float *)slice->mBufferList->mBuffers[channel].mData;
+		vDSP_vmul(buffer, 1, _crossfadeGainIn, 1, buffer, 1, framesToFade);
+	}
+	
+	_fadeInFramesRemaining -= framesToFade;
+}
+
+- (UInt32) drainDSPChainIntoSlice:(ScheduledAudioSlice *)slice
+{
+	float		*buffers [DSP_CHAIN_MAXIMUM_CHANNELS];
+	unsigned	channel;
+	
+	if(DSP_CHAIN_MAXIMUM_CHANNELS < slice->mBufferList->mNumberBuffers)
+		return 0;
+	
+	for(channel = 0; channel < slice->mBufferList->mNumberBuffers; ++channel)
+		buffers[channel] = (float *)slice->mBufferList->mBuffers[channel].mData;
+	
+	UInt32 frameCount = dsp_chain_drain(_dspChain, buffers, slice->mBufferList->mNumberBuffers, [[self regionBeingScheduled] numberOfFramesPerSlice]);
+	
+	// The decoder marked the buffers empty at the end of the region
+	for(channel = 0; channel < slice->mBufferList->mNumberBuffers; ++channel)
+		slice->mBufferList->mBuffers[channel].mDataByteSize = frameCount * sizeof(float);
+	
+	return frameCount;
+}
+
+- (BOOL) scheduleSliceAtIndex:(unsigned)sliceIndex
+{
+	ScheduledAudioRegion	*region		= [self regionBeingScheduled];
+	ScheduledAudioSlice		*slice		= [region sliceAtIndex:sliceIndex];
+	
+	// Prepare the slice
+	[region clearSlice:sliceIndex];
+	
+	SInt64 startingFrame = [[region decoder] currentFrame];
+	
+	// Read some data
+	double		decodeStart		= audio_event_current_time();
+	UInt32		frameCount		= [region readAudioInSlice:sliceIndex];
+	
+	audio_histogram_record(_decodeTimeHistogram, (uint64_t)((audio_event_current_time() - decodeStart) * 1000000));
+	
+	// The limiter holds back the last few milliseconds of the region, so schedule them before finishing it
+	BOOL drainingDSPChain = NO;
+	if(0 == frameCount) {
+		frameCount			= [self drainDSPChainIntoSlice:slice];
+		drainingDSPChain	= (0 < frameCount);
+	}
+	
+	// EOS?
+	if(0 == frameCount) {
+		// The region that was overlapped with this one will be picked up next, already in progress
+		[_regionBeingMixed release], _regionBeingMixed = nil;
+		_crossfadeFrameCount = 0;
+		
+		// Notify the delegate that the last frame of the current region has been scheduled
+		[self postEvent:AudioSchedulerEventFinishedSchedulingRegion region:region frame:[region framesScheduled]];
+		
+		// This region is finished
+		[self setRegionBeingScheduled:nil];
+		
+		return NO;
+	}
+	
+	// Overlap the start of the next region with the end of this one
+	if(NO == drainingDSPChain && 0 < [self crossfadeDuration])
+		[self mixNextRegionIntoSlice:slice startingFrame:startingFrame frameCount:frameCount];
+	
+	// Ramp up the audio following a seek
+	if(NO == drainingDSPChain && 0 < _fadeInFramesRemaining)
+		[self applyFadeInToSlice:slice frameCount:frameCount];
+	
+	// Apply gain, equalization and limiting
+	if(NO == drainingDSPChain && DSP_CHAIN_MAXIMUM_CHANNELS >= slice->mBufferList->mNumberBuffers) {
+		float		*buffers [DSP_CHAIN_MAXIMUM_CHANNELS];
+		unsigned	channel;
+		
+		for(channel = 0; channel < slice->mBufferList->mNumberBuffers; ++channel)
+			buffers[channel] = (float *)slice->mBufferList->mBuffers[channel].mData;
+		
+		frameCount = dsp_chain_process(_dspChain, buffers, slice->mBufferList->mNumberBuffers, frameCount);
+		
+		// The limiter's delay line took everything that was read, so read some more
+		if(0 == frameCount)
+			return [self scheduleSliceAtIndex:sliceIndex];
+	}
+	
+	// To handle the case where the file contains fewer frames than the buffer,
+	// pass the region to the callback proc to ensure that the callback
+	// knows the ScheduledAudioRegion the audio that was just rendered came from
+	if(0 == [region framesScheduled])
+		[self retainRegionUntilRendered:region];
+	
+	// Schedule it
+	slice->mTimeStamp.mFlags		= kAudioTimeStampSampleTimeValid;
+	slice->mTimeStamp.mSampleTime	= [self scheduledStartTime].mSampleTime + [self framesScheduled];
+	slice->mCompletionProc			= scheduledAudioSliceCompletionProc;
+	slice->mCompletionProcUserData	= (void *)region;
+	slice->mFlags					= 0;
+	slice->mNumberFrames			= frameCount;
+	
+	audio_histogram_record(_bufferFillHistogram, (uint64_t)([self framesScheduled] - [self framesRendered]));
+	
+	OSStatus err = [[self output] scheduleAudioSlice:slice];
+	if(noErr != err) {
+		NSLog(@"AudioScheduler: Unable to schedule audio slice: %i", err);
+		slice->mFlags = kScheduledAudioSliceFlag_Complete;
+		return YES;
+	}
+	
+#if EXTENDED_DEBUG
+	NSLog(@"AudioScheduler: Scheduling slice %i (%i frames) to start at sample %qi", sliceIndex, frameCount, (SInt64)slice->mTimeStamp.mSampleTime);
+#endif
+	
+	[self scheduledAdditionalFrames:frameCount];
+	++_slicesScheduledCount;
+	
+	return YES;
+}
+
+- (void) performPendingSeek
+{
+	ScheduledAudioRegion	*region			= nil;
+	SInt64					frame			= 0;
+	SInt64					seekedFrame		= -1;
+	
+	@synchronized(self) {
+		region			= [_regionToSeek autorelease];
+		frame			= _seekFrame;
+		_regionToSeek	= nil;
+		_seekPending	= NO;
+	}
+	
+	// Only seek if the region's audio is the only audio scheduled
+	if(nil != region && region == [self regionBeingScheduled] && region == [self regionBeingRendered]) {
+		
+		// Quiesce the completion proc so it can't update the frame counters while they are reset
+		OSAtomicCompareAndSwap32Barrier(0, 1, &_discardingRenderedSlices);
+		while(0 != _completionProcsActive)
+			sched_yield();
+		
+		// Discard the slices already scheduled, leaving the rest of the AUGraph alone
+		OSStatus result = [[self output] reset];
+		if(noErr != result)
+			NSLog(@"AudioScheduler: Unable to reset output: %i", result);
+		
+		[region clearSliceBuffer];
+		[region clearFramesScheduled];
+		[region clearFramesRendered];
+		[self abandonCrossfade];
+		
+		_framesScheduled					= 0;
+		_framesRendered						= 0;
+		_scheduledStartTime.mSampleTime		= 0;
+		
+		// Slices scheduled from here on are rendered normally
+		OSAtomicCompareAndSwap32Barrier(1, 0, &_discardingRenderedSlices);
+		
+		dsp_chain_reset(_dspChain);
+		
+		seekedFrame = [[region decoder] seekToFrame:frame];
+		
+		// Fade in to avoid a click at the discontinuity
+		_fadeInFrameCount		= (SInt64)(SEEK_FADE_DURATION * [[region decoder] format].mSampleRate);
+		_fadeInFramesRemaining	= _fadeInFrameCount;
+		
+		// Pre-roll a small amount of audio, then restart the output
+		unsigned i;
+		for(i = 0; i < SEEK_PREROLL_SLICES && i < [region numberOfSlicesInBuffer]; ++i) {
+			if(NO == [self scheduleSliceAtIndex:i])
+				break;
+		}
+		
+		AudioTimeStamp timeStamp = { 0 };
+		
+		timeStamp.mFlags		= kAudioTimeStampSampleTimeValid;
+		timeStamp.mSampleTime	= -1;
+		
+		// The latency runs until the first of these slices completes
+		OSAtomicCompareAndSwap32Barrier(0, 1, &_measuringSeekLatency);
+		
+		result = [[self output] setScheduleStartTimeStamp:timeStamp];
+		if(noErr != result)
+			NSLog(@"AudioScheduler: Unable to restart output: %i", result);
+		
+#if DEBUG
+		NSLog(@"AudioScheduler: Seek to frame %qi scheduled in %.1f ms", seekedFrame, (audio_event_current_time() - _seekRequestTime) * 1000);
+#endif
+	}
+	
+	// Notify the delegate where playback resumed (-1 if the seek wasn't performed)
+	[self postEvent:AudioSchedulerEventSeekedRegion region:region frame:seekedFrame];
 }
 
 - (void) processSlicesInThread:(id)dummy
@@ -386,7 +1092,6 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	NSAutoreleasePool		*pool				= [[NSAutoreleasePool alloc] init];
 	mach_timespec_t			timeout				= { 2, 0 };
 	ScheduledAudioSlice		*slice				= NULL;
-	UInt32					frameCount			= 0;
 	BOOL					allFramesScheduled	= NO;
 	unsigned				i;
 	
@@ -394,14 +1099,14 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	[self setThreadPolicy];
 	
 	// Notify the delegate that scheduling has started
-	if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerStartedScheduling:)])
-		[[self delegate] performSelectorOnMainThread:@selector(audioSchedulerStartedScheduling:) withObject:self waitUntilDone:NO];
+	[self postEvent:AudioSchedulerEventStartedScheduling region:nil frame:[self framesScheduled]];
 
 	// Outer scheduling loop, for looping over regions
 	while([self keepScheduling]) {
 
 		// Grab the next ScheduledAudioRegion to work with
 		if(nil == [self regionBeingScheduled]) {
+			_notifiedDelegateOfApproachingEnd = NO;
 
 			@synchronized([self scheduledAudioRegions]) {
 				[self setRegionBeingScheduled:[[self scheduledAudioRegions] lastObject]];
@@ -412,77 +1117,39 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 			// If a new region was found, notify the delegate
 			if(nil != [self regionBeingScheduled]) {
 				allFramesScheduled = NO;
+				
+				// A change in gain between regions is ramped by the DSP chain
+				// A crossfaded region's lead-in was already compensated to its own gain, so switch to it at the handoff
+				dsp_chain_set_sample_rate(_dspChain, [[[self regionBeingScheduled] decoder] format].mSampleRate);
+				if(0 < [[self regionBeingScheduled] leadInFrames])
+					dsp_chain_set_gain_immediately(_dspChain, [[self regionBeingScheduled] gain]);
+				else
+					dsp_chain_set_gain(_dspChain, [[self regionBeingScheduled] gain]);
+				
+				// Don't ramp from the gain of whatever played before scheduling started
+				if(0 == [self framesScheduled])
+					dsp_chain_reset(_dspChain);
 
 				// Notify the delegate that the scheduling has been started for the current region
-				if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerStartedSchedulingRegion:)])
-					[[self delegate] performSelectorOnMainThread:@selector(audioSchedulerStartedSchedulingRegion:)
-													  withObject:[NSDictionary dictionaryWithObjectsAndKeys:self, AudioSchedulerObjectKey, _regionBeingScheduled, ScheduledAudioRegionObjectKey, nil]
-												   waitUntilDone:NO];
+				[self postEvent:AudioSchedulerEventStartedSchedulingRegion region:[self regionBeingScheduled] frame:[[self regionBeingScheduled] framesScheduled]];
 			}
 		}
 		
 		// Inner scheduling loop, for processing an individual region
 		while([self keepScheduling] && nil != [self regionBeingScheduled] && NO == allFramesScheduled) {
 
+			// Seeks are performed here, between slices, so the decoder is never used from two threads
+			if(_seekPending)
+				[self performPendingSeek];
+			
 			// Iterate through the slice buffer, scheduling audio as completed slices become available
 			for(i = 0; i < [[self regionBeingScheduled] numberOfSlicesInBuffer]; ++i) {
 				slice = [[self regionBeingScheduled] sliceAtIndex:i];
 				
 				// If the slice is marked as complete, re-use it
-				if(kScheduledAudioSliceFlag_Complete & slice->mFlags) {
-					
-					// Prepare the slice
-					[[self regionBeingScheduled] clearSlice:i];
-					
-					// Read some data
-					frameCount = [[self regionBeingScheduled] readAudioInSlice:i];
-					
-					// EOS?
-					if(0 == frameCount) {
-						allFramesScheduled = YES;
-						
-						// Notify the delegate that the last frame of the current region has been scheduled
-						if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerFinishedSchedulingRegion:)])
-							[[self delegate] performSelectorOnMainThread:@selector(audioSchedulerFinishedSchedulingRegion:)
-															  withObject:[NSDictionary dictionaryWithObjectsAndKeys:self, AudioSchedulerObjectKey, _regionBeingScheduled, ScheduledAudioRegionObjectKey, nil]
-														   waitUntilDone:NO];
-						
-						// This region is finished
-						[self setRegionBeingScheduled:nil];
-						
-						break;
-					}
-					
-					// To handle the case where the file contains fewer frames than the buffer,
-					// pass the region and self to the callback proc to ensure that the callback
-					// knows the ScheduledAudioRegion the audio that was just rendered came from
-					NSArray *array = [[NSArray alloc] initWithObjects:self, [self regionBeingScheduled], nil];					
-					
-					// Schedule it
-					slice->mTimeStamp.mFlags		= kAudioTimeStampSampleTimeValid;
-					slice->mTimeStamp.mSampleTime	= [self scheduledStartTime].mSampleTime + [self framesScheduled];
-					slice->mCompletionProc			= scheduledAudioSliceCompletionProc;
-					slice->mCompletionProcUserData	= (void *)array;
-					slice->mFlags					= 0;
-					slice->mNumberFrames			= frameCount;
-					
-					ComponentResult err = AudioUnitSetProperty([self audioUnit],
-															   kAudioUnitProperty_ScheduleAudioSlice, 
-															   kAudioUnitScope_Global, 
-															   0,
-															   slice, 
-															   sizeof(ScheduledAudioSlice));
-					if(noErr != err) {
-						NSLog(@"AudioScheduler: Unable to schedule audio slice: %i", err);
-						slice->mFlags = kScheduledAudioSliceFlag_Complete;
-						continue;
-					}
-
-#if EXTENDED_DEBUG
-					NSLog(@"AudioScheduler: Scheduling slice %i (%i frames) to start at sample %qi", i, frameCount, (SInt64)slice->mTimeStamp.mSampleTime);
-#endif
-
-					[self scheduledAdditionalFrames:frameCount];
+				if(kScheduledAudioSliceFlag_Complete & slice->mFlags && NO == [self scheduleSliceAtIndex:i]) {
+					allFramesScheduled = YES;
+					break;
 				}
 			}
 
@@ -490,15 +1157,18 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 			semaphore_timedwait([self semaphore], timeout);
 		}		
 
+		// A seek that arrived after the region finished scheduling can't be honored
+		if(_seekPending)
+			[self performPendingSeek];
+
 		// Sleep until we are signaled or the timeout happens
 		semaphore_timedwait([self semaphore], timeout);
 	}
 	
-	_scheduling = NO;
+	// Notify the delegate that scheduling has stopped (before clearing the flag, so the event is delivered)
+	[self postEvent:AudioSchedulerEventStoppedScheduling region:nil frame:[self framesScheduled]];
 	
-	// Notify the delegate that scheduling has stopped
-	if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerStoppedScheduling:)])
-		[[self delegate] performSelectorOnMainThread:@selector(audioSchedulerStoppedScheduling:) withObject:self waitUntilDone:NO];
+	_scheduling = NO;
 	
 	[pool release];
 }
@@ -0,0 +1,601 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "DSPChain.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#  include <libkern/OSAtomic.h>
+#  define dsp_memory_barrier()		OSMemoryBarrier()
+#else
+#  define dsp_memory_barrier()		__sync_synchronize()
+#endif
+
+// Length of the ramp used for gain changes, in seconds
+#define GAIN_RAMP_DURATION			0.02
+
+// The look-ahead is clamped to this many frames (about 42 ms at 192 kHz)
+#define MAXIMUM_LOOKAHEAD_FRAMES	8192
+#define LIMITER_WINDOW_CAPACITY		(MAXIMUM_LOOKAHEAD_FRAMES + 1)
+
+typedef struct {
+	float	b0, b1, b2, a1, a2;
+} BiquadCoefficients;
+
+struct DSPChain {
+	double					sampleRate;
+	unsigned				maximumFrameCount;
+	
+	// Parameters are published with a sequence counter: odd while being written
+	volatile unsigned		parameterSequence;
+	DSPChainParameters		pendingParameters;
+	unsigned				activeSequence;
+	DSPChainParameters		parameters;
+	
+	// Gain
+	volatile float			targetGain;
+	float					rampTargetGain;
+	float					currentGain;
+	float					gainStep;
+	unsigned				gainRampFramesRemaining;
+	
+	// Equalizer
+	BiquadCoefficients		coefficients [DSP_CHAIN_MAXIMUM_EQUALIZER_BANDS];
+	float					filterState [DSP_CHAIN_MAXIMUM_EQUALIZER_BANDS][DSP_CHAIN_MAXIMUM_CHANNELS][2];
+	
+	// Limiter
+	unsigned				lookaheadFrames;
+	float					attackCoefficient;
+	float					releaseCoefficient;
+	float					envelope;
+	
+	float					delayLines [DSP_CHAIN_MAXIMUM_CHANNELS][MAXIMUM_LOOKAHEAD_FRAMES];
+	unsigned				delayPosition;
+	
+	// Stream frames held in the delay line, and the silence pushed in behind them by a drain
+	unsigned				delayedFrames;
+	unsigned				drainedFrames;
+	
+	// Required gains for the frames in the look-ahead window, in increasing order
+	float					windowGains [LIMITER_WINDOW_CAPACITY];
+	uint64_t				windowFrames [LIMITER_WINDOW_CAPACITY];
+	uint64_t				windowHead;
+	uint64_t				windowTail;
+	uint64_t				limiterFrame;
+	
+	// Scratch space
+	float					*gains;
+};
+
+static void
+calculate_biquad_coefficients(const DSPEqualizerBand *band, double sampleRate, BiquadCoefficients *coefficients)
+{
+	double	frequency	= band->frequency;
+	double	q			= (0 < band->q ? band->q : M_SQRT1_2);
+	
+	if(frequency >= sampleRate / 2)
+		frequency = (sampleRate / 2) * 0.99;
+	
+	double	A			= pow(10, band->gain / 40.0);
+	double	w0			= 2 * M_PI * frequency / sampleRate;
+	double	cosw0		= cos(w0);
+	double	alpha		= sin(w0) / (2 * q);
+	double	twoSqrtAAlpha	= 2 * sqrt(A) * alpha;
+	double	b0, b1, b2, a0, a1, a2;
+	
+	switch(band->type) {
+		case DSPEqualizerBandLowShelf:
+			b0 = A * ((A + 1) - (A - 1) * cosw0 + twoSqrtAAlpha);
+			b1 = 2 * A * ((A - 1) - (A + 1) * cosw0);
+			b2 = A * ((A + 1) - (A - 1) * cosw0 - twoSqrtAAlpha);
+			a0 = (A + 1) + (A - 1) * cosw0 + twoSqrtAAlpha;
+			a1 = -2 * ((A - 1) + (A + 1) * cosw0);
+			a2 = (A + 1) + (A - 1) * cosw0 - twoSqrtAAlpha;
+			break;
+			
+		case DSPEqualizerBandHighShelf:
+			b0 = A * ((A + 1) + (A - 1) * cosw0 + twoSqrtAAlpha);
+			b1 = -2 * A * ((A - 1) + (A + 1) * cosw0);
+			b2 = A * ((A + 1) + (A - 1) * cosw0 - twoSqrtAAlpha);
+			a0 = (A + 1) - (A - 1) * cosw0 + twoSqrtAAlpha;
+			a1 = 2 * ((A - 1) - (A + 1) * cosw0);
+			a2 = (A + 1) - (A - 1) * cosw0 - twoSqrtAAlpha;
+			break;
+			
+		case DSPEqualizerBandPeaking:
+		default:
+			b0 = 1 + alpha * A;
+			b1 = -2 * cosw0;
+			b2 = 1 - alpha * A;
+			a0 = 1 + alpha / A;
+			a1 = -2 * cosw0;
+			a2 = 1 - alpha / A;
+			break;
+	}
+	
+	coefficients->b0 = b0 / a0;
+	coefficients->b1 = b1 / a0;
+	coefficients->b2 = b2 / a0;
+	coefficients->a1 = a1 / a0;
+	coefficients->a2 = a2 / a0;
+}
+
+static void
+reset_limiter(DSPChain *chain)
+{
+	memset(chain->delayLines, 0, sizeof(chain->delayLines));
+	
+	chain->envelope			= 1.0f;
+	chain->delayPosition	= 0;
+	chain->delayedFrames	= 0;
+	chain->drainedFrames	= 0;
+	chain->windowHead		= 0;
+	chain->windowTail		= 0;
+	chain->limiterFrame		= 0;
+}
+
+// Derive everything that depends on the sample rate or the parameters
+static void
+update_derived_state(DSPChain *chain)
+{
+	unsigned i;
+	for(i = 0; i < chain->parameters.equalizerBandCount; ++i)
+		calculate_biquad_coefficients(&chain->parameters.equalizerBands[i], chain->sampleRate, &chain->coefficients[i]);
+	
+	unsigned previousLookaheadFrames = chain->lookaheadFrames;
+	
+	chain->lookaheadFrames = (unsigned)(chain->parameters.limiterLookahead * chain->sampleRate + 0.5);
+	if(1 > chain->lookaheadFrames)
+		chain->lookaheadFrames = 1;
+	else if(MAXIMUM_LOOKAHEAD_FRAMES < chain->lookaheadFrames)
+		chain->lookaheadFrames = MAXIMUM_LOOKAHEAD_FRAMES;
+	
+	// The delay line only holds audio for the old window length
+	if(chain->lookaheadFrames != previousLookaheadFrames)
+		reset_limiter(chain);
+	
+	// The attack settles within the look-ahead window, so the gain is down before the peak arrives
+	chain->attackCoefficient	= 1.0f - expf(-4.0f / chain->lookaheadFrames);
+	chain->releaseCoefficient	= 1.0f - expf(-1.0f / (chain->parameters.limiterRelease * chain->sampleRate));
+}
+
+// Adopt newly published parameters, if a consistent copy can be read
+static void
+read_parameters(DSPChain *chain)
+{
+	unsigned sequence = chain->parameterSequence;
+	if(sequence == chain->activeSequence || (sequence & 1))
+		return;
+	
+	dsp_memory_barrier();
+	DSPChainParameters parameters = chain->pendingParameters;
+	dsp_memory_barrier();
+	
+	// A writer intervened, so try again on the next call
+	if(sequence != chain->parameterSequence)
+		return;
+	
+	unsigned	previousBandCount		= chain->parameters.equalizerBandCount;
+	int			previousLimiterEnabled	= chain->parameters.limiterEnabled;
+	unsigned	band;
+	
+	// Bands at 0 dB are skipped, so their state is stale when they become active again
+	for(band = 0; band < previousBandCount && band < parameters.equalizerBandCount; ++band) {
+		if(0 == chain->parameters.equalizerBands[band].gain && 0 != parameters.equalizerBands[band].gain)
+			memset(chain->filterState[band], 0, sizeof(chain->filterState[band]));
+	}
+	
+	chain->parameters		= parameters;
+	chain->activeSequence	= sequence;
+	
+	// Newly enabled bands start from silence
+	if(parameters.equalizerBandCount > previousBandCount)
+		memset(chain->filterState[previousBandCount], 0, (parameters.equalizerBandCount - previousBandCount) * sizeof(chain->filterState[0]));
+	
+	// The delay line stopped filling while the limiter was off
+	if(parameters.limiterEnabled && !previousLimiterEnabled)
+		reset_limiter(chain);
+	
+	update_derived_state(chain);
+}
+
+static void
+apply_gain(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	float		targetGain	= chain->targetGain;
+	unsigned	channel, i;
+	
+	if(targetGain != chain->rampTargetGain) {
+		unsigned rampFrames = (unsigned)(GAIN_RAMP_DURATION * chain->sampleRate);
+		if(1 > rampFrames)
+			rampFrames = 1;
+		
+		chain->rampTargetGain			= targetGain;
+		chain->gainStep					= (powf(10, targetGain / 20) - chain->currentGain) / rampFrames;
+		chain->gainRampFramesRemaining	= rampFrames;
+	}
+	
+	// Unity gain needs no work
+	if(0 == chain->gainRampFramesRemaining && 1.0f == chain->currentGain)
+		return;
+	
+	float		*gains			= chain->gains;
+	unsigned	rampFrames		= (frameCount < chain->gainRampFramesRemaining ? frameCount : chain->gainRampFramesRemaining);
+	float		gain			= chain->currentGain;
+	
+	for(i = 0; i < rampFrames; ++i)
+		gains[i] = gain + (chain->gainStep * (i + 1));
+	
+	if(0 < rampFrames) {
+		chain->gainRampFramesRemaining	-= rampFrames;
+		chain->currentGain				= (0 == chain->gainRampFramesRemaining ? powf(10, chain->rampTargetGain / 20) : gains[rampFrames - 1]);
+	}
+	
+	for(i = rampFrames; i < frameCount; ++i)
+		gains[i] = chain->currentGain;
+	
+	for(channel = 0; channel < channelCount; ++channel) {
+		float *buffer = buffers[channel];
+		for(i = 0; i < frameCount; ++i)
+			buffer[i] *= gains[i];
+	}
+}
+
+static void
+apply_equalizer(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	unsigned band, channel, i;
+	
+	for(band = 0; band < chain->parameters.equalizerBandCount; ++band) {
+		if(0 == chain->parameters.equalizerBands[band].gain)
+			continue;
+		
+		BiquadCoefficients c = chain->coefficients[band];
+		
+		// Transposed direct form II
+		for(channel = 0; channel < channelCount; ++channel) {
+			float	*buffer		= buffers[channel];
+			float	s1			= chain->filterState[band][channel][0];
+			float	s2			= chain->filterState[band][channel][1];
+			
+			for(i = 0; i < frameCount; ++i) {
+				float x		= buffer[i];
+				float y		= (c.b0 * x) + s1;
+				s1			= (c.b1 * x) - (c.a1 * y) + s2;
+				s2			= (c.b2 * x) - (c.a2 * y);
+				buffer[i]	= y;
+			}
+			
+			chain->filterState[band][channel][0] = s1;
+			chain->filterState[band][channel][1] = s2;
+		}
+	}
+}
+
+static void
+apply_limiter(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	float		threshold		= chain->parameters.limiterThreshold;
+	unsigned	lookahead		= chain->lookaheadFrames;
+	float		*gains			= chain->gains;
+	float		envelope		= chain->envelope;
+	unsigned	channel, i;
+	
+	// The envelope follows the minimum gain required over the look-ahead window, using a monotonic
+	// queue that carries over from the previous call
+	for(i = 0; i < frameCount; ++i) {
+		float		peak		= 0;
+		float		required	= 1.0f;
+		uint64_t	frame		= chain->limiterFrame++;
+		
+		for(channel = 0; channel < channelCount; ++channel) {
+			float magnitude = fabsf(buffers[channel][i]);
+			if(magnitude > peak)
+				peak = magnitude;
+		}
+		
+		if(peak > threshold)
+			required = threshold / peak;
+		
+		while(chain->windowTail > chain->windowHead && chain->windowGains[(chain->windowTail - 1) % LIMITER_WINDOW_CAPACITY] >= required)
+			--chain->windowTail;
+		
+		chain->windowGains[chain->windowTail % LIMITER_WINDOW_CAPACITY]		= required;
+		chain->windowFrames[chain->windowTail % LIMITER_WINDOW_CAPACITY]	= frame;
+		++chain->windowTail;
+		
+		while(chain->windowFrames[chain->windowHead % LIMITER_WINDOW_CAPACITY] + lookahead < frame)
+			++chain->windowHead;
+		
+		float target = chain->windowGains[chain->windowHead % LIMITER_WINDOW_CAPACITY];
+		
+		if(target < envelope)
+			envelope += (target - envelope) * chain->attackCoefficient;
+		else
+			envelope += (target - envelope) * chain->releaseCoefficient;
+		
+		gains[i] = envelope;
+	}
+	
+	// Snap to unity rather than approaching it forever
+	chain->envelope = (0.9999f < envelope ? 1.0f : envelope);
+	
+	// The output is delayed by the look-ahead, so the gain is down before a peak leaves the delay line
+	for(channel = 0; channel < channelCount; ++channel) {
+		float		*buffer		= buffers[channel];
+		float		*delayLine	= chain->delayLines[channel];
+		unsigned	position	= chain->delayPosition;
+		
+		for(i = 0; i < frameCount; ++i) {
+			float sample			= delayLine[position] * gains[i];
+			delayLine[position]		= buffer[i];
+			
+			if(++position == lookahead)
+				position = 0;
+			
+			// Guard against rounding in the envelope
+			if(sample > threshold)
+				sample = threshold;
+			else if(sample < -threshold)
+				sample = -threshold;
+			
+			buffer[i] = sample;
+		}
+	}
+	
+	chain->delayPosition = (chain->delayPosition + frameCount) % lookahead;
+}
+
+// Push silence through the limiter, returning the stream frames that leave the delay line
+static unsigned
+drain_limiter(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	unsigned	leadingFrames	= chain->lookaheadFrames - chain->delayedFrames - chain->drainedFrames;
+	unsigned	framesToDrain;
+	unsigned	channel;
+	
+	// If the stream was shorter than the look-ahead, the silence ahead of it goes out unheard
+	while(0 < leadingFrames) {
+		unsigned framesToSkip = (leadingFrames < frameCount ? leadingFrames : frameCount);
+		
+		for(channel = 0; channel < channelCount; ++channel)
+			memset(buffers[channel], 0, framesToSkip * sizeof(float));
+		
+		apply_limiter(chain, buffers, channelCount, framesToSkip);
+		
+		chain->drainedFrames	+= framesToSkip;
+		leadingFrames			-= framesToSkip;
+	}
+	
+	framesToDrain = (chain->delayedFrames < frameCount ? chain->delayedFrames : frameCount);
+	
+	for(channel = 0; channel < channelCount; ++channel)
+		memset(buffers[channel], 0, framesToDrain * sizeof(float));
+	
+	apply_limiter(chain, buffers, channelCount, framesToDrain);
+	
+	chain->drainedFrames	+= framesToDrain;
+	chain->delayedFrames	-= framesToDrain;
+	
+	// Start over so the next stream fills the delay line before any of it is written
+	if(0 == chain->delayedFrames)
+		reset_limiter(chain);
+	
+	return framesToDrain;
+}
+
+static void
+apply_clipper(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	float		threshold		= chain->parameters.limiterThreshold;
+	unsigned	channel, i;
+	
+	for(channel = 0; channel < channelCount; ++channel) {
+		float *buffer = buffers[channel];
+		
+		for(i = 0; i < frameCount; ++i) {
+			if(buffer[i] > threshold)
+				buffer[i] = threshold;
+			else if(buffer[i] < -threshold)
+				buffer[i] = -threshold;
+		}
+	}
+}
+
+DSPChain *
+dsp_chain_create(double sampleRate, unsigned maximumFrameCount)
+{
+	assert(0 < sampleRate);
+	assert(0 < maximumFrameCount);
+	
+	DSPChain *chain = calloc(1, sizeof(DSPChain));
+	if(NULL == chain)
+		return NULL;
+	
+	chain->gains			= calloc(maximumFrameCount, sizeof(float));
+	
+	if(NULL == chain->gains) {
+		dsp_chain_destroy(chain);
+		return NULL;
+	}
+	
+	chain->sampleRate							= sampleRate;
+	chain->maximumFrameCount					= maximumFrameCount;
+	
+	chain->parameters.limiterEnabled			= 1;
+	chain->parameters.limiterThreshold			= 1.0f;
+	chain->parameters.limiterLookahead			= 0.005f;
+	chain->parameters.limiterRelease			= 0.05f;
+	chain->pendingParameters					= chain->parameters;
+	
+	chain->currentGain							= 1.0f;
+	chain->envelope								= 1.0f;
+	
+	update_derived_state(chain);
+	
+	return chain;
+}
+
+void
+dsp_chain_destroy(DSPChain *chain)
+{
+	if(NULL == chain)
+		return;
+	
+	free(chain->gains);
+	free(chain);
+}
+
+void
+dsp_chain_set_sample_rate(DSPChain *chain, double sampleRate)
+{
+	assert(NULL != chain);
+	assert(0 < sampleRate);
+	
+	if(sampleRate == chain->sampleRate)
+		return;
+	
+	chain->sampleRate = sampleRate;
+	update_derived_state(chain);
+	dsp_chain_reset(chain);
+}
+
+void
+dsp_chain_reset(DSPChain *chain)
+{
+	assert(NULL != chain);
+	
+	memset(chain->filterState, 0, sizeof(chain->filterState));
+	
+	reset_limiter(chain);
+	
+	// Jump straight to the requested gain
+	chain->rampTargetGain			= chain->targetGain;
+	chain->currentGain				= powf(10, chain->rampTargetGain / 20);
+	chain->gainRampFramesRemaining	= 0;
+}
+
+void
+dsp_chain_get_parameters(DSPChain *chain, DSPChainParameters *parameters)
+{
+	assert(NULL != chain);
+	assert(NULL != parameters);
+	
+	*parameters = chain->pendingParameters;
+}
+
+void
+dsp_chain_set_parameters(DSPChain *chain, const DSPChainParameters *parameters)
+{
+	assert(NULL != chain);
+	assert(NULL != parameters);
+	assert(DSP_CHAIN_MAXIMUM_EQUALIZER_BANDS >= parameters->equalizerBandCount);
+	assert(0 < parameters->limiterThreshold && 0 < parameters->limiterRelease);
+	
+	++chain->parameterSequence;
+	dsp_memory_barrier();
+	chain->pendingParameters = *parameters;
+	dsp_memory_barrier();
+	++chain->parameterSequence;
+}
+
+void
+dsp_chain_set_gain(DSPChain *chain, float gain)
+{
+	assert(NULL != chain);
+	
+	chain->targetGain = gain;
+}
+
+void
+dsp_chain_set_gain_immediately(DSPChain *chain, float gain)
+{
+	assert(NULL != chain);
+	
+	chain->targetGain				= gain;
+	chain->rampTargetGain			= gain;
+	chain->currentGain				= powf(10, gain / 20);
+	chain->gainRampFramesRemaining	= 0;
+}
+
+unsigned
+dsp_chain_process(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	assert(NULL != chain);
+	assert(NULL != buffers);
+	assert(frameCount <= chain->maximumFrameCount);
+	
+	if(0 == frameCount)
+		return 0;
+	
+	read_parameters(chain);
+	
+	apply_gain(chain, buffers, channelCount, frameCount);
+	
+	// Filter state is kept for a fixed number of channels
+	if(DSP_CHAIN_MAXIMUM_CHANNELS >= channelCount)
+		apply_equalizer(chain, buffers, channelCount, frameCount);
+	
+	// The delay lines are kept for a fixed number of channels too
+	if(chain->parameters.limiterEnabled && DSP_CHAIN_MAXIMUM_CHANNELS >= channelCount) {
+		// A drain that wasn't finished left silence between the held frames and these
+		if(0 != chain->drainedFrames)
+			reset_limiter(chain);
+		
+		unsigned leadingFrames = chain->lookaheadFrames - chain->delayedFrames;
+		
+		apply_limiter(chain, buffers, channelCount, frameCount);
+		
+		chain->delayedFrames = (leadingFrames > frameCount ? chain->delayedFrames + frameCount : chain->lookaheadFrames);
+		
+		// Until the delay line is full, what leaves it is the silence it was reset to
+		if(0 < leadingFrames) {
+			unsigned framesToSkip = (leadingFrames < frameCount ? leadingFrames : frameCount);
+			unsigned channel;
+			
+			for(channel = 0; channel < channelCount; ++channel)
+				memmove(buffers[channel], buffers[channel] + framesToSkip, (frameCount - framesToSkip) * sizeof(float));
+			
+			return frameCount - framesToSkip;
+		}
+	}
+	else if(chain->parameters.limiterEnabled)
+		apply_clipper(chain, buffers, channelCount, frameCount);
+	
+	return frameCount;
+}
+
+unsigned
+dsp_chain_drain(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount)
+{
+	assert(NULL != chain);
+	assert(NULL != buffers);
+	assert(frameCount <= chain->maximumFrameCount);
+	
+	if(!chain->parameters.limiterEnabled || DSP_CHAIN_MAXIMUM_CHANNELS < channelCount || 0 == frameCount)
+		return 0;
+	
+	return drain_limiter(chain, buffers, channelCount, frameCount);
+}
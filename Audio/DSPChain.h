@@ -0,0 +1,96 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DSPCHAIN_H
+#define DSPCHAIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// A chain of DSP stages (gain, parametric EQ, look-ahead peak limiter) operating
+// in place on non-interleaved float buffers
+// Processing never allocates memory or takes locks; parameters may be changed
+// from another thread while audio is being processed
+// While the limiter is enabled it holds back the look-ahead time's worth of frames:
+// after a reset fewer frames are written than were processed, and the rest are
+// written by draining the chain at the end of the stream
+// ========================================
+
+#define DSP_CHAIN_MAXIMUM_CHANNELS			8
+#define DSP_CHAIN_MAXIMUM_EQUALIZER_BANDS	8
+
+enum {
+	DSPEqualizerBandPeaking			= 0,
+	DSPEqualizerBandLowShelf		= 1,
+	DSPEqualizerBandHighShelf		= 2
+};
+
+typedef struct {
+	int				type;
+	float			frequency;				// Hz
+	float			gain;					// dB
+	float			q;
+} DSPEqualizerBand;
+
+typedef struct {
+	int					limiterEnabled;
+	float				limiterThreshold;		// Linear amplitude
+	float				limiterLookahead;		// Seconds
+	float				limiterRelease;			// Seconds
+	
+	unsigned			equalizerBandCount;
+	DSPEqualizerBand	equalizerBands [DSP_CHAIN_MAXIMUM_EQUALIZER_BANDS];
+} DSPChainParameters;
+
+typedef struct DSPChain DSPChain;
+
+// Create a chain that processes up to maximumFrameCount frames per call
+DSPChain * dsp_chain_create(double sampleRate, unsigned maximumFrameCount);
+void dsp_chain_destroy(DSPChain *chain);
+
+// Must only be called from the thread processing audio (or when none is)
+void dsp_chain_set_sample_rate(DSPChain *chain, double sampleRate);
+void dsp_chain_reset(DSPChain *chain);
+
+// May be called from any one thread at a time while audio is being processed
+void dsp_chain_get_parameters(DSPChain *chain, DSPChainParameters *parameters);
+void dsp_chain_set_parameters(DSPChain *chain, const DSPChainParameters *parameters);
+
+// Gain changes are ramped over a few milliseconds to avoid zipper noise
+void dsp_chain_set_gain(DSPChain *chain, float gain);		// dB
+
+// Change the gain without a ramp, from the thread processing audio, for audio that
+// already has the new gain applied up to this point (such as a crossfade's incoming stream)
+void dsp_chain_set_gain_immediately(DSPChain *chain, float gain);		// dB
+
+// Returns the number of frames written to the start of the buffers
+unsigned dsp_chain_process(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount);
+
+// At the end of a stream, write up to frameCount of the frames still held by the limiter
+// Returns the number of frames written; call until it returns 0 before processing another stream
+unsigned dsp_chain_drain(DSPChain *chain, float * const *buffers, unsigned channelCount, unsigned frameCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSPCHAIN_H */
@@ -0,0 +1,51 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "AudioDecoderMethods.h"
+
+// A wrapper around a decoder that remixes its output to a different channel layout
+// The mixing matrix is built once from the channel labels of the two layouts, so
+// 5.1 -> stereo, mono -> stereo, stereo -> mono, etc. cost one multiply-accumulate per coefficient
+// Each output channel's coefficients are normalized to sum to at most 1, so a downmix can't clip
+@interface ChannelMixingDecoder : NSObject <AudioDecoderMethods>
+{
+	id <AudioDecoderMethods>		_decoder;
+	
+	AudioStreamBasicDescription		_format;
+	AudioChannelLayout				_channelLayout;
+	
+	float							*_matrix;
+	
+	float							**_input;
+	AudioBufferList					*_bufferList;
+}
+
+// The layout the decoders in this application use for a given number of channels
++ (AudioChannelLayout) defaultChannelLayoutForChannelCount:(UInt32)channelCount;
+
++ (id) decoderWithDecoder:(id <AudioDecoderMethods>)decoder channelLayout:(AudioChannelLayout)channelLayout;
+
+- (id) initWithDecoder:(id <AudioDecoderMethods>)decoder channelLayout:(AudioChannelLayout)channelLayout;
+
+// The decoder supplying audio in the source channel layout
+- (id <AudioDecoderMethods>) decoder;
+
+@end
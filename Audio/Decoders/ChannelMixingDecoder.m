@@ -0,0 +1,446 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ChannelMixingDecoder.h"
+#include <Accelerate/Accelerate.h>
+#include <AudioToolbox/AudioFormat.h>
+
+// Frames requested from the wrapped decoder per read
+#define INPUT_CHUNK_FRAMES				4096
+
+#define MAXIMUM_CHANNELS				8
+
+// The longest chain of fallbacks is rear surround -> surround -> front -> center/mono
+#define MAXIMUM_ROUTING_DEPTH			4
+
+// -3 dB and -6 dB
+#define MINUS_3_DB						0.70710678f
+#define MINUS_6_DB						0.5f
+
+struct ChannelLayoutLabels {
+	AudioChannelLayoutTag	tag;
+	AudioChannelLabel		labels [MAXIMUM_CHANNELS];
+};
+
+// Channel order for the layouts produced by the decoders
+static const struct ChannelLayoutLabels sChannelLayoutLabels [] = {
+	{ kAudioChannelLayoutTag_Mono,			{ kAudioChannelLabel_Mono } },
+	{ kAudioChannelLayoutTag_Stereo,		{ kAudioChannelLabel_Left, kAudioChannelLabel_Right } },
+	{ kAudioChannelLayoutTag_StereoHeadphones, { kAudioChannelLabel_Left, kAudioChannelLabel_Right } },
+	{ kAudioChannelLayoutTag_MPEG_3_0_A,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_Center } },
+	{ kAudioChannelLayoutTag_MPEG_3_0_B,	{ kAudioChannelLabel_Center, kAudioChannelLabel_Left, kAudioChannelLabel_Right } },
+	{ kAudioChannelLayoutTag_Quadraphonic,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround } },
+	{ kAudioChannelLayoutTag_MPEG_5_0_A,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_Center, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround } },
+	{ kAudioChannelLayoutTag_MPEG_5_0_B,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_Center } },
+	{ kAudioChannelLayoutTag_MPEG_5_0_C,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Center, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround } },
+	{ kAudioChannelLayoutTag_MPEG_5_0_D,	{ kAudioChannelLabel_Center, kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround } },
+	{ kAudioChannelLayoutTag_MPEG_5_1_A,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_Center, kAudioChannelLabel_LFEScreen, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround } },
+	{ kAudioChannelLayoutTag_MPEG_5_1_B,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_Center, kAudioChannelLabel_LFEScreen } },
+	{ kAudioChannelLayoutTag_MPEG_5_1_C,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Center, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_LFEScreen } },
+	{ kAudioChannelLayoutTag_MPEG_5_1_D,	{ kAudioChannelLabel_Center, kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_LFEScreen } },
+	{ kAudioChannelLayoutTag_MPEG_6_1_A,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_Center, kAudioChannelLabel_LFEScreen, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_CenterSurround } },
+	{ kAudioChannelLayoutTag_MPEG_7_1_A,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_Center, kAudioChannelLabel_LFEScreen, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_LeftCenter, kAudioChannelLabel_RightCenter } },
+	{ kAudioChannelLayoutTag_MPEG_7_1_C,	{ kAudioChannelLabel_Left, kAudioChannelLabel_Right, kAudioChannelLabel_Center, kAudioChannelLabel_LFEScreen, kAudioChannelLabel_LeftSurround, kAudioChannelLabel_RightSurround, kAudioChannelLabel_RearSurroundLeft, kAudioChannelLabel_RearSurroundRight } }
+};
+
+static UInt32
+channel_count_for_layout(const AudioChannelLayout *layout)
+{
+	if(kAudioChannelLayoutTag_UseChannelDescriptions == layout->mChannelLayoutTag)
+		return layout->mNumberChannelDescriptions;
+	
+	if(kAudioChannelLayoutTag_UseChannelBitmap == layout->mChannelLayoutTag) {
+		UInt32	bitmap	= layout->mChannelBitmap;
+		UInt32	count	= 0;
+		
+		for(; 0 != bitmap; bitmap >>= 1)
+			count += (bitmap & 1);
+		return count;
+	}
+	
+	return AudioChannelLayoutTag_GetNumberOfChannels(layout->mChannelLayoutTag);
+}
+
+// Fill labels with the channel labels for layout, in channel order
+static BOOL
+get_channel_labels(const AudioChannelLayout *layout, UInt32 channelCount, AudioChannelLabel *labels)
+{
+	unsigned i, channel;
+	
+	if(kAudioChannelLayoutTag_UseChannelDescriptions == layout->mChannelLayoutTag) {
+		if(layout->mNumberChannelDescriptions != channelCount)
+			return NO;
+		
+		for(channel = 0; channel < channelCount; ++channel)
+			labels[channel] = layout->mChannelDescriptions[channel].mChannelLabel;
+		return YES;
+	}
+	
+	// For the first eighteen bits the channel label is the bit number plus one
+	if(kAudioChannelLayoutTag_UseChannelBitmap == layout->mChannelLayoutTag) {
+		channel = 0;
+		for(i = 0; i < 18 && channel < channelCount; ++i) {
+			if(layout->mChannelBitmap & (1 << i))
+				labels[channel++] = i + 1;
+		}
+		return (channel == channelCount);
+	}
+	
+	for(i = 0; i < sizeof(sChannelLayoutLabels) / sizeof(sChannelLayoutLabels[0]); ++i) {
+		if(sChannelLayoutLabels[i].tag == layout->mChannelLayoutTag) {
+			for(channel = 0; channel < channelCount; ++channel)
+				labels[channel] = sChannelLayoutLabels[i].labels[channel];
+			return YES;
+		}
+	}
+	
+	return NO;
+}
+
+static int
+index_of_label(AudioChannelLabel label, const AudioChannelLabel *labels, UInt32 channelCount)
+{
+	unsigned channel;
+	for(channel = 0; channel < channelCount; ++channel) {
+		if(labels[channel] == label)
+			return channel;
+	}
+	return -1;
+}
+
+// Route a source channel with the given label into the output channels, folding it into its
+// nearest neighbors when the output has no channel with the same label
+// Returns the number of output channels that received a contribution
+static unsigned
+route_label(AudioChannelLabel label, float gain, float *row, const AudioChannelLabel *outputLabels, UInt32 outputChannelCount, unsigned depth)
+{
+	int index = index_of_label(label, outputLabels, outputChannelCount);
+	if(-1 != index) {
+		row[index] += gain;
+		return 1;
+	}
+	
+	// Outputs without any front channels would otherwise fold forever
+	if(MAXIMUM_ROUTING_DEPTH < depth)
+		return 0;
+
+#define HAS_LABEL(l)	(-1 != index_of_label((l), outputLabels, outputChannelCount))
+#define ROUTE(l, g)		route_label((l), (g), row, outputLabels, outputChannelCount, depth + 1)
+	
+	switch(label) {
+		case kAudioChannelLabel_Left:
+		case kAudioChannelLabel_Right:
+			if(HAS_LABEL(kAudioChannelLabel_Mono))
+				return ROUTE(kAudioChannelLabel_Mono, gain * MINUS_6_DB);
+			return ROUTE(kAudioChannelLabel_Center, gain * MINUS_3_DB);
+			
+		case kAudioChannelLabel_Center:
+			if(HAS_LABEL(kAudioChannelLabel_Left) && HAS_LABEL(kAudioChannelLabel_Right))
+				return ROUTE(kAudioChannelLabel_Left, gain * MINUS_3_DB) + ROUTE(kAudioChannelLabel_Right, gain * MINUS_3_DB);
+			return ROUTE(kAudioChannelLabel_Mono, gain * MINUS_3_DB);
+			
+		case kAudioChannelLabel_Mono:
+			if(HAS_LABEL(kAudioChannelLabel_Center))
+				return ROUTE(kAudioChannelLabel_Center, gain);
+			return ROUTE(kAudioChannelLabel_Left, gain) + ROUTE(kAudioChannelLabel_Right, gain);
+			
+		case kAudioChannelLabel_LeftSurround:
+			if(HAS_LABEL(kAudioChannelLabel_RearSurroundLeft))
+				return ROUTE(kAudioChannelLabel_RearSurroundLeft, gain);
+			return ROUTE(kAudioChannelLabel_Left, gain * MINUS_3_DB);
+			
+		case kAudioChannelLabel_RightSurround:
+			if(HAS_LABEL(kAudioChannelLabel_RearSurroundRight))
+				return ROUTE(kAudioChannelLabel_RearSurroundRight, gain);
+			return ROUTE(kAudioChannelLabel_Right, gain * MINUS_3_DB);
+			
+		case kAudioChannelLabel_RearSurroundLeft:
+		case kAudioChannelLabel_LeftSurroundDirect:
+			if(HAS_LABEL(kAudioChannelLabel_LeftSurround))
+				return ROUTE(kAudioChannelLabel_LeftSurround, gain);
+			return ROUTE(kAudioChannelLabel_Left, gain * MINUS_3_DB);
+			
+		case kAudioChannelLabel_RearSurroundRight:
+		case kAudioChannelLabel_RightSurroundDirect:
+			if(HAS_LABEL(kAudioChannelLabel_RightSurround))
+				return ROUTE(kAudioChannelLabel_RightSurround, gain);
+			return ROUTE(kAudioChannelLabel_Right, gain * MINUS_3_DB);
+			
+		case kAudioChannelLabel_CenterSurround:
+			if(HAS_LABEL(kAudioChannelLabel_LeftSurround) && HAS_LABEL(kAudioChannelLabel_RightSurround))
+				return ROUTE(kAudioChannelLabel_LeftSurround, gain * MINUS_3_DB) + ROUTE(kAudioChannelLabel_RightSurround, gain * MINUS_3_DB);
+			if(HAS_LABEL(kAudioChannelLabel_RearSurroundLeft) && HAS_LABEL(kAudioChannelLabel_RearSurroundRight))
+				return ROUTE(kAudioChannelLabel_RearSurroundLeft, gain * MINUS_3_DB) + ROUTE(kAudioChannelLabel_RearSurroundRight, gain * MINUS_3_DB);
+			return ROUTE(kAudioChannelLabel_Left, gain * MINUS_6_DB) + ROUTE(kAudioChannelLabel_Right, gain * MINUS_6_DB);
+			
+		case kAudioChannelLabel_LeftCenter:
+			return ROUTE(kAudioChannelLabel_Left, gain);
+			
+		case kAudioChannelLabel_RightCenter:
+			return ROUTE(kAudioChannelLabel_Right, gain);
+			
+		// The LFE channel is only reproduced by outputs that carry one
+		case kAudioChannelLabel_LFE2:
+			return ROUTE(kAudioChannelLabel_LFEScreen, gain);
+	}
+	
+#undef HAS_LABEL
+#undef ROUTE
+	
+	return 0;
+}
+
+// Build an outputChannelCount x inputChannelCount matrix, stored by output channel, with no
+// output's coefficients summing to more than 1
+static float *
+create_mixing_matrix(const AudioChannelLabel *inputLabels, UInt32 inputChannelCount, const AudioChannelLabel *outputLabels, UInt32 outputChannelCount)
+{
+	float		*matrix		= calloc(outputChannelCount * inputChannelCount, sizeof(float));
+	float		row [MAXIMUM_CHANNELS];
+	unsigned	input, output;
+	
+	NSCAssert(NULL != matrix, @"Unable to allocate memory");
+	
+	for(input = 0; input < inputChannelCount; ++input) {
+		memset(row, 0, sizeof(row));
+		
+		// Channels that can't be placed by label keep their position
+		if(0 == route_label(inputLabels[input], 1.0f, row, outputLabels, outputChannelCount, 0) && kAudioChannelLabel_LFEScreen != inputLabels[input] && kAudioChannelLabel_LFE2 != inputLabels[input] && input < outputChannelCount)
+			row[input] = 1.0f;
+		
+		for(output = 0; output < outputChannelCount; ++output)
+			matrix[(output * inputChannelCount) + input] = row[output];
+	}
+	
+	// Folding several channels into one can sum to more than full scale (L + -3 dB C + -3 dB Ls is 2.41
+	// for 5.1 -> stereo), so scale any output whose coefficients add up to more than 1 back down to 1
+	// This keeps a full-scale source from clipping, at the cost of a quieter downmix
+	for(output = 0; output < outputChannelCount; ++output) {
+		float	*coefficients	= matrix + (output * inputChannelCount);
+		float	sum				= 0;
+		
+		for(input = 0; input < inputChannelCount; ++input)
+			sum += coefficients[input];
+		
+		if(1.0f < sum) {
+			for(input = 0; input < inputChannelCount; ++input)
+				coefficients[input] /= sum;
+		}
+	}
+	
+	return matrix;
+}
+
+@implementation ChannelMixingDecoder
+
++ (AudioChannelLayout) defaultChannelLayoutForChannelCount:(UInt32)channelCount
+{
+	AudioChannelLayout channelLayout;
+	memset(&channelLayout, 0, sizeof(channelLayout));
+	
+	switch(channelCount) {
+		case 1:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Mono;				break;
+		case 2:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Stereo;			break;
+		case 3:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_MPEG_3_0_A;		break;
+		case 4:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Quadraphonic;		break;
+		case 5:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_MPEG_5_0_A;		break;
+		case 6:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_MPEG_5_1_A;		break;
+		case 7:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_MPEG_6_1_A;		break;
+		case 8:		channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_MPEG_7_1_C;		break;
+	}
+	
+	return channelLayout;
+}
+
++ (id) decoderWithDecoder:(id <AudioDecoderMethods>)decoder channelLayout:(AudioChannelLayout)channelLayout
+{
+	return [[[ChannelMixingDecoder alloc] initWithDecoder:decoder channelLayout:channelLayout] autorelease];
+}
+
+- (id) initWithDecoder:(id <AudioDecoderMethods>)decoder channelLayout:(AudioChannelLayout)channelLayout
+{
+	NSParameterAssert(nil != decoder);
+	
+	if((self = [super init])) {
+		_decoder		= [(NSObject *)decoder retain];
+		_format			= [decoder format];
+		_channelLayout	= channelLayout;
+		
+		AudioChannelLayout		sourceChannelLayout		= [decoder channelLayout];
+		UInt32					inputChannelCount		= _format.mChannelsPerFrame;
+		UInt32					outputChannelCount		= channel_count_for_layout(&channelLayout);
+		AudioChannelLabel		inputLabels [MAXIMUM_CHANNELS];
+		AudioChannelLabel		outputLabels [MAXIMUM_CHANNELS];
+		
+		if(0 == inputChannelCount || MAXIMUM_CHANNELS < inputChannelCount || 0 == outputChannelCount || MAXIMUM_CHANNELS < outputChannelCount) {
+			[self release];
+			return nil;
+		}
+		
+		// Decoders that don't describe their layout are assumed to use the default for their channel count
+		if(NO == get_channel_labels(&sourceChannelLayout, inputChannelCount, inputLabels)) {
+			sourceChannelLayout = [ChannelMixingDecoder defaultChannelLayoutForChannelCount:inputChannelCount];
+			get_channel_labels(&sourceChannelLayout, inputChannelCount, inputLabels);
+		}
+		
+		if(NO == get_channel_labels(&channelLayout, outputChannelCount, outputLabels)) {
+			[self release];
+			return nil;
+		}
+		
+		_matrix = create_mixing_matrix(inputLabels, inputChannelCount, outputLabels, outputChannelCount);
+		
+		// The audio is non-interleaved, so only the channel count changes
+		_format.mChannelsPerFrame	= outputChannelCount;
+		
+		_input			= calloc(inputChannelCount, sizeof(float *));
+		_bufferList		= calloc(1, offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * inputChannelCount));
+		NSAssert(NULL != _input && NULL != _bufferList, @"Unable to allocate memory");
+		
+		_bufferList->mNumberBuffers = inputChannelCount;
+		
+		unsigned channel;
+		for(channel = 0; channel < inputChannelCount; ++channel) {
+			_input[channel] = calloc(INPUT_CHUNK_FRAMES, sizeof(float));
+			NSAssert(NULL != _input[channel], @"Unable to allocate memory");
+			
+			_bufferList->mBuffers[channel].mNumberChannels	= 1;
+			_bufferList->mBuffers[channel].mData			= _input[channel];
+		}
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(NULL != _input) {
+		unsigned channel;
+		for(channel = 0; channel < _bufferList->mNumberBuffers; ++channel)
+			free(_input[channel]);
+		free(_input), _input = NULL;
+	}
+	
+	free(_bufferList), _bufferList = NULL;
+	free(_matrix), _matrix = NULL;
+	
+	[(NSObject *)_decoder release], _decoder = nil;
+	
+	[super dealloc];
+}
+
+- (id <AudioDecoderMethods>) decoder						{ return [[(NSObject *)_decoder retain] autorelease]; }
+
+#pragma mark Decoding
+
+- (AudioStreamBasicDescription) format						{ return _format; }
+
+- (NSString *) formatDescription
+{
+	NSString	*description	= nil;
+	UInt32		specifierSize	= sizeof(description);
+	
+	OSStatus err = AudioFormatGetProperty(kAudioFormatProperty_FormatName, 
+										  sizeof(_format), 
+										  &_format, 
+										  &specifierSize, 
+										  &description);
+	if(noErr != err)
+		NSLog(@"AudioFormatGetProperty (kAudioFormatProperty_FormatName) failed: %i", err);
+	
+	return [description autorelease];
+}
+
+- (AudioChannelLayout) channelLayout						{ return _channelLayout; }
+
+- (NSString *) channelLayoutDescription
+{
+	NSString	*description	= nil;
+	UInt32		specifierSize	= sizeof(description);
+	
+	OSStatus err = AudioFormatGetProperty(kAudioFormatProperty_ChannelLayoutName, 
+										  sizeof(_channelLayout), 
+										  &_channelLayout, 
+										  &specifierSize, 
+										  &description);
+	if(noErr != err)
+		NSLog(@"AudioFormatGetProperty (kAudioFormatProperty_ChannelLayoutName) failed: %i", err);
+	
+	return [description autorelease];
+}
+
+- (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != bufferList);
+	NSParameterAssert(_format.mChannelsPerFrame == bufferList->mNumberBuffers);
+	NSParameterAssert(0 < frameCount);
+	
+	unsigned	inputChannel, outputChannel;
+	UInt32		inputChannelCount	= _bufferList->mNumberBuffers;
+	UInt32		framesWritten		= 0;
+	
+	while(framesWritten < frameCount) {
+		UInt32 framesToRead = frameCount - framesWritten;
+		if(INPUT_CHUNK_FRAMES < framesToRead)
+			framesToRead = INPUT_CHUNK_FRAMES;
+		
+		for(inputChannel = 0; inputChannel < inputChannelCount; ++inputChannel)
+			_bufferList->mBuffers[inputChannel].mDataByteSize = framesToRead * sizeof(float);
+		
+		UInt32 framesRead = [_decoder readAudio:_bufferList frameCount:framesToRead];
+		if(0 == framesRead)
+			break;
+		
+		// Each output channel is the sum of the input channels scaled by their coefficients
+		for(outputChannel = 0; outputChannel < _format.mChannelsPerFrame; ++outputChannel) {
+			float		*output		= (float *)bufferList->mBuffers[outputChannel].mData + framesWritten;
+			const float	*row		= _matrix + (outputChannel * inputChannelCount);
+			
+			vDSP_vclr(output, 1, framesRead);
+			
+			for(inputChannel = 0; inputChannel < inputChannelCount; ++inputChannel) {
+				if(0 != row[inputChannel])
+					vDSP_vsma(_input[inputChannel], 1, row + inputChannel, output, 1, output, 1, framesRead);
+			}
+		}
+		
+		framesWritten += framesRead;
+	}
+	
+	for(outputChannel = 0; outputChannel < bufferList->mNumberBuffers; ++outputChannel)
+		bufferList->mBuffers[outputChannel].mDataByteSize = framesWritten * sizeof(float);
+	
+	return framesWritten;
+}
+
+#pragma mark AudioDecoder pass-throughs
+
+- (SInt64)			totalFrames								{ return [_decoder totalFrames]; }
+- (SInt64)			currentFrame							{ return [_decoder currentFrame]; }
+- (SInt64)			framesRemaining							{ return [_decoder framesRemaining]; }
+
+- (BOOL)			supportsSeeking							{ return [_decoder supportsSeeking]; }
+- (SInt64)			seekToFrame:(SInt64)frame				{ return [_decoder seekToFrame:frame]; }
+
+- (AudioStreamBasicDescription) sourceFormat				{ return [_decoder sourceFormat]; }
+- (NSString *)		sourceFormatDescription					{ return [_decoder sourceFormatDescription]; }
+
+- (NSString *)		description								{ return [(NSObject *)_decoder description]; }
+
+@end
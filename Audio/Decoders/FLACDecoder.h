@@ -22,15 +22,41 @@
 #import "AudioDecoder.h"
 
 #include <FLAC/stream_decoder.h>
+#include <stdio.h>
+
+// A single entry in the in-memory frame index
+struct FLACSeekIndexPoint {
+	SInt64		frame;			// The first sample number in the FLAC frame
+	SInt64		offset;			// The byte offset of the FLAC frame in the file
+};
+typedef struct FLACSeekIndexPoint FLACSeekIndexPoint;
 
 @interface FLACDecoder : AudioDecoder
 {
 	FLAC__StreamDecoder					*_flac;
 	FLAC__StreamMetadata_StreamInfo		_streamInfo;
 	SInt64								_currentFrame;
+	FILE								*_file;
 	
 	// For converting push to pull
 	AudioBufferList						*_bufferList;
+	SInt64								_bufferStartingFrame;
+	
+	// For files without a SEEKTABLE block, an index of frame offsets is built while decoding
+	BOOL								_hasSeekTable;
+	FLACSeekIndexPoint					*_seekIndex;
+	unsigned							_seekIndexCount;
+	unsigned							_seekIndexCapacity;
+	SInt64								_indexedFrames;			// Frames [0, _indexedFrames) are covered by the index
+	FLAC__uint64						_frameOffset;			// The byte offset of the frame being decoded
+	BOOL								_seekIndexChanged;
 }
 
+// The frame index in a form suitable for storing in the database, or nil if the file has a SEEKTABLE
+- (NSData *) seekIndex;
+- (void) setSeekIndex:(NSData *)seekIndex;
+
+// Returns YES if frames were added to the index since it was created or set
+- (BOOL) seekIndexChanged;
+
 @end
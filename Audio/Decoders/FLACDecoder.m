@@ -22,9 +22,18 @@
 #import "AudioStream.h"
 #include <FLAC/metadata.h>
 
+// The frame index stores (at most) this many seek points per second of audio
+#define SEEK_INDEX_POINTS_PER_SECOND		2
+
 @interface FLACDecoder (Private)
 - (AudioBufferList *) bufferList;
 - (void) setStreamInfo:(FLAC__StreamMetadata_StreamInfo)streamInfo;
+- (void) setHasSeekTable:(BOOL)hasSeekTable;
+- (void) decodedFrameWithHeader:(const FLAC__FrameHeader *)header;
+- (void) addSeekIndexPointForFrame:(SInt64)frame offset:(SInt64)offset;
+- (SInt64) seekUsingIndexToFrame:(SInt64)frame;
+- (SInt64) seekWithLibFLACToFrame:(SInt64)frame;
+- (SInt64) discardSeekIndexAndSeekToFrame:(SInt64)frame;
 @end
 
 static FLAC__StreamDecoderWriteStatus 
@@ -51,6 +60,8 @@ writeCallback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, cons
 		bufferList->mBuffers[channel].mDataByteSize		= frame->header.blocksize * sizeof(float);
 	}
 	
+	[source decodedFrameWithHeader:&frame->header];
+	
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;	
 }
 
@@ -61,6 +72,7 @@ metadataCallback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata
 	
 	switch(metadata->type) {
 		case FLAC__METADATA_TYPE_STREAMINFO:	[source setStreamInfo:metadata->data.stream_info];			break;
+		case FLAC__METADATA_TYPE_SEEKTABLE:		[source setHasSeekTable:(0 != metadata->data.seek_table.num_points)];		break;
 		default:																							break;
 	}
 }
@@ -83,17 +95,25 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 		_flac = FLAC__stream_decoder_new();
 		NSAssert(NULL != _flac, NSLocalizedStringFromTable(@"Unable to create the FLAC decoder.", @"Errors", @""));
 		
-		// Initialize decoder
-		FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_file(_flac, 
-																			  [[[self URL] path] fileSystemRepresentation],
+		// The file is opened here (and not by libFLAC) so the frame index can reposition it directly
+		_file = fopen([[[self URL] path] fileSystemRepresentation], "rb");
+		NSAssert(NULL != _file, NSLocalizedStringFromTable(@"Unable to open the input file.", @"Errors", @""));
+
+		// The SEEKTABLE is only needed to determine if a frame index should be built
+		FLAC__bool result = FLAC__stream_decoder_set_metadata_respond(_flac, FLAC__METADATA_TYPE_SEEKTABLE);
+		NSAssert1(YES == result, @"FLAC__stream_decoder_set_metadata_respond failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
+
+		// Initialize decoder (libFLAC takes ownership of _file)
+		FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_FILE(_flac, 
+																			  _file,
 																			  writeCallback, 
 																			  metadataCallback, 
 																			  errorCallback,
 																			  self);
-		NSAssert1(FLAC__STREAM_DECODER_INIT_STATUS_OK == status, @"FLAC__stream_decoder_init_file failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
+		NSAssert1(FLAC__STREAM_DECODER_INIT_STATUS_OK == status, @"FLAC__stream_decoder_init_FILE failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 		
 		// Process metadata
-		FLAC__bool result = FLAC__stream_decoder_process_until_end_of_metadata(_flac);
+		result = FLAC__stream_decoder_process_until_end_of_metadata(_flac);
 		NSAssert1(YES == result, @"FLAC__stream_decoder_process_until_end_of_metadata failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));
 		
 		_format.mSampleRate			= _streamInfo.sample_rate;
@@ -144,6 +164,11 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 	
 	FLAC__stream_decoder_delete(_flac), _flac = NULL;
 	
+	// FLAC__stream_decoder_finish closes the file
+	_file = NULL;
+	
+	free(_seekIndex), _seekIndex = NULL;
+	
 	if(_bufferList) {
 		unsigned i;
 		for(i = 0; i < _bufferList->mNumberBuffers; ++i)
@@ -163,20 +188,67 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 {
 	NSParameterAssert(0 <= frame && frame < [self totalFrames]);
 	
-	FLAC__bool result = FLAC__stream_decoder_seek_absolute(_flac, frame);	
+	// Without a SEEKTABLE libFLAC bisects the file, so use the frame index if it covers the desired frame
+	if(frame < _indexedFrames && 0 != _seekIndexCount)
+		return [self seekUsingIndexToFrame:frame];
 	
-	// Attempt to re-sync the stream if necessary
-	if(FLAC__STREAM_DECODER_SEEK_ERROR == FLAC__stream_decoder_get_state(_flac))
-		result = FLAC__stream_decoder_flush(_flac);
+	return [self seekWithLibFLACToFrame:frame];
+}
+
+- (NSData *) seekIndex
+{
+	if(_hasSeekTable || 0 == _seekIndexCount)
+		return nil;
 	
-	if(result) {
-		_currentFrame = frame;
-		unsigned i;
-		for(i = 0; i < _bufferList->mNumberBuffers; ++i)
-			_bufferList->mBuffers[i].mDataByteSize = 0;	
+	NSMutableData	*data		= [NSMutableData dataWithLength:_seekIndexCount * 2 * sizeof(UInt64)];
+	UInt64			*points		= [data mutableBytes];
+	
+	// Stored as big-endian (frame, offset) pairs
+	unsigned i;
+	for(i = 0; i < _seekIndexCount; ++i) {
+		*points++ = CFSwapInt64HostToBig((UInt64)_seekIndex[i].frame);
+		*points++ = CFSwapInt64HostToBig((UInt64)_seekIndex[i].offset);
 	}
 	
-	return (result ? frame : -1);
+	return data;
+}
+
+- (void) setSeekIndex:(NSData *)seekIndex
+{
+	_seekIndexCount		= 0;
+	_indexedFrames		= 0;
+	_seekIndexChanged	= NO;
+	
+	if(_hasSeekTable || nil == seekIndex || 0 != [seekIndex length] % (2 * sizeof(UInt64)))
+		return;
+	
+	const UInt64	*points		= [seekIndex bytes];
+	unsigned		count		= [seekIndex length] / (2 * sizeof(UInt64));
+	
+	unsigned i;
+	for(i = 0; i < count; ++i) {
+		SInt64 frame	= (SInt64)CFSwapInt64BigToHost(*points++);
+		SInt64 offset	= (SInt64)CFSwapInt64BigToHost(*points++);
+		
+		// Discard indexes that are obviously invalid (for example if the file was modified)
+		if((0 != [self totalFrames] && frame >= [self totalFrames]) || (0 != _seekIndexCount && (frame <= _seekIndex[_seekIndexCount - 1].frame || offset <= _seekIndex[_seekIndexCount - 1].offset))) {
+			_seekIndexCount = 0;
+			return;
+		}
+		
+		[self addSeekIndexPointForFrame:frame offset:offset];
+	}
+
+	// Only the frames up to the start of the last point are known to be covered
+	if(0 != _seekIndexCount)
+		_indexedFrames = _seekIndex[_seekIndexCount - 1].frame;
+
+	_seekIndexChanged = NO;
+}
+
+- (BOOL) seekIndexChanged
+{
+	return _seekIndexChanged;
 }
 
 - (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
@@ -223,7 +295,10 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 		if(FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(_flac))
 			break;
 		
-		// Grab the next frame
+		// Grab the next frame, noting its location for the frame index
+		if(NO == _hasSeekTable && NO == FLAC__stream_decoder_get_decode_position(_flac, &_frameOffset))
+			_frameOffset = 0;
+		
 		FLAC__bool result = FLAC__stream_decoder_process_single(_flac);
 		NSAssert1(YES == result, @"FLAC__stream_decoder_process_single failed: %s", FLAC__stream_decoder_get_resolved_state_string(_flac));		
 	}
@@ -251,4 +326,141 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 	memcpy(&_streamInfo, &streamInfo, sizeof(streamInfo));
 }
 
+- (void) setHasSeekTable:(BOOL)hasSeekTable
+{
+	_hasSeekTable = hasSeekTable;
+}
+
+- (void) decodedFrameWithHeader:(const FLAC__FrameHeader *)header
+{
+	NSParameterAssert(FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER == header->number_type);
+	
+	SInt64 frame = header->number.sample_number;
+	
+	_bufferStartingFrame = frame;
+	
+	// A frame can only extend the index if it adjoins or overlaps the indexed region
+	if(_hasSeekTable || 0 == _frameOffset || 0 > _indexedFrames || frame > _indexedFrames || frame + header->blocksize <= _indexedFrames)
+		return;
+	
+	SInt64 spacing = _streamInfo.sample_rate / SEEK_INDEX_POINTS_PER_SECOND;
+	
+	if(0 == _seekIndexCount || spacing <= frame - _seekIndex[_seekIndexCount - 1].frame) {
+		[self addSeekIndexPointForFrame:frame offset:_frameOffset];
+		_seekIndexChanged = YES;
+	}
+	
+	_indexedFrames = frame + header->blocksize;
+}
+
+- (void) addSeekIndexPointForFrame:(SInt64)frame offset:(SInt64)offset
+{
+	if(_seekIndexCount == _seekIndexCapacity) {
+		_seekIndexCapacity	= (0 == _seekIndexCapacity ? 512 : 2 * _seekIndexCapacity);
+		_seekIndex			= realloc(_seekIndex, _seekIndexCapacity * sizeof(FLACSeekIndexPoint));
+		NSAssert(NULL != _seekIndex, @"Unable to allocate memory");
+	}
+	
+	_seekIndex[_seekIndexCount].frame	= frame;
+	_seekIndex[_seekIndexCount].offset	= offset;
+	
+	++_seekIndexCount;
+}
+
+- (SInt64) seekWithLibFLACToFrame:(SInt64)frame
+{
+	// Frames delivered during a libFLAC seek don't begin on frame boundaries, so they can't be indexed
+	SInt64 indexedFrames = _indexedFrames;
+	_indexedFrames = -1;
+	
+	FLAC__bool result = FLAC__stream_decoder_seek_absolute(_flac, frame);	
+	
+	_indexedFrames = indexedFrames;
+	
+	// Attempt to re-sync the stream if necessary
+	if(FLAC__STREAM_DECODER_SEEK_ERROR == FLAC__stream_decoder_get_state(_flac))
+		result = FLAC__stream_decoder_flush(_flac);
+	
+	if(result) {
+		_currentFrame = frame;
+		unsigned i;
+		for(i = 0; i < _bufferList->mNumberBuffers; ++i)
+			_bufferList->mBuffers[i].mDataByteSize = 0;	
+	}
+	
+	return (result ? frame : -1);
+}
+
+- (SInt64) discardSeekIndexAndSeekToFrame:(SInt64)frame
+{
+	// Drop the index so it is rebuilt, and saved again, the next time the file is decoded from the start
+	_seekIndexCount		= 0;
+	_indexedFrames		= 0;
+	_seekIndexChanged	= YES;
+	
+	FLAC__stream_decoder_flush(_flac);
+	
+	return [self seekWithLibFLACToFrame:frame];
+}
+
+- (SInt64) seekUsingIndexToFrame:(SInt64)frame
+{
+	// Locate the last seek point at or before the desired frame
+	unsigned low = 0, high = _seekIndexCount;
+	while(1 < high - low) {
+		unsigned mid = low + ((high - low) / 2);
+		if(_seekIndex[mid].frame <= frame)
+			low = mid;
+		else
+			high = mid;
+	}
+	
+	// Discard any buffered input and jump directly to the frame
+	FLAC__bool result = FLAC__stream_decoder_flush(_flac);
+	if(NO == result || 0 != fseeko(_file, _seekIndex[low].offset, SEEK_SET))
+		return [self discardSeekIndexAndSeekToFrame:frame];
+	
+	// Decode forward until the frame containing the desired frame is in the buffer
+	_bufferStartingFrame = -1;
+
+	unsigned i;
+	for(i = 0; i < _bufferList->mNumberBuffers; ++i)
+		_bufferList->mBuffers[i].mDataByteSize = 0;	
+
+	SInt64	seekPointFrame	= _seekIndex[low].frame;
+	BOOL	firstFrame		= YES;
+	
+	for(;;) {
+		if(NO == FLAC__stream_decoder_get_decode_position(_flac, &_frameOffset))
+			_frameOffset = 0;
+		
+		result = FLAC__stream_decoder_process_single(_flac);
+		if(NO == result || FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(_flac) || 0 == _bufferList->mBuffers[0].mDataByteSize)
+			return [self discardSeekIndexAndSeekToFrame:frame];
+		
+		// If the file was rewritten since it was indexed the offset won't lead to the indexed frame
+		if((firstFrame && seekPointFrame != _bufferStartingFrame) || frame < _bufferStartingFrame)
+			return [self discardSeekIndexAndSeekToFrame:frame];
+		
+		firstFrame = NO;
+		
+		if(frame < _bufferStartingFrame + (SInt64)(_bufferList->mBuffers[0].mDataByteSize / sizeof(float)))
+			break;
+	}
+	
+	// Drop the samples preceding the desired frame
+	UInt32 framesInBuffer	= _bufferList->mBuffers[0].mDataByteSize / sizeof(float);
+	UInt32 framesToSkip		= (UInt32)(frame - _bufferStartingFrame);
+	
+	for(i = 0; i < _bufferList->mNumberBuffers; ++i) {
+		float *floatBuffer = _bufferList->mBuffers[i].mData;
+		memmove(floatBuffer, floatBuffer + framesToSkip, (framesInBuffer - framesToSkip) * sizeof(float));
+		_bufferList->mBuffers[i].mDataByteSize = (framesInBuffer - framesToSkip) * sizeof(float);
+	}
+	
+	_currentFrame = frame;
+	
+	return frame;
+}
+
 @end
@@ -0,0 +1,60 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "AudioDecoderMethods.h"
+#include "PolyphaseFilter.h"
+
+// A wrapper around a decoder that converts its output to a different sample rate
+// The conversion uses a windowed-sinc polyphase filter bank with an exact rational
+// ratio between the two rates, so no frames are gained or lost over a whole stream
+@interface ResamplingDecoder : NSObject <AudioDecoderMethods>
+{
+	id <AudioDecoderMethods>		_decoder;
+	
+	AudioStreamBasicDescription		_format;
+	
+	unsigned						_upsamplingFactor;
+	unsigned						_downsamplingFactor;
+	unsigned						_tapsPerPhase;
+	PolyphaseFilter					*_filter;
+	
+	float							**_input;
+	UInt32							_inputCapacity;
+	UInt32							_inputFrames;
+	AudioBufferList					*_bufferList;
+	
+	UInt32							_inputIndex;
+	unsigned						_phase;
+	
+	SInt64							_sourceFramesRead;
+	SInt64							_currentFrame;
+	SInt64							_outputFrameLimit;
+	BOOL							_sourceExhausted;
+}
+
++ (id) decoderWithDecoder:(id <AudioDecoderMethods>)decoder sampleRate:(Float64)sampleRate;
+
+- (id) initWithDecoder:(id <AudioDecoderMethods>)decoder sampleRate:(Float64)sampleRate;
+
+// The decoder supplying audio at the source sample rate
+- (id <AudioDecoderMethods>) decoder;
+
+@end
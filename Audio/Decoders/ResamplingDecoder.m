@@ -0,0 +1,285 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ResamplingDecoder.h"
+#include <AudioToolbox/AudioFormat.h>
+#include <math.h>
+
+// Frames requested from the wrapped decoder per read
+#define INPUT_CHUNK_FRAMES				4096
+
+@interface ResamplingDecoder (Private)
+- (void) resetAtSourceFrame:(SInt64)sourceFrame;
+- (BOOL) fillInputBuffer;
+@end
+
+@implementation ResamplingDecoder
+
++ (id) decoderWithDecoder:(id <AudioDecoderMethods>)decoder sampleRate:(Float64)sampleRate
+{
+	return [[[ResamplingDecoder alloc] initWithDecoder:decoder sampleRate:sampleRate] autorelease];
+}
+
+- (id) initWithDecoder:(id <AudioDecoderMethods>)decoder sampleRate:(Float64)sampleRate
+{
+	NSParameterAssert(nil != decoder);
+	NSParameterAssert(0 < sampleRate);
+	
+	if((self = [super init])) {
+		_decoder	= [(NSObject *)decoder retain];
+		_format		= [decoder format];
+		
+		// Only integral rates can be related by an exact rational ratio
+		Float64 sourceSampleRate = _format.mSampleRate;
+		if(floor(sourceSampleRate) == sourceSampleRate && floor(sampleRate) == sampleRate)
+			_filter = polyphase_filter_create((unsigned)sourceSampleRate, (unsigned)sampleRate);
+		
+		if(NULL == _filter) {
+			[self release];
+			return nil;
+		}
+		
+		_upsamplingFactor	= polyphase_filter_upsampling_factor(_filter);
+		_downsamplingFactor	= polyphase_filter_downsampling_factor(_filter);
+		_tapsPerPhase		= polyphase_filter_taps_per_phase(_filter);
+		_format.mSampleRate	= sampleRate;
+		
+		// Per-channel input history followed by room for freshly decoded audio
+		_inputCapacity		= (_tapsPerPhase - 1) + INPUT_CHUNK_FRAMES;
+		_input				= calloc(_format.mChannelsPerFrame, sizeof(float *));
+		_bufferList			= calloc(1, offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * _format.mChannelsPerFrame));
+		NSAssert(NULL != _input && NULL != _bufferList, @"Unable to allocate memory");
+		
+		_bufferList->mNumberBuffers = _format.mChannelsPerFrame;
+		
+		unsigned channel;
+		for(channel = 0; channel < _format.mChannelsPerFrame; ++channel) {
+			_input[channel] = calloc(_inputCapacity, sizeof(float));
+			NSAssert(NULL != _input[channel], @"Unable to allocate memory");
+			
+			_bufferList->mBuffers[channel].mNumberChannels = 1;
+		}
+		
+		[self resetAtSourceFrame:[decoder currentFrame]];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(NULL != _input) {
+		unsigned channel;
+		for(channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+			free(_input[channel]);
+		free(_input), _input = NULL;
+	}
+	
+	free(_bufferList), _bufferList = NULL;
+	polyphase_filter_destroy(_filter), _filter = NULL;
+	
+	[(NSObject *)_decoder release], _decoder = nil;
+	
+	[super dealloc];
+}
+
+- (id <AudioDecoderMethods>) decoder						{ return [[(NSObject *)_decoder retain] autorelease]; }
+
+#pragma mark Decoding
+
+- (AudioStreamBasicDescription) format						{ return _format; }
+
+- (NSString *) formatDescription
+{
+	NSString	*description	= nil;
+	UInt32		specifierSize	= sizeof(description);
+	
+	OSStatus err = AudioFormatGetProperty(kAudioFormatProperty_FormatName, 
+										  sizeof(_format), 
+										  &_format, 
+										  &specifierSize, 
+										  &description);
+	if(noErr != err)
+		NSLog(@"AudioFormatGetProperty (kAudioFormatProperty_FormatName) failed: %i", err);
+	
+	return [description autorelease];
+}
+
+- (SInt64) totalFrames
+{
+	SInt64 sourceFrames = [_decoder totalFrames];
+	if(0 >= sourceFrames)
+		return sourceFrames;
+	
+	return ((sourceFrames * _upsamplingFactor) + _downsamplingFactor - 1) / _downsamplingFactor;
+}
+
+- (SInt64)			currentFrame							{ return _currentFrame; }
+- (SInt64)			framesRemaining							{ return ([self totalFrames] - [self currentFrame]); }
+
+- (SInt64) seekToFrame:(SInt64)frame
+{
+	NSParameterAssert(0 <= frame);
+	
+	SInt64 sourceFrame = [_decoder seekToFrame:(frame * _downsamplingFactor) / _upsamplingFactor];
+	if(-1 == sourceFrame)
+		return -1;
+	
+	[self resetAtSourceFrame:sourceFrame];
+	
+	return [self currentFrame];
+}
+
+- (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != bufferList);
+	NSParameterAssert(_format.mChannelsPerFrame == bufferList->mNumberBuffers);
+	NSParameterAssert(0 < frameCount);
+	
+	unsigned	channel;
+	UInt32		framesWritten		= 0;
+	
+	while(framesWritten < frameCount) {
+		UInt32 framesToWrite = frameCount - framesWritten;
+		
+		if(_sourceExhausted) {
+			if(_outputFrameLimit <= _currentFrame)
+				break;
+			if(_outputFrameLimit - _currentFrame < framesToWrite)
+				framesToWrite = (UInt32)(_outputFrameLimit - _currentFrame);
+		}
+		
+		// Every channel starts from the same position and advances by the same amount
+		size_t		inputIndex		= _inputIndex;
+		unsigned	phase			= _phase;
+		size_t		framesConverted	= 0;
+		
+		for(channel = 0; channel < _format.mChannelsPerFrame; ++channel) {
+			inputIndex		= _inputIndex;
+			phase			= _phase;
+			framesConverted	= polyphase_filter_apply(_filter, _input[channel], _inputFrames, &inputIndex, &phase, 
+													 (float *)bufferList->mBuffers[channel].mData + framesWritten, framesToWrite);
+		}
+		
+		if(0 == framesConverted) {
+			if(NO == [self fillInputBuffer])
+				break;
+			continue;
+		}
+		
+		_inputIndex		= (UInt32)inputIndex;
+		_phase			= phase;
+		
+		framesWritten	+= framesConverted;
+		_currentFrame	+= framesConverted;
+	}
+	
+	for(channel = 0; channel < bufferList->mNumberBuffers; ++channel)
+		bufferList->mBuffers[channel].mDataByteSize = framesWritten * sizeof(float);
+	
+	return framesWritten;
+}
+
+#pragma mark AudioDecoder pass-throughs
+
+- (AudioChannelLayout) channelLayout						{ return [_decoder channelLayout]; }
+- (NSString *)		channelLayoutDescription				{ return [_decoder channelLayoutDescription]; }
+
+- (AudioStreamBasicDescription) sourceFormat				{ return [_decoder sourceFormat]; }
+- (NSString *)		sourceFormatDescription					{ return [_decoder sourceFormatDescription]; }
+
+- (BOOL)			supportsSeeking							{ return [_decoder supportsSeeking]; }
+
+- (NSString *)		description								{ return [(NSObject *)_decoder description]; }
+
+@end
+
+@implementation ResamplingDecoder (Private)
+
+- (void) resetAtSourceFrame:(SInt64)sourceFrame
+{
+	unsigned channel;
+	for(channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+		memset(_input[channel], 0, _inputCapacity * sizeof(float));
+	
+	// The history is silent, and sourceFrame sits just past it
+	_inputFrames		= _tapsPerPhase - 1;
+	_sourceFramesRead	= sourceFrame;
+	_sourceExhausted	= NO;
+	_outputFrameLimit	= 0;
+	
+	// The first output frame at or after sourceFrame
+	_currentFrame		= ((sourceFrame * _upsamplingFactor) + _downsamplingFactor - 1) / _downsamplingFactor;
+	
+	// Offset by the group delay of the linear-phase prototype so output is time-aligned with the source
+	SInt64 position		= (_currentFrame * _downsamplingFactor) - (sourceFrame * _upsamplingFactor) + ((_upsamplingFactor * _tapsPerPhase) / 2);
+	_inputIndex			= (_tapsPerPhase - 1) + (UInt32)(position / _upsamplingFactor);
+	_phase				= (unsigned)(position % _upsamplingFactor);
+}
+
+- (BOOL) fillInputBuffer
+{
+	unsigned	channel;
+	unsigned	historyFrames	= _tapsPerPhase - 1;
+	
+	// Discard input that has moved out of the filter's reach
+	UInt32 framesToDiscard = (_inputIndex > historyFrames ? _inputIndex - historyFrames : 0);
+	if(framesToDiscard > _inputFrames)
+		framesToDiscard = _inputFrames;
+	
+	if(0 < framesToDiscard) {
+		for(channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+			memmove(_input[channel], _input[channel] + framesToDiscard, (_inputFrames - framesToDiscard) * sizeof(float));
+		
+		_inputFrames	-= framesToDiscard;
+		_inputIndex		-= framesToDiscard;
+	}
+	
+	UInt32 framesToRead = _inputCapacity - _inputFrames;
+	
+	if(NO == _sourceExhausted) {
+		for(channel = 0; channel < _format.mChannelsPerFrame; ++channel) {
+			_bufferList->mBuffers[channel].mData			= _input[channel] + _inputFrames;
+			_bufferList->mBuffers[channel].mDataByteSize	= framesToRead * sizeof(float);
+		}
+		
+		UInt32 framesRead = [_decoder readAudio:_bufferList frameCount:framesToRead];
+		if(0 < framesRead) {
+			_inputFrames		+= framesRead;
+			_sourceFramesRead	+= framesRead;
+			return YES;
+		}
+		
+		// The source is finished, so the output length is now known
+		_sourceExhausted	= YES;
+		_outputFrameLimit	= ((_sourceFramesRead * _upsamplingFactor) + _downsamplingFactor - 1) / _downsamplingFactor;
+	}
+	
+	if(_outputFrameLimit <= _currentFrame)
+		return NO;
+	
+	// Flush the filter with silence
+	for(channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+		memset(_input[channel] + _inputFrames, 0, framesToRead * sizeof(float));
+	_inputFrames = _inputCapacity;
+	
+	return YES;
+}
+
+@end
@@ -0,0 +1,350 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "LoudnessMeter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define HISTOGRAM_MINIMUM_LOUDNESS		-70.0
+#define HISTOGRAM_MAXIMUM_LOUDNESS		5.0
+#define HISTOGRAM_BIN_COUNT				750
+
+#define MOMENTARY_SUB_BLOCKS			4		// 400 ms
+#define SHORT_TERM_SUB_BLOCKS			30		// 3 s
+#define SHORT_TERM_STEP_SUB_BLOCKS		10		// A new short-term block each second
+
+// A second-order section in transposed direct form II
+typedef struct {
+	double		b0, b1, b2;
+	double		a1, a2;
+} Biquad;
+
+typedef struct {
+	uint32_t	counts [HISTOGRAM_BIN_COUNT];
+	double		energies [HISTOGRAM_BIN_COUNT];
+} LoudnessHistogram;
+
+struct LoudnessMeter {
+	unsigned			channelCount;
+	
+	// K-weighting: a high shelf followed by a high pass
+	Biquad				shelf;
+	Biquad				highPass;
+	double				*filterState;						// Four values per channel
+	
+	// Energies are accumulated in 100 ms sub-blocks, from which the overlapping blocks are formed
+	size_t				subBlockFrames;
+	size_t				framesInSubBlock;
+	double				subBlockSum;
+	double				subBlockEnergies [SHORT_TERM_SUB_BLOCKS];
+	uint64_t			subBlockCount;
+	
+	LoudnessHistogram	momentary;
+	LoudnessHistogram	shortTerm;
+};
+
+static double
+loudness_for_energy(double energy)
+{
+	return -0.691 + 10 * log10(energy);
+}
+
+static void
+histogram_record(LoudnessHistogram *histogram, double energy)
+{
+	double loudness = loudness_for_energy(energy);
+	
+	// Absolute gating
+	if(HISTOGRAM_MINIMUM_LOUDNESS > loudness)
+		return;
+	
+	int bin = (int)((loudness - HISTOGRAM_MINIMUM_LOUDNESS) * 10);
+	if(HISTOGRAM_BIN_COUNT <= bin)
+		bin = HISTOGRAM_BIN_COUNT - 1;
+	
+	++histogram->counts[bin];
+	histogram->energies[bin] += energy;
+}
+
+static double
+bin_loudness(unsigned bin)
+{
+	return HISTOGRAM_MINIMUM_LOUDNESS + (bin + 0.5) / 10;
+}
+
+// The first bin at or above the relative gate, which is offset LU below the power mean of everything recorded
+static unsigned
+relative_gate_bin(const LoudnessHistogram *histogram, double offset)
+{
+	double		energy	= 0;
+	uint64_t	count	= 0;
+	unsigned	bin;
+	
+	for(bin = 0; bin < HISTOGRAM_BIN_COUNT; ++bin) {
+		energy	+= histogram->energies[bin];
+		count	+= histogram->counts[bin];
+	}
+	
+	if(0 == count)
+		return HISTOGRAM_BIN_COUNT;
+	
+	double gate = loudness_for_energy(energy / count) + offset;
+	
+	for(bin = 0; bin < HISTOGRAM_BIN_COUNT; ++bin) {
+		if(bin_loudness(bin) >= gate)
+			break;
+	}
+	
+	return bin;
+}
+
+static double
+histogram_integrated_loudness(const LoudnessHistogram *histogram)
+{
+	double		energy	= 0;
+	uint64_t	count	= 0;
+	unsigned	bin;
+	
+	for(bin = relative_gate_bin(histogram, -10); bin < HISTOGRAM_BIN_COUNT; ++bin) {
+		energy	+= histogram->energies[bin];
+		count	+= histogram->counts[bin];
+	}
+	
+	return (0 == count ? -HUGE_VAL : loudness_for_energy(energy / count));
+}
+
+static double
+histogram_loudness_range(const LoudnessHistogram *histogram)
+{
+	unsigned	gateBin		= relative_gate_bin(histogram, -20);
+	uint64_t	count		= 0;
+	unsigned	bin;
+	
+	for(bin = gateBin; bin < HISTOGRAM_BIN_COUNT; ++bin)
+		count += histogram->counts[bin];
+	
+	if(0 == count)
+		return 0;
+	
+	// The range spans the 10th to the 95th percentile of the gated short-term loudness
+	uint64_t	lowRank		= (uint64_t)(count * 0.10);
+	uint64_t	highRank	= (uint64_t)(count * 0.95);
+	uint64_t	seen		= 0;
+	double		low			= 0;
+	double		high		= 0;
+	int			foundLow	= 0;
+	
+	for(bin = gateBin; bin < HISTOGRAM_BIN_COUNT; ++bin) {
+		seen += histogram->counts[bin];
+		
+		if(!foundLow && seen > lowRank) {
+			low			= bin_loudness(bin);
+			foundLow	= 1;
+		}
+		
+		if(seen > highRank) {
+			high = bin_loudness(bin);
+			break;
+		}
+	}
+	
+	return high - low;
+}
+
+static void
+set_k_weighting(LoudnessMeter *meter, double sampleRate)
+{
+	// Coefficients are derived for the actual sample rate, matching the BS.1770 tables at 48 kHz
+	double f0	= 1681.974450955533;
+	double G	= 3.999843853973347;
+	double Q	= 0.7071752369554196;
+	
+	double K	= tan(M_PI * f0 / sampleRate);
+	double Vh	= pow(10, G / 20);
+	double Vb	= pow(Vh, 0.4996667741545416);
+	double a0	= 1 + K / Q + K * K;
+	
+	meter->shelf.b0		= (Vh + Vb * K / Q + K * K) / a0;
+	meter->shelf.b1		= 2 * (K * K - Vh) / a0;
+	meter->shelf.b2		= (Vh - Vb * K / Q + K * K) / a0;
+	meter->shelf.a1		= 2 * (K * K - 1) / a0;
+	meter->shelf.a2		= (1 - K / Q + K * K) / a0;
+	
+	f0	= 38.13547087602444;
+	Q	= 0.5003270373238773;
+	K	= tan(M_PI * f0 / sampleRate);
+	a0	= 1 + K / Q + K * K;
+	
+	meter->highPass.b0	= 1;
+	meter->highPass.b1	= -2;
+	meter->highPass.b2	= 1;
+	meter->highPass.a1	= 2 * (K * K - 1) / a0;
+	meter->highPass.a2	= (1 - K / Q + K * K) / a0;
+}
+
+static void
+finish_sub_block(LoudnessMeter *meter)
+{
+	unsigned i;
+	
+	meter->subBlockEnergies[meter->subBlockCount % SHORT_TERM_SUB_BLOCKS] = meter->subBlockSum / meter->subBlockFrames;
+	++meter->subBlockCount;
+	
+	meter->subBlockSum		= 0;
+	meter->framesInSubBlock	= 0;
+	
+	if(MOMENTARY_SUB_BLOCKS <= meter->subBlockCount) {
+		double energy = 0;
+		for(i = 1; i <= MOMENTARY_SUB_BLOCKS; ++i)
+			energy += meter->subBlockEnergies[(meter->subBlockCount - i) % SHORT_TERM_SUB_BLOCKS];
+		histogram_record(&meter->momentary, energy / MOMENTARY_SUB_BLOCKS);
+	}
+	
+	if(SHORT_TERM_SUB_BLOCKS <= meter->subBlockCount && 0 == meter->subBlockCount % SHORT_TERM_STEP_SUB_BLOCKS) {
+		double energy = 0;
+		for(i = 0; i < SHORT_TERM_SUB_BLOCKS; ++i)
+			energy += meter->subBlockEnergies[i];
+		histogram_record(&meter->shortTerm, energy / SHORT_TERM_SUB_BLOCKS);
+	}
+}
+
+LoudnessMeter *
+loudness_meter_create(double sampleRate, unsigned channelCount)
+{
+	if(0 >= sampleRate || 0 == channelCount)
+		return NULL;
+	
+	LoudnessMeter *meter = calloc(1, sizeof(LoudnessMeter));
+	if(NULL == meter)
+		return NULL;
+	
+	meter->filterState = calloc(4 * channelCount, sizeof(double));
+	if(NULL == meter->filterState) {
+		free(meter);
+		return NULL;
+	}
+	
+	meter->channelCount		= channelCount;
+	meter->subBlockFrames	= (size_t)floor((sampleRate / 10) + 0.5);
+	
+	set_k_weighting(meter, sampleRate);
+	
+	return meter;
+}
+
+void
+loudness_meter_destroy(LoudnessMeter *meter)
+{
+	if(NULL == meter)
+		return;
+	
+	free(meter->filterState);
+	free(meter);
+}
+
+void
+loudness_meter_process(LoudnessMeter *meter, const float * const *channels, size_t frameCount)
+{
+	size_t		offset	= 0;
+	unsigned	channel;
+	size_t		i;
+	
+	while(offset < frameCount) {
+		size_t framesToProcess = meter->subBlockFrames - meter->framesInSubBlock;
+		if(framesToProcess > frameCount - offset)
+			framesToProcess = frameCount - offset;
+		
+		for(channel = 0; channel < meter->channelCount; ++channel) {
+			const float		*input		= channels[channel] + offset;
+			double			*state		= meter->filterState + (4 * channel);
+			double			s1			= state[0];
+			double			s2			= state[1];
+			double			h1			= state[2];
+			double			h2			= state[3];
+			double			sum			= 0;
+			
+			for(i = 0; i < framesToProcess; ++i) {
+				double x	= input[i];
+				double y	= meter->shelf.b0 * x + s1;
+				s1			= meter->shelf.b1 * x - meter->shelf.a1 * y + s2;
+				s2			= meter->shelf.b2 * x - meter->shelf.a2 * y;
+				
+				double z	= meter->highPass.b0 * y + h1;
+				h1			= meter->highPass.b1 * y - meter->highPass.a1 * z + h2;
+				h2			= meter->highPass.b2 * y - meter->highPass.a2 * z;
+				
+				sum			+= z * z;
+			}
+			
+			state[0]	= s1;
+			state[1]	= s2;
+			state[2]	= h1;
+			state[3]	= h2;
+			
+			// All channels carry unit weight; surround channels are folded down before measurement
+			meter->subBlockSum += sum;
+		}
+		
+		meter->framesInSubBlock	+= framesToProcess;
+		offset					+= framesToProcess;
+		
+		if(meter->framesInSubBlock == meter->subBlockFrames)
+			finish_sub_block(meter);
+	}
+}
+
+double
+loudness_meter_integrated_loudness(const LoudnessMeter *meter)
+{
+	return histogram_integrated_loudness(&meter->momentary);
+}
+
+double
+loudness_meter_loudness_range(const LoudnessMeter *meter)
+{
+	return histogram_loudness_range(&meter->shortTerm);
+}
+
+double
+loudness_meter_integrated_loudness_multiple(const LoudnessMeter * const *meters, size_t count)
+{
+	LoudnessHistogram	*pooled		= calloc(1, sizeof(LoudnessHistogram));
+	size_t				i;
+	unsigned			bin;
+	
+	if(NULL == pooled)
+		return -HUGE_VAL;
+	
+	for(i = 0; i < count; ++i) {
+		for(bin = 0; bin < HISTOGRAM_BIN_COUNT; ++bin) {
+			pooled->counts[bin]		+= meters[i]->momentary.counts[bin];
+			pooled->energies[bin]	+= meters[i]->momentary.energies[bin];
+		}
+	}
+	
+	double loudness = histogram_integrated_loudness(pooled);
+	
+	free(pooled);
+	
+	return loudness;
+}
@@ -0,0 +1,56 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// EBU R128 / ITU-R BS.1770 loudness measurement
+// Integrated loudness and loudness range are gated from 0.1 LU histograms of
+// the 400 ms and 3 s block loudnesses, so several meters can be pooled to
+// measure an album without keeping every block
+// ========================================
+
+typedef struct LoudnessMeter LoudnessMeter;
+
+// Returns NULL if memory could not be allocated
+LoudnessMeter * loudness_meter_create(double sampleRate, unsigned channelCount);
+void loudness_meter_destroy(LoudnessMeter *meter);
+
+// channels holds one deinterleaved buffer of frameCount samples per channel
+void loudness_meter_process(LoudnessMeter *meter, const float * const *channels, size_t frameCount);
+
+// Results are in LUFS and LU; silent input yields -HUGE_VAL for the integrated loudness
+double loudness_meter_integrated_loudness(const LoudnessMeter *meter);
+double loudness_meter_loudness_range(const LoudnessMeter *meter);
+
+double loudness_meter_integrated_loudness_multiple(const LoudnessMeter * const *meters, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOUDNESSMETER_H */
@@ -32,6 +32,7 @@
 
 #import "AudioStream.h"
 #import "UtilityFunctions.h"
+#import "StringInterning.h"
 
 NSString *const AudioMetadataReaderErrorDomain = @"org.sbooth.Play.ErrorDomain.AudioMetadataReader";
 
@@ -144,4 +145,11 @@ NSString *const AudioMetadataReaderErrorDomain = @"org.sbooth.Play.ErrorDomain.A
 
 - (NSDictionary *)	metadata								{ return [[_metadata retain] autorelease]; }
 
+// Readers store their results through KVC, so values are interned once here instead of on every access
+- (void) setMetadata:(NSDictionary *)metadata
+{
+	[_metadata release];
+	_metadata = [internStreamValues(metadata) retain];
+}
+
 @end
@@ -19,9 +19,13 @@
  */
 
 #import "AudioMetadataReader.h"
+#include <FLAC/metadata.h>
 
 @interface FLACMetadataReader : AudioMetadataReader
 {
 }
 
+// Read the metadata from a chain that has already been read, allowing one pass over the file to supply both properties and metadata
+- (BOOL) readMetadataFromChain:(FLAC__Metadata_Chain *)chain error:(NSError **)error;
+
 @end
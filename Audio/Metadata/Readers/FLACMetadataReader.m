@@ -20,7 +20,34 @@
 
 #import "FLACMetadataReader.h"
 #import "AudioStream.h"
-#include <FLAC/metadata.h>
+#import "UtilityFunctions.h"
+
+// Determine the file offset of the first metadata block, skipping an ID3v2 tag if present
+static off_t
+firstMetadataBlockOffset(const char *path)
+{
+	NSCParameterAssert(NULL != path);
+
+	unsigned char	header [10];
+	off_t			offset		= 0;
+	FILE			*file		= fopen(path, "r");
+
+	if(NULL == file)
+		return -1;
+
+	if(10 == fread(header, 1, 10, file) && 0 == memcmp(header, "ID3", 3)) {
+		offset = 10 + ((header[6] & 0x7F) << 21 | (header[7] & 0x7F) << 14 | (header[8] & 0x7F) << 7 | (header[9] & 0x7F));
+
+		// Footer present
+		if(0x10 & header[5])
+			offset += 10;
+	}
+
+	fclose(file);
+
+	// Skip the "fLaC" stream marker
+	return offset + 4;
+}
 
 @implementation FLACMetadataReader
 
@@ -28,14 +55,7 @@
 {
 	NSString						*path				= [_url path];
 	FLAC__Metadata_Chain			*chain				= NULL;
-	FLAC__Metadata_Iterator			*iterator			= NULL;
-	FLAC__StreamMetadata			*block				= NULL;
-	unsigned						i;
-	char							*fieldName			= NULL;
-	char							*fieldValue			= NULL;
-	NSMutableDictionary				*metadataDictionary;
-	NSString						*key, *value;
-	NSImage							*picture;
+	BOOL							result;
 				
 	chain							= FLAC__metadata_chain_new();
 	
@@ -76,12 +96,36 @@
 		return NO;
 	}
 	
+	result = [self readMetadataFromChain:chain error:error];
+
+	FLAC__metadata_chain_delete(chain);
+
+	return result;
+}
+
+- (BOOL) readMetadataFromChain:(FLAC__Metadata_Chain *)chain error:(NSError **)error
+{
+	NSParameterAssert(NULL != chain);
+
+	NSString						*path				= [_url path];
+	FLAC__Metadata_Iterator			*iterator			= NULL;
+	FLAC__StreamMetadata			*block				= NULL;
+	unsigned						i;
+	char							*fieldName			= NULL;
+	char							*fieldValue			= NULL;
+	NSMutableDictionary				*metadataDictionary;
+	NSString						*key, *value;
+	off_t							blockOffset;
+	BOOL							haveFrontCover		= NO;
+
 	metadataDictionary	= [NSMutableDictionary dictionary];				
 	iterator			= FLAC__metadata_iterator_new();
 	
 	NSAssert(NULL != iterator, @"Unable to allocate memory.");
 	
 	FLAC__metadata_iterator_init(iterator, chain);
+
+	blockOffset			= firstMetadataBlockOffset([path fileSystemRepresentation]);
 	
 	do {
 		block = FLAC__metadata_iterator_get_block(iterator);
@@ -176,10 +220,18 @@
 				break;
 				
 			case FLAC__METADATA_TYPE_PICTURE:
-				picture = [[NSImage alloc] initWithData:[NSData dataWithBytes:block->data.picture.data length:block->data.picture.data_length]];
-				if(nil != picture) {
-					[metadataDictionary setValue:[picture TIFFRepresentation] forKey:@"albumArt"];
-					[picture release];
+				// Only the location of the picture is recorded; it is decoded on demand by AlbumArtCache
+				// A front cover takes precedence over any other picture type
+				if(-1 != blockOffset && NO == haveFrontCover && (nil == [metadataDictionary valueForKey:MetadataAlbumArtHashKey] || FLAC__STREAM_METADATA_PICTURE_TYPE_FRONT_COVER == block->data.picture.type)) {
+					// The picture data follows the block header and the variable-length picture fields
+					off_t dataOffset = blockOffset + 4 + 32 + strlen(block->data.picture.mime_type) + strlen((const char *)block->data.picture.description);
+					
+					[metadataDictionary setValue:[NSNumber numberWithLongLong:dataOffset] forKey:MetadataAlbumArtOffsetKey];
+					[metadataDictionary setValue:[NSNumber numberWithUnsignedInt:block->data.picture.data_length] forKey:MetadataAlbumArtLengthKey];
+					[metadataDictionary setValue:[NSString stringWithCString:block->data.picture.mime_type encoding:NSASCIIStringEncoding] forKey:MetadataAlbumArtMIMETypeKey];
+					[metadataDictionary setValue:getMD5DigestForBytes(block->data.picture.data, block->data.picture.data_length) forKey:MetadataAlbumArtHashKey];
+
+					haveFrontCover = (FLAC__STREAM_METADATA_PICTURE_TYPE_FRONT_COVER == block->data.picture.type);
 				}
 				break;
 				
@@ -191,10 +243,13 @@
 			case FLAC__METADATA_TYPE_UNDEFINED:						break;
 			default:												break;
 		}
+
+		if(-1 != blockOffset)
+			blockOffset += 4 + block->length;
+		
 	} while(FLAC__metadata_iterator_next(iterator));
 	
 	FLAC__metadata_iterator_delete(iterator);
-	FLAC__metadata_chain_delete(chain);
 	
 	[self setValue:metadataDictionary forKey:@"metadata"];
 
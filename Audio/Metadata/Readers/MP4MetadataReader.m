@@ -20,7 +20,115 @@
 
 #import "MP4MetadataReader.h"
 #import "AudioStream.h"
+#import "UtilityFunctions.h"
 #include <mp4v2/mp4.h>
+#include <libkern/OSByteOrder.h>
+
+// Locate the child atom of the given type between start and end, returning the bounds of its payload
+static BOOL
+findChildAtom(FILE *file, off_t start, off_t end, const char *type, off_t *payloadStart, off_t *payloadEnd)
+{
+	NSCParameterAssert(NULL != file);
+	NSCParameterAssert(NULL != type);
+	NSCParameterAssert(NULL != payloadStart);
+	NSCParameterAssert(NULL != payloadEnd);
+
+	unsigned char	header [16];
+	off_t			position		= start;
+	off_t			headerSize;
+	UInt64			atomSize;
+
+	while(position + 8 <= end) {
+		if(0 != fseeko(file, position, SEEK_SET) || 8 != fread(header, 1, 8, file))
+			return NO;
+
+		atomSize	= OSReadBigInt32(header, 0);
+		headerSize	= 8;
+
+		// 64-bit atom size
+		if(1 == atomSize) {
+			if(8 != fread(header + 8, 1, 8, file))
+				return NO;
+			atomSize	= OSReadBigInt64(header, 8);
+			headerSize	= 16;
+		}
+		// Atom extends to the end of its container
+		else if(0 == atomSize)
+			atomSize = end - position;
+
+		if(atomSize < (UInt64)headerSize || position + (off_t)atomSize > end)
+			return NO;
+
+		if(0 == memcmp(header + 4, type, 4)) {
+			*payloadStart	= position + headerSize;
+			*payloadEnd		= position + atomSize;
+			return YES;
+		}
+
+		position += atomSize;
+	}
+
+	return NO;
+}
+
+// Read the location, type and digest of the first cover art item (moov.udta.meta.ilst.covr.data)
+static void
+readCoverArtLocation(const char *path, NSMutableDictionary *metadataDictionary)
+{
+	NSCParameterAssert(NULL != path);
+	NSCParameterAssert(nil != metadataDictionary);
+
+	FILE			*file			= fopen(path, "r");
+	off_t			start, end;
+	unsigned char	dataHeader [8];
+	NSString		*mimeType		= nil;
+
+	if(NULL == file)
+		return;
+
+	if(0 != fseeko(file, 0, SEEK_END))
+		goto cleanup;
+
+	end = ftello(file);
+
+	if(NO == findChildAtom(file, 0, end, "moov", &start, &end)
+	   || NO == findChildAtom(file, start, end, "udta", &start, &end)
+	   || NO == findChildAtom(file, start, end, "meta", &start, &end)
+	   // meta is a full atom, with version and flags preceding its children
+	   || NO == findChildAtom(file, start + 4, end, "ilst", &start, &end)
+	   || NO == findChildAtom(file, start, end, "covr", &start, &end)
+	   || NO == findChildAtom(file, start, end, "data", &start, &end))
+		goto cleanup;
+
+	// The data atom's payload begins with a type indicator and locale
+	if(start + 8 >= end || 0 != fseeko(file, start, SEEK_SET) || 8 != fread(dataHeader, 1, 8, file))
+		goto cleanup;
+
+	switch(OSReadBigInt32(dataHeader, 0) & 0x00FFFFFF) {
+		case 13:	mimeType = @"image/jpeg";		break;
+		case 14:	mimeType = @"image/png";		break;
+		case 27:	mimeType = @"image/bmp";		break;
+	}
+
+	start += 8;
+
+	// Calculating the digest requires reading the image, but not decoding it
+	void *bytes = malloc(end - start);
+	if(NULL == bytes)
+		goto cleanup;
+
+	if((size_t)(end - start) == fread(bytes, 1, end - start, file)) {
+		[metadataDictionary setValue:[NSNumber numberWithLongLong:start] forKey:MetadataAlbumArtOffsetKey];
+		[metadataDictionary setValue:[NSNumber numberWithUnsignedInt:(end - start)] forKey:MetadataAlbumArtLengthKey];
+		[metadataDictionary setValue:mimeType forKey:MetadataAlbumArtMIMETypeKey];
+		[metadataDictionary setValue:getMD5DigestForBytes(bytes, end - start) forKey:MetadataAlbumArtHashKey];
+	}
+
+	free(bytes);
+
+cleanup:
+	fclose(file);
+}
 
 @implementation MP4MetadataReader
 
@@ -111,16 +219,8 @@
 	if(MP4GetMetadataTempo(mp4FileHandle, &bpm))
 		[metadataDictionary setValue:[NSNumber numberWithInt:bpm] forKey:MetadataBPMKey];
 	
-	// Album art
-/*	artCount = MP4GetMetadataCoverArtCount(mp4FileHandle);
-	if(0 < artCount) {
-		MP4GetMetadataCoverArt(mp4FileHandle, &bytes, &length, 0);
-		NSImage				*image	= [[NSImage alloc] initWithData:[NSData dataWithBytes:bytes length:length]];
-		if(nil != image) {
-			[metadataDictionary setValue:[image TIFFRepresentation] forKey:@"albumArt"];
-			[image release];
-		}
-	}*/
+	// Album art (only the location is recorded; it is decoded on demand by AlbumArtCache)
+	readCoverArtLocation([path fileSystemRepresentation], metadataDictionary);
 	
 	// ReplayGain
 	u_int8_t *rawValue;
@@ -24,4 +24,7 @@
 {
 }
 
+// Read the metadata from a Vorbis comment header that has already been read, without the packet type and "vorbis" prefix
+- (BOOL) readMetadataFromCommentHeader:(NSData *)commentHeader error:(NSError **)error;
+
 @end
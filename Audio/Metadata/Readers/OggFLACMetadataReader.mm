@@ -23,15 +23,16 @@
 #include <taglib/oggflacfile.h>
 #include <taglib/xiphcomment.h>
 
+@interface OggFLACMetadataReader (Private)
+- (void) readMetadataFromXiphComment:(TagLib::Ogg::XiphComment *)xiphComment;
+@end
+
 @implementation OggFLACMetadataReader
 
 - (BOOL) readMetadata:(NSError **)error
 {
-	NSMutableDictionary				*metadataDictionary;
 	NSString						*path					= [_url path];
 	TagLib::Ogg::FLAC::File			f						([path fileSystemRepresentation], false);
-	TagLib::String					s;
-	TagLib::Ogg::XiphComment		*xiphComment;
 
 	if(NO == f.isValid()) {
 		if(nil != error) {
@@ -49,8 +50,29 @@
 		return NO;
 	}
 	
-	metadataDictionary			= [NSMutableDictionary dictionary];
-	xiphComment					= f.tag();
+	[self readMetadataFromXiphComment:f.tag()];
+
+	return YES;
+}
+
+- (BOOL) readMetadataFromCommentHeader:(NSData *)commentHeader error:(NSError **)error
+{
+	NSParameterAssert(nil != commentHeader);
+	
+	TagLib::Ogg::XiphComment xiphComment (TagLib::ByteVector((const char *)[commentHeader bytes], [commentHeader length]));
+	
+	[self readMetadataFromXiphComment:&xiphComment];
+	
+	return YES;
+}
+
+@end
+
+@implementation OggFLACMetadataReader (Private)
+
+- (void) readMetadataFromXiphComment:(TagLib::Ogg::XiphComment *)xiphComment
+{
+	NSMutableDictionary *metadataDictionary = [NSMutableDictionary dictionary];
 
 	if(NULL != xiphComment) {
 		TagLib::Ogg::FieldListMap		fieldList		= xiphComment->fieldListMap();
@@ -214,8 +236,6 @@
 	}		
 	
 	[self setValue:metadataDictionary forKey:@"metadata"];
-
-	return YES;
 }
 
 @end
@@ -21,6 +21,7 @@
 #import "WAVEMetadataReader.h"
 
 #import "AudioStream.h"
+#import "UtilityFunctions.h"
 #include <taglib/wavfile.h>
 #include <taglib/id3v2tag.h>
 #include <taglib/id3v2frame.h>
@@ -145,17 +146,29 @@
 			[metadataDictionary setValue:[NSNumber numberWithInt:[discString intValue]] forKey:MetadataDiscNumberKey];
 	}
 	
-	// Extract album art if present
-	/*		TagLib::ID3v2::AttachedPictureFrame *picture = NULL;
-	 frameList = f.tag()->frameListMap()["APIC"];
-	 if(NO == frameList.isEmpty() && NULL != (picture = dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(frameList.front()))) {
-	 TagLib::ByteVector	bv		= picture->picture();
-	 NSImage				*image	= [[NSImage alloc] initWithData:[NSData dataWithBytes:bv.data() length:bv.size()]];
-	 if(nil != image) {
-	 [metadataDictionary setValue:[image TIFFRepresentation] forKey:@"albumArt"];
-	 [image release];
-	 }
-	 }*/
+	// Record the location of the album art; it is decoded on demand by AlbumArtCache
+	// A front cover takes precedence over any other picture type
+	TagLib::ID3v2::AttachedPictureFrame *picture = NULL;
+	frameList = f.tag()->frameListMap()["APIC"];
+	for(TagLib::ID3v2::FrameList::ConstIterator it = frameList.begin(); it != frameList.end(); ++it) {
+		TagLib::ID3v2::AttachedPictureFrame *frame = dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*it);
+		if(NULL != frame && (NULL == picture || TagLib::ID3v2::AttachedPictureFrame::FrontCover == frame->type())) {
+			picture = frame;
+			if(TagLib::ID3v2::AttachedPictureFrame::FrontCover == frame->type())
+				break;
+		}
+	}
+
+	if(NULL != picture) {
+		TagLib::ByteVector	bv			= picture->picture();
+		off_t				offset		= getID3v2PictureOffset(path, bv.data(), bv.size());
+		if(-1 != offset) {
+			[metadataDictionary setValue:[NSNumber numberWithLongLong:offset] forKey:MetadataAlbumArtOffsetKey];
+			[metadataDictionary setValue:[NSNumber numberWithUnsignedInt:bv.size()] forKey:MetadataAlbumArtLengthKey];
+			[metadataDictionary setValue:[NSString stringWithUTF8String:picture->mimeType().toCString(true)] forKey:MetadataAlbumArtMIMETypeKey];
+			[metadataDictionary setValue:getMD5DigestForBytes(bv.data(), bv.size()) forKey:MetadataAlbumArtHashKey];
+		}
+	}
 	
 	// Extract compilation if present (iTunes TCMP tag)
 	frameList = f.tag()->frameListMap()["TCMP"];
@@ -0,0 +1,66 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+@class AudioStream;
+
+// ========================================
+// Notification names
+// ========================================
+extern NSString * const		AudioMetadataWriteQueueDidWriteFileNotification;
+
+// ========================================
+// Notification keys
+// ========================================
+extern NSString * const		AudioMetadataWriteQueueURLKey;
+extern NSString * const		AudioMetadataWriteQueueErrorKey;
+extern NSString * const		AudioMetadataWriteQueueCompletedFileCountKey;
+extern NSString * const		AudioMetadataWriteQueueTotalFileCountKey;
+
+// ========================================
+// Writes stream metadata to files on a small pool of I/O threads
+// The stream's values are copied when a write is queued; queuing a file again before
+// it has been written replaces the earlier copy, so each file is written once per burst of edits
+// AudioMetadataWriteQueueDidWriteFileNotification is posted on the main thread after each file
+// ========================================
+@interface AudioMetadataWriteQueue : NSObject
+{
+	NSMutableDictionary		*_pendingMetadata;		// Keyed by URL
+	NSMutableArray			*_pendingURLs;			// In the order they were queued
+	NSMutableSet			*_activeURLs;			// Currently being written
+	
+	unsigned				_activeWorkers;
+	unsigned				_completedFileCount;
+	unsigned				_totalFileCount;
+}
+
+// Returns the singleton instance
++ (AudioMetadataWriteQueue *) sharedQueue;
+
+- (void) writeMetadataForStream:(AudioStream *)stream;
+
+// The number of files queued or being written
+- (unsigned) pendingFileCount;
+
+// Returns once every queued write has finished
+- (void) waitUntilAllWritesAreFinished;
+
+@end
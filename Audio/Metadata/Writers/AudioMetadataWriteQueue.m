@@ -0,0 +1,241 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioMetadataWriteQueue.h"
+#import "AudioMetadataWriter.h"
+#import "AudioStream.h"
+
+// Metadata writes are bound by disk I/O, so only a couple of threads are used
+#define MAX_WORKERS				2
+
+NSString * const	AudioMetadataWriteQueueDidWriteFileNotification		= @"org.sbooth.Play.AudioMetadataWriteQueue.DidWriteFileNotification";
+
+NSString * const	AudioMetadataWriteQueueURLKey						= @"url";
+NSString * const	AudioMetadataWriteQueueErrorKey						= @"error";
+NSString * const	AudioMetadataWriteQueueCompletedFileCountKey		= @"completedFileCount";
+NSString * const	AudioMetadataWriteQueueTotalFileCountKey			= @"totalFileCount";
+
+@interface AudioMetadataWriteQueue (Private)
+- (NSURL *) nextURL:(NSDictionary **)metadata;
+- (void) finishedWritingURL:(NSURL *)url error:(NSError *)error;
+- (void) writeInThread:(id)dummy;
+- (void) postDidWriteFileNotification:(NSDictionary *)userInfo;
+@end
+
+// ========================================
+// The singleton instance
+// ========================================
+static AudioMetadataWriteQueue *sharedQueueInstance = nil;
+
+@implementation AudioMetadataWriteQueue
+
++ (AudioMetadataWriteQueue *) sharedQueue
+{
+	@synchronized(self) {
+		if(nil == sharedQueueInstance) {
+			// assignment not done here
+			[[self alloc] init];
+		}
+	}
+	return sharedQueueInstance;
+}
+
++ (id) allocWithZone:(NSZone *)zone
+{
+    @synchronized(self) {
+        if(nil == sharedQueueInstance) {
+			// assignment and return on first allocation
+            sharedQueueInstance = [super allocWithZone:zone];
+			return sharedQueueInstance;
+        }
+    }
+    return nil;
+}
+
+- (id) init
+{
+	if((self = [super init])) {
+		_pendingMetadata	= [[NSMutableDictionary alloc] init];
+		_pendingURLs		= [[NSMutableArray alloc] init];
+		_activeURLs			= [[NSMutableSet alloc] init];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_pendingMetadata release], _pendingMetadata = nil;
+	[_pendingURLs release], _pendingURLs = nil;
+	[_activeURLs release], _activeURLs = nil;
+	
+	[super dealloc];
+}
+
+- (id) 			copyWithZone:(NSZone *)zone			{ return self; }
+- (id) 			retain								{ return self; }
+- (unsigned) 	retainCount							{ return UINT_MAX;  /* denotes an object that cannot be released */ }
+- (void) 		release								{ /* do nothing */ }
+- (id) 			autorelease							{ return self; }
+
+- (void) writeMetadataForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	// FIXME: Save album-only metadata to original file?
+	if([stream isPartOfCueSheet])
+		return;
+	
+	NSURL *url = [stream valueForKey:StreamURLKey];
+	if(nil == url)
+		return;
+	
+	// Copy the values on the calling thread so the workers never touch the stream
+	NSMutableDictionary *metadata = [NSMutableDictionary dictionary];
+	for(NSString *key in [stream supportedKeys]) {
+		id value = [stream valueForKey:key];
+		if(nil != value)
+			[metadata setObject:value forKey:key];
+	}
+	
+	@synchronized(self) {
+		// A file that is already queued keeps its place in line
+		if(nil == [_pendingMetadata objectForKey:url]) {
+			[_pendingURLs addObject:url];
+			++_totalFileCount;
+		}
+		
+		[_pendingMetadata setObject:metadata forKey:url];
+		
+		// The worker threads exit when the queue is empty
+		if(MAX_WORKERS > _activeWorkers && [_pendingURLs count] > _activeWorkers) {
+			++_activeWorkers;
+			[NSThread detachNewThreadSelector:@selector(writeInThread:) toTarget:self withObject:nil];
+		}
+	}
+}
+
+- (unsigned) pendingFileCount
+{
+	@synchronized(self) {
+		return [_pendingURLs count] + [_activeURLs count];
+	}
+	
+	return 0;
+}
+
+- (void) waitUntilAllWritesAreFinished
+{
+	for(;;) {
+		@synchronized(self) {
+			if(0 == [_pendingURLs count] && 0 == _activeWorkers)
+				break;
+		}
+		
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+	}
+}
+
+@end
+
+@implementation AudioMetadataWriteQueue (Private)
+
+- (NSURL *) nextURL:(NSDictionary **)metadata
+{
+	NSParameterAssert(NULL != metadata);
+	
+	@synchronized(self) {
+		unsigned i;
+		
+		// Skip files another worker is still writing; they are picked up again once that write finishes
+		for(i = 0; i < [_pendingURLs count]; ++i) {
+			NSURL *url = [_pendingURLs objectAtIndex:i];
+			if([_activeURLs containsObject:url])
+				continue;
+			
+			*metadata = [[[_pendingMetadata objectForKey:url] retain] autorelease];
+			
+			[_activeURLs addObject:url];
+			[_pendingMetadata removeObjectForKey:url];
+			[[url retain] autorelease];
+			[_pendingURLs removeObjectAtIndex:i];
+			
+			return url;
+		}
+		
+		// Nothing left to do, so this worker exits
+		--_activeWorkers;
+	}
+	
+	return nil;
+}
+
+- (void) finishedWritingURL:(NSURL *)url error:(NSError *)error
+{
+	NSParameterAssert(nil != url);
+	
+	NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:url forKey:AudioMetadataWriteQueueURLKey];
+	if(nil != error)
+		[userInfo setObject:error forKey:AudioMetadataWriteQueueErrorKey];
+	
+	@synchronized(self) {
+		[_activeURLs removeObject:url];
+		++_completedFileCount;
+		
+		[userInfo setObject:[NSNumber numberWithUnsignedInt:_completedFileCount] forKey:AudioMetadataWriteQueueCompletedFileCountKey];
+		[userInfo setObject:[NSNumber numberWithUnsignedInt:_totalFileCount] forKey:AudioMetadataWriteQueueTotalFileCountKey];
+		
+		// Start counting afresh once the queue drains
+		if(0 == [_pendingURLs count] && 0 == [_activeURLs count])
+			_completedFileCount = _totalFileCount = 0;
+	}
+	
+	[self performSelectorOnMainThread:@selector(postDidWriteFileNotification:) withObject:userInfo waitUntilDone:NO];
+}
+
+- (void) writeInThread:(id)dummy
+{
+	for(;;) {
+		NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+		NSDictionary		*metadata	= nil;
+		NSURL				*url		= [self nextURL:&metadata];
+		NSError				*error		= nil;
+		
+		if(nil == url) {
+			[pool release];
+			break;
+		}
+		
+		AudioMetadataWriter *metadataWriter = [AudioMetadataWriter metadataWriterForURL:url error:&error];
+		if(nil != metadataWriter && [metadataWriter writeMetadata:metadata error:&error])
+			error = nil;
+		
+		// The notification's userInfo retains the error past this pool
+		[self finishedWritingURL:url error:error];
+		
+		[pool release];
+	}
+}
+
+- (void) postDidWriteFileNotification:(NSDictionary *)userInfo
+{
+	[[NSNotificationCenter defaultCenter] postNotificationName:AudioMetadataWriteQueueDidWriteFileNotification object:self userInfo:userInfo];
+}
+
+@end
@@ -22,6 +22,9 @@
 #import "AudioStream.h"
 #include <FLAC/metadata.h>
 
+// Padding reserved when the file has to be rewritten, so later edits fit in place
+#define PADDING_RESERVE_SIZE 8192
+
 static void
 setVorbisComment(FLAC__StreamMetadata		*block,
 				 NSString					*key,
@@ -213,6 +216,30 @@ setVorbisComment(FLAC__StreamMetadata		*block,
 	setVorbisComment(block, @"MUSICDNS_PUID", [metadata valueForKey:MetadataMusicDNSPUIDKey]);
 	setVorbisComment(block, @"MUSICBRAINZ_ID", [metadata valueForKey:MetadataMusicBrainzIDKey]);
 
+	// If the metadata no longer fits in the existing padding the whole file will be rewritten,
+	// so make the padding large enough for the next edit to be written in place
+	if(FLAC__metadata_chain_check_if_tempfile_needed(chain, YES)) {
+		FLAC__metadata_iterator_init(iterator, chain);
+		while(FLAC__metadata_iterator_next(iterator))
+			;
+		
+		// After sorting, the padding is the last block if it exists
+		if(FLAC__METADATA_TYPE_PADDING == FLAC__metadata_iterator_get_block_type(iterator)) {
+			block = FLAC__metadata_iterator_get_block(iterator);
+			if(PADDING_RESERVE_SIZE > block->length)
+				block->length = PADDING_RESERVE_SIZE;
+		}
+		else {
+			block = FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING);
+			NSAssert(NULL != block, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+			
+			block->length = PADDING_RESERVE_SIZE;
+			
+			if(NO == FLAC__metadata_iterator_insert_block_after(iterator, block))
+				FLAC__metadata_object_delete(block);
+		}
+	}
+
 	// Write the new metadata to the file
 	result = FLAC__metadata_chain_write(chain, YES, NO);
 	if(NO == result) {
@@ -0,0 +1,40 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <AudioToolbox/AudioToolbox.h>
+
+// ========================================
+// An output is responsible for rendering the slices scheduled by an AudioScheduler
+// Slices are rendered in the order they are scheduled; once a slice has been rendered
+// the output must set kScheduledAudioSliceFlag_Complete in its flags and call its completion proc
+// ========================================
+@protocol AudioOutputMethods
+// Queue a slice of 32-bit float non-interleaved audio for rendering
+- (OSStatus) scheduleAudioSlice:(ScheduledAudioSlice *)slice;
+
+// Begin rendering scheduled slices at the given sample time (-1 means as soon as possible)
+- (OSStatus) setScheduleStartTimeStamp:(AudioTimeStamp)timeStamp;
+
+// Discard all scheduled slices without rendering them
+- (OSStatus) reset;
+
+// The sample time of the last frame rendered, or -1 if rendering hasn't started
+- (AudioTimeStamp) currentPlayTime;
+@end
@@ -0,0 +1,68 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "AudioOutputMethods.h"
+
+#include <pthread.h>
+
+// An output that renders slices on its own thread without Core Audio, for running the
+// playback pipeline on machines without an audio device
+// Paced outputs render in real time from the system clock; unpaced outputs render as fast
+// as slices are scheduled (or as fast as a blocking device accepts them)
+// Subclasses override renderSlice: to do something with the audio
+@interface QueuedAudioOutput : NSObject <AudioOutputMethods>
+{
+	Float64					_sampleRate;
+	BOOL					_paced;
+	
+	pthread_t				_thread;
+	pthread_mutex_t			_mutex;
+	pthread_cond_t			_condition;
+	BOOL					_keepRendering;
+	
+	ScheduledAudioSlice		**_queue;
+	unsigned				_queueCapacity;
+	unsigned				_queueHead;
+	unsigned				_queueCount;
+	
+	BOOL					_started;
+	BOOL					_renderingSlice;
+	unsigned				_generation;
+	SInt64					_framesRendered;
+	double					_startTime;
+	
+	unsigned				_underrunCount;
+}
+
+- (id) initWithSampleRate:(Float64)sampleRate paced:(BOOL)paced;
+
+- (Float64) sampleRate;
+- (BOOL) isPaced;
+
+// The number of slices that began rendering after their deadline (paced outputs only)
+- (unsigned) underrunCount;
+
+// Subclass hooks: renderSlice: is called on the render thread, and didReset
+// on the thread calling reset once the render thread has let go of the discarded slices
+- (void) renderSlice:(const ScheduledAudioSlice *)slice;
+- (void) didReset;
+
+@end
@@ -0,0 +1,284 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "QueuedAudioOutput.h"
+
+#include <sys/time.h>
+
+// Initial number of slices the queue can hold; it grows as needed
+#define INITIAL_QUEUE_CAPACITY			16
+
+// How late a paced slice may begin rendering before it counts as an underrun, in seconds
+#define UNDERRUN_TOLERANCE				0.002
+
+static double
+current_time()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static struct timespec
+timespec_for_time(double t)
+{
+	struct timespec ts;
+	ts.tv_sec	= (time_t)t;
+	ts.tv_nsec	= (long)((t - ts.tv_sec) * 1000000000.0);
+	return ts;
+}
+
+@interface QueuedAudioOutput (Private)
+- (void) renderSlicesInThread;
+@end
+
+static void *
+renderThreadEntry(void *arg)
+{
+	[(QueuedAudioOutput *)arg renderSlicesInThread];
+	return NULL;
+}
+
+@implementation QueuedAudioOutput
+
+- (id) initWithSampleRate:(Float64)sampleRate paced:(BOOL)paced
+{
+	NSParameterAssert(0 < sampleRate);
+	
+	if((self = [super init])) {
+		_sampleRate			= sampleRate;
+		_paced				= paced;
+		
+		_queueCapacity		= INITIAL_QUEUE_CAPACITY;
+		_queue				= calloc(_queueCapacity, sizeof(ScheduledAudioSlice *));
+		NSAssert(NULL != _queue, @"Unable to allocate memory");
+		
+		pthread_mutex_init(&_mutex, NULL);
+		pthread_cond_init(&_condition, NULL);
+		
+		// The thread doesn't retain this object, so it can be stopped in dealloc
+		_keepRendering = YES;
+		if(0 != pthread_create(&_thread, NULL, renderThreadEntry, self)) {
+			NSLog(@"QueuedAudioOutput: Unable to create render thread");
+			_keepRendering = NO;
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(_keepRendering) {
+		pthread_mutex_lock(&_mutex);
+		_keepRendering = NO;
+		pthread_cond_broadcast(&_condition);
+		pthread_mutex_unlock(&_mutex);
+		
+		pthread_join(_thread, NULL);
+	}
+	
+	pthread_cond_destroy(&_condition);
+	pthread_mutex_destroy(&_mutex);
+	
+	free(_queue), _queue = NULL;
+	
+	[super dealloc];
+}
+
+- (Float64)			sampleRate						{ return _sampleRate; }
+- (BOOL)			isPaced							{ return _paced; }
+- (unsigned)		underrunCount					{ return _underrunCount; }
+
+- (void) renderSlice:(const ScheduledAudioSlice *)slice
+{}
+
+- (void) didReset
+{}
+
+#pragma mark AudioOutputMethods
+
+- (OSStatus) scheduleAudioSlice:(ScheduledAudioSlice *)slice
+{
+	NSParameterAssert(NULL != slice);
+	
+	pthread_mutex_lock(&_mutex);
+	
+	if(_queueCount == _queueCapacity) {
+		ScheduledAudioSlice		**queue		= calloc(2 * _queueCapacity, sizeof(ScheduledAudioSlice *));
+		unsigned				i;
+		
+		NSAssert(NULL != queue, @"Unable to allocate memory");
+		
+		for(i = 0; i < _queueCount; ++i)
+			queue[i] = _queue[(_queueHead + i) % _queueCapacity];
+		
+		free(_queue);
+		_queue			= queue;
+		_queueHead		= 0;
+		_queueCapacity	*= 2;
+	}
+	
+	_queue[(_queueHead + _queueCount) % _queueCapacity] = slice;
+	++_queueCount;
+	
+	pthread_cond_broadcast(&_condition);
+	pthread_mutex_unlock(&_mutex);
+	
+	return noErr;
+}
+
+- (OSStatus) setScheduleStartTimeStamp:(AudioTimeStamp)timeStamp
+{
+	pthread_mutex_lock(&_mutex);
+	
+	_started		= YES;
+	_startTime		= current_time();
+	
+	pthread_cond_broadcast(&_condition);
+	pthread_mutex_unlock(&_mutex);
+	
+	return noErr;
+}
+
+- (OSStatus) reset
+{
+	pthread_mutex_lock(&_mutex);
+	
+	++_generation;
+	
+	_queueHead			= 0;
+	_queueCount			= 0;
+	_started			= NO;
+	_framesRendered		= 0;
+	
+	// Don't return while the render thread is still using a discarded slice
+	pthread_cond_broadcast(&_condition);
+	while(_renderingSlice)
+		pthread_cond_wait(&_condition, &_mutex);
+	
+	pthread_mutex_unlock(&_mutex);
+	
+	[self didReset];
+	
+	return noErr;
+}
+
+- (AudioTimeStamp) currentPlayTime
+{
+	AudioTimeStamp timeStamp = { 0 };
+	
+	timeStamp.mFlags		= kAudioTimeStampSampleTimeValid;
+	timeStamp.mSampleTime	= -1;
+	
+	pthread_mutex_lock(&_mutex);
+	
+	if(_started) {
+		timeStamp.mSampleTime = _framesRendered;
+		
+		// A paced output is partway through its current slice
+		if(_paced && 0 < _queueCount) {
+			SInt64 elapsedFrames = (SInt64)((current_time() - _startTime) * _sampleRate);
+			if(elapsedFrames > _framesRendered)
+				timeStamp.mSampleTime = (elapsedFrames < _framesRendered + _queue[_queueHead]->mNumberFrames ? elapsedFrames : _framesRendered + _queue[_queueHead]->mNumberFrames);
+		}
+	}
+	
+	pthread_mutex_unlock(&_mutex);
+	
+	return timeStamp;
+}
+
+@end
+
+@implementation QueuedAudioOutput (Private)
+
+- (void) renderSlicesInThread
+{
+	pthread_mutex_lock(&_mutex);
+	
+	while(_keepRendering) {
+		if(NO == _started || 0 == _queueCount) {
+			pthread_cond_wait(&_condition, &_mutex);
+			continue;
+		}
+		
+		ScheduledAudioSlice		*slice			= _queue[_queueHead];
+		unsigned				generation		= _generation;
+		
+		if(_paced) {
+			double	sliceStart	= _startTime + (_framesRendered / _sampleRate);
+			double	now			= current_time();
+			
+			// Resume the clock from here rather than rushing to catch up
+			if(now > sliceStart + UNDERRUN_TOLERANCE) {
+				slice->mFlags |= kScheduledAudioSliceFlag_BeganToRenderLate;
+				++_underrunCount;
+				_startTime = now - (_framesRendered / _sampleRate);
+			}
+		}
+		
+		_renderingSlice = YES;
+		pthread_mutex_unlock(&_mutex);
+		
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		[self renderSlice:slice];
+		[pool release];
+		
+		pthread_mutex_lock(&_mutex);
+		
+		// Paced outputs hold each slice until its audio would have finished playing
+		if(_paced) {
+			double				deadline	= _startTime + ((_framesRendered + slice->mNumberFrames) / _sampleRate);
+			struct timespec		ts			= timespec_for_time(deadline);
+			
+			while(_keepRendering && generation == _generation && current_time() < deadline)
+				pthread_cond_timedwait(&_condition, &_mutex, &ts);
+		}
+		
+		_renderingSlice = NO;
+		
+		// The slice was discarded by a reset while it was being rendered
+		if(generation != _generation) {
+			pthread_cond_broadcast(&_condition);
+			continue;
+		}
+		
+		if(NO == _keepRendering)
+			break;
+		
+		_queueHead = (_queueHead + 1) % _queueCapacity;
+		--_queueCount;
+		_framesRendered += slice->mNumberFrames;
+		
+		pthread_mutex_unlock(&_mutex);
+		
+		slice->mFlags |= kScheduledAudioSliceFlag_Complete;
+		if(NULL != slice->mCompletionProc)
+			slice->mCompletionProc(slice->mCompletionProcUserData, slice);
+		
+		pthread_mutex_lock(&_mutex);
+	}
+	
+	pthread_mutex_unlock(&_mutex);
+}
+
+@end
@@ -0,0 +1,104 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ScheduledSoundPlayerOutput.h"
+
+@implementation ScheduledSoundPlayerOutput
+
++ (id) outputWithAudioUnit:(AudioUnit)audioUnit
+{
+	return [[[ScheduledSoundPlayerOutput alloc] initWithAudioUnit:audioUnit] autorelease];
+}
+
+- (id) initWithAudioUnit:(AudioUnit)audioUnit
+{
+	NSParameterAssert(NULL != audioUnit);
+	
+	if((self = [super init])) {
+		// Ensure the audio unit is a ScheduledSoundPlayer
+		ComponentDescription componentDescription;
+		ComponentResult err = GetComponentInfo((Component)audioUnit,
+											   &componentDescription,
+											   NULL,
+											   NULL,
+											   NULL);
+		if(noErr != err || 
+		   kAudioUnitType_Generator != componentDescription.componentType || 
+		   kAudioUnitSubType_ScheduledSoundPlayer != componentDescription.componentSubType) {
+			NSLog(@"Illegal audio unit passed to initWithAudioUnit");
+			[self release];
+			return nil;
+		}
+		
+		_audioUnit = audioUnit;
+	}
+	return self;
+}
+
+- (AudioUnit) audioUnit
+{
+	return _audioUnit;
+}
+
+- (OSStatus) scheduleAudioSlice:(ScheduledAudioSlice *)slice
+{
+	NSParameterAssert(NULL != slice);
+	
+	return AudioUnitSetProperty([self audioUnit],
+								kAudioUnitProperty_ScheduleAudioSlice, 
+								kAudioUnitScope_Global, 
+								0,
+								slice, 
+								sizeof(ScheduledAudioSlice));
+}
+
+- (OSStatus) setScheduleStartTimeStamp:(AudioTimeStamp)timeStamp
+{
+	return AudioUnitSetProperty([self audioUnit],
+								kAudioUnitProperty_ScheduleStartTimeStamp, 
+								kAudioUnitScope_Global, 
+								0,
+								&timeStamp, 
+								sizeof(timeStamp));
+}
+
+- (OSStatus) reset
+{
+	return AudioUnitReset([self audioUnit], kAudioUnitScope_Global, 0);
+}
+
+- (AudioTimeStamp) currentPlayTime
+{
+	AudioTimeStamp		timeStamp	= { 0 };
+	UInt32				dataSize	= sizeof(AudioTimeStamp);
+	ComponentResult		result		= AudioUnitGetProperty([self audioUnit],
+														   kAudioUnitProperty_CurrentPlayTime,
+														   kAudioUnitScope_Global,
+														   0,
+														   &timeStamp,
+														   &dataSize);
+	
+	if(noErr != result)
+		NSLog(@"Unable to query kAudioUnitProperty_CurrentPlayTime");
+	
+	return timeStamp;
+}
+
+@end
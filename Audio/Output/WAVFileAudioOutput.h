@@ -0,0 +1,44 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "QueuedAudioOutput.h"
+
+#include <stdio.h>
+
+// An output that writes its audio to a 32-bit float WAVE file as fast as it is scheduled
+@interface WAVFileAudioOutput : QueuedAudioOutput
+{
+	FILE				*_file;
+	UInt32				_channelsPerFrame;
+	UInt32				_framesWritten;
+	
+	float				*_interleavedBuffer;
+	UInt32				_interleavedBufferFrames;
+}
+
++ (id) outputWithURL:(NSURL *)url format:(AudioStreamBasicDescription)format;
+
+// Only the sample rate and number of channels in format are used
+- (id) initWithURL:(NSURL *)url format:(AudioStreamBasicDescription)format;
+
+// Finish the file's header and close it; no further audio is written
+- (void) close;
+
+@end
@@ -0,0 +1,150 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "WAVFileAudioOutput.h"
+
+#define WAVE_FORMAT_IEEE_FLOAT			3
+
+static void
+write_uint16_le(FILE *file, UInt16 value)
+{
+	unsigned char bytes [2] = { value & 0xFF, (value >> 8) & 0xFF };
+	fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void
+write_uint32_le(FILE *file, UInt32 value)
+{
+	unsigned char bytes [4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF };
+	fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+// The fmt chunk carries cbSize and a fact chunk follows, as required for non-PCM formats
+static void
+write_header(FILE *file, UInt32 sampleRate, UInt16 channels, UInt32 frames)
+{
+	UInt32 dataSize = frames * channels * sizeof(float);
+	
+	rewind(file);
+	
+	fwrite("RIFF", 1, 4, file);
+	write_uint32_le(file, 50 + dataSize);
+	fwrite("WAVE", 1, 4, file);
+	
+	fwrite("fmt ", 1, 4, file);
+	write_uint32_le(file, 18);
+	write_uint16_le(file, WAVE_FORMAT_IEEE_FLOAT);
+	write_uint16_le(file, channels);
+	write_uint32_le(file, sampleRate);
+	write_uint32_le(file, sampleRate * channels * sizeof(float));
+	write_uint16_le(file, channels * sizeof(float));
+	write_uint16_le(file, 8 * sizeof(float));
+	write_uint16_le(file, 0);
+	
+	fwrite("fact", 1, 4, file);
+	write_uint32_le(file, 4);
+	write_uint32_le(file, frames);
+	
+	fwrite("data", 1, 4, file);
+	write_uint32_le(file, dataSize);
+}
+
+@implementation WAVFileAudioOutput
+
++ (id) outputWithURL:(NSURL *)url format:(AudioStreamBasicDescription)format
+{
+	return [[[WAVFileAudioOutput alloc] initWithURL:url format:format] autorelease];
+}
+
+- (id) initWithURL:(NSURL *)url format:(AudioStreamBasicDescription)format
+{
+	NSParameterAssert(nil != url);
+	NSParameterAssert([url isFileURL]);
+	NSParameterAssert(0 < format.mChannelsPerFrame);
+	
+	if((self = [super initWithSampleRate:format.mSampleRate paced:NO])) {
+		_channelsPerFrame	= format.mChannelsPerFrame;
+		_file				= fopen([[url path] fileSystemRepresentation], "w+b");
+		
+		if(NULL == _file) {
+			NSLog(@"WAVFileAudioOutput: Unable to open %@", [url path]);
+			[self release];
+			return nil;
+		}
+		
+		// The sizes are filled in when the file is closed
+		write_header(_file, (UInt32)format.mSampleRate, _channelsPerFrame, 0);
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[self close];
+	
+	free(_interleavedBuffer), _interleavedBuffer = NULL;
+	
+	[super dealloc];
+}
+
+- (void) close
+{
+	if(NULL == _file)
+		return;
+	
+	// Stop the render thread from writing any more audio
+	[self reset];
+	
+	write_header(_file, (UInt32)[self sampleRate], _channelsPerFrame, _framesWritten);
+	fclose(_file), _file = NULL;
+}
+
+- (void) renderSlice:(const ScheduledAudioSlice *)slice
+{
+	if(NULL == _file || _channelsPerFrame != slice->mBufferList->mNumberBuffers)
+		return;
+	
+	UInt32		frameCount		= slice->mNumberFrames;
+	UInt32		frame, channel;
+	
+	if(_interleavedBufferFrames < frameCount) {
+		free(_interleavedBuffer);
+		_interleavedBuffer			= calloc(frameCount * _channelsPerFrame, sizeof(float));
+		_interleavedBufferFrames	= frameCount;
+		NSAssert(NULL != _interleavedBuffer, @"Unable to allocate memory");
+	}
+	
+	for(channel = 0; channel < _channelsPerFrame; ++channel) {
+		const float *input = (const float *)slice->mBufferList->mBuffers[channel].mData;
+		for(frame = 0; frame < frameCount; ++frame)
+			_interleavedBuffer[(frame * _channelsPerFrame) + channel] = input[frame];
+	}
+	
+	// WAVE files are little-endian
+#if __BIG_ENDIAN__
+	UInt32 *samples = (UInt32 *)_interleavedBuffer;
+	for(frame = 0; frame < frameCount * _channelsPerFrame; ++frame)
+		samples[frame] = CFSwapInt32HostToLittle(samples[frame]);
+#endif
+	
+	_framesWritten += fwrite(_interleavedBuffer, _channelsPerFrame * sizeof(float), frameCount, _file);
+}
+
+@end
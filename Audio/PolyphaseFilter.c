@@ -0,0 +1,222 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "PolyphaseFilter.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__APPLE__)
+#  include <Accelerate/Accelerate.h>
+#endif
+
+// Taps per polyphase branch for a 1:1 bandwidth ratio; downsampling scales this up
+#define TAPS_PER_PHASE					64
+#define MAXIMUM_TAPS_PER_PHASE			512
+
+// Larger rational ratios would produce unreasonably large filter banks
+#define MAXIMUM_PHASES					4096
+
+// Kaiser window design target, in dB
+#define STOPBAND_ATTENUATION			90.0
+
+struct PolyphaseFilter {
+	unsigned	upsamplingFactor;
+	unsigned	downsamplingFactor;
+	unsigned	tapsPerPhase;
+	float		*filterBank;						// upsamplingFactor branches of tapsPerPhase taps
+};
+
+static unsigned
+greatest_common_divisor(unsigned a, unsigned b)
+{
+	while(0 != b) {
+		unsigned t = b;
+		b = a % b;
+		a = t;
+	}
+	return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind
+static double
+bessel_i0(double x)
+{
+	double	sum		= 1.0;
+	double	term	= 1.0;
+	double	half	= x / 2.0;
+	unsigned k;
+
+	for(k = 1; k < 64; ++k) {
+		term *= (half / k) * (half / k);
+		sum += term;
+		if(term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+// Build the polyphase filter bank for a prototype lowpass at upsamplingFactor times the source rate
+// Each branch is stored in reverse order so it can be applied to the input history with a single dot product
+static float *
+create_filter_bank(unsigned upsamplingFactor, unsigned downsamplingFactor, unsigned tapsPerPhase)
+{
+	unsigned	length		= upsamplingFactor * tapsPerPhase;
+	double		*prototype	= calloc(length, sizeof(double));
+	float		*filterBank	= calloc(length, sizeof(float));
+	
+	if(NULL == prototype || NULL == filterBank) {
+		free(prototype);
+		free(filterBank);
+		return NULL;
+	}
+	
+	// The transition band is placed just below the Nyquist frequency of the lower of the two rates
+	double	bandwidth		= (upsamplingFactor < downsamplingFactor ? (double)upsamplingFactor / downsamplingFactor : 1.0);
+	double	transition		= (STOPBAND_ATTENUATION - 7.95) / (14.36 * tapsPerPhase);
+	double	cutoff			= bandwidth * (0.5 - (transition / 2.0)) / upsamplingFactor;
+	double	beta			= 0.1102 * (STOPBAND_ATTENUATION - 8.7);
+	double	center			= (length - 1) / 2.0;
+	double	i0Beta			= bessel_i0(beta);
+	double	sum				= 0;
+	unsigned n, phase, tap;
+	
+	for(n = 0; n < length; ++n) {
+		double x		= n - center;
+		double sinc		= (0 == x ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x));
+		double r		= (2.0 * n) / (length - 1) - 1.0;
+		double window	= bessel_i0(beta * sqrt(1.0 - (r * r))) / i0Beta;
+		
+		prototype[n]	= sinc * window;
+		sum				+= prototype[n];
+	}
+	
+	// Normalize for unity passband gain in each branch
+	for(phase = 0; phase < upsamplingFactor; ++phase) {
+		for(tap = 0; tap < tapsPerPhase; ++tap)
+			filterBank[(phase * tapsPerPhase) + tap] = (float)(prototype[phase + ((tapsPerPhase - 1 - tap) * upsamplingFactor)] * upsamplingFactor / sum);
+	}
+	
+	free(prototype);
+	
+	return filterBank;
+}
+
+PolyphaseFilter *
+polyphase_filter_create(unsigned sourceSampleRate, unsigned sampleRate)
+{
+	if(0 == sourceSampleRate || 0 == sampleRate || sourceSampleRate == sampleRate)
+		return NULL;
+	
+	unsigned divisor				= greatest_common_divisor(sampleRate, sourceSampleRate);
+	unsigned upsamplingFactor		= sampleRate / divisor;
+	unsigned downsamplingFactor		= sourceSampleRate / divisor;
+	
+	if(MAXIMUM_PHASES < upsamplingFactor)
+		return NULL;
+	
+	PolyphaseFilter *filter = calloc(1, sizeof(PolyphaseFilter));
+	if(NULL == filter)
+		return NULL;
+	
+	filter->upsamplingFactor	= upsamplingFactor;
+	filter->downsamplingFactor	= downsamplingFactor;
+	
+	// Keep the transition band the same width in the output when downsampling
+	filter->tapsPerPhase = TAPS_PER_PHASE;
+	if(downsamplingFactor > upsamplingFactor)
+		filter->tapsPerPhase = (unsigned)ceil((double)TAPS_PER_PHASE * downsamplingFactor / upsamplingFactor);
+	if(MAXIMUM_TAPS_PER_PHASE < filter->tapsPerPhase)
+		filter->tapsPerPhase = MAXIMUM_TAPS_PER_PHASE;
+	
+	filter->filterBank = create_filter_bank(upsamplingFactor, downsamplingFactor, filter->tapsPerPhase);
+	if(NULL == filter->filterBank) {
+		polyphase_filter_destroy(filter);
+		return NULL;
+	}
+	
+	return filter;
+}
+
+void
+polyphase_filter_destroy(PolyphaseFilter *filter)
+{
+	if(NULL == filter)
+		return;
+	
+	free(filter->filterBank);
+	free(filter);
+}
+
+unsigned
+polyphase_filter_upsampling_factor(const PolyphaseFilter *filter)
+{
+	return filter->upsamplingFactor;
+}
+
+unsigned
+polyphase_filter_downsampling_factor(const PolyphaseFilter *filter)
+{
+	return filter->downsamplingFactor;
+}
+
+unsigned
+polyphase_filter_taps_per_phase(const PolyphaseFilter *filter)
+{
+	return filter->tapsPerPhase;
+}
+
+size_t
+polyphase_filter_apply(const PolyphaseFilter *filter, const float *input, size_t inputFrames, size_t *inputIndex, unsigned *phase, float *output, size_t frameCount)
+{
+	unsigned	taps			= filter->tapsPerPhase;
+	size_t		index			= *inputIndex;
+	unsigned	currentPhase	= *phase;
+	size_t		framesWritten	= 0;
+	
+	while(framesWritten < frameCount && index < inputFrames) {
+		const float *branch		= filter->filterBank + (currentPhase * taps);
+		const float *history	= input + index - (taps - 1);
+		
+#if defined(__APPLE__)
+		vDSP_dotpr(branch, 1, history, 1, output + framesWritten, taps);
+#else
+		float		sum = 0;
+		unsigned	tap;
+		
+		for(tap = 0; tap < taps; ++tap)
+			sum += branch[tap] * history[tap];
+		
+		output[framesWritten] = sum;
+#endif
+		
+		++framesWritten;
+		
+		currentPhase	+= filter->downsamplingFactor;
+		index			+= currentPhase / filter->upsamplingFactor;
+		currentPhase	%= filter->upsamplingFactor;
+	}
+	
+	*inputIndex		= index;
+	*phase			= currentPhase;
+	
+	return framesWritten;
+}
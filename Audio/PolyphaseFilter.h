@@ -0,0 +1,57 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef POLYPHASEFILTER_H
+#define POLYPHASEFILTER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// Sample rate conversion by an exact rational ratio
+// A Kaiser-windowed sinc prototype is split into one branch per output phase;
+// each output sample is the dot product of one branch with the input history
+// ========================================
+
+typedef struct PolyphaseFilter PolyphaseFilter;
+
+// Returns NULL if the rates are not related by a usable ratio or memory could not be allocated
+PolyphaseFilter * polyphase_filter_create(unsigned sourceSampleRate, unsigned sampleRate);
+void polyphase_filter_destroy(PolyphaseFilter *filter);
+
+// sampleRate / sourceSampleRate, reduced to lowest terms
+unsigned polyphase_filter_upsampling_factor(const PolyphaseFilter *filter);
+unsigned polyphase_filter_downsampling_factor(const PolyphaseFilter *filter);
+
+// Each output sample reads the input at its index and the (taps - 1) samples before it
+unsigned polyphase_filter_taps_per_phase(const PolyphaseFilter *filter);
+
+// Writes up to frameCount samples of one channel, stopping when inputIndex reaches inputFrames
+// inputIndex and phase give the position of the next output sample and are advanced past it
+size_t polyphase_filter_apply(const PolyphaseFilter *filter, const float *input, size_t inputFrames, size_t *inputIndex, unsigned *phase, float *output, size_t frameCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POLYPHASEFILTER_H */
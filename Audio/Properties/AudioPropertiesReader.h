@@ -41,6 +41,7 @@ enum {
 {
 	NSURL							*_url;
 	NSDictionary					*_properties;
+	NSDictionary					*_metadata;
 }
 
 + (AudioPropertiesReader *)			propertiesReaderForURL:(NSURL *)url error:(NSError **)error;
@@ -50,4 +51,7 @@ enum {
 - (NSDictionary *)					properties;
 - (NSDictionary *)					cueSheet;
 
+// Metadata read in the same pass as the properties, or nil if the reader doesn't support this
+- (NSDictionary *)					metadata;
+
 @end
@@ -30,6 +30,7 @@
 
 #import "AudioStream.h"
 #import "UtilityFunctions.h"
+#import "StringInterning.h"
 
 NSString *const AudioPropertiesCueSheetKey			= @"org.sbooth.Play.AudioPropertiesReader.CueSheet";
 NSString *const AudioPropertiesCueSheetTracksKey	= @"org.sbooth.Play.AudioPropertiesReader.CueSheet.Tracks";
@@ -137,6 +138,7 @@ NSString *const AudioPropertiesReaderErrorDomain	= @"org.sbooth.Play.ErrorDomain
 {
 	[_url release], _url = nil;
 	[_properties release], _properties = nil;
+	[_metadata release], _metadata = nil;
 
 	[super dealloc];
 }
@@ -145,5 +147,19 @@ NSString *const AudioPropertiesReaderErrorDomain	= @"org.sbooth.Play.ErrorDomain
 
 - (NSDictionary *)	properties								{ return [[_properties retain] autorelease]; }
 - (NSDictionary *)	cueSheet								{ return [_properties valueForKey:AudioPropertiesCueSheetKey]; }
+- (NSDictionary *)	metadata								{ return [[_metadata retain] autorelease]; }
+
+// Readers store their results through KVC, so values are interned once here instead of on every access
+- (void) setProperties:(NSDictionary *)properties
+{
+	[_properties release];
+	_properties = [internStreamValues(properties) retain];
+}
+
+- (void) setMetadata:(NSDictionary *)metadata
+{
+	[_metadata release];
+	_metadata = [internStreamValues(metadata) retain];
+}
 
 @end
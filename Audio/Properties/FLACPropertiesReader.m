@@ -19,6 +19,7 @@
  */
 
 #import "FLACPropertiesReader.h"
+#import "FLACMetadataReader.h"
 #import "AudioStream.h"
 #include <FLAC/metadata.h>
 
@@ -174,10 +175,18 @@
 	} while(FLAC__metadata_iterator_next(iterator));
 	
 	FLAC__metadata_iterator_delete(iterator);
-	FLAC__metadata_chain_delete(chain);
 	
 	[self setValue:propertiesDictionary forKey:@"properties"];
 
+	// The chain contains the Vorbis comments as well, so read the metadata now instead of parsing the file again
+	FLACMetadataReader *metadataReader = [[FLACMetadataReader alloc] init];
+	[metadataReader setValue:_url forKey:StreamURLKey];
+	if([metadataReader readMetadataFromChain:chain error:nil])
+		[self setValue:[metadataReader metadata] forKey:@"metadata"];
+	[metadataReader release];
+
+	FLAC__metadata_chain_delete(chain);
+
 	return YES;
 }
 
@@ -19,6 +19,7 @@
  */
 
 #import "OggFLACPropertiesReader.h"
+#import "OggFLACMetadataReader.h"
 #import "AudioStream.h"
 #include <FLAC/stream_decoder.h>
 #include <FLAC/metadata.h>
@@ -47,6 +48,35 @@ metadataCallback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata
 			[source setValue:[NSNumber numberWithLongLong:metadata->data.stream_info.total_samples] forKeyPath:@"localProperties.totalFrames"];
 			break;
 			
+		// Rebuild the Vorbis comment header so the metadata reader doesn't have to parse the file again
+		case FLAC__METADATA_TYPE_VORBIS_COMMENT:
+		{
+			const FLAC__StreamMetadata_VorbisComment	*comment		= &(metadata->data.vorbis_comment);
+			NSMutableData								*header			= [NSMutableData data];
+			FLAC__uint32								length;
+			unsigned									i;
+			
+			length = OSSwapHostToLittleInt32(comment->vendor_string.length);
+			[header appendBytes:&length length:sizeof(length)];
+			[header appendBytes:comment->vendor_string.entry length:comment->vendor_string.length];
+			
+			length = OSSwapHostToLittleInt32(comment->num_comments);
+			[header appendBytes:&length length:sizeof(length)];
+			
+			for(i = 0; i < comment->num_comments; ++i) {
+				length = OSSwapHostToLittleInt32(comment->comments[i].length);
+				[header appendBytes:&length length:sizeof(length)];
+				[header appendBytes:comment->comments[i].entry length:comment->comments[i].length];
+			}
+			
+			OggFLACMetadataReader *metadataReader = [[OggFLACMetadataReader alloc] init];
+			[metadataReader setValue:[source valueForKey:StreamURLKey] forKey:StreamURLKey];
+			if([metadataReader readMetadataFromCommentHeader:header error:nil])
+				[source setValue:[metadataReader metadata] forKey:@"metadata"];
+			[metadataReader release];
+			break;
+		}
+			
 			/*
 			 case FLAC__METADATA_TYPE_CUESHEET:
 				 cueSheet = &(metadata->data.cue_sheet);
@@ -100,6 +130,10 @@ errorCallback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus
 	flac		= FLAC__stream_decoder_new();
 	NSAssert(NULL != flac, @"Unable to create the Ogg FLAC decoder.");
 	
+	// The Vorbis comments supply the metadata
+	result		= FLAC__stream_decoder_set_metadata_respond(flac, FLAC__METADATA_TYPE_VORBIS_COMMENT);
+	NSAssert(YES == result, @"FLAC__stream_decoder_set_metadata_respond failed.");
+	
 	// Initialize decoder
 	status		= FLAC__stream_decoder_init_ogg_file(flac, 
 													 [path fileSystemRepresentation],
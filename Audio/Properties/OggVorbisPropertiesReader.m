@@ -19,6 +19,7 @@
  */
 
 #import "OggVorbisPropertiesReader.h"
+#import "OggVorbisMetadataReader.h"
 #import "AudioStream.h"
 #include <ogg/os_types.h>
 #include <ogg/ogg.h>
@@ -92,6 +93,18 @@
 	
 	[self setValue:propertiesDictionary forKey:@"properties"];
 	
+	// The comment header was read along with the stream information, so read the metadata now instead of parsing the file again
+	ogg_packet commentPacket;
+	if(0 == vorbis_commentheader_out(ov_comment(&vf, -1), &commentPacket) && 7 < commentPacket.bytes) {
+		OggVorbisMetadataReader *metadataReader = [[OggVorbisMetadataReader alloc] init];
+		[metadataReader setValue:[self valueForKey:StreamURLKey] forKey:StreamURLKey];
+		if([metadataReader readMetadataFromCommentHeader:[NSData dataWithBytes:commentPacket.packet + 7 length:commentPacket.bytes - 7] error:nil])
+			[self setValue:[metadataReader metadata] forKey:@"metadata"];
+		[metadataReader release];
+		
+		ogg_packet_clear(&commentPacket);
+	}
+	
 	result = ov_clear(&vf);
 	NSAssert(0 == result, NSLocalizedStringFromTable(@"Unable to close the input file.", @"Errors", @""));
 	
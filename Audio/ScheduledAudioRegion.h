@@ -23,11 +23,14 @@
 
 #import "AudioDecoderMethods.h"
 
+@class AudioScheduler;
+
 // A class encapsulating an AudioDecoder and the buffers and associated internal state that 
 // AudioScheduler needs to use a decoder
 @interface ScheduledAudioRegion : NSObject
 {
 	id <AudioDecoderMethods>	_decoder;
+	AudioScheduler				*_scheduler;		// Not retained
 	BOOL						_atEnd;
 	
 	AudioTimeStamp				_startTime;
@@ -39,6 +42,11 @@
 
 	SInt64						_framesScheduled;
 	SInt64						_framesRendered;
+	
+	SInt64						_leadInFrames;
+	
+	float						_gain;
+	SInt64						_pregapFrameCount;
 }	
 
 + (ScheduledAudioRegion *) scheduledAudioRegionWithDecoder:(id <AudioDecoderMethods>)decoder;
@@ -52,6 +60,18 @@
 
 - (BOOL) atEnd;
 
+// The scheduler this region was scheduled with
+- (AudioScheduler *) scheduler;
+- (void) setScheduler:(AudioScheduler *)scheduler;
+
+// The gain (in dB) applied to this region's audio while it is scheduled
+- (float) gain;
+- (void) setGain:(float)gain;
+
+// Frames at the start of the region that precede the track itself (a cue sheet pregap)
+- (SInt64) pregapFrameCount;
+- (void) setPregapFrameCount:(SInt64)pregapFrameCount;
+
 - (AudioTimeStamp) startTime;
 - (void) setStartTime:(AudioTimeStamp)startTime;
 
@@ -70,6 +90,11 @@
 
 - (UInt32) readAudioInSlice:(unsigned)sliceIndex;
 
+// Audio from the start of the region that was mixed into the end of the preceding region
+- (SInt64) leadInFrames;
+- (UInt32) readLeadInAudioInSlice:(unsigned)sliceIndex frameCount:(UInt32)frameCount;
+- (void) rewindLeadIn;
+
 - (ScheduledAudioSlice *) buffer;
 - (ScheduledAudioSlice *) sliceAtIndex:(unsigned)sliceIndex;
 
@@ -182,6 +182,15 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, unsigned numberOfSlicesInBu
 	_startTime = startTime;
 }
 
+- (float)			gain									{ return _gain; }
+- (void)			setGain:(float)gain						{ _gain = gain; }
+
+- (SInt64)			pregapFrameCount						{ return _pregapFrameCount; }
+- (void)			setPregapFrameCount:(SInt64)pregapFrameCount	{ _pregapFrameCount = pregapFrameCount; }
+
+- (AudioScheduler *)	scheduler							{ return _scheduler; }
+- (void)			setScheduler:(AudioScheduler *)scheduler	{ _scheduler = scheduler; }
+
 - (id <AudioDecoderMethods>)	decoder						{ return [[_decoder retain] autorelease]; }
 
 - (void) setDecoder:(id <AudioDecoderMethods>)decoder
@@ -249,6 +258,30 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, unsigned numberOfSlicesInBu
 	return framesRead;
 }
 
+- (SInt64)			leadInFrames							{ return _leadInFrames; }
+
+- (UInt32) readLeadInAudioInSlice:(unsigned)sliceIndex frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(sliceIndex < [self numberOfSlicesInBuffer]);
+	NSParameterAssert(0 < frameCount && frameCount <= [self numberOfFramesPerSlice]);
+	
+	clear_buffer_list(_sliceBuffer[sliceIndex].mBufferList, [self numberOfFramesPerSlice]);
+	
+	UInt32 framesRead = [[self decoder] readAudio:_sliceBuffer[sliceIndex].mBufferList frameCount:frameCount];
+	_leadInFrames += framesRead;
+	
+	return framesRead;
+}
+
+- (void) rewindLeadIn
+{
+	if(0 == _leadInFrames)
+		return;
+	
+	[[self decoder] seekToFrame:0];
+	_leadInFrames = 0;
+}
+
 - (ScheduledAudioSlice *) buffer
 {
 	return _sliceBuffer;
@@ -0,0 +1,157 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TruePeakMeter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__APPLE__)
+#  include <Accelerate/Accelerate.h>
+#endif
+
+#define PHASE_COUNT			4
+#define TAPS_PER_PHASE		12
+#define HISTORY_LENGTH		(TAPS_PER_PHASE - 1)
+#define CHUNK_LENGTH		4096
+
+// The interpolation filter from ITU-R BS.1770-4 Annex 2, split into its four phases
+static const float sPhases [PHASE_COUNT][TAPS_PER_PHASE] = {
+	{  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,
+	   0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+	{ -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,
+	   0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+	{ -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,
+	   0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+	{ -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,
+	   0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f }
+};
+
+struct TruePeakMeter {
+	unsigned	channelCount;
+	float		*history;							// HISTORY_LENGTH samples per channel
+	float		*input;								// HISTORY_LENGTH + CHUNK_LENGTH samples
+	float		*output;							// CHUNK_LENGTH samples
+	float		peak;
+};
+
+// Returns the largest magnitude of one phase of the interpolated signal
+// input holds HISTORY_LENGTH samples of history followed by frameCount new samples
+static float
+interpolated_peak(const float *input, float *output, const float *taps, size_t frameCount)
+{
+	float peak = 0;
+	
+#if defined(__APPLE__)
+	// With a negative filter stride vDSP_conv computes a true convolution
+	vDSP_conv(input, 1, taps + TAPS_PER_PHASE - 1, -1, output, 1, frameCount, TAPS_PER_PHASE);
+	vDSP_maxmgv(output, 1, &peak, frameCount);
+#else
+	size_t		i;
+	unsigned	k;
+	
+	for(i = 0; i < frameCount; ++i) {
+		float sum = 0;
+		for(k = 0; k < TAPS_PER_PHASE; ++k)
+			sum += taps[k] * input[i + HISTORY_LENGTH - k];
+		
+		output[i] = sum;
+		if(fabsf(sum) > peak)
+			peak = fabsf(sum);
+	}
+#endif
+	
+	return peak;
+}
+
+TruePeakMeter *
+true_peak_meter_create(unsigned channelCount)
+{
+	if(0 == channelCount)
+		return NULL;
+	
+	TruePeakMeter *meter = calloc(1, sizeof(TruePeakMeter));
+	if(NULL == meter)
+		return NULL;
+	
+	meter->channelCount		= channelCount;
+	meter->history			= calloc(HISTORY_LENGTH * channelCount, sizeof(float));
+	meter->input			= calloc(HISTORY_LENGTH + CHUNK_LENGTH, sizeof(float));
+	meter->output			= calloc(CHUNK_LENGTH, sizeof(float));
+	
+	if(NULL == meter->history || NULL == meter->input || NULL == meter->output) {
+		true_peak_meter_destroy(meter);
+		return NULL;
+	}
+	
+	return meter;
+}
+
+void
+true_peak_meter_destroy(TruePeakMeter *meter)
+{
+	if(NULL == meter)
+		return;
+	
+	free(meter->history);
+	free(meter->input);
+	free(meter->output);
+	free(meter);
+}
+
+void
+true_peak_meter_process(TruePeakMeter *meter, const float * const *channels, size_t frameCount)
+{
+	unsigned	channel;
+	unsigned	phase;
+	
+	for(channel = 0; channel < meter->channelCount; ++channel) {
+		const float		*samples	= channels[channel];
+		float			*history	= meter->history + (HISTORY_LENGTH * channel);
+		size_t			offset		= 0;
+		
+		while(offset < frameCount) {
+			size_t chunkLength = frameCount - offset;
+			if(CHUNK_LENGTH < chunkLength)
+				chunkLength = CHUNK_LENGTH;
+			
+			memcpy(meter->input, history, HISTORY_LENGTH * sizeof(float));
+			memcpy(meter->input + HISTORY_LENGTH, samples + offset, chunkLength * sizeof(float));
+			
+			for(phase = 0; phase < PHASE_COUNT; ++phase) {
+				float peak = interpolated_peak(meter->input, meter->output, sPhases[phase], chunkLength);
+				if(peak > meter->peak)
+					meter->peak = peak;
+			}
+			
+			// The most recent samples become the history for the next chunk
+			memcpy(history, meter->input + chunkLength, HISTORY_LENGTH * sizeof(float));
+			
+			offset += chunkLength;
+		}
+	}
+}
+
+float
+true_peak_meter_peak(const TruePeakMeter *meter)
+{
+	return meter->peak;
+}
@@ -0,0 +1,52 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef TRUEPEAKMETER_H
+#define TRUEPEAKMETER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// ITU-R BS.1770 true peak measurement
+// Each channel is upsampled 4x with a 48-tap polyphase FIR so peaks that fall
+// between samples are found; the result is never below the sample peak
+// ========================================
+
+typedef struct TruePeakMeter TruePeakMeter;
+
+// Returns NULL if memory could not be allocated
+TruePeakMeter * true_peak_meter_create(unsigned channelCount);
+void true_peak_meter_destroy(TruePeakMeter *meter);
+
+// channels holds one deinterleaved buffer of frameCount samples per channel
+void true_peak_meter_process(TruePeakMeter *meter, const float * const *channels, size_t frameCount);
+
+// The linear peak magnitude over all channels
+float true_peak_meter_peak(const TruePeakMeter *meter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRUEPEAKMETER_H */
@@ -27,6 +27,7 @@
 @class BrowserOutlineView, BrowserTreeController;
 @class BrowserNode;
 @class RBSplitView;
+@class ShuffleEngine;
 
 // ========================================
 // Notification Names
@@ -112,6 +113,13 @@ extern NSString * const		PlayQueueKey;
 	unsigned				_playbackIndex;
 	unsigned				_nextPlaybackIndex;
 	
+	ShuffleEngine			*_playQueueShuffle;
+	BOOL					_playQueueShuffleNeedsReset;
+	
+	ShuffleEngine			*_libraryShuffle;
+	NSMutableArray			*_libraryShuffleStreams;
+	NSMapTable				*_libraryShuffleIndexes;
+	
 	BOOL					_sentNextStreamRequest;
 	
 	BrowserNode				*_libraryNode;
@@ -134,6 +142,9 @@ extern NSString * const		PlayQueueKey;
 	NSMutableSet			*_playQueueTableVisibleColumns;
 	NSMutableSet			*_playQueueTableHiddenColumns;
 	NSMenu					*_playQueueTableHeaderContextMenu;
+	
+	NSString				*_windowTitle;				// Saved while tag writing progress is shown
+	NSMutableArray			*_metadataWriteErrors;		// Errors from the current batch of tag writes
 }
 
 // ========================================
@@ -53,6 +53,7 @@
 #import "AudioPropertiesReader.h"
 #import "AudioMetadataReader.h"
 #import "AudioMetadataWriter.h"
+#import "AudioMetadataWriteQueue.h"
 
 #import "PlaylistInformationSheet.h"
 #import "SmartPlaylistInformationSheet.h"
@@ -86,6 +87,8 @@
 
 #import "UtilityFunctions.h"
 #import "CueSheetParser.h"
+#import "ShuffleEngine.h"
+#import "AudioStreamSorting.h"
 
 #import "IconFamily.h"
 #import "ImageAndTextCell.h"
@@ -160,6 +163,36 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 #define PLAY_QUEUE_TABLE_COLUMNS_MENU_ITEM_INDEX	5
 #define STREAM_TABLE_COLUMNS_MENU_ITEM_INDEX		6
 
+// ========================================
+// The relative likelihood of a stream being chosen by weighted shuffle
+// ========================================
+static float
+shuffleWeightForStream(AudioStream *stream)
+{
+	unsigned	rating		= [[stream valueForKey:StatisticsRatingKey] unsignedIntValue];
+	unsigned	playCount	= [[stream valueForKey:StatisticsPlayCountKey] unsignedIntValue];
+	unsigned	skipCount	= [[stream valueForKey:StatisticsSkipCountKey] unsignedIntValue];
+	NSDate		*lastPlayed	= [stream valueForKey:StatisticsLastPlayedDateKey];
+	float		weight;
+	
+	// Unrated streams count as three stars
+	weight = (0 == rating ? 3 : rating);
+	
+	// Streams that are usually skipped come up less often
+	weight *= (playCount + 1.f) / (playCount + (2.f * skipCount) + 1.f);
+	
+	// Recently played streams recover over about a week
+	if(nil != lastPlayed) {
+		double daysSincePlayed = -[lastPlayed timeIntervalSinceNow] / (60 * 60 * 24);
+		if(0 < daysSincePlayed)
+			weight *= (float)(1 - (0.95 * exp(-daysSincePlayed / 7)));
+		else
+			weight *= 0.05f;
+	}
+	
+	return weight;
+}
+
 //#if MAC_OS_X_VERSION_MIN_REQUIRED <= MAC_OS_X_VERSION_10_4
 // ========================================
 // Completely bogus NSTreeController bindings hack (unnecessary on 10.5)
@@ -193,9 +226,17 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 
 - (void) setPlayQueueFromArray:(NSArray *)streams;
 
+- (unsigned) randomPlayQueueIndexExcludingIndex:(unsigned)index;
+
+- (ShuffleEngine *) libraryShuffle;
+- (void) addStreamToLibraryShuffle:(AudioStream *)stream;
+- (void) removeStreamFromLibraryShuffle:(AudioStream *)stream;
+- (void) updateLibraryShuffleWeightForStream:(AudioStream *)stream;
+
 - (void) addRandomTracksFromLibraryToPlayQueue:(unsigned)count;
 
 - (BOOL) addStreamsFromExternalCueSheet:(NSString *)filename;
+- (NSDictionary *) metadataForFile:(NSString *)filename propertiesReader:(AudioPropertiesReader *)propertiesReader error:(NSError **)error;
 
 - (void) updatePlayQueueHistory;
 
@@ -227,10 +268,14 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 - (void) streamsAdded:(NSNotification *)aNotification;
 - (void) streamRemoved:(NSNotification *)aNotification;
 - (void) streamsRemoved:(NSNotification *)aNotification;
+- (void) streamChanged:(NSNotification *)aNotification;
+- (void) streamsChanged:(NSNotification *)aNotification;
 
 - (void) watchFolderAdded:(NSNotification *)aNotification;
 - (void) watchFolderChanged:(NSNotification *)aNotification;
 
+- (void) metadataWritten:(NSNotification *)aNotification;
+
 @end
 
 @implementation AudioLibrary
@@ -440,6 +485,10 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 		_playbackIndex		= NSNotFound;
 		_nextPlaybackIndex	= NSNotFound;
 		
+		_playQueueShuffle	= [[ShuffleEngine alloc] init];
+		
+		_metadataWriteErrors	= [[NSMutableArray alloc] init];
+		
 		[[NSNotificationCenter defaultCenter] addObserver:self 
 												 selector:@selector(streamAdded:) 
 													 name:AudioStreamAddedToLibraryNotification
@@ -459,6 +508,16 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 												 selector:@selector(streamsRemoved:) 
 													 name:AudioStreamsRemovedFromLibraryNotification
 												   object:nil];
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(streamChanged:) 
+													 name:AudioStreamDidChangeNotification
+												   object:nil];
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(streamsChanged:) 
+													 name:AudioStreamsDidChangeNotification
+												   object:nil];
 
 		[[NSNotificationCenter defaultCenter] addObserver:self 
 												 selector:@selector(watchFolderAdded:) 
@@ -469,6 +528,11 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 												 selector:@selector(watchFolderChanged:) 
 													 name:WatchFolderDidChangeNotification
 												   object:nil];
+
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(metadataWritten:) 
+													 name:AudioMetadataWriteQueueDidWriteFileNotification
+												   object:nil];
 	}
 	return self;
 }
@@ -489,8 +553,17 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	[_playQueueTableHiddenColumns release], _playQueueTableHiddenColumns = nil;
 	[_playQueueTableHeaderContextMenu release], _playQueueTableHeaderContextMenu = nil;
 	
+	[_windowTitle release], _windowTitle = nil;
+	[_metadataWriteErrors release], _metadataWriteErrors = nil;
+	
 	[_playQueue release], _playQueue = nil;
 	
+	[_playQueueShuffle release], _playQueueShuffle = nil;
+	[_libraryShuffle release], _libraryShuffle = nil;
+	[_libraryShuffleStreams release], _libraryShuffleStreams = nil;
+	if(NULL != _libraryShuffleIndexes)
+		NSFreeMapTable(_libraryShuffleIndexes), _libraryShuffleIndexes = NULL;
+	
 	[_libraryNode release], _libraryNode = nil;
 	[_artistsNode release], _artistsNode = nil;
 	[_albumsNode release], _albumsNode = nil;
@@ -831,12 +904,8 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	NSDictionary *cueSheet = [propertiesReader cueSheet];
 	if(nil != cueSheet) {
 		// Read the metadata for the file as a whole
-		AudioMetadataReader *metadataReader	= [AudioMetadataReader metadataReaderForURL:[NSURL fileURLWithPath:filename] error:&error];
-		if(nil == metadataReader)
-			return NO;
-		
-		result = [metadataReader readMetadata:&error];
-		if(NO == result)
+		NSDictionary *metadata = [self metadataForFile:filename propertiesReader:propertiesReader error:&error];
+		if(nil == metadata)
 			return NO;
 
 		// Iterate through each track in the cue sheet, adding it to the library if required
@@ -851,7 +920,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 			// Create a dictionary containing all applicable keys for this stream
 			NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:[propertiesReader properties]];
 			[values addEntriesFromDictionary:cueSheetTrack];
-			[values addEntriesFromDictionary:[metadataReader metadata]];
+			[values addEntriesFromDictionary:metadata];
 			
 			// Insert the object in the database
 			stream = [AudioStream insertStreamForURL:[NSURL fileURLWithPath:filename] withInitialValues:values];
@@ -870,16 +939,12 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 			return YES;
 
 		// Read the metadata
-		AudioMetadataReader *metadataReader	= [AudioMetadataReader metadataReaderForURL:[NSURL fileURLWithPath:filename] error:&error];
-		if(nil == metadataReader)
-			return NO;
-		
-		result = [metadataReader readMetadata:&error];
-		if(NO == result)
+		NSDictionary *metadata = [self metadataForFile:filename propertiesReader:propertiesReader error:&error];
+		if(nil == metadata)
 			return NO;
 		
 		NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:[propertiesReader properties]];
-		[values addEntriesFromDictionary:[metadataReader metadata]];
+		[values addEntriesFromDictionary:metadata];
 		
 		// Insert the object in the database
 		stream = [AudioStream insertStreamForURL:[NSURL fileURLWithPath:filename] withInitialValues:values];
@@ -1146,16 +1211,14 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	
 	if(NO == [[self player] hasValidStream]) {
 		if(0 != [self countOfPlayQueue]) {
-			unsigned playIndex = ([self randomPlayback] ? (unsigned)(genrand_real2() * [self countOfPlayQueue]) : 0);			
+			unsigned playIndex = ([self randomPlayback] ? [self randomPlayQueueIndexExcludingIndex:NSNotFound] : 0);			
 			[self playStreamAtIndex:playIndex];
 		}
 		else if([self randomPlayback]) {
 			NSArray		*streams			= (1 < [[_streamController selectedObjects] count] ? [_streamController selectedObjects] : [_streamController arrangedObjects]);
-			double		randomNumber		= genrand_real2();
-			unsigned	randomIndex			= (unsigned)(randomNumber * [streams count]);
 			
 			[self setPlayQueueFromArray:streams];
-			[self playStreamAtIndex:randomIndex];
+			[self playStreamAtIndex:[self randomPlayQueueIndexExcludingIndex:NSNotFound]];
 		}
 		else {
 			[_streamTable addToPlayQueue:sender];
@@ -1279,15 +1342,8 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 		[self setPlaybackIndex:NSNotFound];
 		[self updatePlayButtonState];
 	}
-	else if([self randomPlayback]) {
-		double			randomNumber;
-		unsigned		randomIndex;
-		
-		randomNumber	= genrand_real2();
-		randomIndex		= (unsigned)(randomNumber * [streams count]);
-		
-		[self playStreamAtIndex:randomIndex];
-	}
+	else if([self randomPlayback])
+		[self playStreamAtIndex:[self randomPlayQueueIndexExcludingIndex:[self playbackIndex]]];
 	else if([self loopPlayback]) {
 		streamIndex = [self playbackIndex];
 		[self playStreamAtIndex:(streamIndex + 1 < [streams count] ? streamIndex + 1 : 0)];
@@ -1321,15 +1377,8 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	
 	if(nil == stream || 0 == [streams count])
 		[self setPlaybackIndex:NSNotFound];
-	else if([self randomPlayback]) {
-		double			randomNumber;
-		unsigned		randomIndex;
-		
-		randomNumber	= genrand_real2();
-		randomIndex		= (unsigned)(randomNumber * [streams count]);
-		
-		[self playStreamAtIndex:randomIndex];
-	}
+	else if([self randomPlayback])
+		[self playStreamAtIndex:[self randomPlayQueueIndexExcludingIndex:[self playbackIndex]]];
 	else if([self loopPlayback]) {
 		streamIndex = [self playbackIndex];		
 		[self playStreamAtIndex:(1 <= streamIndex ? streamIndex - 1 : [streams count] - 1)];
@@ -1450,6 +1499,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 - (void) insertObject:(AudioStream *)stream inPlayQueueAtIndex:(NSUInteger)thisIndex
 {
 	[_playQueue insertObject:stream atIndex:thisIndex];	
+	_playQueueShuffleNeedsReset = YES;
 
 	if(NSNotFound != [self nextPlaybackIndex] && thisIndex >= [self nextPlaybackIndex])
 		[self setNextPlaybackIndex:[self nextPlaybackIndex] + 1];
@@ -1463,6 +1513,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 - (void) removeObjectFromPlayQueueAtIndex:(NSUInteger)thisIndex
 {
 	[_playQueue removeObjectAtIndex:thisIndex];	
+	_playQueueShuffleNeedsReset = YES;
 
 	if(NSNotFound != [self nextPlaybackIndex] && thisIndex < [self nextPlaybackIndex])
 		[self setNextPlaybackIndex:[self nextPlaybackIndex] - 1];
@@ -1499,7 +1550,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 {
 	NSParameterAssert(nil != streams);
 	
-	NSArray *sortedStreams = [streams sortedArrayUsingDescriptors:[_streamController sortDescriptors]];
+	NSArray *sortedStreams = sortStreamsUsingDescriptors(streams, [_streamController sortDescriptors]);
 	[self addStreamsToPlayQueue:sortedStreams];
 }
 
@@ -1516,6 +1567,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 		
 	[self willChangeValueForKey:PlayQueueKey];
 	[_playQueue insertObjects:streams atIndexes:indexes];
+	_playQueueShuffleNeedsReset = YES;
 	[self didChangeValueForKey:PlayQueueKey];
 	
 	[self updatePlayButtonState];
@@ -1528,6 +1580,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	
 	[self willChangeValueForKey:PlayQueueKey];
 	[_playQueue removeAllObjects];
+	_playQueueShuffleNeedsReset = YES;
 	[self didChangeValueForKey:PlayQueueKey];
 
 	[self updatePlayButtonState];
@@ -1552,6 +1605,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 		
 		[_playQueue exchangeObjectAtIndex:i withObjectAtIndex:randomIndex];
 	}
+	_playQueueShuffleNeedsReset = YES;
 	[self didChangeValueForKey:PlayQueueKey];
 }
 
@@ -2222,25 +2276,10 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	if(nil == stream || 0 == [streams count])
 		[self setNextPlaybackIndex:NSNotFound];
 	else if([self randomPlayback]) {
-		double		randomNumber;
-		unsigned	randomIndex;
-		
-		if([[NSUserDefaults standardUserDefaults] boolForKey:@"removeStreamsFromPlayQueueWhenFinished"]) {
-			if(1 == [streams count])
-				randomIndex = NSNotFound;
-			else {
-				do {
-					randomNumber	= genrand_real2();
-					randomIndex		= (unsigned)(randomNumber * [streams count]);
-				} while(randomIndex == [self playbackIndex]);
-			}
-		}
-		else {
-			randomNumber	= genrand_real2();
-			randomIndex		= (unsigned)(randomNumber * [streams count]);
-		}
-		
-		[self setNextPlaybackIndex:randomIndex];
+		if([[NSUserDefaults standardUserDefaults] boolForKey:@"removeStreamsFromPlayQueueWhenFinished"] && 1 == [streams count])
+			[self setNextPlaybackIndex:NSNotFound];
+		else
+			[self setNextPlaybackIndex:[self randomPlayQueueIndexExcludingIndex:[self playbackIndex]]];
 	}
 	else if([self loopPlayback]) {
 		streamIndex = [self playbackIndex];		
@@ -2316,27 +2355,150 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	[self willChangeValueForKey:PlayQueueKey];	
 	[_playQueue removeAllObjects];
 	[_playQueue addObjectsFromArray:streams];
+	_playQueueShuffleNeedsReset = YES;
 	[self didChangeValueForKey:PlayQueueKey];
 }
 
+// Play queue indexes are only stable while streams are appended, so any other change starts a new shuffle
+- (unsigned) randomPlayQueueIndexExcludingIndex:(unsigned)index
+{
+	BOOL		weighted	= [[NSUserDefaults standardUserDefaults] boolForKey:@"weightedShuffle"];
+	unsigned	count		= [self countOfPlayQueue];
+	unsigned	i;
+	
+	if(_playQueueShuffleNeedsReset || count < [_playQueueShuffle count] || weighted != [_playQueueShuffle weighted]) {
+		[_playQueueShuffle setCount:0];
+		[_playQueueShuffle setWeighted:weighted];
+		_playQueueShuffleNeedsReset = NO;
+	}
+	
+	for(i = [_playQueueShuffle count]; i < count; ++i) {
+		[_playQueueShuffle addIndex];
+		if(weighted)
+			[_playQueueShuffle setWeight:shuffleWeightForStream([self objectInPlayQueueAtIndex:i]) forIndex:i];
+	}
+	
+	return [_playQueueShuffle nextIndexExcludingIndex:index];
+}
+
+// The library shuffle is built on first use and then kept current from the library notifications
+- (ShuffleEngine *) libraryShuffle
+{
+	BOOL weighted = [[NSUserDefaults standardUserDefaults] boolForKey:@"weightedShuffle"];
+	
+	if(nil == _libraryShuffle) {
+		NSArray *streams = [[[CollectionManager manager] streamManager] streams];
+		
+		_libraryShuffle			= [[ShuffleEngine alloc] init];
+		_libraryShuffleStreams	= [[NSMutableArray alloc] initWithCapacity:[streams count]];
+		_libraryShuffleIndexes	= NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSIntegerMapValueCallBacks, [streams count]);
+		
+		[_libraryShuffle setWeighted:weighted];
+		
+		for(AudioStream *stream in streams)
+			[self addStreamToLibraryShuffle:stream];
+	}
+	else if(weighted != [_libraryShuffle weighted]) {
+		[_libraryShuffle setWeighted:weighted];
+		
+		if(weighted) {
+			for(AudioStream *stream in _libraryShuffleStreams)
+				[self updateLibraryShuffleWeightForStream:stream];
+		}
+	}
+	
+	return _libraryShuffle;
+}
+
+- (void) addStreamToLibraryShuffle:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	void *key = NULL, *value = NULL;
+	if(NSMapMember(_libraryShuffleIndexes, stream, &key, &value))
+		return;
+	
+	unsigned index = [_libraryShuffle addIndex];
+	
+	[_libraryShuffleStreams addObject:stream];
+	NSMapInsert(_libraryShuffleIndexes, stream, (void *)index);
+	
+	if([_libraryShuffle weighted])
+		[_libraryShuffle setWeight:shuffleWeightForStream(stream) forIndex:index];
+}
+
+// The last stream takes the place of the removed one, matching -[ShuffleEngine removeIndex:]
+- (void) removeStreamFromLibraryShuffle:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	void *key = NULL, *value = NULL;
+	if(NO == NSMapMember(_libraryShuffleIndexes, stream, &key, &value))
+		return;
+	
+	unsigned		index		= (unsigned)value;
+	unsigned		last		= [_libraryShuffleStreams count] - 1;
+	AudioStream		*lastStream	= [_libraryShuffleStreams objectAtIndex:last];
+	
+	[_libraryShuffle removeIndex:index];
+	NSMapRemove(_libraryShuffleIndexes, stream);
+	
+	if(index != last) {
+		[_libraryShuffleStreams replaceObjectAtIndex:index withObject:lastStream];
+		NSMapInsert(_libraryShuffleIndexes, lastStream, (void *)index);
+	}
+	
+	[_libraryShuffleStreams removeLastObject];
+}
+
+- (void) updateLibraryShuffleWeightForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	void *key = NULL, *value = NULL;
+	if([_libraryShuffle weighted] && NSMapMember(_libraryShuffleIndexes, stream, &key, &value))
+		[_libraryShuffle setWeight:shuffleWeightForStream(stream) forIndex:(unsigned)value];
+}
+
 - (void) addRandomTracksFromLibraryToPlayQueue:(unsigned)count
 {
-	NSArray			*streams		= [[[CollectionManager manager] streamManager] streams];
-	double			randomNumber;
+	ShuffleEngine	*shuffle		= [self libraryShuffle];
 	unsigned		randomIndex;
 	unsigned		i;
 	
 	[self willChangeValueForKey:PlayQueueKey];
 	for(i = 0; i < count; ++i) {
-		randomNumber	= genrand_real2();
-		randomIndex		= (unsigned)(randomNumber * [streams count]);
-		[_playQueue addObject:[streams objectAtIndex:randomIndex]];
+		randomIndex = [shuffle nextIndex];
+		if(NSNotFound == randomIndex)
+			break;
+		
+		[_playQueue addObject:[_libraryShuffleStreams objectAtIndex:randomIndex]];
 	}
 	[self didChangeValueForKey:PlayQueueKey];
 	
 	[self updatePlayButtonState];
 }
 
+- (NSDictionary *) metadataForFile:(NSString *)filename propertiesReader:(AudioPropertiesReader *)propertiesReader error:(NSError **)error
+{
+	NSParameterAssert(nil != filename);
+	NSParameterAssert(nil != propertiesReader);
+
+	// Some properties readers supply the metadata from the same pass over the file
+	if(nil != [propertiesReader metadata])
+		return [propertiesReader metadata];
+
+	AudioMetadataReader *metadataReader	= [AudioMetadataReader metadataReaderForURL:[NSURL fileURLWithPath:filename] error:error];
+	if(nil == metadataReader)
+		return nil;
+	
+	if(NO == [metadataReader readMetadata:error])
+		return nil;
+
+	// Readers for formats without metadata succeed without supplying any
+	return (nil == [metadataReader metadata] ? [NSDictionary dictionary] : [metadataReader metadata]);
+}
+
 - (BOOL) addStreamsFromExternalCueSheet:(NSString *)filename
 {
 	NSParameterAssert(nil != filename);
@@ -2377,6 +2539,7 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 			[_playQueue removeObjectAtIndex:0];
 			--thisIndex;
 		}
+		_playQueueShuffleNeedsReset = YES;
 		[self didChangeValueForKey:PlayQueueKey];
 
 		[self setPlaybackIndex:thisIndex];
@@ -2864,11 +3027,19 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 
 - (void) streamAdded:(NSNotification *)aNotification
 {
+	if(nil != _libraryShuffle)
+		[self addStreamToLibraryShuffle:[[aNotification userInfo] objectForKey:AudioStreamObjectKey]];
+	
 	[self updatePlayButtonState];
 }
 
 - (void) streamsAdded:(NSNotification *)aNotification
 {
+	if(nil != _libraryShuffle) {
+		for(AudioStream *stream in [[aNotification userInfo] objectForKey:AudioStreamsObjectKey])
+			[self addStreamToLibraryShuffle:stream];
+	}
+	
 	[self updatePlayButtonState];
 }
 
@@ -2876,8 +3047,12 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 {
 	AudioStream				*stream			= [[aNotification userInfo] objectForKey:AudioStreamObjectKey];
 
+	if(nil != _libraryShuffle)
+		[self removeStreamFromLibraryShuffle:stream];
+
 	[self willChangeValueForKey:PlayQueueKey];
 	[_playQueue removeObject:stream];
+	_playQueueShuffleNeedsReset = YES;
 	[self didChangeValueForKey:PlayQueueKey];
 
 	[self updatePlayButtonState];
@@ -2887,14 +3062,34 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 {
 	[self willChangeValueForKey:PlayQueueKey];
 	
-	for(AudioStream *stream in [[aNotification userInfo] objectForKey:AudioStreamsObjectKey])
+	for(AudioStream *stream in [[aNotification userInfo] objectForKey:AudioStreamsObjectKey]) {
+		if(nil != _libraryShuffle)
+			[self removeStreamFromLibraryShuffle:stream];
+		
 		[_playQueue removeObject:stream];
+	}
 	
+	_playQueueShuffleNeedsReset = YES;
 	[self didChangeValueForKey:PlayQueueKey];
 
 	[self updatePlayButtonState];
 }
 
+- (void) streamChanged:(NSNotification *)aNotification
+{
+	if(nil != _libraryShuffle)
+		[self updateLibraryShuffleWeightForStream:[[aNotification userInfo] objectForKey:AudioStreamObjectKey]];
+}
+
+- (void) streamsChanged:(NSNotification *)aNotification
+{
+	if(nil == _libraryShuffle)
+		return;
+	
+	for(AudioStream *stream in [[aNotification userInfo] objectForKey:AudioStreamsObjectKey])
+		[self updateLibraryShuffleWeightForStream:stream];
+}
+
 - (void) watchFolderAdded:(NSNotification *)aNotification
 {
 	[self synchronizeWithWatchFolder:[[aNotification userInfo] objectForKey:WatchFolderObjectKey]];
@@ -2908,6 +3103,58 @@ static NSString * const SearchFieldToolbarItemIdentifier		= @"org.sbooth.Play.Li
 	[_streamTable setNeedsDisplay:YES];
 }
 
+- (void) metadataWritten:(NSNotification *)aNotification
+{
+	NSDictionary	*userInfo		= [aNotification userInfo];
+	NSError			*error			= [userInfo objectForKey:AudioMetadataWriteQueueErrorKey];
+	unsigned		completed		= [[userInfo objectForKey:AudioMetadataWriteQueueCompletedFileCountKey] unsignedIntValue];
+	unsigned		total			= [[userInfo objectForKey:AudioMetadataWriteQueueTotalFileCountKey] unsignedIntValue];
+	
+	if(nil != error)
+		[_metadataWriteErrors addObject:error];
+	else {
+		// Rewriting tags can move the audio, so any frame index for the file is stale
+		AudioStream *stream = [[[CollectionManager manager] streamManager] streamForURL:[userInfo objectForKey:AudioMetadataWriteQueueURLKey]];
+		if(nil != stream)
+			[[[CollectionManager manager] streamManager] saveSeekIndex:nil forStream:stream];
+	}
+	
+	if(nil == _windowTitle)
+		_windowTitle = [[[self window] title] copy];
+	
+	// Show progress in the window title until the batch is finished
+	if(completed < total) {
+		[[self window] setTitle:[NSString stringWithFormat:NSLocalizedStringFromTable(@"%@ (Saving tags to file %u of %u)", @"Library", @""), _windowTitle, completed + 1, total]];
+		return;
+	}
+	
+	[[self window] setTitle:_windowTitle];
+	[_windowTitle release], _windowTitle = nil;
+	
+	// Report the failures from the batch together
+	if(1 == [_metadataWriteErrors count])
+		[self presentError:[_metadataWriteErrors lastObject] modalForWindow:[self window] delegate:nil didPresentSelector:nil contextInfo:NULL];
+	else if(1 < [_metadataWriteErrors count]) {
+		NSMutableDictionary		*errorDictionary	= [NSMutableDictionary dictionary];
+		NSMutableArray			*descriptions		= [NSMutableArray array];
+		
+		for(NSError *writeError in _metadataWriteErrors)
+			[descriptions addObject:[writeError localizedDescription]];
+		
+		[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Tags could not be saved to %u files.", @"Errors", @""), [_metadataWriteErrors count]] forKey:NSLocalizedDescriptionKey];
+		[errorDictionary setObject:NSLocalizedStringFromTable(@"Unable to write metadata", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+		[errorDictionary setObject:[descriptions componentsJoinedByString:@"\n"] forKey:NSLocalizedRecoverySuggestionErrorKey];
+		
+		[self presentError:[NSError errorWithDomain:AudioMetadataWriterErrorDomain code:AudioMetadataWriterInputOutputError userInfo:errorDictionary] 
+			modalForWindow:[self window] 
+				  delegate:nil 
+		didPresentSelector:nil 
+			   contextInfo:NULL];
+	}
+	
+	[_metadataWriteErrors removeAllObjects];
+}
+
 @end
 
 @implementation AudioLibrary (ScriptingAdditions)
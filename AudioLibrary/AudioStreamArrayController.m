@@ -24,6 +24,7 @@
 #import "AudioLibrary.h"
 #import "BrowserTreeController.h"
 #import "FileAdditionProgressSheet.h"
+#import "AudioStreamSorting.h"
 
 // ========================================
 // Pboard Types
@@ -45,6 +46,15 @@ NSString * const iTunesPboardType						= @"CorePasteboardFlavorType 0x6974756E";
 
 @implementation AudioStreamArrayController
 
+// Sorting through the sort descriptors is slow for large libraries, so use the sort engine
+- (NSArray *) arrangeObjects:(NSArray *)objects
+{
+	NSPredicate		*predicate		= [self filterPredicate];
+	NSArray			*filtered		= (nil == predicate ? objects : [objects filteredArrayUsingPredicate:predicate]);
+	
+	return sortStreamsUsingDescriptors(filtered, [self sortDescriptors]);
+}
+
 - (BOOL) tableView:(NSTableView *)tableView writeRowsWithIndexes:(NSIndexSet *)rowIndexes toPasteboard:(NSPasteboard *)pboard
 {
 	NSArray				*objects		= [[self arrangedObjects] objectsAtIndexes:rowIndexes];
@@ -23,13 +23,11 @@
 #import "AudioStream.h"
 #import "Playlist.h"
 #import "AudioLibrary.h"
-#import "AudioDecoder.h"
 
 #import "AudioStreamInformationSheet.h"
 #import "AudioMetadataEditingSheet.h"
 #import "MusicBrainzMatchesSheet.h"
 #import "MusicBrainzSearchSheet.h"
-//#import "FileConversionSheet.h"
 
 #import "CollectionManager.h"
 #import "AudioStreamManager.h"
@@ -41,30 +39,11 @@
 
 #import "PUIDUtilities.h"
 #import "MusicBrainzUtilities.h"
+#import "AudioExport.h"
 
 #import "CTBadge.h"
 
-#import <AudioToolbox/AudioToolbox.h>
-#import <QuickTime/QuickTime.h>
-
 #define kMaximumStreamsForContextMenuAction 10
-#define BUFFER_LENGTH 4096
-
-#if DEBUG
-static void 
-dumpASBD(const AudioStreamBasicDescription *asbd)
-{
-	NSLog(@"mSampleRate         %f", asbd->mSampleRate);
-	NSLog(@"mFormatID           %.4s", (const char *)(&asbd->mFormatID));
-	NSLog(@"mFormatFlags        %u", asbd->mFormatFlags);
-	NSLog(@"mBytesPerPacket     %u", asbd->mBytesPerPacket);
-	NSLog(@"mFramesPerPacket    %u", asbd->mFramesPerPacket);
-	NSLog(@"mBytesPerFrame      %u", asbd->mBytesPerFrame);
-	NSLog(@"mChannelsPerFrame   %u", asbd->mChannelsPerFrame);
-	NSLog(@"mBitsPerChannel     %u", asbd->mBitsPerChannel);
-	NSLog(@"mReserved           %u", asbd->mReserved);
-}
-#endif
 
 @interface AudioStreamTableView (Private)
 - (void) openWithPanelDidEnd:(NSOpenPanel *)panel returnCode:(int)returnCode contextInfo:(void *)contextInfo;
@@ -74,6 +53,7 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 - (void) showMusicBrainzSearchSheetDidEnd:(NSWindow *)sheet returnCode:(int)returnCode contextInfo:(void *)contextInfo;
 - (void) performReplayGainCalculationForStreams:(NSArray *)streams calculateAlbumGain:(BOOL)calculateAlbumGain;
 - (void) performPUIDCalculationForStreams:(NSArray *)streams;
+- (void) performExportForStreams:(NSArray *)streams toDirectory:(NSURL *)directory format:(AudioExportFormat)format;
 @end
 
 @implementation AudioStreamTableView
@@ -254,7 +234,7 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 	else if([menuItem action] == @selector(insertPlaylistWithSelection:))
 		return (/*[_browserController canInsert] && */0 != [[_streamController selectedObjects] count]);
 	else if([menuItem action] == @selector(convert:))
-		return (1 == [[_streamController selectedObjects] count]);
+		return (0 != [[_streamController selectedObjects] count]);
 	else if([menuItem action] == @selector(convertWithMax:))
 		return (nil != [[NSWorkspace sharedWorkspace] fullPathForApplication:@"Max"] && kMaximumStreamsForContextMenuAction >= [[_streamController selectedObjects] count]);
 	else if([menuItem action] == @selector(editWithTag:))
@@ -744,353 +724,35 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 
 - (IBAction) convert:(id)sender
 {
-	if(1 != [[_streamController selectedObjects] count]) {
+	if(0 == [[_streamController selectedObjects] count]) {
 		NSBeep();
 		return;
 	}
 	
-#if 0
-	FileConversionSheet *fileConversionSheet = [[FileConversionSheet alloc] init];
-
-	[[NSApplication sharedApplication] beginSheet:[fileConversionSheet sheet] 
-								   modalForWindow:[self window] 
-									modalDelegate:self 
-								   didEndSelector:@selector(showFileConversionSheetDidEnd:returnCode:contextInfo:) 
-									  contextInfo:fileConversionSheet];
-#endif
-#if 0
-	// Create a decoder for the desired stream
-	NSError *error = nil;
-	AudioDecoder *decoder = [AudioDecoder audioDecoderForStream:[_streamController selection] error:&error];
-
-	if(nil == decoder) {
-		if(nil != error)
-			[self presentError:error modalForWindow:[self window] delegate:nil didPresentSelector:NULL contextInfo:NULL];
-		return;
-	}
-	
-	ComponentInstance	component				= 0;
-	AudioConverterRef	myAudioConverter		= NULL;	
-	CFArrayRef			codecSpecificSettings	= NULL;
-	UInt32				magicCookieSize			= 0;
-	void				*magicCookie			= NULL;	
-	UInt32				flags;
-	
-	// open StdAudio (added in QuickTime 7.0)
-	OSErr err = OpenADefaultComponent(StandardCompressionType, 
-									  StandardCompressionSubTypeAudio, 
-									  &component);
-	if(noErr != err)
-		goto bail;
-	
-	AudioStreamBasicDescription		format			= [decoder sourceFormat];
-	AudioChannelLayout				channelLayout	= [decoder channelLayout];
-
-	err = QTSetComponentProperty(component, 
-								 kQTPropertyClass_SCAudio,
-								 kQTSCAudioPropertyID_InputBasicDescription,
-								 sizeof(format), 
-								 &format);
-	if(noErr != err)
-		goto bail;
-
-	err = QTSetComponentProperty(component, 
-								 kQTPropertyClass_SCAudio,
-								 kQTSCAudioPropertyID_InputChannelLayout,
-								 sizeof(channelLayout), 
-								 &channelLayout);
-	if(noErr != err)
-		goto bail;
-
-	// Show the configuration dialog
-	err = SCRequestImageSettings(component);
-	if(noErr != err)
-		goto bail;
-
-	AudioStreamBasicDescription		outputFormat;
-	AudioChannelLayout				*outputChannelLayout = NULL;
-
-	// Get the configuration properties from the dialog
-	err = QTGetComponentPropertyInfo(component,
-									 kQTPropertyClass_SCAudio,
-									 kQTSCAudioPropertyID_BasicDescription,
-									 NULL, 
-									 NULL, 
-									 &flags);
-	   
-   if(noErr == err && (kComponentPropertyFlagCanGetNow & flags)) {	
-	   err = QTGetComponentProperty(component, 
-									kQTPropertyClass_SCAudio,
-									kQTSCAudioPropertyID_BasicDescription,
-									sizeof(outputFormat), 
-									&outputFormat, 
-									NULL);
-	   
-	   if(noErr != err)
-		   goto bail;
-	}
-
-/*   UInt32 propValueSize = 0;
-   err = QTGetComponentPropertyInfo(component,
-									kQTPropertyClass_SCAudio,
-									kQTSCAudioPropertyID_ChannelLayout,
-									NULL, 
-									&propValueSize, 
-									&flags);
-   
-   if(noErr == err && (kComponentPropertyFlagCanGetNow & flags)) {
-	   outputChannelLayout = malloc(propValueSize);
-	   
-	   err = QTGetComponentProperty(component, 
-									kQTPropertyClass_SCAudio,
-									kQTSCAudioPropertyID_ChannelLayout,
-									sizeof(outputChannelLayout), 
-									&outputChannelLayout, 
-									NULL);
-	   
-	   if(noErr != err)
-		   goto bail;
-   }*/
-   
-	// Get the codec specific settings (if available)
-	err = QTGetComponentPropertyInfo(component,
-									 kQTPropertyClass_SCAudio,
-									 kQTSCAudioPropertyID_CodecSpecificSettingsArray,
-									 NULL, 
-									 NULL, 
-									 &flags);
-   
-   if(noErr == err && (kComponentPropertyFlagCanGetNow & flags)) {	
-	   err = QTGetComponentProperty(component,
-									kQTPropertyClass_SCAudio,
-									kQTSCAudioPropertyID_CodecSpecificSettingsArray,
-									sizeof(CFArrayRef), 
-									&codecSpecificSettings, 
-									NULL);
-	   if(noErr != err)
-		   goto bail;
-	}
-	
-	// Get the magic cookie (if available)
-	err = QTGetComponentPropertyInfo(component,
-									 kQTPropertyClass_SCAudio,
-									 kQTSCAudioPropertyID_MagicCookie,
-									 NULL, 
-									 &magicCookieSize, 
-									 NULL);
-
-	if(noErr == err && 0 != magicCookieSize) {
-
-		magicCookie = calloc(1, magicCookieSize);
-		if(NULL == magicCookie) {
-			err = memFullErr; 
-			goto bail;
-		}
-
-		err = QTGetComponentProperty(component,
-									 kQTPropertyClass_SCAudio,
-									 kQTSCAudioPropertyID_MagicCookie,
-									 magicCookieSize, 
-									 magicCookie, 
-									 &magicCookieSize);
-		if(noErr != err)
-			goto bail;
-	}
-
-	// Once we have all the required properties close StdAudio
-	CloseComponent(component), component = 0;
-	
-	// Determine the allowed file types for this ASBD
-	
-	// First, get the writable types
-	UInt32 writableTypeSize;
-	err = AudioFileGetGlobalInfoSize(kAudioFileGlobalInfo_WritableTypes, 0, NULL, &writableTypeSize);
-	
-	UInt32 *writableTypes = malloc(writableTypeSize);
-	
-	UInt32 numWritableTypes = writableTypeSize / sizeof(UInt32);
-	err = AudioFileGetGlobalInfo(kAudioFileGlobalInfo_WritableTypes, 0, NULL, &writableTypeSize, writableTypes);
-
-	if(noErr != err)
-		goto bail;
-	
-	AudioFileTypeID outputTypeID;
-	
-	// Iterate through them and determine which support this format
-	unsigned i;
-	for(i = 0; i < numWritableTypes; ++i) {
-		AudioFileTypeAndFormatID typeAndFormatID;
-		
-		typeAndFormatID.mFileType = writableTypes[i];
-		typeAndFormatID.mFormatID = outputFormat.mFormatID;
-		
-		UInt32 availableStreamDescriptionsSize;
-		err = AudioFileGetGlobalInfoSize(kAudioFileGlobalInfo_AvailableStreamDescriptionsForFormat, sizeof(typeAndFormatID), &typeAndFormatID, &availableStreamDescriptionsSize);
-		if(noErr != err)
-			continue;
-		
-		AudioStreamBasicDescription *availableStreamDescriptions = malloc(availableStreamDescriptionsSize);
-		
-		UInt32 numAvailableStreamDescriptions = availableStreamDescriptionsSize / sizeof(AudioStreamBasicDescription);
-		err = AudioFileGetGlobalInfo(kAudioFileGlobalInfo_AvailableStreamDescriptionsForFormat, sizeof(typeAndFormatID), &typeAndFormatID, &availableStreamDescriptionsSize, availableStreamDescriptions);
-		
-		unsigned j;
-		for(j = 0; j < numAvailableStreamDescriptions; ++j) {
-			AudioFileTypeID		typeID				= typeAndFormatID.mFileType;
-			CFStringRef			fileTypeName		= nil;
-			UInt32				fileTypeNameSize	= sizeof(fileTypeName);
-			
-			err = AudioFileGetGlobalInfo(kAudioFileGlobalInfo_FileTypeName, sizeof(typeID), &typeID, &fileTypeNameSize, &fileTypeName);
-
-			NSLog(@"Match: %@",fileTypeName);
-						
-			CFArrayRef			fileTypeExtensions		= nil;
-			UInt32				fileTypeExtensionsSize	= sizeof(fileTypeExtensions);
-			
-			err = AudioFileGetGlobalInfo(kAudioFileGlobalInfo_ExtensionsForType, sizeof(typeID), &typeID, &fileTypeExtensionsSize, &fileTypeExtensions);
-			
-			NSLog(@"Extensions: %@", fileTypeExtensions);
-			
-			outputTypeID = typeID;
-				
-		}
-		
-		free(availableStreamDescriptions), availableStreamDescriptions = NULL;
-	}
-	
-	free(writableTypes), writableTypes = NULL;
-	
-	NSSavePanel *savePanel = [NSSavePanel savePanel];
+	NSOpenPanel		*panel			= [NSOpenPanel openPanel];
+	NSPopUpButton	*formatPopUp	= [[NSPopUpButton alloc] initWithFrame:NSMakeRect(0, 0, 200, 26) pullsDown:NO];
 	
-	NSPopUpButton *view = [[NSPopUpButton alloc] initWithFrame:NSMakeRect(0,0,100,50)];
+	// The item indexes match the AudioExportFormat constants
+	[formatPopUp addItemWithTitle:NSLocalizedStringFromTable(@"WAVE", @"Library", @"")];
+	[formatPopUp addItemWithTitle:NSLocalizedStringFromTable(@"FLAC", @"Library", @"")];
+	[formatPopUp addItemWithTitle:NSLocalizedStringFromTable(@"Ogg Vorbis", @"Library", @"")];
+	[formatPopUp selectItemAtIndex:[[NSUserDefaults standardUserDefaults] integerForKey:@"exportFormat"]];
 	
-	[view addItemWithTitle:@"foo"];
-	[view addItemWithTitle:@"bar"];
-	[view addItemWithTitle:@"fnord"];
+	[panel setAllowsMultipleSelection:NO];
+	[panel setCanChooseDirectories:YES];
+	[panel setCanChooseFiles:NO];
+	[panel setCanCreateDirectories:YES];
+	[panel setPrompt:NSLocalizedStringFromTable(@"Export", @"Library", @"")];
+	[panel setAccessoryView:formatPopUp];
 	
-	[savePanel setAccessoryView:[view autorelease]];
-	
-	if(NSOKButton == [savePanel runModal]) {
-		
-		ExtAudioFileRef outputExtAudioFile;
-		
-		NSURL		*fileURL		= [savePanel URL];
-		NSString	*filePath		= [fileURL path];
-		NSString	*fileDirectory	= [filePath stringByDeletingLastPathComponent];
-		NSString	*fileName		= [filePath lastPathComponent];
-		
-		FSRef fileDirectoryFSRef;
-		err = FSPathMakeRef([fileDirectory UTF8String], &fileDirectoryFSRef, NULL);
-		if(noErr != err)
-			goto bail;
-		
-		err = ExtAudioFileCreateNew(&fileDirectoryFSRef, fileName, outputTypeID, &outputFormat, NULL, &outputExtAudioFile);
-		if(noErr != err)
-			goto bail;
-		
-		AudioStreamBasicDescription clientFormat = [decoder format];
-		err = ExtAudioFileSetProperty(outputExtAudioFile, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
-		if(noErr != err)
-			goto bail;
-
-//		AudioConverterRef audioConverter;
-//		UInt32 dataSize = sizeof(audioConverter);
-//		err = ExtAudioFileGetProperty(outputExtAudioFile, kExtAudioFileProperty_AudioConverter, &dataSize, &audioConverter);
-//		if(noErr != err)
-//			goto bail;
+	if(NSOKButton == [panel runModalForTypes:nil]) {
+		AudioExportFormat format = [formatPopUp indexOfSelectedItem];
 		
-		if(NULL != codecSpecificSettings) {
-			err = ExtAudioFileSetProperty(outputExtAudioFile, kExtAudioFileProperty_ConverterConfig, sizeof(codecSpecificSettings), &codecSpecificSettings);
-			if(noErr != err)
-				goto bail;
-			
-			CFRelease(codecSpecificSettings);
-		}
-		
-		// Allocate the AudioBufferList for the decoder
-		AudioBufferList *bufferList = calloc(sizeof(AudioBufferList) + (sizeof(AudioBuffer) * (clientFormat.mChannelsPerFrame - 1)), 1);
-		NSAssert(NULL != bufferList, @"Unable to allocate memory");
-		
-		bufferList->mNumberBuffers = clientFormat.mChannelsPerFrame;
-		
-		for(i = 0; i < bufferList->mNumberBuffers; ++i) {
-			bufferList->mBuffers[i].mData = calloc(BUFFER_LENGTH, sizeof(float));
-			NSCAssert(NULL != bufferList->mBuffers[i].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
-			bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
-			bufferList->mBuffers[i].mNumberChannels = 1;
-		}
-				
-		// Process the file
-		for(;;) {
-			// Reset read parameters
-			for(i = 0; i < bufferList->mNumberBuffers; ++i)
-				bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
-			
-			// Read some audio
-			UInt32 framesRead = [decoder readAudio:bufferList frameCount:BUFFER_LENGTH];
-			if(0 == framesRead)
-				break;
-
-			// Write it out
-			err = ExtAudioFileWrite(outputExtAudioFile, framesRead, bufferList);
-			if(noErr != err)
-				goto bail;
-		}			
-		
-		for(i = 0; i < bufferList->mNumberBuffers; ++i)
-			free(bufferList->mBuffers[i].mData);
-		free(bufferList);
-		
-		err = ExtAudioFileDispose(outputExtAudioFile);
-		if(noErr != err)
-			goto bail;
+		[[NSUserDefaults standardUserDefaults] setInteger:format forKey:@"exportFormat"];
+		[self performExportForStreams:[_streamController selectedObjects] toDirectory:[[panel URLs] lastObject] format:format];
 	}
 	
-	// create an AudioConverter
-	//		err = AudioConverterNew(&myInputASBD, &myOutputASBD, &myAudioConverter);
-	//		if (err) goto bail;
-	
-	// set other Audio Converter properties such as channel layout and so on
-	//		...
-	
-	// a codec that has CodecSpecificSettings may have a MagicCookie
-	// prefer the CodecSpecificSettingsArray if you have both
-	/*			if (NULL != codecSpecificSettings) {
-		
-		err = AudioConverterSetProperty(myAudioConverter,
-										kAudioConverterPropertySettings,
-										sizeof(CFArray),
-										codecSpecificSettings);
-				if (err) goto bail;
-				
-				CFRelease(codecSpecificSettings);
-				
-	} else if (NULL != magicCookie) {
-		err = AudioConverterSetProperty(myAudioConverter,
-										kAudioConverterCompressionMagicCookie,
-										magicCookieSize,
-										magicCookie);
-		if (err) goto bail;
-		
-		// we may need the magic cookie later if we're going to write the data to a file
-		// but make sure and remember to free it when we're done!
-	}
-	*/
-	// continue with any other required setup
-	//		...
-	
-bail:
-	if(noErr != err) {
-		if(codecSpecificSettings) 
-			CFRelease(codecSpecificSettings);
-		if(magicCookie) 
-			free(magicCookie);
-		if(component) 
-			CloseComponent(component);
-		if(myAudioConverter) 
-			AudioConverterDispose(myAudioConverter);
-	}
-#endif
+	[formatPopUp release];
 }
 
 - (IBAction) convertWithMax:(id)sender
@@ -1299,16 +961,6 @@ bail:
 	[searchSheet release];
 }
 
-#if 0
-- (void) showFileConversionSheetDidEnd:(NSWindow *)sheet returnCode:(int)returnCode contextInfo:(void *)contextInfo
-{
-	FileConversionSheet *fileConversionSheet = (FileConversionSheet *)contextInfo;
-	
-	[sheet orderOut:self];
-	[fileConversionSheet release];
-}
-#endif
-
 - (void) performReplayGainCalculationForStreams:(NSArray *)streams calculateAlbumGain:(BOOL)calculateAlbumGain
 {
 	CancelableProgressSheet *progressSheet = [[CancelableProgressSheet alloc] init];
@@ -1365,4 +1017,47 @@ bail:
 	[progressSheet release];
 }
 
+- (void) performExportForStreams:(NSArray *)streams toDirectory:(NSURL *)directory format:(AudioExportFormat)format
+{
+	AudioExportJob *job = [[AudioExportJob alloc] initWithStreams:streams outputDirectory:directory format:format];
+	
+	CancelableProgressSheet *progressSheet = [[CancelableProgressSheet alloc] init];
+	[progressSheet setLegend:NSLocalizedStringFromTable(@"Exporting...", @"Library", @"")];
+	
+	[[NSApplication sharedApplication] beginSheet:[progressSheet sheet]
+								   modalForWindow:[self window]
+									modalDelegate:nil
+								   didEndSelector:nil
+									  contextInfo:nil];
+	
+	NSModalSession modalSession = [[NSApplication sharedApplication] beginModalSessionForWindow:[progressSheet sheet]];
+	
+	[progressSheet startProgressIndicator:self];
+	[job start];
+	
+	while(NO == [job isFinished]) {
+		[progressSheet setLegend:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Exporting %u of %u tracks (%.0f%%, %.1fx realtime)...", @"Library", @""), 
+			[job exportedStreamCount], [streams count], 100 * [job progress], [job realtimeFactor]]];
+		
+		// Allow user cancellation
+		if(NO == [job isCancelled] && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
+			[job cancel];
+		
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+	}
+	
+	[progressSheet stopProgressIndicator:self];
+	
+	[NSApp endModalSession:modalSession];
+	
+	[NSApp endSheet:[progressSheet sheet]];
+	[[progressSheet sheet] close];
+	[progressSheet release];
+	
+	if(NO == [job isCancelled] && 0 != [[job errors] count])
+		[self presentError:[[job errors] objectAtIndex:0] modalForWindow:[self window] delegate:nil didPresentSelector:NULL contextInfo:NULL];
+	
+	[job release];
+}
+
 @end
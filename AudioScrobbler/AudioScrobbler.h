@@ -23,17 +23,27 @@
 #import <mach/mach.h>
 
 @class AudioStream;
+@class AudioScrobblerJournal;
 
 @interface AudioScrobbler : NSObject
 {
-	NSString			*_pluginID;
-	NSMutableArray		*_queue;
-
-	BOOL				_audioScrobblerThreadCompleted;
-	BOOL				_keepProcessingAudioScrobblerCommands;
-    semaphore_t			_semaphore;
+	NSString				*_pluginID;
+	NSMutableArray			*_queue;
+	AudioScrobblerJournal	*_journal;
+
+	NSString				*_playCommand;
+	int						_playLength;
+	CFAbsoluteTime			_playResumeTime;
+	CFTimeInterval			_playedTime;
+
+	BOOL					_audioScrobblerThreadCompleted;
+	BOOL					_keepProcessingAudioScrobblerCommands;
+	semaphore_t				_semaphore;
 }
 
+// YES if plays from a previous session are waiting to be submitted
++ (BOOL)	hasUnsubmittedCommands;
+
 - (void)	start:(AudioStream *)stream;
 - (void)	stop;
 - (void)	pause;
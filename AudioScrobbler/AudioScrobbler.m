@@ -21,6 +21,7 @@
 #import "AudioScrobbler.h"
 
 #import "AudioScrobblerClient.h"
+#import "AudioScrobblerJournal.h"
 #import "AudioStream.h"
 
 // ========================================
@@ -28,6 +29,22 @@
 // ========================================
 NSString * const	AudioScrobblerRunLoopMode			= @"org.sbooth.Play.AudioScrobbler.RunLoopMode";
 
+// Commands sent before waiting for their replies
+#define MAXIMUM_BATCH_SIZE			16
+
+// Delays between attempts to reach an unavailable Last.fm client, in seconds
+#define INITIAL_RETRY_INTERVAL		1
+#define MAXIMUM_RETRY_INTERVAL		300
+
+// How often the queue is checked when nothing has been added, in seconds
+#define IDLE_INTERVAL				30
+
+// Last.fm only accepts plays of tracks at least this long, in seconds
+#define MINIMUM_TRACK_LENGTH		30
+
+// A play counts once half the track or this much of it was heard, in seconds
+#define MAXIMUM_REQUIRED_PLAY_TIME	240
+
 // ========================================
 // Helpers
 // ========================================
@@ -40,6 +57,12 @@ escapeForLastFM(NSString *string)
 							withString:@"&&" 
 							   options:NSLiteralSearch 
 								 range:NSMakeRange(0, [result length])];
+
+	// Commands are newline-terminated, both on the wire and in the journal
+	[result replaceOccurrencesOfString:@"\n" 
+							withString:@" " 
+							   options:NSLiteralSearch 
+								 range:NSMakeRange(0, [result length])];
 	
 	return (nil == result ? @"" : [result autorelease]);
 }
@@ -47,9 +70,12 @@ escapeForLastFM(NSString *string)
 @interface AudioScrobbler (Private)
 
 - (NSMutableArray *)	queue;
+- (AudioScrobblerJournal *) journal;
 - (NSString *)			pluginID;
+- (in_port_t)			port;
 
-- (void)				sendCommand:(NSString *)command;
+- (void)				sendCommand:(NSString *)command completingPlay:(NSDictionary *)play;
+- (NSDictionary *)		finishPlay;
 
 - (BOOL)				keepProcessingAudioScrobblerCommands;
 - (void)				setKeepProcessingAudioScrobblerCommands:(BOOL)keepProcessingAudioScrobblerCommands;
@@ -59,17 +85,42 @@ escapeForLastFM(NSString *string)
 
 - (semaphore_t)			semaphore;
 
+- (NSIndexSet *)		submitEntries:(NSArray *)entries withClient:(AudioScrobblerClient *)client port:(in_port_t *)port failed:(BOOL *)failed;
+- (void)				acknowledgeEntries:(NSArray *)entries atIndexes:(NSIndexSet *)indexes;
 - (void)				processAudioScrobblerCommands:(AudioScrobbler *)myself;
 
 @end
 
 @implementation AudioScrobbler
 
++ (BOOL) hasUnsubmittedCommands
+{
+	NSString		*path			= [AudioScrobblerJournal defaultJournalPath];
+	NSDictionary	*attributes		= (nil == path ? nil : [[NSFileManager defaultManager] fileAttributesAtPath:path traverseLink:YES]);
+	
+	return (0 != [attributes fileSize]);
+}
+
 - (id) init
 {
 	if((self = [super init])) {
 
 		_pluginID = @"pla";
+		
+		// Plays that weren't acknowledged in a previous session are submitted first
+		NSString *journalPath = [AudioScrobblerJournal defaultJournalPath];
+		if(nil != journalPath)
+			_journal = [[AudioScrobblerJournal alloc] initWithPath:journalPath];
+		if(nil == _journal)
+			NSLog(@"AudioScrobbler: Unable to open the journal, plays will not be saved between sessions");
+		
+		// The Last.fm client only understands START, STOP, PAUSE and RESUME, so each play is replayed as a START and STOP pair
+		_queue = [[NSMutableArray alloc] init];
+		for(NSDictionary *play in [_journal unacknowledgedEntries])
+			[_queue addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+				[play objectForKey:AudioScrobblerJournalSequenceNumberKey], AudioScrobblerJournalSequenceNumberKey,
+				[NSString stringWithFormat:@"%@STOP c=%@\n", [play objectForKey:AudioScrobblerJournalCommandKey], _pluginID], AudioScrobblerJournalCommandKey,
+				nil]];
 
 		if([[NSUserDefaults standardUserDefaults] boolForKey:@"automaticallyLaunchLastFM"])
 			[[NSWorkspace sharedWorkspace] launchApplication:@"Last.fm.app"];
@@ -96,6 +147,8 @@ escapeForLastFM(NSString *string)
 		[self shutdown];
 	
 	[_queue release], _queue = nil;
+	[_journal release], _journal = nil;
+	[_playCommand release], _playCommand = nil;
 	
 	semaphore_destroy(mach_task_self(), _semaphore), _semaphore = 0;
 
@@ -104,7 +157,7 @@ escapeForLastFM(NSString *string)
 
 - (void) start:(AudioStream *)stream
 {
-	[self sendCommand:[NSString stringWithFormat:@"START c=%@&a=%@&t=%@&b=%@&m=%@&l=%i&p=%@\n", 
+	NSString *parameters = [NSString stringWithFormat:@"c=%@&a=%@&t=%@&b=%@&m=%@&l=%i&p=%@", 
 		[self pluginID],
 		escapeForLastFM([stream valueForKey:MetadataArtistKey]), 
 		escapeForLastFM([stream valueForKey:MetadataTitleKey]), 
@@ -112,26 +165,50 @@ escapeForLastFM(NSString *string)
 		escapeForLastFM([stream valueForKey:MetadataMusicBrainzIDKey]), 
 		[[stream duration] intValue], 
 		escapeForLastFM([[stream valueForKey:StreamURLKey] path])
-		]];	
+		];
+	
+	NSString *command = [NSString stringWithFormat:@"START %@\n", parameters];
+	
+	// Starting a track ends the one before it
+	[self sendCommand:command completingPlay:[self finishPlay]];
+	
+	// If the play isn't acknowledged this session its START is journaled for replay
+	[_playCommand release];
+	_playCommand		= [command retain];
+	_playLength			= [[stream duration] intValue];
+	_playResumeTime		= CFAbsoluteTimeGetCurrent();
+	_playedTime			= 0;
 }
 
 - (void) stop
 {
-	[self sendCommand:[NSString stringWithFormat:@"STOP c=%@\n", [self pluginID]]];
+	[self sendCommand:[NSString stringWithFormat:@"STOP c=%@\n", [self pluginID]] completingPlay:[self finishPlay]];
 }
 
 - (void) pause
 {
-	[self sendCommand:[NSString stringWithFormat:@"PAUSE c=%@\n", [self pluginID]]];
+	if(0 != _playResumeTime) {
+		_playedTime		+= CFAbsoluteTimeGetCurrent() - _playResumeTime;
+		_playResumeTime	= 0;
+	}
+	
+	[self sendCommand:[NSString stringWithFormat:@"PAUSE c=%@\n", [self pluginID]] completingPlay:nil];
 }
 
 - (void) resume
 {
-	[self sendCommand:[NSString stringWithFormat:@"RESUME c=%@\n", [self pluginID]]];
+	if(nil != _playCommand && 0 == _playResumeTime)
+		_playResumeTime = CFAbsoluteTimeGetCurrent();
+	
+	[self sendCommand:[NSString stringWithFormat:@"RESUME c=%@\n", [self pluginID]] completingPlay:nil];
 }
 
 - (void) shutdown
 {
+	// Record the track that was playing
+	if(nil != _playCommand)
+		[self stop];
+	
 	[self setKeepProcessingAudioScrobblerCommands:NO];
 	semaphore_signal([self semaphore]);
 
@@ -152,19 +229,64 @@ escapeForLastFM(NSString *string)
 	return [[_queue retain] autorelease];
 }
 
+- (AudioScrobblerJournal *) journal
+{
+	return [[_journal retain] autorelease];
+}
+
 - (NSString *) pluginID
 {
 	return [[_pluginID retain] autorelease];
 }
 
-- (void) sendCommand:(NSString *)command
+// The port can be changed to point at a stand-in for the Last.fm client
+- (in_port_t) port
+{
+	int port = [[NSUserDefaults standardUserDefaults] integerForKey:@"audioScrobblerPort"];
+	return (0 < port && 65535 >= port ? (in_port_t)port : 33367);
+}
+
+// Commands only make sense while the track is playing, so they aren't journaled
+// A completed play is acknowledged along with the command that ended it, since the Last.fm client submits it then
+- (void) sendCommand:(NSString *)command completingPlay:(NSDictionary *)play
 {
+	NSDictionary *entry = nil;
+	
+	if(nil != play)
+		entry = [NSDictionary dictionaryWithObjectsAndKeys:
+			[play objectForKey:AudioScrobblerJournalSequenceNumberKey], AudioScrobblerJournalSequenceNumberKey,
+			command, AudioScrobblerJournalCommandKey,
+			nil];
+	else
+		entry = [NSDictionary dictionaryWithObject:command forKey:AudioScrobblerJournalCommandKey];
+	
 	@synchronized([self queue]) {
-		[[self queue] addObject:command];
+		[[self queue] addObject:entry];
 	}
 	semaphore_signal([self semaphore]);
 }
 
+// Journals the current play if enough of it was heard, and returns its journal entry
+- (NSDictionary *) finishPlay
+{
+	NSDictionary *play = nil;
+	
+	if(nil == _playCommand)
+		return nil;
+	
+	if(0 != _playResumeTime)
+		_playedTime += CFAbsoluteTimeGetCurrent() - _playResumeTime;
+	
+	if(MINIMUM_TRACK_LENGTH <= _playLength && MIN(_playLength / 2, MAXIMUM_REQUIRED_PLAY_TIME) <= _playedTime)
+		play = [[self journal] appendCommand:_playCommand];
+	
+	[_playCommand release], _playCommand = nil;
+	_playResumeTime		= 0;
+	_playedTime			= 0;
+	
+	return play;
+}
+
 - (BOOL) keepProcessingAudioScrobblerCommands
 {
 	return _keepProcessingAudioScrobblerCommands;
@@ -190,57 +312,181 @@ escapeForLastFM(NSString *string)
 	return _semaphore;
 }
 
+// Pipelines entries over the open connection, reconnecting once if the connection went stale
+// An entry may hold several commands and is handled once each of them has a reply
+// A journaled play is only handled by OK replies; after one fails no later play is handled, since acknowledgements are cumulative
+// Returns the indexes of the handled entries and sets failed if a journaled play was refused or went unanswered
+- (NSIndexSet *) submitEntries:(NSArray *)entries withClient:(AudioScrobblerClient *)client port:(in_port_t *)port failed:(BOOL *)failed
+{
+	NSMutableIndexSet	*handled		= [NSMutableIndexSet indexSet];
+	NSString			*response		= nil;
+	unsigned			sent, replied, attempt, i, j;
+	BOOL				wasConnected, playFailed;
+	
+	*failed = NO;
+	
+	for(attempt = 0; attempt < 2; ++attempt) {
+		wasConnected	= [client isConnected];
+		sent			= 0;
+		replied			= 0;
+		playFailed		= NO;
+		
+		if(NO == wasConnected) {
+			if(NO == [client connectToHost:@"localhost" port:*port])
+				break;
+			*port = [client connectedPort];
+		}
+		
+		for(NSDictionary *entry in entries) {
+			if(NO == [client send:[entry objectForKey:AudioScrobblerJournalCommandKey]])
+				break;
+			++sent;
+		}
+		
+		// Replies arrive in the order the commands were sent
+		for(i = 0; i < sent; ++i) {
+			NSDictionary	*entry		= [entries objectAtIndex:i];
+			NSArray			*commands	= [[entry objectForKey:AudioScrobblerJournalCommandKey] componentsSeparatedByString:@"\n"];
+			BOOL			isPlay		= (nil != [entry objectForKey:AudioScrobblerJournalSequenceNumberKey]);
+			BOOL			succeeded	= YES;
+			
+			// The final component follows the last newline and is empty
+			for(j = 0; j + 1 < [commands count]; ++j) {
+				response = [client receiveLine];
+				if(nil == response)
+					break;
+				
+				if(2 > [response length] || NSOrderedSame != [response compare:@"OK" options:NSLiteralSearch range:NSMakeRange(0,2)]) {
+					NSLog(@"AudioScrobbler error: %@", response);
+					succeeded = NO;
+				}
+			}
+			
+			if(nil == response)
+				break;
+			
+			++replied;
+			
+			// Other commands only matter while the track is playing, so a refusal isn't retried
+			if(isPlay && (NO == succeeded || playFailed))
+				playFailed = YES;
+			else
+				[handled addIndex:i];
+		}
+		
+		// The Last.fm client may close the connection after replying
+		if(replied < [entries count])
+			[client shutdown];
+		
+		if(0 != replied || NO == wasConnected) {
+			*failed = (playFailed || replied < [entries count]);
+			break;
+		}
+	}
+	
+	if(0 == [handled count])
+		*failed = YES;
+	
+	return handled;
+}
+
+// Acknowledges the last journaled play among the handled entries
+- (void) acknowledgeEntries:(NSArray *)entries atIndexes:(NSIndexSet *)indexes
+{
+	unsigned index = [indexes lastIndex];
+	
+	while(NSNotFound != index) {
+		NSDictionary *entry = [entries objectAtIndex:index];
+		if(nil != [entry objectForKey:AudioScrobblerJournalSequenceNumberKey]) {
+			[[self journal] acknowledgeEntry:entry];
+			break;
+		}
+		index = [indexes indexLessThanIndex:index];
+	}
+}
+
 - (void) processAudioScrobblerCommands:(AudioScrobbler *)myself
 {
 	NSAutoreleasePool		*pool				= [[NSAutoreleasePool alloc] init];
 	AudioScrobblerClient	*client				= [[AudioScrobblerClient alloc] init];
-	mach_timespec_t			timeout				= { 5, 0 };
-	NSEnumerator			*enumerator			= nil;
-	NSString				*command			= nil;
+	in_port_t				port				= [myself port];
+	NSArray					*batch				= nil;
 	NSString				*response			= nil;
-	in_port_t				port				= 33367;
+	NSIndexSet				*handled			= nil;
+	unsigned				retryInterval		= 0;
+	BOOL					failed				= NO;
+	BOOL					progressed			= NO;
+	BOOL					commandsQueued		= NO;
+	CFAbsoluteTime			nextAttemptTime		= 0;
+	CFAbsoluteTime			now;
+	mach_timespec_t			timeout;
 	
 	while([myself keepProcessingAudioScrobblerCommands]) {
-
-		// Get the first command to be sent
-		@synchronized([myself queue]) {
-			enumerator	= [[myself queue] objectEnumerator];
-			command		= [[enumerator nextObject] retain];
+		NSAutoreleasePool *loopPool = [[NSAutoreleasePool alloc] init];
 		
-			[[myself queue] removeObjectIdenticalTo:command];
+		now = CFAbsoluteTimeGetCurrent();
+		
+		@synchronized([myself queue]) {
+			batch = [[myself queue] subarrayWithRange:NSMakeRange(0, MIN(MAXIMUM_BATCH_SIZE, [[myself queue] count]))];
 		}
-
-		if(nil != command) {
-			@try {
-				if([client connectToHost:@"localhost" port:port]) {
-					port = [client connectedPort];
-					[client send:command];
-					[command release];
-					
-					response = [client receive];
-					if(2 > [response length] || NSOrderedSame != [response compare:@"OK" options:NSLiteralSearch range:NSMakeRange(0,2)])
-						NSLog(@"AudioScrobbler error: %@", response);
-					
-					[client shutdown];
+		
+		progressed = NO;
+		if(0 != [batch count] && now >= nextAttemptTime) {
+			handled = [myself submitEntries:batch withClient:client port:&port failed:&failed];
+			
+			// The batch is a prefix of the queue, so its indexes are still valid
+			if(0 != [handled count]) {
+				@synchronized([myself queue]) {
+					[[myself queue] removeObjectsAtIndexes:handled];
 				}
+				[myself acknowledgeEntries:batch atIndexes:handled];
 			}
 			
-			@catch(NSException *exception) {
-				[client shutdown];
-//				NSLog(@"Exception: %@",exception);
-				continue;
+			if(NO == failed) {
+				retryInterval	= 0;
+				progressed		= YES;
+			}
+			// Back off while the Last.fm client is unavailable or refuses a play
+			else {
+				retryInterval	= (0 == retryInterval ? INITIAL_RETRY_INTERVAL : MIN(2 * retryInterval, MAXIMUM_RETRY_INTERVAL));
+				nextAttemptTime	= now + retryInterval;
 			}
 		}
-				
+		
+		@synchronized([myself queue]) {
+			commandsQueued = (0 != [[myself queue] count]);
+		}
+		
+		[loopPool release];
+		
+		// Keep going if commands remain after a successful batch
+		if(progressed && commandsQueued)
+			continue;
+		
+		// Otherwise wait for a new command or the next retry
+		timeout.tv_sec	= (commandsQueued && now < nextAttemptTime ? (unsigned)ceil(nextAttemptTime - now) : IDLE_INTERVAL);
+		timeout.tv_nsec	= 0;
+		
 		semaphore_timedwait([myself semaphore], timeout);
 	}
 	
+	// Make one last attempt to send queued commands, unless the client was unavailable
+	@synchronized([myself queue]) {
+		batch = [[[myself queue] copy] autorelease];
+	}
+	
+	// Plays that aren't acknowledged stay in the journal for the next session
+	if(0 != [batch count] && 0 == retryInterval) {
+		handled = [myself submitEntries:batch withClient:client port:&port failed:&failed];
+		[myself acknowledgeEntries:batch atIndexes:handled];
+	}
+	
 	// Send a final stop command to cleanup
 	@try {
-		if([client connectToHost:@"localhost" port:port]) {
+		if([client isConnected] || [client connectToHost:@"localhost" port:port]) {
 			[client send:[NSString stringWithFormat:@"STOP c=%@\n", [myself pluginID]]];
 			
-			response = [client receive];
+			response = [client receiveLine];
 			if(2 > [response length] || NSOrderedSame != [response compare:@"OK" options:NSLiteralSearch range:NSMakeRange(0,2)])
 				NSLog(@"AudioScrobbler error: %@", response);
 			
@@ -252,6 +498,8 @@ escapeForLastFM(NSString *string)
 		[client shutdown];
 	}
 	
+	[[myself journal] close];
+	
 	[client release];
 	[myself setAudioScrobblerThreadCompleted:YES];
 	
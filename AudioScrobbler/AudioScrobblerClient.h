@@ -24,9 +24,10 @@
 
 @interface AudioScrobblerClient : NSObject
 {
-	int			_socket;
-	BOOL		_doPortStepping;
-	in_port_t	_port;
+	int				_socket;
+	BOOL			_doPortStepping;
+	in_port_t		_port;
+	NSMutableData	*_receiveBuffer;
 }
 
 - (BOOL)		connectToHost:(NSString *)hostname port:(in_port_t)port;
@@ -34,9 +35,12 @@
 - (BOOL)		isConnected;
 - (in_port_t)	connectedPort;
 
-- (void)		send:(NSString *)data;
+- (BOOL)		send:(NSString *)data;
 - (NSString *)	receive;
 
+// Returns the next newline-terminated reply, without the newline, or nil if the connection closed or timed out
+- (NSString *)	receiveLine;
+
 - (void)		shutdown;
 
 @end
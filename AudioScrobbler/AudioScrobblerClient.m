@@ -29,6 +29,7 @@
 
 #define kBufferSize		1024
 #define	kPortsToStep	5
+#define kReceiveTimeout	5
 
 static in_addr_t 
 addressForHost(NSString *hostname)
@@ -64,10 +65,18 @@ addressForHost(NSString *hostname)
 	if((self = [super init])) {
 		_socket				= -1;
 		_doPortStepping		= YES;
+		_receiveBuffer		= [[NSMutableData alloc] init];
 	}
 	return self;
 }
 
+- (void) dealloc
+{
+	[_receiveBuffer release], _receiveBuffer = nil;
+	
+	[super dealloc];
+}
+
 - (BOOL) connectToHost:(NSString *)hostname port:(in_port_t)port
 {
 	NSParameterAssert(nil != hostname);
@@ -90,7 +99,7 @@ addressForHost(NSString *hostname)
 	return _port;
 }
 
-- (void) send:(NSString *)data
+- (BOOL) send:(NSString *)data
 {	
 	const char		*utf8data		= [data UTF8String];
 	unsigned		len				= strlen(utf8data);	
@@ -100,17 +109,23 @@ addressForHost(NSString *hostname)
 
 	if(NO == [self isConnected]) {
 		NSLog(@"AudioScrobblerClient error: Can't send data, client not connected");
-		return;
+		return NO;
 	}
 	
-	while(totalBytesSent < bytesToSend && -1 != bytesSent) {
+	while(totalBytesSent < bytesToSend) {
 		bytesSent = send(_socket, utf8data + totalBytesSent, bytesToSend - totalBytesSent, 0);
 		
-		if(-1 == bytesSent || 0 == bytesSent)
+		if(-1 == bytesSent && EINTR == errno)
+			continue;
+		else if(-1 == bytesSent || 0 == bytesSent) {
 			NSLog(@"AudioScrobblerClient error: Unable to send data through socket: %s", strerror(errno));
+			return NO;
+		}
 		
 		totalBytesSent += bytesSent;
 	}
+	
+	return YES;
 }
 
 - (NSString *) receive
@@ -146,6 +161,44 @@ addressForHost(NSString *hostname)
 	return [result autorelease];
 }
 
+- (NSString *) receiveLine
+{
+	char		buffer			[ kBufferSize ];
+	ssize_t		bytesRead		= 0;
+	
+	if(NO == [self isConnected]) {
+		NSLog(@"AudioScrobblerClient error: Can't receive data, client not connected");
+		return nil;
+	}
+	
+	for(;;) {
+		const char	*bytes		= [_receiveBuffer bytes];
+		const char	*newline	= (0 == [_receiveBuffer length] ? NULL : memchr(bytes, '\n', [_receiveBuffer length]));
+		
+		if(NULL != newline) {
+			NSUInteger	lineLength	= newline - bytes;
+			NSString	*line		= [[NSString alloc] initWithBytes:bytes length:lineLength encoding:NSUTF8StringEncoding];
+			
+			[_receiveBuffer replaceBytesInRange:NSMakeRange(0, lineLength + 1) withBytes:NULL length:0];
+			
+			return [line autorelease];
+		}
+
+		bytesRead = recv(_socket, buffer, kBufferSize, 0);
+		if(-1 == bytesRead && EINTR == errno)
+			continue;
+		// Don't log a closed connection, since the peer may close after each reply
+		else if(-1 == bytesRead) {
+			NSLog(@"AudioScrobblerClient error: Unable to receive data through socket: %s", strerror(errno));
+			return nil;
+		}
+		else if(0 == bytesRead)
+			return nil;
+		
+		[_receiveBuffer appendBytes:buffer length:bytesRead];
+	}
+}
+
 - (void) shutdown
 {
 	int			result;
@@ -180,6 +233,8 @@ addressForHost(NSString *hostname)
 	
 	_socket		= -1;
 	_port		= 0;
+	
+	[_receiveBuffer setLength:0];
 }
 
 @end
@@ -225,6 +280,18 @@ addressForHost(NSString *hostname)
 		return NO;
 	}
 	
+	// The connection is kept open between commands, so writes after the peer closes it must not raise SIGPIPE
+	// and a peer that stops replying must not block the caller forever
+	int				noSigPipe	= 1;
+	struct timeval	timeout		= { kReceiveTimeout, 0 };
+	
+	if(-1 == setsockopt(_socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe)))
+		NSLog(@"AudioScrobblerClient error: Unable to set SO_NOSIGPIPE (%s)", strerror(errno));
+	if(-1 == setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+		NSLog(@"AudioScrobblerClient error: Unable to set SO_RCVTIMEO (%s)", strerror(errno));
+	
+	[_receiveBuffer setLength:0];
+	
 	return YES;
 }
 
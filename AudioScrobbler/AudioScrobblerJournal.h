@@ -0,0 +1,68 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#import <mach/mach.h>
+
+// ========================================
+// Journal entry keys
+// ========================================
+extern NSString * const		AudioScrobblerJournalSequenceNumberKey;		// NSNumber (unsigned long long)
+extern NSString * const		AudioScrobblerJournalCommandKey;			// NSString
+
+// ========================================
+// An append-only record of completed plays, stored as their START commands
+// A play is recorded when it ends and acknowledged once the Last.fm client
+// replies OK to the command that ended it, so plays lost to a crash or an
+// unreachable client can be replayed the next time the journal is opened
+// Records are written and flushed on a dedicated thread
+// ========================================
+@interface AudioScrobblerJournal : NSObject
+{
+	NSString				*_path;
+	int						_fd;
+	unsigned long long		_lastSequenceNumber;
+	unsigned long long		_lastAcknowledgedSequenceNumber;
+	NSArray					*_unacknowledgedEntries;
+	NSMutableArray			*_pendingRecords;
+	semaphore_t				_semaphore;
+	semaphore_t				_writerFinishedSemaphore;
+	BOOL					_writerRunning;
+	BOOL					_closing;
+}
+
++ (NSString *) defaultJournalPath;
+
+- (id) initWithPath:(NSString *)path;
+
+// The entries that were recorded but not acknowledged when the journal was opened, in order
+- (NSArray *) unacknowledgedEntries;
+
+// Returns the new entry, which is written asynchronously; thread safe
+- (NSDictionary *) appendCommand:(NSString *)command;
+
+// Acknowledges entry and all entries before it; thread safe
+- (void) acknowledgeEntry:(NSDictionary *)entry;
+
+// Waits for outstanding records to be written
+- (void) close;
+
+@end
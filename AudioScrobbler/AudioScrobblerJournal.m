@@ -0,0 +1,342 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioScrobblerJournal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// ========================================
+// Journal entry keys
+// ========================================
+NSString * const	AudioScrobblerJournalSequenceNumberKey		= @"sequenceNumber";
+NSString * const	AudioScrobblerJournalCommandKey				= @"command";
+
+// ========================================
+// The journal is a text file with one record per line:
+//   P <sequence number> <command>	a completed play, as the command that submits it
+//   A <sequence number>			the play and all before it were acknowledged
+// A partial final line is the result of an interrupted write and is ignored
+// ========================================
+
+// Once everything is acknowledged, a journal larger than this is truncated
+#define JOURNAL_COMPACTION_SIZE			(64 * 1024)
+
+@interface AudioScrobblerJournal (Private)
+- (NSArray *) readEntries;
+- (BOOL) rewriteWithEntries:(NSArray *)entries;
+- (BOOL) writeRecord:(NSString *)record;
+- (void) writeRecordsInThread:(id)dummy;
+@end
+
+@implementation AudioScrobblerJournal
+
++ (NSString *) defaultJournalPath
+{
+	NSArray *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+	if(0 == [paths count])
+		return nil;
+	
+	NSString *applicationName = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+	
+	return [[[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName] stringByAppendingPathComponent:@"AudioScrobbler.journal"];
+}
+
+- (id) initWithPath:(NSString *)path
+{
+	NSParameterAssert(nil != path);
+	
+	if((self = [super init])) {
+		_path	= [path copy];
+		_fd		= -1;
+		
+		_unacknowledgedEntries = [[self readEntries] retain];
+		
+		// Start the journal over with only the entries that still need to be sent
+		if(NO == [self rewriteWithEntries:_unacknowledgedEntries]) {
+			[self release];
+			return nil;
+		}
+		
+		_fd = open([_path fileSystemRepresentation], O_WRONLY | O_APPEND);
+		if(-1 == _fd) {
+			NSLog(@"AudioScrobblerJournal error: Unable to open \"%@\" (%s)", _path, strerror(errno));
+			[self release];
+			return nil;
+		}
+		
+		_pendingRecords = [[NSMutableArray alloc] init];
+		
+		kern_return_t result = semaphore_create(mach_task_self(), &_semaphore, SYNC_POLICY_FIFO, 0);
+		if(KERN_SUCCESS == result)
+			result = semaphore_create(mach_task_self(), &_writerFinishedSemaphore, SYNC_POLICY_FIFO, 0);
+		
+		if(KERN_SUCCESS != result) {
+			NSLog(@"Couldn't create semaphore (%s).", mach_error_type(result));
+			[self release];
+			return nil;
+		}
+		
+		// Writes and flushes can block for a long time, so they don't happen on the calling thread
+		_writerRunning = YES;
+		[NSThread detachNewThreadSelector:@selector(writeRecordsInThread:) toTarget:self withObject:nil];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[self close];
+	
+	// The writer thread closes the journal, but it never started if initialization failed
+	if(-1 != _fd && -1 == close(_fd))
+		NSLog(@"AudioScrobblerJournal error: Unable to close \"%@\" (%s)", _path, strerror(errno));
+	_fd = -1;
+	
+	if(0 != _semaphore)
+		semaphore_destroy(mach_task_self(), _semaphore), _semaphore = 0;
+	if(0 != _writerFinishedSemaphore)
+		semaphore_destroy(mach_task_self(), _writerFinishedSemaphore), _writerFinishedSemaphore = 0;
+	
+	[_path release], _path = nil;
+	[_unacknowledgedEntries release], _unacknowledgedEntries = nil;
+	[_pendingRecords release], _pendingRecords = nil;
+	
+	[super dealloc];
+}
+
+- (NSArray *) unacknowledgedEntries
+{
+	return [[_unacknowledgedEntries retain] autorelease];
+}
+
+- (NSDictionary *) appendCommand:(NSString *)command
+{
+	NSParameterAssert(nil != command);
+	
+	NSDictionary *entry = nil;
+	
+	@synchronized(self) {
+		unsigned long long	sequenceNumber	= _lastSequenceNumber + 1;
+		NSString			*record			= [command stringByTrimmingCharactersInSet:[NSCharacterSet newlineCharacterSet]];
+		
+		// An entry is created even if it can't be written, so the command is still sent
+		if(_closing)
+			NSLog(@"AudioScrobblerJournal error: Unable to record command");
+		else
+			[_pendingRecords addObject:[NSString stringWithFormat:@"P %llu %@\n", sequenceNumber, record]];
+
+		_lastSequenceNumber = sequenceNumber;
+		
+		entry = [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedLongLong:sequenceNumber], AudioScrobblerJournalSequenceNumberKey,
+			command, AudioScrobblerJournalCommandKey,
+			nil];
+	}
+	
+	semaphore_signal(_semaphore);
+	
+	return entry;
+}
+
+- (void) acknowledgeEntry:(NSDictionary *)entry
+{
+	NSParameterAssert(nil != entry);
+	
+	unsigned long long sequenceNumber = [[entry objectForKey:AudioScrobblerJournalSequenceNumberKey] unsignedLongLongValue];
+	
+	@synchronized(self) {
+		if(sequenceNumber <= _lastAcknowledgedSequenceNumber || _closing)
+			return;
+		
+		[_pendingRecords addObject:[NSString stringWithFormat:@"A %llu\n", sequenceNumber]];
+		_lastAcknowledgedSequenceNumber = sequenceNumber;
+	}
+	
+	semaphore_signal(_semaphore);
+}
+
+- (void) close
+{
+	@synchronized(self) {
+		if(NO == _writerRunning || _closing)
+			return;
+		_closing = YES;
+	}
+	
+	semaphore_signal(_semaphore);
+	semaphore_wait(_writerFinishedSemaphore);
+}
+
+@end
+
+@implementation AudioScrobblerJournal (Private)
+
+- (NSArray *) readEntries
+{
+	NSData				*data				= [NSData dataWithContentsOfFile:_path];
+	NSMutableArray		*entries			= [NSMutableArray array];
+	const char			*bytes				= [data bytes];
+	const char			*end				= bytes + [data length];
+	const char			*lineEnd;
+	unsigned long long	sequenceNumber;
+	int					commandOffset;
+	NSString			*command;
+	
+	_lastSequenceNumber				= 0;
+	_lastAcknowledgedSequenceNumber	= 0;
+	
+	while(NULL != bytes && bytes < end) {
+		lineEnd = memchr(bytes, '\n', end - bytes);
+		if(NULL == lineEnd)
+			break;
+		
+		NSString *line = [[NSString alloc] initWithBytes:bytes length:(lineEnd - bytes) encoding:NSUTF8StringEncoding];
+		const char *record = [line UTF8String];
+		
+		commandOffset = 0;
+		if(NULL != record && 1 == sscanf(record, "P %llu %n", &sequenceNumber, &commandOffset) && 0 != commandOffset) {
+			command = [NSString stringWithFormat:@"%s\n", record + commandOffset];
+			[entries addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+				[NSNumber numberWithUnsignedLongLong:sequenceNumber], AudioScrobblerJournalSequenceNumberKey,
+				command, AudioScrobblerJournalCommandKey,
+				nil]];
+			
+			if(sequenceNumber > _lastSequenceNumber)
+				_lastSequenceNumber = sequenceNumber;
+		}
+		else if(NULL != record && 1 == sscanf(record, "A %llu", &sequenceNumber)) {
+			if(sequenceNumber > _lastAcknowledgedSequenceNumber)
+				_lastAcknowledgedSequenceNumber = sequenceNumber;
+		}
+		else
+			NSLog(@"AudioScrobblerJournal error: Skipping malformed record \"%@\"", line);
+		
+		[line release];
+		bytes = lineEnd + 1;
+	}
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"%K > %llu", AudioScrobblerJournalSequenceNumberKey, _lastAcknowledgedSequenceNumber];
+	return [entries filteredArrayUsingPredicate:predicate];
+}
+
+// Writes to a temporary file which replaces the journal, so a crash leaves either the old or the new journal
+- (BOOL) rewriteWithEntries:(NSArray *)entries
+{
+	NSMutableString *contents = [NSMutableString string];
+	
+	for(NSDictionary *entry in entries)
+		[contents appendFormat:@"P %llu %@\n", 
+			[[entry objectForKey:AudioScrobblerJournalSequenceNumberKey] unsignedLongLongValue],
+			[[entry objectForKey:AudioScrobblerJournalCommandKey] stringByTrimmingCharactersInSet:[NSCharacterSet newlineCharacterSet]]];
+	
+	NSString *directory = [_path stringByDeletingLastPathComponent];
+	if(NO == [[NSFileManager defaultManager] fileExistsAtPath:directory])
+		[[NSFileManager defaultManager] createDirectoryAtPath:directory attributes:nil];
+	
+	if(NO == [[contents dataUsingEncoding:NSUTF8StringEncoding] writeToFile:_path atomically:YES]) {
+		NSLog(@"AudioScrobblerJournal error: Unable to write \"%@\"", _path);
+		return NO;
+	}
+	
+	return YES;
+}
+
+// Records are written with a single call, so a record is either complete or a partial final line
+- (BOOL) writeRecord:(NSString *)record
+{
+	if(-1 == _fd)
+		return NO;
+	
+	const char	*bytes			= [record UTF8String];
+	size_t		length			= strlen(bytes);
+	ssize_t		bytesWritten;
+	
+	while(0 < length) {
+		bytesWritten = write(_fd, bytes, length);
+		if(-1 == bytesWritten) {
+			if(EINTR == errno)
+				continue;
+			
+			NSLog(@"AudioScrobblerJournal error: Unable to write to \"%@\" (%s)", _path, strerror(errno));
+			return NO;
+		}
+		
+		bytes	+= bytesWritten;
+		length	-= bytesWritten;
+	}
+	
+	return YES;
+}
+
+- (void) writeRecordsInThread:(id)dummy
+{
+	NSAutoreleasePool	*pool			= [[NSAutoreleasePool alloc] init];
+	NSArray				*records		= nil;
+	BOOL				closing			= NO;
+	BOOL				acknowledged	= NO;
+	
+	for(;;) {
+		semaphore_wait(_semaphore);
+		
+		NSAutoreleasePool *loopPool = [[NSAutoreleasePool alloc] init];
+		
+		// Records queued before close was requested are always written
+		@synchronized(self) {
+			records = [[_pendingRecords copy] autorelease];
+			[_pendingRecords removeAllObjects];
+			closing = _closing;
+		}
+		
+		// Records that arrived together share a single flush
+		if(0 != [records count]) {
+			for(NSString *record in records)
+				[self writeRecord:record];
+			
+			if(-1 == fsync(_fd))
+				NSLog(@"AudioScrobblerJournal error: Unable to flush \"%@\" (%s)", _path, strerror(errno));
+		}
+		
+		@synchronized(self) {
+			acknowledged = (0 == [_pendingRecords count] && _lastAcknowledgedSequenceNumber == _lastSequenceNumber);
+		}
+		
+		// Nothing is left to replay, so the journal can be emptied
+		if(acknowledged && (closing || JOURNAL_COMPACTION_SIZE < lseek(_fd, 0, SEEK_END))) {
+			if(-1 == ftruncate(_fd, 0))
+				NSLog(@"AudioScrobblerJournal error: Unable to truncate \"%@\" (%s)", _path, strerror(errno));
+		}
+		
+		[loopPool release];
+		
+		if(closing)
+			break;
+	}
+	
+	if(-1 == close(_fd))
+		NSLog(@"AudioScrobblerJournal error: Unable to close \"%@\" (%s)", _path, strerror(errno));
+	_fd = -1;
+	
+	semaphore_signal(_writerFinishedSemaphore);
+	
+	[pool release];
+}
+
+@end
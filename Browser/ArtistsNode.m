@@ -52,6 +52,11 @@
 													 name:AudioStreamsAddedToLibraryNotification
 												   object:nil];
 		
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(streamsChanged:) 
+													 name:AudioStreamsDidChangeNotification
+												   object:nil];
+		
 		[[NSNotificationCenter defaultCenter] addObserver:self 
 												 selector:@selector(streamsChanged:) 
 													 name:AudioStreamRemovedFromLibraryNotification
@@ -76,7 +81,9 @@
 
 - (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
 {
-	[self loadChildren];
+	// Changes made during an update reach the database when it finishes
+	if(NO == [[CollectionManager manager] updateInProgress])
+		[self loadChildren];
 }
 
 @end
@@ -90,9 +97,7 @@
 
 - (void) loadChildren
 {
-	NSString		*keyName		= [NSString stringWithFormat:@"@distinctUnionOfObjects.%@", MetadataArtistKey];
-	NSArray			*streams		= [[[CollectionManager manager] streamManager] streams];
-	NSArray			*artists		= [[streams valueForKeyPath:keyName] sortedArrayUsingSelector:@selector(compare:)];
+	NSArray			*artists		= [[[[CollectionManager manager] streamManager] artistNames] sortedArrayUsingSelector:@selector(compare:)];
 	ArtistNode		*node			= nil;
 
 	[self willChangeValueForKey:@"children"];
@@ -28,6 +28,7 @@
 extern NSString * const		StreamURLKey;
 extern NSString * const		StreamStartingFrameKey;
 extern NSString * const		StreamFrameCountKey;
+extern NSString * const		StreamPregapFrameCountKey;
 
 extern NSString * const		StatisticsDateAddedKey;
 extern NSString * const		StatisticsFirstPlayedDateKey;
@@ -55,12 +56,21 @@ extern NSString * const		MetadataMCNKey;
 extern NSString * const		MetadataBPMKey;
 extern NSString * const		MetadataMusicDNSPUIDKey;
 extern NSString * const		MetadataMusicBrainzIDKey;
+extern NSString * const		MetadataAlbumArtOffsetKey;
+extern NSString * const		MetadataAlbumArtLengthKey;
+extern NSString * const		MetadataAlbumArtMIMETypeKey;
+extern NSString * const		MetadataAlbumArtHashKey;
 
 extern NSString * const		ReplayGainReferenceLoudnessKey;
 extern NSString * const		ReplayGainTrackGainKey;
 extern NSString * const		ReplayGainTrackPeakKey;
 extern NSString * const		ReplayGainAlbumGainKey;
 extern NSString * const		ReplayGainAlbumPeakKey;
+extern NSString * const		ReplayGainTrackTruePeakKey;
+extern NSString * const		ReplayGainAlbumTruePeakKey;
+extern NSString * const		LoudnessTrackIntegratedKey;
+extern NSString * const		LoudnessTrackRangeKey;
+extern NSString * const		LoudnessAlbumIntegratedKey;
 
 extern NSString * const		PropertiesFileTypeKey;
 extern NSString * const		PropertiesDataFormatKey;
@@ -106,6 +116,11 @@ extern NSString * const		PropertiesBitrateKey;
 
 - (BOOL) isPartOfCueSheet;
 
+// The track's audio, from INDEX 01 for cue sheet tracks
 - (id <AudioDecoderMethods>) decoder:(NSError **)error;
 
+// The track's audio preceded by any pregap played with it, which isn't counted in its duration
+- (UInt32) playablePregapFrameCount;
+- (id <AudioDecoderMethods>) playbackDecoder:(NSError **)error;
+
 @end
@@ -23,14 +23,16 @@
 #import "AudioStreamManager.h"
 #import "AudioPropertiesReader.h"
 #import "AudioMetadataReader.h"
-#import "AudioMetadataWriter.h"
+#import "AudioMetadataWriteQueue.h"
 #import "AudioLibrary.h"
 #import "AudioDecoder.h"
+#import "FLACDecoder.h"
 #import "LoopableRegionDecoder.h"
 
 NSString * const	StreamURLKey							= @"url";
 NSString * const	StreamStartingFrameKey					= @"startingFrame";
 NSString * const	StreamFrameCountKey						= @"frameCount";
+NSString * const	StreamPregapFrameCountKey				= @"pregapFrameCount";
 
 NSString * const	StatisticsDateAddedKey					= @"dateAdded";
 NSString * const	StatisticsFirstPlayedDateKey			= @"firstPlayed";
@@ -58,12 +60,21 @@ NSString * const	MetadataMCNKey							= @"mcn";
 NSString * const	MetadataBPMKey							= @"bpm";
 NSString * const	MetadataMusicDNSPUIDKey					= @"musicDNSPUID";
 NSString * const	MetadataMusicBrainzIDKey				= @"musicBrainzID";
+NSString * const	MetadataAlbumArtOffsetKey				= @"albumArtOffset";
+NSString * const	MetadataAlbumArtLengthKey				= @"albumArtLength";
+NSString * const	MetadataAlbumArtMIMETypeKey				= @"albumArtMIMEType";
+NSString * const	MetadataAlbumArtHashKey					= @"albumArtHash";
 
 NSString * const	ReplayGainReferenceLoudnessKey			= @"referenceLoudness";
 NSString * const	ReplayGainTrackGainKey					= @"trackGain";
 NSString * const	ReplayGainTrackPeakKey					= @"trackPeak";
 NSString * const	ReplayGainAlbumGainKey					= @"albumGain";
 NSString * const	ReplayGainAlbumPeakKey					= @"albumPeak";
+NSString * const	ReplayGainTrackTruePeakKey				= @"trackTruePeak";
+NSString * const	ReplayGainAlbumTruePeakKey				= @"albumTruePeak";
+NSString * const	LoudnessTrackIntegratedKey				= @"trackLoudness";
+NSString * const	LoudnessTrackRangeKey					= @"trackLoudnessRange";
+NSString * const	LoudnessAlbumIntegratedKey				= @"albumLoudness";
 
 NSString * const	PropertiesFileTypeKey					= @"fileType";
 NSString * const	PropertiesDataFormatKey					= @"dataFormat";
@@ -136,6 +147,7 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 	[self setValue:nil forKey:PropertiesSampleRateKey];
 	[self setValue:nil forKey:PropertiesTotalFramesKey];
 	[self setValue:nil forKey:PropertiesBitrateKey];
+	[[[CollectionManager manager] streamManager] saveSeekIndex:nil forStream:self];
 }
 
 - (IBAction) clearMetadata:(id)sender
@@ -158,6 +170,10 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 	[self setValue:nil forKey:MetadataBPMKey];
 	[self setValue:nil forKey:MetadataMusicDNSPUIDKey];
 	[self setValue:nil forKey:MetadataMusicBrainzIDKey];
+	[self setValue:nil forKey:MetadataAlbumArtOffsetKey];
+	[self setValue:nil forKey:MetadataAlbumArtLengthKey];
+	[self setValue:nil forKey:MetadataAlbumArtMIMETypeKey];
+	[self setValue:nil forKey:MetadataAlbumArtHashKey];
 }
 
 - (IBAction) clearReplayGain:(id)sender
@@ -167,6 +183,11 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 	[self setValue:nil forKey:ReplayGainTrackPeakKey];
 	[self setValue:nil forKey:ReplayGainAlbumGainKey];
 	[self setValue:nil forKey:ReplayGainAlbumPeakKey];
+	[self setValue:nil forKey:ReplayGainTrackTruePeakKey];
+	[self setValue:nil forKey:ReplayGainAlbumTruePeakKey];
+	[self setValue:nil forKey:LoudnessTrackIntegratedKey];
+	[self setValue:nil forKey:LoudnessTrackRangeKey];
+	[self setValue:nil forKey:LoudnessAlbumIntegratedKey];
 }
 
 - (IBAction) rescanProperties:(id)sender
@@ -236,27 +257,7 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 
 - (IBAction) saveMetadata:(id)sender
 {
-	// FIXME: Save album-only metadata to original file?
-	if([self isPartOfCueSheet])
-		return;
-	
-	NSError					*error				= nil;
-	AudioMetadataWriter		*metadataWriter		= [AudioMetadataWriter metadataWriterForURL:[self valueForKey:StreamURLKey] error:&error];
-	
-	if(nil == metadataWriter) {
-/*		if(nil != error)
-			[[AudioLibrary library] presentError:error];
-		*/
-		return;
-	}
-	
-	BOOL result = [metadataWriter writeMetadata:self error:&error];
-	if(NO == result) {
-/*		if(nil != error)
-			[[AudioLibrary library] presentError:error];
-		*/
-		return;
-	}	
+	[[AudioMetadataWriteQueue sharedQueue] writeMetadataForStream:self];
 }
 
 - (NSString *) trackString
@@ -331,8 +332,39 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 									  startingFrame:[[self valueForKey:StreamStartingFrameKey] longLongValue]
 										 frameCount:[[self valueForKey:StreamFrameCountKey] unsignedIntValue]
 											  error:error];
-	else
-		return [AudioDecoder decoderWithURL:[self valueForKey:StreamURLKey] error:error];
+	else {
+		AudioDecoder *decoder = [AudioDecoder decoderWithURL:[self valueForKey:StreamURLKey] error:error];
+		
+		// Decoders that build a frame index can reuse the one saved from previous playback
+		if([decoder isKindOfClass:[FLACDecoder class]])
+			[(FLACDecoder *)decoder setSeekIndex:[[[CollectionManager manager] streamManager] seekIndexForStream:self]];
+		
+		return decoder;
+	}
+}
+
+- (UInt32) playablePregapFrameCount
+{
+	if(NO == [self isPartOfCueSheet])
+		return 0;
+	
+	SInt64		startingFrame		= [[self valueForKey:StreamStartingFrameKey] longLongValue];
+	UInt32		pregapFrameCount	= [[self valueForKey:StreamPregapFrameCountKey] unsignedIntValue];
+	
+	// The pregap can't start before the file does
+	return (pregapFrameCount > startingFrame ? (UInt32)startingFrame : pregapFrameCount);
+}
+
+- (id <AudioDecoderMethods>) playbackDecoder:(NSError **)error
+{
+	UInt32 pregapFrameCount = [self playablePregapFrameCount];
+	if(0 == pregapFrameCount)
+		return [self decoder:error];
+	
+	return [LoopableRegionDecoder decoderWithURL:[self valueForKey:StreamURLKey] 
+								  startingFrame:[[self valueForKey:StreamStartingFrameKey] longLongValue] - pregapFrameCount
+									 frameCount:[[self valueForKey:StreamFrameCountKey] unsignedIntValue] + pregapFrameCount
+										  error:error];
 }
 
 - (void) save
@@ -371,6 +403,7 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 			StreamURLKey,
 			StreamStartingFrameKey,
 			StreamFrameCountKey,
+			StreamPregapFrameCountKey,
 			
 			StatisticsDateAddedKey,
 			StatisticsFirstPlayedDateKey,
@@ -398,12 +431,21 @@ NSString * const	PropertiesBitrateKey					= @"bitrate";
 			MetadataBPMKey,
 			MetadataMusicDNSPUIDKey,
 			MetadataMusicBrainzIDKey,
+			MetadataAlbumArtOffsetKey,
+			MetadataAlbumArtLengthKey,
+			MetadataAlbumArtMIMETypeKey,
+			MetadataAlbumArtHashKey,
 
 			ReplayGainReferenceLoudnessKey,
 			ReplayGainTrackGainKey,
 			ReplayGainTrackPeakKey,
 			ReplayGainAlbumGainKey,
 			ReplayGainAlbumPeakKey,
+			ReplayGainTrackTruePeakKey,
+			ReplayGainAlbumTruePeakKey,
+			LoudnessTrackIntegratedKey,
+			LoudnessTrackRangeKey,
+			LoudnessAlbumIntegratedKey,
 			
 			PropertiesFileTypeKey,
 			PropertiesDataFormatKey,
@@ -47,6 +47,7 @@
 	BOOL					_updating;				// Indicates if a transaction is in progress
 	
 	NSArray					*_streamKeys;			// AudioStream (aggregate) keys this object supports
+	NSString				*_databasePath;			// The database file, used to locate the snapshot
 }
 
 // ========================================
@@ -63,6 +64,18 @@
 - (NSArray *) streamsForGenre:(NSString *)genre;
 - (NSArray *) streamsForComposer:(NSString *)composer;
 
+// Distinct values in use, read from the artist, album, genre and composer tables
+- (NSArray *) artistNames;
+- (NSArray *) albumTitles;
+- (NSArray *) genreNames;
+- (NSArray *) composerNames;
+
+// Rename a value in every stream that uses it; renaming to a value already in use merges the two
+- (void) renameArtist:(NSString *)artist toName:(NSString *)name;
+- (void) renameAlbumTitle:(NSString *)albumTitle toTitle:(NSString *)title;
+- (void) renameGenre:(NSString *)genre toName:(NSString *)name;
+- (void) renameComposer:(NSString *)composer toName:(NSString *)name;
+
 - (NSArray *) streamsContainedByURL:(NSURL *)url;
 
 - (BOOL) insertStream:(AudioStream *)stream;
@@ -70,6 +83,10 @@
 - (void) deleteStream:(AudioStream *)stream;
 - (void) revertStream:(AudioStream *)stream;
 
+// Frame indexes are large and only needed by decoders, so they aren't loaded with the stream
+- (NSData *) seekIndexForStream:(AudioStream *)stream;
+- (void) saveSeekIndex:(NSData *)seekIndex forStream:(AudioStream *)stream;
+
 @end
 
 // ========================================
@@ -79,6 +96,8 @@
 @interface AudioStreamManager (CollectionManagerMethods)
 - (BOOL) connectedToDatabase:(sqlite3 *)db error:(NSError **)error;
 - (BOOL) disconnectedFromDatabase:(NSError **)error;
+- (void) setDatabasePath:(NSString *)databasePath;
+- (BOOL) writeSnapshot;
 - (void) reset;
 
 - (void) beginUpdate;
@@ -27,6 +27,8 @@
 #import "AudioLibrary.h"
 
 #import "SQLiteUtilityFunctions.h"
+#import "AudioStreamSnapshot.h"
+#import "StringInterning.h"
 
 @interface AudioStreamManager (Private)
 - (BOOL) prepareSQL:(NSError **)error;
@@ -37,6 +39,9 @@
 - (BOOL) updateInProgress;
 
 - (NSArray *) fetchStreams;
+- (NSArray *) fetchNames:(NSString *)action;
+- (void) renameValue:(NSString *)value toValue:(NSString *)newValue action:(NSString *)action keys:(NSArray *)keys;
+- (NSString *) snapshotPath;
 
 - (AudioStream *) loadStream:(sqlite3_stmt *)statement;
 
@@ -74,6 +79,7 @@
 	[_deletedStreams release], _deletedStreams = nil;
 
 	[_streamKeys release], _streamKeys = nil;
+	[_databasePath release], _databasePath = nil;
 
 	_db = NULL;
 
@@ -85,8 +91,16 @@
 - (NSArray *) streams
 {
 	@synchronized(self) {
-		if(nil == _cachedStreams)
+		if(nil == _cachedStreams) {
 			_cachedStreams = [[self fetchStreams] retain];
+			
+			if([[NSUserDefaults standardUserDefaults] boolForKey:@"logStringInterningStatistics"]) {
+				unsigned			stringCount, duplicateCount;
+				unsigned long long	bytesSaved;
+				getStringInterningStatistics(&stringCount, &duplicateCount, &bytesSaved);
+				NSLog(@"AudioStreamManager: Interned %u distinct strings for %u streams, replacing %u duplicates (%llu KB saved)", stringCount, [_cachedStreams count], duplicateCount, bytesSaved / 1024);
+			}
+		}
 	}
 	return _cachedStreams;
 }
@@ -119,6 +133,46 @@
 	return [[self streams] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"%K == %@", MetadataComposerKey, composer]];
 }
 
+- (NSArray *) artistNames
+{
+	return [self fetchNames:@"select_artist_names"];
+}
+
+- (NSArray *) albumTitles
+{
+	return [self fetchNames:@"select_album_titles"];
+}
+
+- (NSArray *) genreNames
+{
+	return [self fetchNames:@"select_genre_names"];
+}
+
+- (NSArray *) composerNames
+{
+	return [self fetchNames:@"select_composer_names"];
+}
+
+- (void) renameArtist:(NSString *)artist toName:(NSString *)name
+{
+	[self renameValue:artist toValue:name action:@"rename_artist" keys:[NSArray arrayWithObjects:MetadataArtistKey, MetadataAlbumArtistKey, nil]];
+}
+
+- (void) renameAlbumTitle:(NSString *)albumTitle toTitle:(NSString *)title
+{
+	[self renameValue:albumTitle toValue:title action:@"rename_album" keys:[NSArray arrayWithObject:MetadataAlbumTitleKey]];
+}
+
+- (void) renameGenre:(NSString *)genre toName:(NSString *)name
+{
+	[self renameValue:genre toValue:name action:@"rename_genre" keys:[NSArray arrayWithObject:MetadataGenreKey]];
+}
+
+- (void) renameComposer:(NSString *)composer toName:(NSString *)name
+{
+	[self renameValue:composer toValue:name action:@"rename_composer" keys:[NSArray arrayWithObject:MetadataComposerKey]];
+}
+
 - (NSArray *) streamsContainedByURL:(NSURL *)url
 {
 	NSParameterAssert(nil != url);
@@ -311,6 +365,75 @@
 		[self didChange:NSKeyValueChangeSetting valuesAtIndexes:indexes forKey:@"streams"];
 }
 
+// ========================================
+// Frame indexes
+- (NSData *) seekIndexForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	if(nil == [stream valueForKey:ObjectIDKey])
+		return nil;
+	
+	NSData			*seekIndex		= nil;
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_seek_index"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	// Decoders may be created off the main thread
+	@synchronized(self) {
+		result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":id"), [[stream valueForKey:ObjectIDKey] unsignedIntValue]);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		while(SQLITE_ROW == (result = sqlite3_step(statement))) {
+			if(SQLITE_NULL != sqlite3_column_type(statement, 0))
+				seekIndex = [NSData dataWithBytes:sqlite3_column_blob(statement, 0) length:sqlite3_column_bytes(statement, 0)];
+		}
+		
+		NSAssert1(SQLITE_DONE == result, @"Error while fetching seek index (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_reset(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	}
+	
+	return seekIndex;
+}
+
+- (void) saveSeekIndex:(NSData *)seekIndex forStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	if(nil == [stream valueForKey:ObjectIDKey])
+		return;
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"update_seek_index"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	@synchronized(self) {
+		result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":id"), [[stream valueForKey:ObjectIDKey] unsignedIntValue]);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		if(nil == seekIndex)
+			result = sqlite3_bind_null(statement, sqlite3_bind_parameter_index(statement, ":seek_index"));
+		else
+			result = sqlite3_bind_blob(statement, sqlite3_bind_parameter_index(statement, ":seek_index"), [seekIndex bytes], [seekIndex length], SQLITE_TRANSIENT);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_step(statement);
+		NSAssert1(SQLITE_DONE == result, @"Unable to save seek index (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_reset(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_clear_bindings(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	}
+}
+
 #pragma mark Metadata support
 
 - (id) valueForKey:(NSString *)key
@@ -335,10 +458,30 @@
 
 - (BOOL) disconnectedFromDatabase:(NSError **)error
 {
+	[self writeSnapshot];
+	
 	_db = NULL;
 	return [self finalizeSQL:error];
 }
 
+- (void) setDatabasePath:(NSString *)databasePath
+{
+	[_databasePath release];
+	_databasePath = [databasePath copy];
+}
+
+// Only the saved state of loaded streams is written, and only if the snapshot is out of date
+- (BOOL) writeSnapshot
+{
+	if(nil == _databasePath || nil == _cachedStreams)
+		return NO;
+	
+	if(audioStreamSnapshotIsCurrent([self snapshotPath], _databasePath))
+		return YES;
+	
+	return writeAudioStreamSnapshot(_cachedStreams, [self snapshotPath], _databasePath);
+}
+
 - (void) reset
 {
 	[self willChangeValueForKey:@"streams"];
@@ -586,7 +729,10 @@
 	NSString		*path				= nil;
 	NSString		*sql				= nil;
 	NSArray			*files				= [NSArray arrayWithObjects:
-		@"select_all_streams", @"select_stream_by_id", @"select_stream_by_url", @"select_streams_for_playlist", @"insert_stream", @"update_stream", @"delete_stream", nil];
+		@"select_all_streams", @"select_stream_by_id", @"select_stream_by_url", @"select_streams_for_playlist", @"insert_stream", @"update_stream", @"delete_stream",
+		@"select_seek_index", @"update_seek_index",
+		@"select_artist_names", @"select_album_titles", @"select_genre_names", @"select_composer_names",
+		@"rename_artist", @"rename_album", @"rename_genre", @"rename_composer", nil];
 	sqlite3_stmt	*statement			= NULL;
 	const char		*tail				= NULL;
 	
@@ -667,8 +813,35 @@
 
 #pragma mark Object Loading
 
+- (NSString *) snapshotPath
+{
+	return [[_databasePath stringByDeletingPathExtension] stringByAppendingPathExtension:@"snapshot"];
+}
+
 - (NSArray *) fetchStreams
 {
+	// A current snapshot holds the same rows as the database and loads without stepping through SQLite
+	if(nil != _databasePath) {
+		NSArray *snapshotStreams = readAudioStreamSnapshot([self snapshotPath], _databasePath);
+		if(nil != snapshotStreams) {
+			NSMutableArray *streams = [[NSMutableArray alloc] initWithCapacity:[snapshotStreams count]];
+			
+			for(AudioStream *stream in snapshotStreams) {
+				unsigned objectID = [[stream valueForKey:ObjectIDKey] unsignedIntValue];
+				AudioStream *registeredStream = (AudioStream *)NSMapGet(_registeredStreams, (void *)objectID);
+				
+				if(nil != registeredStream)
+					[streams addObject:registeredStream];
+				else {
+					NSMapInsert(_registeredStreams, (void *)objectID, (void *)stream);
+					[streams addObject:stream];
+				}
+			}
+			
+			return [streams autorelease];
+		}
+	}
+	
 	NSMutableArray	*streams		= [[NSMutableArray alloc] init];
 	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_all_streams"];
 	int				result			= SQLITE_OK;
@@ -700,6 +873,98 @@
 	return [streams autorelease];
 }
 
+- (NSArray *) fetchNames:(NSString *)action
+{
+	NSParameterAssert(nil != action);
+	
+	NSMutableArray	*names			= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:action];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		[names addObject:internString([NSString stringWithCString:(const char *)sqlite3_column_text(statement, 0) encoding:NSUTF8StringEncoding])];
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching names (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	return [names autorelease];
+}
+
+- (void) renameValue:(NSString *)value toValue:(NSString *)newValue action:(NSString *)action keys:(NSArray *)keys
+{
+	NSParameterAssert(nil != value);
+	NSParameterAssert(nil != newValue);
+	NSParameterAssert(nil != action);
+	NSParameterAssert(nil != keys);
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NO == [self updateInProgress], @"Unable to rename during an update");
+	
+	if([value isEqualToString:newValue])
+		return;
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:action];
+	int				result			= SQLITE_OK;
+	
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	// The triggers rewrite the matching stream columns, and merge the two rows if newValue is already in use
+	@synchronized(self) {
+		result = sqlite3_bind_text(statement, sqlite3_bind_parameter_index(statement, ":value"), [value UTF8String], -1, SQLITE_TRANSIENT);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_bind_text(statement, sqlite3_bind_parameter_index(statement, ":new_value"), [newValue UTF8String], -1, SQLITE_TRANSIENT);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_step(statement);
+		NSAssert2(SQLITE_DONE == result, @"Unable to rename \"%@\" (%@).", value, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_reset(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_clear_bindings(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	}
+	
+	// Bring the cached streams into line with the database, without saving them again
+	NSMutableSet		*changedStreams		= [NSMutableSet set];
+	NSMutableIndexSet	*indexes			= [NSMutableIndexSet indexSet];
+	NSArray				*streams			= [self streams];
+	NSString			*internedValue		= internString(newValue);
+	unsigned			i;
+	
+	for(NSString *key in keys) {
+		[indexes removeAllIndexes];
+		
+		for(i = 0; i < [streams count]; ++i) {
+			if([value isEqualToString:[[streams objectAtIndex:i] savedValueForKey:key]])
+				[indexes addIndex:i];
+		}
+		
+		if(0 == [indexes count])
+			continue;
+		
+		[self willChange:NSKeyValueChangeSetting valuesAtIndexes:indexes forKey:key];
+		
+		for(AudioStream *stream in [streams objectsAtIndexes:indexes]) {
+			[stream initValue:internedValue forKey:key];
+			[changedStreams addObject:stream];
+		}
+		
+		[self didChange:NSKeyValueChangeSetting valuesAtIndexes:indexes forKey:key];
+	}
+	
+	if(0 != [changedStreams count])
+		[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamsDidChangeNotification 
+															object:self
+														  userInfo:[NSDictionary dictionaryWithObject:[changedStreams allObjects] forKey:AudioStreamsObjectKey]];
+}
+
 - (AudioStream *) loadStream:(sqlite3_stmt *)statement
 {
 	NSParameterAssert(NULL != statement);
@@ -770,6 +1035,25 @@
 	getColumnValue(statement, 39, stream, PropertiesSampleRateKey, eObjectTypeDouble);
 	getColumnValue(statement, 40, stream, PropertiesTotalFramesKey, eObjectTypeLongLong);
 	getColumnValue(statement, 41, stream, PropertiesBitrateKey, eObjectTypeDouble);
+	// Column 42 is the frame index, which is loaded on demand
+
+	// Album art
+	getColumnValue(statement, 43, stream, MetadataAlbumArtOffsetKey, eObjectTypeLongLong);
+	getColumnValue(statement, 44, stream, MetadataAlbumArtLengthKey, eObjectTypeUnsignedInt);
+	getColumnValue(statement, 45, stream, MetadataAlbumArtMIMETypeKey, eObjectTypeString);
+	getColumnValue(statement, 46, stream, MetadataAlbumArtHashKey, eObjectTypeString);
+
+	// Loudness
+	getColumnValue(statement, 47, stream, LoudnessTrackIntegratedKey, eObjectTypeDouble);
+	getColumnValue(statement, 48, stream, LoudnessTrackRangeKey, eObjectTypeDouble);
+	getColumnValue(statement, 49, stream, LoudnessAlbumIntegratedKey, eObjectTypeDouble);
+
+	// True peaks
+	getColumnValue(statement, 50, stream, ReplayGainTrackTruePeakKey, eObjectTypeDouble);
+	getColumnValue(statement, 51, stream, ReplayGainAlbumTruePeakKey, eObjectTypeDouble);
+
+	// Pregap (after the normalized metadata IDs, which aren't loaded)
+	getColumnValue(statement, 57, stream, StreamPregapFrameCountKey, eObjectTypeUnsignedInt);
 		
 	// Register the object	
 	NSMapInsert(_registeredStreams, (void *)objectID, (void *)stream);
@@ -846,6 +1130,24 @@
 		bindParameter(statement, 39, stream, PropertiesSampleRateKey, eObjectTypeDouble);
 		bindParameter(statement, 40, stream, PropertiesTotalFramesKey, eObjectTypeLongLong);
 		bindParameter(statement, 41, stream, PropertiesBitrateKey, eObjectTypeDouble);
+
+		// Album art
+		bindParameter(statement, 42, stream, MetadataAlbumArtOffsetKey, eObjectTypeLongLong);
+		bindParameter(statement, 43, stream, MetadataAlbumArtLengthKey, eObjectTypeUnsignedInt);
+		bindParameter(statement, 44, stream, MetadataAlbumArtMIMETypeKey, eObjectTypeString);
+		bindParameter(statement, 45, stream, MetadataAlbumArtHashKey, eObjectTypeString);
+
+		// Loudness
+		bindParameter(statement, 46, stream, LoudnessTrackIntegratedKey, eObjectTypeDouble);
+		bindParameter(statement, 47, stream, LoudnessTrackRangeKey, eObjectTypeDouble);
+		bindParameter(statement, 48, stream, LoudnessAlbumIntegratedKey, eObjectTypeDouble);
+
+		// True peaks
+		bindParameter(statement, 49, stream, ReplayGainTrackTruePeakKey, eObjectTypeDouble);
+		bindParameter(statement, 50, stream, ReplayGainAlbumTruePeakKey, eObjectTypeDouble);
+
+		// Pregap
+		bindParameter(statement, 51, stream, StreamPregapFrameCountKey, eObjectTypeUnsignedInt);
 		
 		result = sqlite3_step(statement);
 		NSAssert2(SQLITE_DONE == result, @"Unable to insert a record for %@ (%@).", [[NSFileManager defaultManager] displayNameAtPath:[[stream valueForKey:StreamURLKey] path]], [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
@@ -948,6 +1250,24 @@
 	bindNamedParameter(statement, ":sample_rate", stream, PropertiesSampleRateKey, eObjectTypeDouble);
 	bindNamedParameter(statement, ":total_frames", stream, PropertiesTotalFramesKey, eObjectTypeLongLong);
 	bindNamedParameter(statement, ":bitrate", stream, PropertiesBitrateKey, eObjectTypeDouble);
+
+	// Album art
+	bindNamedParameter(statement, ":album_art_offset", stream, MetadataAlbumArtOffsetKey, eObjectTypeLongLong);
+	bindNamedParameter(statement, ":album_art_length", stream, MetadataAlbumArtLengthKey, eObjectTypeUnsignedInt);
+	bindNamedParameter(statement, ":album_art_mime_type", stream, MetadataAlbumArtMIMETypeKey, eObjectTypeString);
+	bindNamedParameter(statement, ":album_art_hash", stream, MetadataAlbumArtHashKey, eObjectTypeString);
+
+	// Loudness
+	bindNamedParameter(statement, ":track_loudness", stream, LoudnessTrackIntegratedKey, eObjectTypeDouble);
+	bindNamedParameter(statement, ":track_loudness_range", stream, LoudnessTrackRangeKey, eObjectTypeDouble);
+	bindNamedParameter(statement, ":album_loudness", stream, LoudnessAlbumIntegratedKey, eObjectTypeDouble);
+
+	// True peaks
+	bindNamedParameter(statement, ":track_true_peak", stream, ReplayGainTrackTruePeakKey, eObjectTypeDouble);
+	bindNamedParameter(statement, ":album_true_peak", stream, ReplayGainAlbumTruePeakKey, eObjectTypeDouble);
+
+	// Pregap
+	bindNamedParameter(statement, ":pregap_frame_count", stream, StreamPregapFrameCountKey, eObjectTypeUnsignedInt);
 	
 	result = sqlite3_step(statement);
 	NSAssert2(SQLITE_DONE == result, @"Unable to update the record for %@ (%@).", stream, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
@@ -1015,6 +1335,7 @@
 				StreamURLKey,
 				StreamStartingFrameKey,
 				StreamFrameCountKey,
+				StreamPregapFrameCountKey,
 				
 				StatisticsDateAddedKey,
 				StatisticsFirstPlayedDateKey,
@@ -1043,12 +1364,21 @@
 
 				MetadataMusicDNSPUIDKey,
 				MetadataMusicBrainzIDKey,
+				MetadataAlbumArtOffsetKey,
+				MetadataAlbumArtLengthKey,
+				MetadataAlbumArtMIMETypeKey,
+				MetadataAlbumArtHashKey,
 
 				ReplayGainReferenceLoudnessKey,
 				ReplayGainTrackGainKey,
 				ReplayGainTrackPeakKey,
 				ReplayGainAlbumGainKey,
 				ReplayGainAlbumPeakKey,
+				ReplayGainTrackTruePeakKey,
+				ReplayGainAlbumTruePeakKey,
+				LoudnessTrackIntegratedKey,
+				LoudnessTrackRangeKey,
+				LoudnessAlbumIntegratedKey,
 
 				PropertiesFileTypeKey,
 				PropertiesDataFormatKey,
@@ -0,0 +1,47 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// ========================================
+	// A memory-mappable copy of the streams table, kept next to the database so the library can be
+	// loaded without stepping through SQLite
+	// Each column is stored as a null bitmap followed by fixed-width values; strings, URLs and blobs
+	// are (offset, length) pairs into a shared pool in which each distinct string appears once
+	// The snapshot records the database's file change counter and size and is ignored once either differs
+	// ========================================
+
+	// Returns YES if the snapshot at snapshotPath matches the current contents of the database
+	BOOL audioStreamSnapshotIsCurrent(NSString *snapshotPath, NSString *databasePath);
+
+	// Writes the saved values of streams to snapshotPath, atomically
+	BOOL writeAudioStreamSnapshot(NSArray *streams, NSString *snapshotPath, NSString *databasePath);
+
+	// Returns new AudioStream objects for every row in the snapshot, or nil if the snapshot is missing, damaged or out of date
+	// Only the IDs are decoded up front; other values are read from the mapped snapshot as they are first accessed
+	NSArray * readAudioStreamSnapshot(NSString *snapshotPath, NSString *databasePath);
+
+#ifdef __cplusplus
+}
+#endif
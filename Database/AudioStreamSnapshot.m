@@ -0,0 +1,676 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioStreamSnapshot.h"
+#import "AudioStream.h"
+#import "SQLiteUtilityFunctions.h"
+#import "StringInterning.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libkern/OSByteOrder.h>
+
+#define SNAPSHOT_MAGIC		'PLSS'
+#define SNAPSHOT_VERSION	1
+
+#define ALIGN8(x)			(((x) + 7) & ~(uint64_t)7)
+
+// ========================================
+// File layout
+// ========================================
+// header
+// column descriptors
+// column data (each column starts on an 8-byte boundary)
+// string pool
+enum {
+	kSnapshotStorageInt32		= 0,
+	kSnapshotStorageInt64		= 1,
+	kSnapshotStorageDouble		= 2,
+	kSnapshotStorageBytes		= 3
+};
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	columnSignature;	// Hash of the column keys and types
+	uint32_t	changeCounter;		// SQLite file change counter when the snapshot was written
+	uint64_t	databaseSize;
+	uint32_t	rowCount;
+	uint32_t	columnCount;
+	uint64_t	stringPoolOffset;
+	uint64_t	stringPoolLength;
+} AudioStreamSnapshotHeader;
+
+typedef struct {
+	uint32_t	storage;
+	uint32_t	nonNullCount;		// Columns without any values have no data
+	uint64_t	offset;				// The null bitmap; values follow it
+} AudioStreamSnapshotColumn;
+
+typedef struct {
+	uint32_t	offset;
+	uint32_t	length;
+} AudioStreamSnapshotBytes;
+
+// ========================================
+// The columns, in the same order as select_all_streams
+// ========================================
+static const eObjectType sColumnTypes [] = {
+	eObjectTypeUnsignedInt,
+	
+	// Location
+	eObjectTypeURL, eObjectTypeLongLong, eObjectTypeUnsignedInt,
+	
+	// Statistics
+	eObjectTypeDate, eObjectTypeDate, eObjectTypeDate, eObjectTypeDate,
+	eObjectTypeUnsignedInt, eObjectTypeUnsignedInt, eObjectTypeUnsignedInt,
+	
+	// Metadata
+	eObjectTypeString, eObjectTypeString, eObjectTypeString, eObjectTypeString, eObjectTypeString, eObjectTypeString, eObjectTypeString,
+	eObjectTypeBool,
+	eObjectTypeInt, eObjectTypeInt, eObjectTypeInt, eObjectTypeInt,
+	eObjectTypeString, eObjectTypeString, eObjectTypeString,
+	eObjectTypeInt,
+	eObjectTypeString, eObjectTypeString,
+	
+	// Replay Gain
+	eObjectTypeDouble, eObjectTypeDouble, eObjectTypeDouble, eObjectTypeDouble, eObjectTypeDouble,
+	
+	// Properties
+	eObjectTypeString, eObjectTypeString, eObjectTypeString,
+	eObjectTypeUnsignedInt, eObjectTypeUnsignedInt,
+	eObjectTypeDouble, eObjectTypeLongLong, eObjectTypeDouble,
+	
+	// Album art
+	eObjectTypeLongLong, eObjectTypeUnsignedInt, eObjectTypeString, eObjectTypeString,
+	
+	// Loudness and true peaks
+	eObjectTypeDouble, eObjectTypeDouble, eObjectTypeDouble,
+	eObjectTypeDouble, eObjectTypeDouble,
+	
+	// Pregap
+	eObjectTypeUnsignedInt
+};
+
+#define COLUMN_COUNT (sizeof(sColumnTypes) / sizeof(sColumnTypes[0]))
+
+static NSArray *
+snapshotColumnKeys()
+{
+	static NSArray *keys = nil;
+	
+	@synchronized([AudioStream class]) {
+		if(nil == keys) {
+			keys = [[NSArray alloc] initWithObjects:
+				ObjectIDKey,
+				
+				StreamURLKey, StreamStartingFrameKey, StreamFrameCountKey,
+				
+				StatisticsDateAddedKey, StatisticsFirstPlayedDateKey, StatisticsLastPlayedDateKey, StatisticsLastSkippedDateKey,
+				StatisticsPlayCountKey, StatisticsSkipCountKey, StatisticsRatingKey,
+				
+				MetadataTitleKey, MetadataAlbumTitleKey, MetadataArtistKey, MetadataAlbumArtistKey, MetadataGenreKey, MetadataComposerKey, MetadataDateKey,
+				MetadataCompilationKey,
+				MetadataTrackNumberKey, MetadataTrackTotalKey, MetadataDiscNumberKey, MetadataDiscTotalKey,
+				MetadataCommentKey, MetadataISRCKey, MetadataMCNKey,
+				MetadataBPMKey,
+				MetadataMusicDNSPUIDKey, MetadataMusicBrainzIDKey,
+				
+				ReplayGainReferenceLoudnessKey, ReplayGainTrackGainKey, ReplayGainTrackPeakKey, ReplayGainAlbumGainKey, ReplayGainAlbumPeakKey,
+				
+				PropertiesFileTypeKey, PropertiesDataFormatKey, PropertiesFormatDescriptionKey,
+				PropertiesBitsPerChannelKey, PropertiesChannelsPerFrameKey,
+				PropertiesSampleRateKey, PropertiesTotalFramesKey, PropertiesBitrateKey,
+				
+				MetadataAlbumArtOffsetKey, MetadataAlbumArtLengthKey, MetadataAlbumArtMIMETypeKey, MetadataAlbumArtHashKey,
+				
+				LoudnessTrackIntegratedKey, LoudnessTrackRangeKey, LoudnessAlbumIntegratedKey,
+				ReplayGainTrackTruePeakKey, ReplayGainAlbumTruePeakKey,
+				
+				StreamPregapFrameCountKey,
+				nil];
+
+			NSCAssert(COLUMN_COUNT == [keys count], @"Snapshot column keys and types do not match");
+		}
+	}
+	
+	return keys;
+}
+
+static uint32_t
+storageForObjectType(eObjectType type)
+{
+	switch(type) {
+		case eObjectTypeURL:
+		case eObjectTypeString:
+		case eObjectTypePredicate:
+		case eObjectTypeData:
+			return kSnapshotStorageBytes;
+			
+		case eObjectTypeDate:
+		case eObjectTypeFloat:
+		case eObjectTypeDouble:
+			return kSnapshotStorageDouble;
+			
+		case eObjectTypeUnsignedLong:
+		case eObjectTypeLong:
+		case eObjectTypeUnsignedLongLong:
+		case eObjectTypeLongLong:
+			return kSnapshotStorageInt64;
+			
+		default:
+			return kSnapshotStorageInt32;
+	}
+}
+
+// FNV-1a over the column keys and types, so a snapshot written for a different schema is never read
+static uint32_t
+columnSignature()
+{
+	uint32_t	hash	= 2166136261U;
+	NSArray		*keys	= snapshotColumnKeys();
+	unsigned	i;
+	
+	for(i = 0; i < COLUMN_COUNT; ++i) {
+		const char *key = [[keys objectAtIndex:i] UTF8String];
+		while(*key) {
+			hash ^= (uint8_t)*key++;
+			hash *= 16777619U;
+		}
+		hash ^= (uint8_t)sColumnTypes[i];
+		hash *= 16777619U;
+	}
+	
+	return hash;
+}
+
+// SQLite increments the file change counter (offset 24 of the database header) on every committed write
+static BOOL
+getDatabaseState(NSString *databasePath, uint32_t *changeCounter, uint64_t *databaseSize)
+{
+	uint8_t		header [28];
+	struct stat	fileInfo;
+	BOOL		result;
+	
+	int fd = open([databasePath fileSystemRepresentation], O_RDONLY);
+	if(-1 == fd)
+		return NO;
+	
+	result = (sizeof(header) == pread(fd, header, sizeof(header), 0) && 0 == fstat(fd, &fileInfo));
+	close(fd);
+	
+	if(NO == result || 0 != memcmp(header, "SQLite format 3", 16))
+		return NO;
+	
+	*changeCounter	= OSReadBigInt32(header, 24);
+	*databaseSize	= fileInfo.st_size;
+	
+	return YES;
+}
+
+static BOOL
+headerIsCurrent(const AudioStreamSnapshotHeader *header, NSString *databasePath)
+{
+	uint32_t	changeCounter;
+	uint64_t	databaseSize;
+	
+	if(SNAPSHOT_MAGIC != header->magic || SNAPSHOT_VERSION != header->version)
+		return NO;
+	
+	if(COLUMN_COUNT != header->columnCount || columnSignature() != header->columnSignature)
+		return NO;
+	
+	if(NO == getDatabaseState(databasePath, &changeCounter, &databaseSize))
+		return NO;
+	
+	return (changeCounter == header->changeCounter && databaseSize == header->databaseSize);
+}
+
+BOOL
+audioStreamSnapshotIsCurrent(NSString *snapshotPath, NSString *databasePath)
+{
+	NSCParameterAssert(nil != snapshotPath);
+	NSCParameterAssert(nil != databasePath);
+	
+	AudioStreamSnapshotHeader	header;
+	BOOL						result;
+	
+	int fd = open([snapshotPath fileSystemRepresentation], O_RDONLY);
+	if(-1 == fd)
+		return NO;
+	
+	result = (sizeof(header) == pread(fd, &header, sizeof(header), 0));
+	close(fd);
+	
+	return (result && headerIsCurrent(&header, databasePath));
+}
+
+BOOL
+writeAudioStreamSnapshot(NSArray *streams, NSString *snapshotPath, NSString *databasePath)
+{
+	NSCParameterAssert(nil != streams);
+	NSCParameterAssert(nil != snapshotPath);
+	NSCParameterAssert(nil != databasePath);
+	
+	AudioStreamSnapshotHeader	header;
+	AudioStreamSnapshotColumn	columns [COLUMN_COUNT];
+	uint32_t					changeCounter;
+	uint64_t					databaseSize;
+	
+	if(NO == getDatabaseState(databasePath, &changeCounter, &databaseSize))
+		return NO;
+	
+	if(UINT32_MAX < [streams count])
+		return NO;
+	
+	NSArray				*keys				= snapshotColumnKeys();
+	uint32_t			rowCount			= [streams count];
+	size_t				bitmapLength		= ALIGN8((rowCount + 7) / 8);
+	NSMutableData		*columnData			= [NSMutableData data];
+	NSMutableData		*pool				= [NSMutableData data];
+	NSMutableDictionary	*poolOffsets		= [NSMutableDictionary dictionary];
+	uint64_t			dataOffset			= ALIGN8(sizeof(header) + sizeof(columns));
+	unsigned			column;
+	uint32_t			row;
+	
+	for(column = 0; column < COLUMN_COUNT; ++column) {
+		NSString			*key			= [keys objectAtIndex:column];
+		eObjectType			type			= sColumnTypes[column];
+		uint32_t			storage			= storageForObjectType(type);
+		size_t				width			= (kSnapshotStorageInt32 == storage ? 4 : 8);
+		NSMutableData		*bitmap			= [NSMutableData dataWithLength:bitmapLength];
+		NSMutableData		*values			= [NSMutableData dataWithLength:ALIGN8(rowCount * width)];
+		uint8_t				*bitmapBytes	= [bitmap mutableBytes];
+		uint8_t				*valueBytes		= [values mutableBytes];
+		uint32_t			nonNullCount	= 0;
+		
+		for(row = 0; row < rowCount; ++row) {
+			id value = [[streams objectAtIndex:row] savedValueForKey:key];
+			if(nil == value)
+				continue;
+			
+			switch(storage) {
+				case kSnapshotStorageInt32:
+				{
+					int32_t v = (eObjectTypeUnsignedInt == type || eObjectTypeUnsignedShort == type ? (int32_t)[value unsignedIntValue] : [value intValue]);
+					memcpy(valueBytes + (row * width), &v, sizeof(v));
+					break;
+				}
+					
+				case kSnapshotStorageInt64:
+				{
+					int64_t v = [value longLongValue];
+					memcpy(valueBytes + (row * width), &v, sizeof(v));
+					break;
+				}
+					
+				case kSnapshotStorageDouble:
+				{
+					double v = (eObjectTypeDate == type ? [value timeIntervalSinceReferenceDate] : [value doubleValue]);
+					memcpy(valueBytes + (row * width), &v, sizeof(v));
+					break;
+				}
+					
+				case kSnapshotStorageBytes:
+				{
+					AudioStreamSnapshotBytes	entry;
+					NSNumber					*existingOffset		= nil;
+					NSString					*string				= nil;
+					
+					if(eObjectTypeData == type) {
+						entry.length = [value length];
+						if(UINT32_MAX - [pool length] < entry.length)
+							return NO;
+						entry.offset = [pool length];
+						[pool appendData:value];
+					}
+					else {
+						if(eObjectTypeURL == type)
+							string = [value absoluteString];
+						else if(eObjectTypePredicate == type)
+							string = [value predicateFormat];
+						else
+							string = value;
+						
+						const char *utf8 = [string UTF8String];
+						entry.length = strlen(utf8);
+						
+						// Each distinct string is stored once
+						existingOffset = [poolOffsets objectForKey:string];
+						if(0 == entry.length)
+							entry.offset = 0;
+						else if(nil != existingOffset)
+							entry.offset = [existingOffset unsignedIntValue];
+						else {
+							if(UINT32_MAX - [pool length] < entry.length)
+								return NO;
+							entry.offset = [pool length];
+							[pool appendBytes:utf8 length:entry.length];
+							[poolOffsets setObject:[NSNumber numberWithUnsignedInt:entry.offset] forKey:string];
+						}
+					}
+					
+					memcpy(valueBytes + (row * width), &entry, sizeof(entry));
+					break;
+				}
+			}
+			
+			bitmapBytes[row >> 3] |= (1 << (row & 7));
+			++nonNullCount;
+		}
+		
+		columns[column].storage			= storage;
+		columns[column].nonNullCount	= nonNullCount;
+		columns[column].offset			= 0;
+		
+		if(0 != nonNullCount) {
+			columns[column].offset = dataOffset + [columnData length];
+			[columnData appendData:bitmap];
+			[columnData appendData:values];
+		}
+	}
+	
+	header.magic				= SNAPSHOT_MAGIC;
+	header.version				= SNAPSHOT_VERSION;
+	header.columnSignature		= columnSignature();
+	header.changeCounter		= changeCounter;
+	header.databaseSize			= databaseSize;
+	header.rowCount				= rowCount;
+	header.columnCount			= COLUMN_COUNT;
+	header.stringPoolOffset		= dataOffset + [columnData length];
+	header.stringPoolLength		= [pool length];
+	
+	NSMutableData *snapshot = [NSMutableData dataWithCapacity:header.stringPoolOffset + header.stringPoolLength];
+	
+	[snapshot appendBytes:&header length:sizeof(header)];
+	[snapshot appendBytes:columns length:sizeof(columns)];
+	[snapshot setLength:dataOffset];
+	[snapshot appendData:columnData];
+	[snapshot appendData:pool];
+	
+	return [snapshot writeToFile:snapshotPath atomically:YES];
+}
+
+// ========================================
+// Decodes the values of a row as its AudioStream first asks for them
+// ========================================
+@interface AudioStreamSnapshotReader : NSObject <DatabaseObjectFaultSource>
+{
+	NSData						*_snapshot;
+	const uint8_t				*_pool;
+	uint64_t					_bitmapLength;
+	AudioStreamSnapshotColumn	_columns [COLUMN_COUNT];
+	NSDictionary				*_columnIndexes;
+	NSMapTable					*_strings;
+}
+
+- (id) initWithSnapshot:(NSData *)snapshot header:(const AudioStreamSnapshotHeader *)header columns:(const AudioStreamSnapshotColumn *)columns;
+- (id) valueInColumn:(unsigned)column row:(uint32_t)row;
+@end
+
+@implementation AudioStreamSnapshotReader
+
+- (id) initWithSnapshot:(NSData *)snapshot header:(const AudioStreamSnapshotHeader *)header columns:(const AudioStreamSnapshotColumn *)columns
+{
+	NSParameterAssert(nil != snapshot);
+	NSParameterAssert(NULL != header);
+	NSParameterAssert(NULL != columns);
+	
+	if((self = [super init])) {
+		NSArray				*keys			= snapshotColumnKeys();
+		NSMutableDictionary	*columnIndexes	= [NSMutableDictionary dictionaryWithCapacity:COLUMN_COUNT];
+		unsigned			column;
+		
+		for(column = 0; column < COLUMN_COUNT; ++column)
+			[columnIndexes setObject:[NSNumber numberWithUnsignedInt:column] forKey:[keys objectAtIndex:column]];
+		
+		_snapshot		= [snapshot retain];
+		_pool			= (const uint8_t *)[snapshot bytes] + header->stringPoolOffset;
+		_bitmapLength	= ALIGN8(((uint64_t)header->rowCount + 7) / 8);
+		_columnIndexes	= [columnIndexes copy];
+		_strings		= NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 4096);
+		
+		memcpy(_columns, columns, sizeof(_columns));
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	NSFreeMapTable(_strings), _strings = NULL;
+	
+	[_columnIndexes release], _columnIndexes = nil;
+	[_snapshot release], _snapshot = nil;
+	
+	[super dealloc];
+}
+
+- (id) savedValueForKey:(NSString *)key inRow:(unsigned)row
+{
+	NSNumber *column = [_columnIndexes objectForKey:key];
+	if(nil == column)
+		return nil;
+	
+	@synchronized(self) {
+		return [self valueInColumn:[column unsignedIntValue] row:row];
+	}
+	
+	return nil;
+}
+
+// The bounds of every pool entry were checked when the snapshot was opened
+- (id) valueInColumn:(unsigned)column row:(uint32_t)row
+{
+	NSNull *null = [NSNull null];
+	
+	if(0 == _columns[column].nonNullCount)
+		return null;
+	
+	const uint8_t	*bitmap		= (const uint8_t *)[_snapshot bytes] + _columns[column].offset;
+	const uint8_t	*values		= bitmap + _bitmapLength;
+	eObjectType		type		= sColumnTypes[column];
+	
+	if(0 == (bitmap[row >> 3] & (1 << (row & 7))))
+		return null;
+	
+	switch(type) {
+		case eObjectTypeBool:
+		case eObjectTypeShort:
+		case eObjectTypeInt:
+		case eObjectTypeUnsignedShort:
+		case eObjectTypeUnsignedInt:
+		{
+			int32_t v;
+			memcpy(&v, values + (row * 4), sizeof(v));
+			
+			if(eObjectTypeBool == type)					return [NSNumber numberWithBool:v];
+			else if(eObjectTypeShort == type)			return [NSNumber numberWithShort:v];
+			else if(eObjectTypeInt == type)				return [NSNumber numberWithInt:v];
+			else if(eObjectTypeUnsignedShort == type)	return [NSNumber numberWithUnsignedShort:v];
+			else										return [NSNumber numberWithUnsignedInt:v];
+		}
+			
+		case eObjectTypeLong:
+		case eObjectTypeUnsignedLong:
+		case eObjectTypeLongLong:
+		case eObjectTypeUnsignedLongLong:
+		{
+			int64_t v;
+			memcpy(&v, values + (row * 8), sizeof(v));
+			
+			if(eObjectTypeLong == type)					return [NSNumber numberWithLong:v];
+			else if(eObjectTypeUnsignedLong == type)	return [NSNumber numberWithUnsignedLong:v];
+			else if(eObjectTypeLongLong == type)		return [NSNumber numberWithLongLong:v];
+			else										return [NSNumber numberWithUnsignedLongLong:v];
+		}
+			
+		case eObjectTypeDate:
+		case eObjectTypeFloat:
+		case eObjectTypeDouble:
+		{
+			double v;
+			memcpy(&v, values + (row * 8), sizeof(v));
+			
+			if(eObjectTypeDate == type)					return [NSDate dateWithTimeIntervalSinceReferenceDate:v];
+			else if(eObjectTypeFloat == type)			return [NSNumber numberWithFloat:v];
+			else										return [NSNumber numberWithDouble:v];
+		}
+			
+		case eObjectTypeURL:
+		case eObjectTypeString:
+		case eObjectTypePredicate:
+		case eObjectTypeData:
+		{
+			AudioStreamSnapshotBytes	entry;
+			NSString					*string		= nil;
+			
+			memcpy(&entry, values + (row * 8), sizeof(entry));
+			
+			if(eObjectTypeData == type)
+				return [NSData dataWithBytes:_pool + entry.offset length:entry.length];
+			
+			// Empty strings take no space in the pool, so their offset is shared with the next string
+			if(0 == entry.length)
+				string = @"";
+			else {
+				// Strings that repeat (artists, albums, genres, formats) share one object
+				string = (NSString *)NSMapGet(_strings, (void *)(entry.offset + 1));
+				if(nil == string) {
+					string = [[NSString alloc] initWithBytes:_pool + entry.offset length:entry.length encoding:NSUTF8StringEncoding];
+					if(nil == string)
+						return null;
+					
+					// Keep the shared instance so later rows find it directly
+					if(eObjectTypeString == type && isInternedStreamKey([snapshotColumnKeys() objectAtIndex:column])) {
+						NSString *internedString = internString(string);
+						[string release];
+						string = [internedString retain];
+					}
+					
+					NSMapInsert(_strings, (void *)(entry.offset + 1), string);
+					[string release];
+				}
+			}
+			
+			if(eObjectTypeURL == type)					return [NSURL URLWithString:string];
+			else if(eObjectTypePredicate == type)		return [NSPredicate predicateWithFormat:string];
+			else										return string;
+		}
+	}
+	
+	return null;
+}
+
+@end
+
+NSArray *
+readAudioStreamSnapshot(NSString *snapshotPath, NSString *databasePath)
+{
+	NSCParameterAssert(nil != snapshotPath);
+	NSCParameterAssert(nil != databasePath);
+	
+	AudioStreamSnapshotHeader	header;
+	AudioStreamSnapshotColumn	columns [COLUMN_COUNT];
+	
+	NSData *snapshot = [NSData dataWithContentsOfFile:snapshotPath options:NSMappedRead error:nil];
+	if(nil == snapshot || sizeof(header) + sizeof(columns) > [snapshot length])
+		return nil;
+	
+	const uint8_t	*bytes		= [snapshot bytes];
+	uint64_t		length		= [snapshot length];
+	
+	memcpy(&header, bytes, sizeof(header));
+	if(NO == headerIsCurrent(&header, databasePath))
+		return nil;
+	
+	memcpy(columns, bytes + sizeof(header), sizeof(columns));
+	
+	// Validate everything up front so values decoded later never read outside the file
+	if(header.stringPoolOffset > length || header.stringPoolLength > length - header.stringPoolOffset)
+		return nil;
+	
+	uint32_t		rowCount		= header.rowCount;
+	uint64_t		bitmapLength	= ALIGN8(((uint64_t)rowCount + 7) / 8);
+	unsigned		column;
+	uint32_t		row;
+	
+	for(column = 0; column < COLUMN_COUNT; ++column) {
+		uint32_t storage = storageForObjectType(sColumnTypes[column]);
+		
+		if(storage != columns[column].storage || rowCount < columns[column].nonNullCount)
+			return nil;
+		
+		if(0 == columns[column].nonNullCount)
+			continue;
+		
+		uint64_t columnLength = bitmapLength + ALIGN8((uint64_t)rowCount * (kSnapshotStorageInt32 == storage ? 4 : 8));
+		if(columns[column].offset > header.stringPoolOffset || columnLength > header.stringPoolOffset - columns[column].offset)
+			return nil;
+		
+		if(kSnapshotStorageBytes != storage)
+			continue;
+		
+		const uint8_t *bitmap = bytes + columns[column].offset;
+		const uint8_t *values = bitmap + bitmapLength;
+		
+		for(row = 0; row < rowCount; ++row) {
+			AudioStreamSnapshotBytes entry;
+			
+			if(0 == (bitmap[row >> 3] & (1 << (row & 7))))
+				continue;
+			
+			memcpy(&entry, values + (row * 8), sizeof(entry));
+			if((uint64_t)entry.offset + entry.length > header.stringPoolLength)
+				return nil;
+		}
+	}
+	
+	// The ID should never be NULL
+	if(rowCount != columns[0].nonNullCount)
+		return nil;
+	
+#if DEBUG
+	clock_t start = clock();
+#endif
+	
+	AudioStreamSnapshotReader	*reader		= [[AudioStreamSnapshotReader alloc] initWithSnapshot:snapshot header:&header columns:columns];
+	NSMutableArray				*streams	= [NSMutableArray arrayWithCapacity:rowCount];
+	
+	// Only the ID is decoded now; the rest of each row is read from the mapped file on first access
+	for(row = 0; row < rowCount; ++row) {
+		AudioStream *stream = [[AudioStream alloc] init];
+		
+		[stream initValue:[reader valueInColumn:0 row:row] forKey:ObjectIDKey];
+		[stream initFaultSource:reader row:row];
+		
+		[streams addObject:stream];
+		[stream release];
+	}
+	
+	[reader release];
+	
+#if DEBUG
+	clock_t end = clock();
+	NSLog(@"Loaded %u streams from snapshot in %f seconds", rowCount, (end - start) / (double)CLOCKS_PER_SEC);
+#endif
+	
+	return streams;
+}
@@ -118,6 +118,7 @@ NSString *const DatabaseErrorDomain = @"org.sbooth.Play.ErrorDomain.Database";
 - (BOOL) createPlaylistEntryTable:(NSError **)error;
 - (BOOL) createSmartPlaylistTable:(NSError **)error;
 - (BOOL) createWatchFolderTable:(NSError **)error;
+- (BOOL) createMetadataTables:(NSError **)error;
 - (BOOL) createTriggers:(NSError **)error;
 
 - (BOOL) prepareSQL:(NSError **)error;
@@ -279,6 +280,48 @@ static CollectionManager *collectionManagerInstance = nil;
 		rescanMP3s = YES;
 	}
 
+	// The third database upgrade added storage for frame indexes built during playback
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_seek_index_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_seek_indexes", error))
+			return NO;
+	}
+
+	// The fourth database upgrade added the location of embedded album art
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_album_art_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_album_art", error))
+			return NO;
+	}
+
+	// The fifth database upgrade added EBU R128 loudness measurements
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_loudness_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_loudness", error))
+			return NO;
+	}
+
+	// The sixth database upgrade added oversampled true peaks
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_true_peaks_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_true_peaks", error))
+			return NO;
+	}
+
+	// The seventh database upgrade moved artists, albums, genres and composers into their own tables
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_normalized_metadata_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_normalized_metadata", error))
+			return NO;
+	}
+
+	// The eighth database upgrade replaced dense playlist indexes with sparse order keys
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_playlist_order_key_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_playlist_order_keys", error))
+			return NO;
+	}
+
+	// The ninth database upgrade added cue sheet pregaps, which are played before a track but not counted in its location
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_pregaps_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_pregaps", error))
+			return NO;
+	}
+
 	if(SQLITE_OK != sqlite3_close(db)) {
 		if(nil != error) {
 			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
@@ -355,6 +398,9 @@ static CollectionManager *collectionManagerInstance = nil;
 	if(NO == [self prepareSQL:error])
 		return NO;
 	
+	// An in-memory database has no file to snapshot
+	[[self streamManager] setDatabasePath:([databasePath isEqualToString:@":memory:"] ? nil : databasePath)];
+	
 	if(NO == [[self streamManager] connectedToDatabase:_db error:error])
 		return NO;
 	if(NO == [[self playlistManager] connectedToDatabase:_db error:error])
@@ -527,6 +573,8 @@ static CollectionManager *collectionManagerInstance = nil;
 		return NO;
 	if(NO == [self createWatchFolderTable:error])
 		return NO;
+	if(NO == [self createMetadataTables:error])
+		return NO;
 	
 	if(NO == [self createTriggers:error])
 		return NO;
@@ -569,14 +617,27 @@ static CollectionManager *collectionManagerInstance = nil;
 	return executeSQLFromFileInBundle(_db, @"create_watch_folder_table", error);
 }
 
+- (BOOL) createMetadataTables:(NSError **)error
+{
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	return executeSQLFromFileInBundle(_db, @"create_metadata_tables", error);
+}
+
 - (BOOL) createTriggers:(NSError **)error
 {
 	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
 	
 	if(NO == executeSQLFromFileInBundle(_db, @"delete_playlist_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"delete_stream_trigger", error))
 		return NO;
-	else
-		return YES;
+	
+	// The artist, album, genre and composer tables are maintained entirely by triggers
+	if(NO == executeSQLFromFileInBundle(_db, @"insert_stream_metadata_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"update_stream_metadata_triggers", error))
+		return NO;
+	if(NO == executeSQLFromFileInBundle(_db, @"delete_stream_metadata_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"rename_metadata_triggers", error))
+		return NO;
+	
+	return YES;
 }
 
 #pragma mark Prepared SQL Statements
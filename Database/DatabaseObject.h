@@ -27,6 +27,15 @@ extern NSString * const		ObjectIDKey;
 
 @class CollectionManager;
 
+// ========================================
+// Supplies saved values when they are first accessed, so an object can be created
+// without decoding every column of its row
+// ========================================
+@protocol DatabaseObjectFaultSource
+// Returns the value of key in row, or NSNull if it is NULL
+- (id) savedValueForKey:(NSString *)key inRow:(unsigned)row;
+@end
+
 // ========================================
 // KVC-compliant object whose persistent properties are stored in a database
 // An instance of this class typically represents a single row in a table
@@ -39,6 +48,9 @@ extern NSString * const		ObjectIDKey;
 	@private
 	NSMutableDictionary		*_savedValues;
 	NSMutableDictionary		*_changedValues;
+	
+	id <DatabaseObjectFaultSource>	_faultSource;
+	unsigned				_faultRow;
 }
 
 // ========================================
@@ -56,6 +68,9 @@ extern NSString * const		ObjectIDKey;
 - (void) initValue:(id)value forKey:(NSString *)key;
 - (void) initValuesForKeysWithDictionary:(NSDictionary *)keyedValues;
 
+// Saved values not set with initValue:forKey: are read from faultSource as they are needed
+- (void) initFaultSource:(id <DatabaseObjectFaultSource>)faultSource row:(unsigned)row;
+
 // ========================================
 // Change manaagement
 - (BOOL) hasChanges;
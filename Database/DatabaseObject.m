@@ -25,6 +25,7 @@ NSString * const	ObjectIDKey								= @"id";
 
 @interface DatabaseObject (Private)
 - (void) mySetValue:(id)value forKey:(NSString *)key;
+- (id) storedValueForKey:(NSString *)key;
 @end
 
 @implementation DatabaseObject
@@ -36,6 +37,8 @@ NSString * const	ObjectIDKey								= @"id";
 	[_savedValues release], _savedValues = nil;
 	[_changedValues release], _changedValues = nil;
 	
+	[_faultSource release], _faultSource = nil;
+	
 	[super dealloc];
 }
 
@@ -44,7 +47,7 @@ NSString * const	ObjectIDKey								= @"id";
 	if([[self supportedKeys] containsObject:key]) {
 		id value = [_changedValues valueForKey:key];
 		if(nil == value)
-			value = [_savedValues valueForKey:key];
+			value = [self storedValueForKey:key];
 		
 		return ([value isEqual:[NSNull null]] ? nil : value);
 	}
@@ -65,7 +68,7 @@ NSString * const	ObjectIDKey								= @"id";
 		if(nil == value)
 			value = [NSNull null];
 		
-		if([[_savedValues valueForKey:key] isEqual:value])
+		if([[self storedValueForKey:key] isEqual:value])
 			[_changedValues removeObjectForKey:key];
 		else
 			[_changedValues setValue:value forKey:key];			
@@ -82,6 +85,25 @@ NSString * const	ObjectIDKey								= @"id";
 	[self setValue:value forKey:key];
 }
 
+- (id) storedValueForKey:(NSString *)key
+{
+	id value = [_savedValues valueForKey:key];
+	
+	// Values read from the fault source are saved values, so no change is posted
+	if(nil == value && nil != _faultSource) {
+		@synchronized(self) {
+			value = [_savedValues valueForKey:key];
+			if(nil == value) {
+				value = [_faultSource savedValueForKey:key inRow:_faultRow];
+				if(nil != value)
+					[_savedValues setValue:value forKey:key];
+			}
+		}
+	}
+	
+	return value;
+}
+
 - (unsigned) hash
 {
 	// Database ID is guaranteed to be unique
@@ -141,6 +163,13 @@ NSString * const	ObjectIDKey								= @"id";
 		[self initValue:[keyedValues valueForKey:key] forKey:key];
 }
 
+- (void) initFaultSource:(id <DatabaseObjectFaultSource>)faultSource row:(unsigned)row
+{
+	[_faultSource release];
+	_faultSource	= [faultSource retain];
+	_faultRow		= row;
+}
+
 - (BOOL) hasChanges
 {
 	return 0 != [_changedValues count];
@@ -154,7 +183,7 @@ NSString * const	ObjectIDKey								= @"id";
 
 - (id) savedValueForKey:(NSString *)key
 {
-	id value = [_savedValues valueForKey:key];
+	id value = [self storedValueForKey:key];
 	return ([value isEqual:[NSNull null]] ? nil : value);
 }
 
@@ -165,6 +194,11 @@ NSString * const	ObjectIDKey								= @"id";
 
 - (NSDictionary *) savedValues
 {
+	if(nil != _faultSource) {
+		for(NSString *key in [self supportedKeys])
+			[self storedValueForKey:key];
+	}
+	
 	return [[_savedValues retain] autorelease];
 }
 
@@ -44,6 +44,10 @@
 	NSMutableSet			*_updatedPlaylists;		// Playlists updated during a transaction
 	NSMutableSet			*_deletedPlaylists;		// Playlists deleted during a transaction
 	
+	NSMapTable				*_playlistEntries;		// Row IDs and order keys of each playlist's entries, in order
+	NSMutableArray			*_entryChanges;			// Entries inserted or removed during a transaction
+	NSMutableSet			*_staleEntryPlaylists;	// Playlists whose entries must be rewritten
+	
 	BOOL					_updating;				// Indicates if a transaction is in progress
 	
 	NSArray					*_playlistKeys;			// Playlist (aggregate) keys this object supports
@@ -25,6 +25,16 @@
 
 #import "SQLiteUtilityFunctions.h"
 
+// Entries are ordered by sparse keys so an insert or removal touches a single row
+// When two neighbors leave no room between them the playlist's entries are rewritten
+#define ORDER_KEY_SPACING		1048576
+
+struct PlaylistEntry {
+	sqlite3_int64		rowID;
+	sqlite3_int64		orderKey;
+};
+typedef struct PlaylistEntry PlaylistEntry;
+
 @interface PlaylistManager (Private)
 - (BOOL) prepareSQL:(NSError **)error;
 - (BOOL) finalizeSQL:(NSError **)error;
@@ -41,9 +51,16 @@
 - (void) doUpdatePlaylist:(Playlist *)playlist;
 - (void) doDeletePlaylist:(Playlist *)playlist;
 
+- (NSMutableData *) entriesForPlaylist:(Playlist *)playlist;
+- (void) processEntryChange:(NSArray *)change;
+
+- (BOOL) doInsertEntryForStream:(AudioStream *)stream inPlaylist:(Playlist *)playlist atIndex:(unsigned)index;
+- (BOOL) doDeleteEntryFromPlaylist:(Playlist *)playlist atIndex:(unsigned)index;
 - (void) doUpdatePlaylistEntriesForPlaylist:(Playlist *)playlist;
 
 - (NSArray *) playlistKeys;
+
+- (void) streamsRemovedFromLibrary:(NSNotification *)aNotification;
 @end
 
 @implementation PlaylistManager
@@ -56,12 +73,27 @@
 		_insertedPlaylists		= [[NSMutableSet alloc] init];
 		_updatedPlaylists		= [[NSMutableSet alloc] init];
 		_deletedPlaylists		= [[NSMutableSet alloc] init];	
+		_playlistEntries		= NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 64);
+		_entryChanges			= [[NSMutableArray alloc] init];
+		_staleEntryPlaylists	= [[NSMutableSet alloc] init];
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(streamsRemovedFromLibrary:) 
+													 name:AudioStreamRemovedFromLibraryNotification
+												   object:nil];
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(streamsRemovedFromLibrary:) 
+													 name:AudioStreamsRemovedFromLibraryNotification
+												   object:nil];
 	}
 	return self;
 }
 
 - (void) dealloc
 {
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
 	NSFreeMapTable(_registeredPlaylists), _registeredPlaylists = NULL;	
 	
 	[_sql release], _sql = nil;
@@ -72,6 +104,10 @@
 	[_updatedPlaylists release], _updatedPlaylists = nil;
 	[_deletedPlaylists release], _deletedPlaylists = nil;
 	
+	NSFreeMapTable(_playlistEntries), _playlistEntries = NULL;
+	[_entryChanges release], _entryChanges = nil;
+	[_staleEntryPlaylists release], _staleEntryPlaylists = nil;
+	
 	[_playlistKeys release], _playlistKeys = nil;
 	
 	_db = NULL;
@@ -235,6 +271,9 @@
 
 - (BOOL) disconnectedFromDatabase:(NSError **)error
 {
+	NSResetMapTable(_playlistEntries);
+	[_staleEntryPlaylists removeAllObjects];
+	
 	_db = NULL;
 	return [self finalizeSQL:error];
 }
@@ -243,6 +282,8 @@
 {
 	[self willChangeValueForKey:@"playlists"];
 	NSResetMapTable(_registeredPlaylists);
+	NSResetMapTable(_playlistEntries);
+	[_staleEntryPlaylists removeAllObjects];
 	[_cachedPlaylists release], _cachedPlaylists = nil;
 	[self didChangeValueForKey:@"playlists"];
 }
@@ -256,6 +297,7 @@
 	[_insertedPlaylists removeAllObjects];
 	[_updatedPlaylists removeAllObjects];
 	[_deletedPlaylists removeAllObjects];
+	[_entryChanges removeAllObjects];
 }
 
 - (void) processUpdate
@@ -284,6 +326,24 @@
 				[_insertedPlaylists removeObject:playlist];
 		}
 	}	
+	
+	// ========================================
+	// Playlist entries last, since they may belong to newly inserted playlists
+	if(0 != [_entryChanges count]) {
+		for(NSArray *change in _entryChanges)
+			[self processEntryChange:change];
+		
+		[_entryChanges removeAllObjects];
+	}
+	
+	if(0 != [_staleEntryPlaylists count]) {
+		for(Playlist *playlist in _staleEntryPlaylists) {
+			if(NO == [_deletedPlaylists containsObject:playlist])
+				[self doUpdatePlaylistEntriesForPlaylist:playlist];
+		}
+		
+		[_staleEntryPlaylists removeAllObjects];
+	}
 }
 
 - (void) finishUpdate
@@ -364,6 +424,11 @@
 	[_updatedPlaylists removeAllObjects];
 	[_deletedPlaylists removeAllObjects];
 	
+	// The playlists still hold the canceled entries, so their rows are rewritten on the next change
+	for(NSArray *change in _entryChanges)
+		[_staleEntryPlaylists addObject:[change objectAtIndex:0]];
+	[_entryChanges removeAllObjects];
+	
 	_updating = NO;
 }
 
@@ -389,20 +454,35 @@
 
 @implementation PlaylistManager (PlaylistMethods)
 
+// The entries are read before the playlist changes, so they can be checked against it
 - (void) playlist:(Playlist *)playlist willInsertStream:(AudioStream *)stream atIndex:(unsigned)index
-{}
+{
+	[self entriesForPlaylist:playlist];
+}
 
 - (void) playlist:(Playlist *)playlist didInsertStream:(AudioStream *)stream atIndex:(unsigned)index
 {
-	[self doUpdatePlaylistEntriesForPlaylist:playlist];
+	NSArray *change = [NSArray arrayWithObjects:playlist, [NSNumber numberWithUnsignedInt:index], stream, nil];
+	
+	if([self updateInProgress])
+		[_entryChanges addObject:change];
+	else
+		[self processEntryChange:change];
 }
 
 - (void) playlist:(Playlist *)playlist willRemoveStreamAtIndex:(unsigned)index
-{}
+{
+	[self entriesForPlaylist:playlist];
+}
 
 - (void) playlist:(Playlist *)playlist didRemoveStreamAtIndex:(unsigned)index
 {
-	[self doUpdatePlaylistEntriesForPlaylist:playlist];
+	NSArray *change = [NSArray arrayWithObjects:playlist, [NSNumber numberWithUnsignedInt:index], [NSNull null], nil];
+	
+	if([self updateInProgress])
+		[_entryChanges addObject:change];
+	else
+		[self processEntryChange:change];
 }
 
 @end
@@ -417,7 +497,7 @@
 	NSString		*sql				= nil;
 	NSArray			*files				= [NSArray arrayWithObjects:
 		@"select_all_playlists", @"select_playlist_by_id", @"insert_playlist", @"update_playlist", @"delete_playlist", 
-		@"delete_playlist_entries_for_playlist", @"insert_playlist_entry", nil];
+		@"delete_playlist_entries_for_playlist", @"insert_playlist_entry", @"delete_playlist_entry", @"select_playlist_entries", nil];
 	sqlite3_stmt	*statement			= NULL;
 	const char		*tail				= NULL;
 	
@@ -700,9 +780,174 @@
 	
 	// Deregister the object
 	NSMapRemove(_registeredPlaylists, (void *)objectID);
+	NSMapRemove(_playlistEntries, (void *)objectID);
+	[_staleEntryPlaylists removeObject:playlist];
+}
+
+#pragma mark Playlist Entries
+
+- (NSMutableData *) entriesForPlaylist:(Playlist *)playlist
+{
+	NSParameterAssert(nil != playlist);
+	
+	unsigned		objectID		= [[playlist valueForKey:ObjectIDKey] unsignedIntValue];
+	NSMutableData	*entries		= nil;
+	
+	// Playlists that have not been inserted have no entries
+	if(0 == objectID)
+		return nil;
+	
+	entries = (NSMutableData *)NSMapGet(_playlistEntries, (void *)objectID);
+	if(nil != entries)
+		return entries;
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_playlist_entries"];
+	int				result			= SQLITE_OK;
+	PlaylistEntry	entry;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":playlist_id"), objectID);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	entries = [[NSMutableData alloc] init];
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement))) {
+		entry.rowID		= sqlite3_column_int64(statement, 0);
+		entry.orderKey	= sqlite3_column_int64(statement, 1);
+		[entries appendBytes:&entry length:sizeof(entry)];
+	}
+	
+	NSAssert2(SQLITE_DONE == result, @"Unable to select the entries for %@ (%@).", playlist, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	// Entries that don't match the playlist can't be edited in place
+	if([entries length] / sizeof(PlaylistEntry) != [playlist countOfStreams])
+		[_staleEntryPlaylists addObject:playlist];
+	
+	NSMapInsert(_playlistEntries, (void *)objectID, (void *)entries);
+	
+	return [entries autorelease];
+}
+
+- (void) processEntryChange:(NSArray *)change
+{
+	NSParameterAssert(nil != change);
+	
+	Playlist		*playlist		= [change objectAtIndex:0];
+	unsigned		index			= [[change objectAtIndex:1] unsignedIntValue];
+	id				stream			= [change objectAtIndex:2];
+	BOOL			success			= NO;
+	
+	// Deleted playlists lose their entries through a trigger
+	if(nil == [playlist valueForKey:ObjectIDKey] || [_deletedPlaylists containsObject:playlist])
+		return;
+	
+	if(NO == [_staleEntryPlaylists containsObject:playlist]) {
+		if([stream isKindOfClass:[NSNull class]])
+			success = [self doDeleteEntryFromPlaylist:playlist atIndex:index];
+		else
+			success = [self doInsertEntryForStream:stream inPlaylist:playlist atIndex:index];
+		
+		if(NO == success)
+			[_staleEntryPlaylists addObject:playlist];
+	}
+	
+	// During an update stale playlists are rewritten once, after all the changes
+	if(NO == [self updateInProgress] && [_staleEntryPlaylists containsObject:playlist]) {
+		[self doUpdatePlaylistEntriesForPlaylist:playlist];
+		[_staleEntryPlaylists removeObject:playlist];
+	}
 }
 
-// TODO: Would it be better to update the rows instead of deleting and re-inserting them?
+- (BOOL) doInsertEntryForStream:(AudioStream *)stream inPlaylist:(Playlist *)playlist atIndex:(unsigned)index
+{
+	NSParameterAssert(nil != stream);
+	NSParameterAssert(nil != playlist);
+	
+	NSMutableData	*entries		= [self entriesForPlaylist:playlist];
+	unsigned		count			= [entries length] / sizeof(PlaylistEntry);
+	
+	if(nil == entries || index > count)
+		return NO;
+	
+	const PlaylistEntry		*existingEntries	= (const PlaylistEntry *)[entries bytes];
+	sqlite3_int64			previousKey			= (0 == index ? 0 : existingEntries[index - 1].orderKey);
+	sqlite3_int64			nextKey				= (count == index ? previousKey + (2 * ORDER_KEY_SPACING) : existingEntries[index].orderKey);
+	PlaylistEntry			entry;
+	
+	// No room left between the neighbors
+	if(2 > nextKey - previousKey)
+		return NO;
+	
+	entry.orderKey = (count == index ? previousKey + ORDER_KEY_SPACING : previousKey + ((nextKey - previousKey) / 2));
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"insert_playlist_entry"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	bindParameter(statement, 1, playlist, ObjectIDKey, eObjectTypeUnsignedInt);
+	bindParameter(statement, 2, stream, ObjectIDKey, eObjectTypeUnsignedInt);
+	result = sqlite3_bind_int64(statement, 3, entry.orderKey);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter %i to sql statement.", 3);
+	
+	result = sqlite3_step(statement);
+	NSAssert4(SQLITE_DONE == result, @"Unable to insert a record for %@ in %@ at index %i (%@).", stream, playlist, index, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	entry.rowID = sqlite3_last_insert_rowid(_db);
+	[entries replaceBytesInRange:NSMakeRange(index * sizeof(entry), 0) withBytes:&entry length:sizeof(entry)];
+	
+	return YES;
+}
+
+- (BOOL) doDeleteEntryFromPlaylist:(Playlist *)playlist atIndex:(unsigned)index
+{
+	NSParameterAssert(nil != playlist);
+	
+	NSMutableData	*entries		= [self entriesForPlaylist:playlist];
+	unsigned		count			= [entries length] / sizeof(PlaylistEntry);
+	
+	if(nil == entries || index >= count)
+		return NO;
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"delete_playlist_entry"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":id"), ((const PlaylistEntry *)[entries bytes])[index].rowID);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_step(statement);
+	NSAssert3(SQLITE_DONE == result, @"Unable to delete the record at index %i in %@ (%@).", index, playlist, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	[entries replaceBytesInRange:NSMakeRange(index * sizeof(PlaylistEntry), sizeof(PlaylistEntry)) withBytes:NULL length:0];
+	
+	return YES;
+}
+
+// Rewrites every entry with evenly spaced keys; only needed when the keys run out or the entries are out of sync
 - (void) doUpdatePlaylistEntriesForPlaylist:(Playlist *)playlist
 {
 	NSParameterAssert(nil != playlist);
@@ -717,7 +962,7 @@
 	
 #if SQL_DEBUG
 	clock_t start = clock();
-#endif*/
+#endif
 	
 	// First delete the old playlist entries for the playlist
 	result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":playlist_id"), objectID);
@@ -739,14 +984,16 @@
 	unsigned		index		= 0;
 	NSArray			*streams	= [playlist streams];
 	AudioStream		*stream		= nil;
+	NSMutableData	*entries	= [NSMutableData dataWithCapacity:[streams count] * sizeof(PlaylistEntry)];
+	PlaylistEntry	entry;
 	
 	for(index = 0; index < [streams count]; ++index) {
-		stream = [streams objectAtIndex:index];
+		stream			= [streams objectAtIndex:index];
+		entry.orderKey	= (sqlite3_int64)(index + 1) * ORDER_KEY_SPACING;
 		
 		bindParameter(statement, 1, playlist, ObjectIDKey, eObjectTypeUnsignedInt);
 		bindParameter(statement, 2, stream, ObjectIDKey, eObjectTypeUnsignedInt);
-//		bindParameter(statement, 3, playlist, StatisticsLastPlayedDateKey, eObjectTypeDate);
-		result = sqlite3_bind_int(statement, 3, index);	
+		result = sqlite3_bind_int64(statement, 3, entry.orderKey);	
 		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter %i to sql statement.", 3/*, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]*/);
 
 		result = sqlite3_step(statement);
@@ -757,8 +1004,13 @@
 		
 		result = sqlite3_clear_bindings(statement);
 		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		entry.rowID = sqlite3_last_insert_rowid(_db);
+		[entries appendBytes:&entry length:sizeof(entry)];
 	}
 	
+	NSMapInsert(_playlistEntries, (void *)objectID, (void *)entries);
+	
 #if SQL_DEBUG
 	clock_t end = clock();
 	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
@@ -785,4 +1037,12 @@
 	return _playlistKeys;
 }
 
+- (void) streamsRemovedFromLibrary:(NSNotification *)aNotification
+{
+	// The stream_was_deleted trigger removes the streams' entries from every playlist,
+	// so the cached row IDs and order keys no longer match the table
+	NSResetMapTable(_playlistEntries);
+	[_staleEntryPlaylists removeAllObjects];
+}
+
 @end
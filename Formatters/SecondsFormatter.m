@@ -37,7 +37,10 @@
 	if(isnan(floatValue) || isinf(floatValue))
 		return nil;
 	
-	unsigned value			= (unsigned)floatValue;
+	// Negative times count down through a cue sheet track's pregap
+	NSString *sign = (floatValue <= -1 ? @"-" : @"");
+	
+	unsigned value			= (unsigned)fabsf(floatValue);
 	unsigned seconds		= value % 60;
 	unsigned minutes		= value / 60;
 	
@@ -52,13 +55,13 @@
 	}
 
 	if(0 < days)
-		result = [NSString stringWithFormat:@"%u:%.2u:%.2u:%.2u", days, hours, minutes, seconds];
+		result = [NSString stringWithFormat:@"%@%u:%.2u:%.2u:%.2u", sign, days, hours, minutes, seconds];
 	else if(0 < hours)
-		result = [NSString stringWithFormat:@"%u:%.2u:%.2u", hours, minutes, seconds];
+		result = [NSString stringWithFormat:@"%@%u:%.2u:%.2u", sign, hours, minutes, seconds];
 	else if(0 < minutes)
-		result = [NSString stringWithFormat:@"%u:%.2u", minutes, seconds];
+		result = [NSString stringWithFormat:@"%@%u:%.2u", sign, minutes, seconds];
 	else
-		result = [NSString stringWithFormat:@"0:%.2u", seconds];
+		result = [NSString stringWithFormat:@"%@0:%.2u", sign, seconds];
 	
 	return [[result retain] autorelease];
 }
@@ -0,0 +1 @@
+SELECT album_art_offset, album_art_length, album_art_mime_type, album_art_hash FROM 'streams' LIMIT 0;
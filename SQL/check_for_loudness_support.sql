@@ -0,0 +1 @@
+SELECT track_loudness, track_loudness_range, album_loudness FROM 'streams' LIMIT 0;
@@ -0,0 +1,2 @@
+SELECT artist_id, album_artist_id, album_id, genre_id, composer_id FROM 'streams' LIMIT 0;
+SELECT id, name, stream_count FROM 'artists' LIMIT 0;
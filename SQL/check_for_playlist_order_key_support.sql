@@ -0,0 +1 @@
+SELECT order_key FROM 'playlist_entries' LIMIT 0;
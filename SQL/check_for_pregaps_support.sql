@@ -0,0 +1 @@
+SELECT pregap_frame_count FROM 'streams' LIMIT 0;
@@ -0,0 +1 @@
+SELECT seek_index FROM 'streams' LIMIT 0;
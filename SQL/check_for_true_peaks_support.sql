@@ -0,0 +1 @@
+SELECT track_true_peak, album_true_peak FROM 'streams' LIMIT 0;
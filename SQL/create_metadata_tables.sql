@@ -0,0 +1,37 @@
+CREATE TABLE IF NOT EXISTS 'artists' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'name'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE TABLE IF NOT EXISTS 'albums' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'title'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE TABLE IF NOT EXISTS 'genres' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'name'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE TABLE IF NOT EXISTS 'composers' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'name'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE INDEX IF NOT EXISTS 'streams_artist_id' ON 'streams' (artist_id);
+CREATE INDEX IF NOT EXISTS 'streams_album_artist_id' ON 'streams' (album_artist_id);
+CREATE INDEX IF NOT EXISTS 'streams_album_id' ON 'streams' (album_id);
+CREATE INDEX IF NOT EXISTS 'streams_genre_id' ON 'streams' (genre_id);
+CREATE INDEX IF NOT EXISTS 'streams_composer_id' ON 'streams' (composer_id);
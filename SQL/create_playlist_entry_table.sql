@@ -3,6 +3,8 @@ CREATE TABLE IF NOT EXISTS 'playlist_entries' (
 	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
 	'playlist_id'			INTEGER,
 	'stream_id'				INTEGER,
-	'stream_index' 			INTEGER
+	'order_key' 			INTEGER
 
 );
+
+CREATE INDEX IF NOT EXISTS 'playlist_entries_order' ON 'playlist_entries' (playlist_id, order_key, stream_id);
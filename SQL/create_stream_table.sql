@@ -47,6 +47,27 @@ CREATE TABLE IF NOT EXISTS 'streams' (
 	'sample_rate'				REAL,
 	'total_frames'				INTEGER,
 	'bitrate'					REAL,
+	'seek_index'				BLOB,
+
+	'album_art_offset'			INTEGER,
+	'album_art_length'			INTEGER,
+	'album_art_mime_type'		TEXT,
+	'album_art_hash'			TEXT,
+
+	'track_loudness'			REAL,
+	'track_loudness_range'		REAL,
+	'album_loudness'			REAL,
+
+	'track_true_peak'			REAL,
+	'album_true_peak'			REAL,
+
+	'artist_id'					INTEGER,
+	'album_artist_id'			INTEGER,
+	'album_id'					INTEGER,
+	'genre_id'					INTEGER,
+	'composer_id'				INTEGER,
+
+	'pregap_frame_count'		INTEGER,
 	
 	UNIQUE (url, starting_frame, frame_count)
 	
@@ -0,0 +1 @@
+DELETE FROM 'playlist_entries' WHERE id == :id;
@@ -0,0 +1,7 @@
+CREATE TRIGGER IF NOT EXISTS 'stream_metadata_was_deleted' DELETE ON 'streams'
+	BEGIN
+		UPDATE 'artists' SET stream_count = stream_count - 1 WHERE id == old.artist_id;
+		UPDATE 'albums' SET stream_count = stream_count - 1 WHERE id == old.album_id;
+		UPDATE 'genres' SET stream_count = stream_count - 1 WHERE id == old.genre_id;
+		UPDATE 'composers' SET stream_count = stream_count - 1 WHERE id == old.composer_id;
+	END;
@@ -2,7 +2,7 @@ INSERT INTO 'playlist_entries' (
 
 		playlist_id,
 		stream_id,
-		stream_index
+		order_key
 		
 	) 
 	
@@ -45,7 +45,17 @@ INSERT INTO 'streams' (
 		channels_per_frame,
 		sample_rate,
 		total_frames,
-		bitrate
+		bitrate,
+		album_art_offset,
+		album_art_length,
+		album_art_mime_type,
+		album_art_hash,
+		track_loudness,
+		track_loudness_range,
+		album_loudness,
+		track_true_peak,
+		album_true_peak,
+		pregap_frame_count
 
 	) 
 	
@@ -96,6 +106,16 @@ INSERT INTO 'streams' (
 		?, 
 		?, 
 		?, 
+		?,
+		?,
+		?,
+		?,
+		?,
+		?,
+		?,
+		?,
+		?,
+		?,
 		?
 				
 	);
@@ -0,0 +1,21 @@
+CREATE TRIGGER IF NOT EXISTS 'stream_was_inserted' AFTER INSERT ON 'streams'
+	BEGIN
+		INSERT OR IGNORE INTO 'artists' (name) SELECT new.artist WHERE new.artist IS NOT NULL;
+		INSERT OR IGNORE INTO 'artists' (name) SELECT new.album_artist WHERE new.album_artist IS NOT NULL;
+		INSERT OR IGNORE INTO 'albums' (title) SELECT new.album_title WHERE new.album_title IS NOT NULL;
+		INSERT OR IGNORE INTO 'genres' (name) SELECT new.genre WHERE new.genre IS NOT NULL;
+		INSERT OR IGNORE INTO 'composers' (name) SELECT new.composer WHERE new.composer IS NOT NULL;
+
+		UPDATE 'streams' SET
+				artist_id = (SELECT id FROM 'artists' WHERE name == new.artist),
+				album_artist_id = (SELECT id FROM 'artists' WHERE name == new.album_artist),
+				album_id = (SELECT id FROM 'albums' WHERE title == new.album_title),
+				genre_id = (SELECT id FROM 'genres' WHERE name == new.genre),
+				composer_id = (SELECT id FROM 'composers' WHERE name == new.composer)
+			WHERE id == new.id;
+
+		UPDATE 'artists' SET stream_count = stream_count + 1 WHERE name == new.artist;
+		UPDATE 'albums' SET stream_count = stream_count + 1 WHERE title == new.album_title;
+		UPDATE 'genres' SET stream_count = stream_count + 1 WHERE name == new.genre;
+		UPDATE 'composers' SET stream_count = stream_count + 1 WHERE name == new.composer;
+	END;
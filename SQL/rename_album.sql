@@ -0,0 +1 @@
+UPDATE 'albums' SET title = :new_value WHERE title == :value;
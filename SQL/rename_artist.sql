@@ -0,0 +1 @@
+UPDATE 'artists' SET name = :new_value WHERE name == :value;
@@ -0,0 +1 @@
+UPDATE 'composers' SET name = :new_value WHERE name == :value;
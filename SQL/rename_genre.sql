@@ -0,0 +1 @@
+UPDATE 'genres' SET name = :new_value WHERE name == :value;
@@ -0,0 +1,53 @@
+CREATE TRIGGER IF NOT EXISTS 'artist_was_merged' BEFORE UPDATE OF name ON 'artists'
+	WHEN EXISTS (SELECT 1 FROM 'artists' WHERE name == new.name AND id != old.id)
+	BEGIN
+		UPDATE 'streams' SET artist_id = (SELECT id FROM 'artists' WHERE name == new.name), artist = new.name WHERE artist_id == old.id;
+		UPDATE 'streams' SET album_artist_id = (SELECT id FROM 'artists' WHERE name == new.name), album_artist = new.name WHERE album_artist_id == old.id;
+		DELETE FROM 'artists' WHERE id == old.id;
+		SELECT RAISE(IGNORE);
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'artist_was_renamed' AFTER UPDATE OF name ON 'artists'
+	BEGIN
+		UPDATE 'streams' SET artist = new.name WHERE artist_id == old.id;
+		UPDATE 'streams' SET album_artist = new.name WHERE album_artist_id == old.id;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'album_was_merged' BEFORE UPDATE OF title ON 'albums'
+	WHEN EXISTS (SELECT 1 FROM 'albums' WHERE title == new.title AND id != old.id)
+	BEGIN
+		UPDATE 'streams' SET album_id = (SELECT id FROM 'albums' WHERE title == new.title), album_title = new.title WHERE album_id == old.id;
+		DELETE FROM 'albums' WHERE id == old.id;
+		SELECT RAISE(IGNORE);
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'album_was_renamed' AFTER UPDATE OF title ON 'albums'
+	BEGIN
+		UPDATE 'streams' SET album_title = new.title WHERE album_id == old.id;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'genre_was_merged' BEFORE UPDATE OF name ON 'genres'
+	WHEN EXISTS (SELECT 1 FROM 'genres' WHERE name == new.name AND id != old.id)
+	BEGIN
+		UPDATE 'streams' SET genre_id = (SELECT id FROM 'genres' WHERE name == new.name), genre = new.name WHERE genre_id == old.id;
+		DELETE FROM 'genres' WHERE id == old.id;
+		SELECT RAISE(IGNORE);
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'genre_was_renamed' AFTER UPDATE OF name ON 'genres'
+	BEGIN
+		UPDATE 'streams' SET genre = new.name WHERE genre_id == old.id;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'composer_was_merged' BEFORE UPDATE OF name ON 'composers'
+	WHEN EXISTS (SELECT 1 FROM 'composers' WHERE name == new.name AND id != old.id)
+	BEGIN
+		UPDATE 'streams' SET composer_id = (SELECT id FROM 'composers' WHERE name == new.name), composer = new.name WHERE composer_id == old.id;
+		DELETE FROM 'composers' WHERE id == old.id;
+		SELECT RAISE(IGNORE);
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'composer_was_renamed' AFTER UPDATE OF name ON 'composers'
+	BEGIN
+		UPDATE 'streams' SET composer = new.name WHERE composer_id == old.id;
+	END;
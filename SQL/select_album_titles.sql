@@ -0,0 +1 @@
+SELECT title FROM 'albums' WHERE stream_count > 0;
@@ -0,0 +1 @@
+SELECT name FROM 'artists' WHERE stream_count > 0;
@@ -0,0 +1 @@
+SELECT name FROM 'composers' WHERE stream_count > 0;
@@ -0,0 +1 @@
+SELECT name FROM 'genres' WHERE stream_count > 0;
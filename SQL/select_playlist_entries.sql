@@ -0,0 +1 @@
+SELECT id, order_key FROM 'playlist_entries' WHERE playlist_id == :playlist_id ORDER BY order_key;
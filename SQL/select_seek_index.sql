@@ -0,0 +1 @@
+SELECT seek_index FROM 'streams' WHERE id == :id;
@@ -0,0 +1 @@
+UPDATE 'streams' SET seek_index = :seek_index WHERE id == :id;
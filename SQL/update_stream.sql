@@ -44,7 +44,17 @@ UPDATE 'streams' SET
 		channels_per_frame = :channels_per_frame,
 		sample_rate = :sample_rate,
 		total_frames = :total_frames,
-		bitrate = :bitrate
+		bitrate = :bitrate,
+		album_art_offset = :album_art_offset,
+		album_art_length = :album_art_length,
+		album_art_mime_type = :album_art_mime_type,
+		album_art_hash = :album_art_hash,
+		track_loudness = :track_loudness,
+		track_loudness_range = :track_loudness_range,
+		album_loudness = :album_loudness,
+		track_true_peak = :track_true_peak,
+		album_true_peak = :album_true_peak,
+		pregap_frame_count = :pregap_frame_count
 
 	WHERE id == :id;
 	
\ No newline at end of file
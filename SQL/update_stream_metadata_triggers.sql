@@ -0,0 +1,42 @@
+CREATE TRIGGER IF NOT EXISTS 'stream_artist_was_updated' AFTER UPDATE OF artist ON 'streams'
+	WHEN new.artist != old.artist OR (new.artist IS NULL) != (old.artist IS NULL)
+	BEGIN
+		UPDATE 'artists' SET stream_count = stream_count - 1 WHERE id == old.artist_id;
+		INSERT OR IGNORE INTO 'artists' (name) SELECT new.artist WHERE new.artist IS NOT NULL;
+		UPDATE 'streams' SET artist_id = (SELECT id FROM 'artists' WHERE name == new.artist) WHERE id == new.id;
+		UPDATE 'artists' SET stream_count = stream_count + 1 WHERE name == new.artist;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'stream_album_artist_was_updated' AFTER UPDATE OF album_artist ON 'streams'
+	WHEN new.album_artist != old.album_artist OR (new.album_artist IS NULL) != (old.album_artist IS NULL)
+	BEGIN
+		INSERT OR IGNORE INTO 'artists' (name) SELECT new.album_artist WHERE new.album_artist IS NOT NULL;
+		UPDATE 'streams' SET album_artist_id = (SELECT id FROM 'artists' WHERE name == new.album_artist) WHERE id == new.id;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'stream_album_title_was_updated' AFTER UPDATE OF album_title ON 'streams'
+	WHEN new.album_title != old.album_title OR (new.album_title IS NULL) != (old.album_title IS NULL)
+	BEGIN
+		UPDATE 'albums' SET stream_count = stream_count - 1 WHERE id == old.album_id;
+		INSERT OR IGNORE INTO 'albums' (title) SELECT new.album_title WHERE new.album_title IS NOT NULL;
+		UPDATE 'streams' SET album_id = (SELECT id FROM 'albums' WHERE title == new.album_title) WHERE id == new.id;
+		UPDATE 'albums' SET stream_count = stream_count + 1 WHERE title == new.album_title;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'stream_genre_was_updated' AFTER UPDATE OF genre ON 'streams'
+	WHEN new.genre != old.genre OR (new.genre IS NULL) != (old.genre IS NULL)
+	BEGIN
+		UPDATE 'genres' SET stream_count = stream_count - 1 WHERE id == old.genre_id;
+		INSERT OR IGNORE INTO 'genres' (name) SELECT new.genre WHERE new.genre IS NOT NULL;
+		UPDATE 'streams' SET genre_id = (SELECT id FROM 'genres' WHERE name == new.genre) WHERE id == new.id;
+		UPDATE 'genres' SET stream_count = stream_count + 1 WHERE name == new.genre;
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'stream_composer_was_updated' AFTER UPDATE OF composer ON 'streams'
+	WHEN new.composer != old.composer OR (new.composer IS NULL) != (old.composer IS NULL)
+	BEGIN
+		UPDATE 'composers' SET stream_count = stream_count - 1 WHERE id == old.composer_id;
+		INSERT OR IGNORE INTO 'composers' (name) SELECT new.composer WHERE new.composer IS NOT NULL;
+		UPDATE 'streams' SET composer_id = (SELECT id FROM 'composers' WHERE name == new.composer) WHERE id == new.id;
+		UPDATE 'composers' SET stream_count = stream_count + 1 WHERE name == new.composer;
+	END;
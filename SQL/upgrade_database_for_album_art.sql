@@ -0,0 +1,4 @@
+ALTER TABLE 'streams' ADD COLUMN 'album_art_offset' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'album_art_length' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'album_art_mime_type' TEXT;
+ALTER TABLE 'streams' ADD COLUMN 'album_art_hash' TEXT;
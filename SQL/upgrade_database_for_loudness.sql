@@ -0,0 +1,3 @@
+ALTER TABLE 'streams' ADD COLUMN 'track_loudness' REAL;
+ALTER TABLE 'streams' ADD COLUMN 'track_loudness_range' REAL;
+ALTER TABLE 'streams' ADD COLUMN 'album_loudness' REAL;
@@ -0,0 +1,61 @@
+ALTER TABLE 'streams' ADD COLUMN 'artist_id' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'album_artist_id' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'album_id' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'genre_id' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'composer_id' INTEGER;
+
+CREATE TABLE IF NOT EXISTS 'artists' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'name'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE TABLE IF NOT EXISTS 'albums' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'title'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE TABLE IF NOT EXISTS 'genres' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'name'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+CREATE TABLE IF NOT EXISTS 'composers' (
+
+	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+	'name'					TEXT NOT NULL UNIQUE,
+	'stream_count'			INTEGER NOT NULL DEFAULT 0
+
+);
+
+INSERT OR IGNORE INTO 'artists' (name) SELECT DISTINCT artist FROM 'streams' WHERE artist IS NOT NULL;
+INSERT OR IGNORE INTO 'artists' (name) SELECT DISTINCT album_artist FROM 'streams' WHERE album_artist IS NOT NULL;
+INSERT OR IGNORE INTO 'albums' (title) SELECT DISTINCT album_title FROM 'streams' WHERE album_title IS NOT NULL;
+INSERT OR IGNORE INTO 'genres' (name) SELECT DISTINCT genre FROM 'streams' WHERE genre IS NOT NULL;
+INSERT OR IGNORE INTO 'composers' (name) SELECT DISTINCT composer FROM 'streams' WHERE composer IS NOT NULL;
+
+UPDATE 'streams' SET
+		artist_id = (SELECT id FROM 'artists' WHERE name == streams.artist),
+		album_artist_id = (SELECT id FROM 'artists' WHERE name == streams.album_artist),
+		album_id = (SELECT id FROM 'albums' WHERE title == streams.album_title),
+		genre_id = (SELECT id FROM 'genres' WHERE name == streams.genre),
+		composer_id = (SELECT id FROM 'composers' WHERE name == streams.composer);
+
+CREATE INDEX IF NOT EXISTS 'streams_artist_id' ON 'streams' (artist_id);
+CREATE INDEX IF NOT EXISTS 'streams_album_artist_id' ON 'streams' (album_artist_id);
+CREATE INDEX IF NOT EXISTS 'streams_album_id' ON 'streams' (album_id);
+CREATE INDEX IF NOT EXISTS 'streams_genre_id' ON 'streams' (genre_id);
+CREATE INDEX IF NOT EXISTS 'streams_composer_id' ON 'streams' (composer_id);
+
+UPDATE 'artists' SET stream_count = (SELECT COUNT(*) FROM 'streams' WHERE artist_id == artists.id);
+UPDATE 'albums' SET stream_count = (SELECT COUNT(*) FROM 'streams' WHERE album_id == albums.id);
+UPDATE 'genres' SET stream_count = (SELECT COUNT(*) FROM 'streams' WHERE genre_id == genres.id);
+UPDATE 'composers' SET stream_count = (SELECT COUNT(*) FROM 'streams' WHERE composer_id == composers.id);
@@ -0,0 +1,3 @@
+ALTER TABLE 'playlist_entries' ADD COLUMN 'order_key' INTEGER;
+UPDATE 'playlist_entries' SET order_key = (stream_index + 1) * 1048576;
+CREATE INDEX IF NOT EXISTS 'playlist_entries_order' ON 'playlist_entries' (playlist_id, order_key, stream_id);
@@ -0,0 +1 @@
+ALTER TABLE 'streams' ADD COLUMN 'pregap_frame_count' INTEGER;
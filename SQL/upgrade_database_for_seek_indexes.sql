@@ -0,0 +1 @@
+ALTER TABLE 'streams' ADD COLUMN 'seek_index' BLOB;
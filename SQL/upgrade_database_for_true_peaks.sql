@@ -0,0 +1,2 @@
+ALTER TABLE 'streams' ADD COLUMN 'track_true_peak' REAL;
+ALTER TABLE 'streams' ADD COLUMN 'album_true_peak' REAL;
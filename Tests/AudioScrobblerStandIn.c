@@ -0,0 +1,293 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// A stand-in for the Last.fm client's local plugin port, for exercising AudioScrobbler
+// It accepts the commands the Last.fm client does (START, STOP, PAUSE and RESUME),
+// replies OK or ERROR to each one on its line, and prints what it received
+//
+// Point Play at it with "defaults write org.sbooth.Play audioScrobblerPort 33368", then
+//   AudioScrobblerStandIn -p 33368              accept everything
+//   AudioScrobblerStandIn -p 33368 -e 3         refuse every third command with ERROR
+//   AudioScrobblerStandIn -p 33368 -c           close the connection after each reply
+//   AudioScrobblerStandIn -p 33368 -q 5         quit on the fifth command without replying to it
+// Quitting mid-session, or refusing the STOP that ends a play, should leave the play in
+// the journal; it is replayed as START and STOP the next time Play launches
+//
+// With -t the stand-in checks itself instead: it serves one connection on a free port
+// and plays the client's part over the wire, including a refused and an unknown command
+// Build with "make -C Tests AudioScrobblerStandIn"; "make -C Tests test" runs the check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_PORT		33367
+#define LINE_LENGTH			4096
+
+typedef struct {
+	unsigned	errorInterval;		// Refuse every nth command, or 0
+	int			closeAfterReply;
+	unsigned	quitAfter;			// Stop replying after this many commands, or 0
+	unsigned	commandCount;
+} StandInOptions;
+
+static int
+is_supported(const char *line)
+{
+	static const char * const sCommands [] = { "START ", "STOP ", "PAUSE ", "RESUME " };
+	unsigned i;
+	
+	for(i = 0; i < sizeof(sCommands) / sizeof(sCommands[0]); ++i) {
+		if(0 == strncmp(line, sCommands[i], strlen(sCommands[i])))
+			return 1;
+	}
+	
+	return 0;
+}
+
+static int
+send_line(int fd, const char *line)
+{
+	size_t length = strlen(line);
+	return (write(fd, line, length) == (ssize_t)length);
+}
+
+// Serves one connection; returns 0 if the stand-in should quit
+static int
+serve_connection(int fd, StandInOptions *options)
+{
+	char	buffer [LINE_LENGTH];
+	size_t	length		= 0;
+	
+	for(;;) {
+		char *newline = memchr(buffer, '\n', length);
+		
+		if(NULL == newline) {
+			if(sizeof(buffer) == length)
+				length = 0;
+			
+			ssize_t bytesRead = read(fd, buffer + length, sizeof(buffer) - length);
+			if(0 >= bytesRead)
+				return 1;
+			
+			length += bytesRead;
+			continue;
+		}
+		
+		*newline = '\0';
+		
+		++options->commandCount;
+		printf("%4u %s\n", options->commandCount, buffer);
+		fflush(stdout);
+		
+		if(0 != options->quitAfter && options->commandCount >= options->quitAfter)
+			return 0;
+		
+		if(!is_supported(buffer)) {
+			if(!send_line(fd, "ERROR unknown command\n"))
+				return 1;
+		}
+		else if(0 != options->errorInterval && 0 == options->commandCount % options->errorInterval) {
+			if(!send_line(fd, "ERROR\n"))
+				return 1;
+		}
+		else if(!send_line(fd, "OK\n"))
+			return 1;
+		
+		length -= (newline + 1) - buffer;
+		memmove(buffer, newline + 1, length);
+		
+		if(options->closeAfterReply)
+			return 1;
+	}
+}
+
+static int
+create_listener(unsigned short *port)
+{
+	struct sockaddr_in	address;
+	socklen_t			addressLength	= sizeof(address);
+	int					listener		= socket(AF_INET, SOCK_STREAM, 0);
+	int					reuse			= 1;
+	
+	if(-1 == listener)
+		return -1;
+	
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	
+	memset(&address, 0, sizeof(address));
+	address.sin_family		= AF_INET;
+	address.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	address.sin_port		= htons(*port);
+	
+	if(-1 == bind(listener, (struct sockaddr *)&address, sizeof(address)) || -1 == listen(listener, 4) || -1 == getsockname(listener, (struct sockaddr *)&address, &addressLength)) {
+		close(listener);
+		return -1;
+	}
+	
+	*port = ntohs(address.sin_port);
+	
+	return listener;
+}
+
+// ========================================
+// Self check
+// ========================================
+
+static void *
+serve_one_connection(void *arg)
+{
+	int				listener	= (int)(long)arg;
+	StandInOptions	options		= { 3, 0, 0, 0 };
+	int				fd			= accept(listener, NULL, NULL);
+	
+	if(-1 != fd) {
+		serve_connection(fd, &options);
+		close(fd);
+	}
+	
+	return NULL;
+}
+
+static int
+self_check(void)
+{
+	// Pipelined as AudioScrobbler sends them; a replayed play is a START and STOP pair
+	static const char * const sRequest =
+		"START c=pla&a=Artist&t=Title&b=Album&m=&l=215&p=/Music/track.flac\n"
+		"STOP c=pla\n"
+		"PAUSE c=pla\n"
+		"SUBMIT c=pla&a=Artist&t=Title\n"
+		"RESUME c=pla\n";
+	static const char * const sExpected [] = { "OK", "OK", "ERROR", "ERROR unknown command", "OK" };
+	
+	unsigned short		port		= 0;
+	int					listener	= create_listener(&port);
+	int					fd			= socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in	address;
+	pthread_t			thread;
+	char				replies [256];
+	size_t				length		= 0;
+	unsigned			i;
+	int					failures	= 0;
+	
+	if(-1 == listener || -1 == fd || 0 != pthread_create(&thread, NULL, serve_one_connection, (void *)(long)listener)) {
+		fprintf(stderr, "Unable to start the stand-in\n");
+		return 1;
+	}
+	
+	memset(&address, 0, sizeof(address));
+	address.sin_family		= AF_INET;
+	address.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	address.sin_port		= htons(port);
+	
+	if(-1 == connect(fd, (struct sockaddr *)&address, sizeof(address)) || !send_line(fd, sRequest)) {
+		fprintf(stderr, "Unable to reach the stand-in\n");
+		return 1;
+	}
+	
+	shutdown(fd, SHUT_WR);
+	
+	for(;;) {
+		ssize_t bytesRead = read(fd, replies + length, sizeof(replies) - 1 - length);
+		if(0 >= bytesRead)
+			break;
+		length += bytesRead;
+	}
+	replies[length] = '\0';
+	
+	close(fd);
+	pthread_join(thread, NULL);
+	close(listener);
+	
+	char *line = replies;
+	for(i = 0; i < sizeof(sExpected) / sizeof(sExpected[0]); ++i) {
+		char *newline = (NULL == line ? NULL : strchr(line, '\n'));
+		if(NULL == newline) {
+			fprintf(stderr, "Reply %u is missing\n", i + 1);
+			++failures;
+			break;
+		}
+		
+		*newline = '\0';
+		if(0 != strcmp(line, sExpected[i])) {
+			fprintf(stderr, "Reply %u was \"%s\", expected \"%s\"\n", i + 1, line, sExpected[i]);
+			++failures;
+		}
+		line = newline + 1;
+	}
+	
+	if(0 < failures)
+		return 1;
+	
+	printf("All AudioScrobbler stand-in checks passed\n");
+	return 0;
+}
+
+int
+main(int argc, char *argv [])
+{
+	StandInOptions	options		= { 0, 0, 0, 0 };
+	unsigned short	port		= DEFAULT_PORT;
+	int				ch;
+	
+	while(-1 != (ch = getopt(argc, argv, "p:e:cq:t"))) {
+		switch(ch) {
+			case 'p':	port					= (unsigned short)atoi(optarg);		break;
+			case 'e':	options.errorInterval	= (unsigned)atoi(optarg);			break;
+			case 'c':	options.closeAfterReply	= 1;								break;
+			case 'q':	options.quitAfter		= (unsigned)atoi(optarg);			break;
+			case 't':	return self_check();
+			default:
+				fprintf(stderr, "usage: %s [-p port] [-e n] [-c] [-q n] | -t\n", argv[0]);
+				return 1;
+		}
+	}
+	
+	int listener = create_listener(&port);
+	if(-1 == listener) {
+		fprintf(stderr, "Unable to listen on port %u\n", (unsigned)port);
+		return 1;
+	}
+	
+	printf("Listening on port %u\n", (unsigned)port);
+	fflush(stdout);
+	
+	for(;;) {
+		int fd = accept(listener, NULL, NULL);
+		if(-1 == fd)
+			continue;
+		
+		int keepRunning = serve_connection(fd, &options);
+		close(fd);
+		
+		if(!keepRunning)
+			break;
+	}
+	
+	close(listener);
+	
+	return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Headless checks for the biquad equalizer and look-ahead limiter in DSPChain
+// Build and run with "make -C Tests"
+
+#include "DSPChain.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SAMPLE_RATE		48000.0
+#define SLICE_FRAMES	512
+#define CHANNELS		2
+
+static int sFailures = 0;
+
+#define CHECK(condition, ...)											\
+	do {																\
+		if(!(condition)) {												\
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);				\
+			fprintf(stderr, __VA_ARGS__);								\
+			fputc('\n', stderr);										\
+			++sFailures;												\
+		}																\
+	} while(0)
+
+static float sLeft [SLICE_FRAMES];
+static float sRight [SLICE_FRAMES];
+static float * const sBuffers [CHANNELS] = { sLeft, sRight };
+
+static DSPChain *
+create_chain(int limiterEnabled, float threshold, unsigned bandCount, float bandGain)
+{
+	DSPChain			*chain		= dsp_chain_create(SAMPLE_RATE, SLICE_FRAMES);
+	DSPChainParameters	parameters;
+	
+	dsp_chain_get_parameters(chain, &parameters);
+	
+	parameters.limiterEnabled		= limiterEnabled;
+	parameters.limiterThreshold		= threshold;
+	parameters.equalizerBandCount	= bandCount;
+	
+	if(0 < bandCount) {
+		parameters.equalizerBands[0].type		= DSPEqualizerBandPeaking;
+		parameters.equalizerBands[0].frequency	= 1000;
+		parameters.equalizerBands[0].gain		= bandGain;
+		parameters.equalizerBands[0].q			= 1;
+	}
+	
+	dsp_chain_set_parameters(chain, &parameters);
+	
+	return chain;
+}
+
+static void
+set_band_gain(DSPChain *chain, float gain)
+{
+	DSPChainParameters parameters;
+	
+	dsp_chain_get_parameters(chain, &parameters);
+	parameters.equalizerBands[0].gain = gain;
+	dsp_chain_set_parameters(chain, &parameters);
+}
+
+// Returns the largest output magnitude of the last slice
+static float
+process_sine(DSPChain *chain, double frequency, float amplitude, unsigned sliceCount)
+{
+	unsigned	slice, i;
+	float		peak		= 0;
+	
+	for(slice = 0; slice < sliceCount; ++slice) {
+		peak = 0;
+		
+		for(i = 0; i < SLICE_FRAMES; ++i) {
+			double t = (double)(slice * SLICE_FRAMES + i) / SAMPLE_RATE;
+			sLeft[i] = sRight[i] = amplitude * (float)sin(2 * M_PI * frequency * t);
+		}
+		
+		dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+		
+		for(i = 0; i < SLICE_FRAMES; ++i) {
+			if(fabsf(sLeft[i]) > peak)
+				peak = fabsf(sLeft[i]);
+		}
+	}
+	
+	return peak;
+}
+
+static void
+test_peaking_band(void)
+{
+	DSPChain	*chain		= create_chain(0, 1, 1, 6);
+	float		boosted		= process_sine(chain, 1000, 0.25f, 40);
+	
+	dsp_chain_reset(chain);
+	float		untouched	= process_sine(chain, 50, 0.25f, 40);
+	
+	CHECK(fabsf(20 * log10f(boosted / 0.25f) - 6) < 0.2f, "1 kHz gain was %f dB, expected 6 dB", 20 * log10f(boosted / 0.25f));
+	CHECK(fabsf(20 * log10f(untouched / 0.25f)) < 0.2f, "50 Hz gain was %f dB, expected 0 dB", 20 * log10f(untouched / 0.25f));
+	
+	dsp_chain_destroy(chain);
+}
+
+static void
+test_band_reenabled_after_zero_gain(void)
+{
+	DSPChain	*chain		= create_chain(0, 1, 1, 6);
+	unsigned	i;
+	
+	process_sine(chain, 1000, 0.5f, 4);
+	
+	// At 0 dB the band is skipped and its state left as it was
+	set_band_gain(chain, 0);
+	process_sine(chain, 1000, 0, 1);
+	
+	// Silence in must be silence out once the band is active again
+	set_band_gain(chain, 6);
+	memset(sLeft, 0, sizeof(sLeft));
+	memset(sRight, 0, sizeof(sRight));
+	dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	
+	for(i = 0; i < SLICE_FRAMES; ++i) {
+		if(0 != sLeft[i]) {
+			CHECK(0, "Frame %u was %g after the band was re-enabled, expected 0", i, sLeft[i]);
+			break;
+		}
+	}
+	
+	dsp_chain_destroy(chain);
+}
+
+// Constant input, so each output frame shows the gain applied to it
+static void
+test_gain_handoff(void)
+{
+	DSPChain	*chain		= create_chain(0, 1, 0, 0);
+	unsigned	i;
+	
+	dsp_chain_set_gain(chain, -6);
+	dsp_chain_reset(chain);
+	
+	// A ramped change doesn't reach the new gain at once
+	for(i = 0; i < SLICE_FRAMES; ++i)
+		sLeft[i] = sRight[i] = 1;
+	dsp_chain_set_gain(chain, 0);
+	dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	CHECK(sLeft[0] < 0.6f, "First frame after a ramped change was %f, expected about 0.5", sLeft[0]);
+	
+	// An immediate change applies from the first frame, replacing the ramp in progress
+	dsp_chain_set_gain_immediately(chain, -6);
+	for(i = 0; i < SLICE_FRAMES; ++i)
+		sLeft[i] = sRight[i] = 1;
+	dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	
+	for(i = 0; i < SLICE_FRAMES; ++i) {
+		if(fabsf(sLeft[i] - powf(10, -6.0f / 20)) > 1e-6f) {
+			CHECK(0, "Frame %u was %f after an immediate change, expected %f", i, sLeft[i], powf(10, -6.0f / 20));
+			break;
+		}
+	}
+	
+	dsp_chain_destroy(chain);
+}
+
+static void
+test_limiter_ceiling(void)
+{
+	DSPChain	*chain		= create_chain(1, 0.5f, 0, 0);
+	float		peak		= process_sine(chain, 440, 1, 40);
+	
+	CHECK(peak <= 0.5f, "Limited peak was %f, expected at most 0.5", peak);
+	CHECK(peak > 0.45f, "Limited peak was %f, expected close to 0.5", peak);
+	
+	dsp_chain_destroy(chain);
+}
+
+static void
+test_limiter_delay(void)
+{
+	DSPChain	*chain		= create_chain(1, 0.5f, 0, 0);
+	unsigned	lookahead	= (unsigned)(0.005 * SAMPLE_RATE);
+	unsigned	impulse		= SLICE_FRAMES - 10;
+	unsigned	written		= 0;
+	unsigned	slice, i;
+	int			found		= -1;
+	
+	// An impulse below the threshold passes unchanged, at its own position in the stream
+	for(slice = 0; slice < 2; ++slice) {
+		memset(sLeft, 0, sizeof(sLeft));
+		memset(sRight, 0, sizeof(sRight));
+		
+		if(0 == slice)
+			sLeft[impulse] = sRight[impulse] = 0.25f;
+		
+		unsigned frameCount = dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+		
+		// The delay line fills before anything is written
+		if(0 == slice)
+			CHECK(frameCount == SLICE_FRAMES - lookahead, "Wrote %u frames, expected %u", frameCount, SLICE_FRAMES - lookahead);
+		else
+			CHECK(frameCount == SLICE_FRAMES, "Wrote %u frames, expected %u", frameCount, SLICE_FRAMES);
+		
+		for(i = 0; i < frameCount; ++i) {
+			if(0 != sLeft[i]) {
+				found = (int)(written + i);
+				CHECK(0.25f == sLeft[i], "Impulse came out as %f, expected 0.25", sLeft[i]);
+			}
+		}
+		
+		written += frameCount;
+	}
+	
+	CHECK(found == (int)impulse, "Impulse came out at frame %d, expected %u", found, impulse);
+	
+	dsp_chain_destroy(chain);
+}
+
+static void
+test_limiter_lookahead_across_slices(void)
+{
+	DSPChain	*chain		= create_chain(1, 0.5f, 0, 0);
+	unsigned	lookahead	= (unsigned)(0.005 * SAMPLE_RATE);
+	unsigned	i;
+	
+	// A quiet signal, then a peak on the last frame of the first slice
+	for(i = 0; i < SLICE_FRAMES; ++i)
+		sLeft[i] = sRight[i] = 0.1f;
+	sLeft[SLICE_FRAMES - 1] = sRight[SLICE_FRAMES - 1] = 1;
+	
+	dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	
+	for(i = 0; i < SLICE_FRAMES; ++i)
+		sLeft[i] = sRight[i] = 0.1f;
+	
+	dsp_chain_process(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	
+	// The peak leaves the delay line lookahead - 1 frames into the second slice
+	float peak		= sLeft[lookahead - 1];
+	float before	= sLeft[lookahead - 2];
+	
+	CHECK(peak <= 0.5f, "Peak came out as %f, expected at most 0.5", peak);
+	CHECK(peak > 0.45f, "Peak came out as %f, expected close to 0.5", peak);
+	CHECK(before < 0.06f, "The frame before the peak was %f, expected the gain to be reduced ahead of it", before);
+	
+	dsp_chain_destroy(chain);
+}
+
+// Writes a ramp below the threshold, returning the number of frames written
+static unsigned
+process_ramp(DSPChain *chain, unsigned frameCount)
+{
+	unsigned i;
+	for(i = 0; i < frameCount; ++i)
+		sLeft[i] = sRight[i] = 0.25f * (float)(i + 1) / SLICE_FRAMES;
+	
+	return dsp_chain_process(chain, sBuffers, CHANNELS, frameCount);
+}
+
+// Checks that the buffers hold the ramp from frame start on
+static void
+check_ramp(unsigned start, unsigned frameCount)
+{
+	unsigned i;
+	for(i = 0; i < frameCount; ++i) {
+		float expected = 0.25f * (float)(start + i + 1) / SLICE_FRAMES;
+		if(expected != sLeft[i] || expected != sRight[i]) {
+			CHECK(0, "Frame %u was %f, expected %f", start + i, sLeft[i], expected);
+			break;
+		}
+	}
+}
+
+static void
+test_limiter_drain(void)
+{
+	DSPChain	*chain		= create_chain(1, 0.5f, 0, 0);
+	unsigned	lookahead	= (unsigned)(0.005 * SAMPLE_RATE);
+	unsigned	written, drained;
+	
+	// The frames held back at the end of a stream come out of the delay line unchanged
+	written = process_ramp(chain, SLICE_FRAMES);
+	check_ramp(0, written);
+	
+	drained = dsp_chain_drain(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	CHECK(written + drained == SLICE_FRAMES, "Wrote %u frames and drained %u, expected %u in all", written, drained, SLICE_FRAMES);
+	check_ramp(written, drained);
+	
+	drained = dsp_chain_drain(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	CHECK(0 == drained, "Drained %u more frames, expected none", drained);
+	
+	// A stream shorter than the look-ahead is all held back, and drained in pieces
+	written = process_ramp(chain, lookahead / 2);
+	CHECK(0 == written, "Wrote %u frames of a stream shorter than the look-ahead, expected none", written);
+	
+	drained = dsp_chain_drain(chain, sBuffers, CHANNELS, lookahead / 4);
+	CHECK(drained == lookahead / 4, "Drained %u frames, expected %u", drained, lookahead / 4);
+	check_ramp(0, drained);
+	
+	written = drained;
+	drained = dsp_chain_drain(chain, sBuffers, CHANNELS, SLICE_FRAMES);
+	CHECK(written + drained == lookahead / 2, "Drained %u frames in all, expected %u", written + drained, lookahead / 2);
+	check_ramp(written, drained);
+	
+	// The next stream starts with an empty delay line
+	written = process_ramp(chain, SLICE_FRAMES);
+	CHECK(written == SLICE_FRAMES - lookahead, "Wrote %u frames of the next stream, expected %u", written, SLICE_FRAMES - lookahead);
+	check_ramp(0, written);
+	
+	dsp_chain_destroy(chain);
+}
+
+int
+main(void)
+{
+	test_peaking_band();
+	test_band_reenabled_after_zero_gain();
+	test_gain_handoff();
+	test_limiter_ceiling();
+	test_limiter_delay();
+	test_limiter_lookahead_across_slices();
+	test_limiter_drain();
+	
+	if(0 != sFailures) {
+		fprintf(stderr, "%d DSPChain checks failed\n", sFailures);
+		return 1;
+	}
+	
+	printf("All DSPChain checks passed\n");
+	return 0;
+}
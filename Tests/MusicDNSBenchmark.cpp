@@ -0,0 +1,290 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Measures MusicDNS lookup throughput against a mock server on the loopback interface
+// The server answers every POST with a fixed document, split across several writes so
+// the response reaches expat in pieces, and counts the connections it accepts
+// Build and run with "make -C Tests benchmark" (Mac OS X only)
+
+#include "protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define LOOKUPS_PER_THREAD		500
+#define MAXIMUM_THREADS			4
+
+static const char *sPUID	= "b0b8dce1-7d3b-4a2c-9b5e-1f3a6c2d4e5f";
+static const char *sTitle	= "Jóga";
+static const char *sArtist	= "Björk";
+
+static pthread_mutex_t	sMutex					= PTHREAD_MUTEX_INITIALIZER;
+static unsigned			sConnectionsAccepted	= 0;
+static unsigned			sRequestsServed			= 0;
+
+// ========================================
+// Mock server
+// ========================================
+
+static bool
+write_fully(int fd, const char *bytes, size_t length)
+{
+	while(0 < length) {
+		ssize_t written = write(fd, bytes, length);
+		if(0 >= written)
+			return false;
+		bytes	+= written;
+		length	-= written;
+	}
+	return true;
+}
+
+// Reads one request, headers and body; returns false when the client closes the connection
+static bool
+read_request(int fd, string &buffer)
+{
+	string::size_type headerEnd;
+	char chunk [4096];
+	
+	while(string::npos == (headerEnd = buffer.find("\r\n\r\n"))) {
+		ssize_t bytesRead = read(fd, chunk, sizeof(chunk));
+		if(0 >= bytesRead)
+			return false;
+		buffer.append(chunk, bytesRead);
+	}
+	
+	size_t contentLength = 0;
+	string::size_type field = buffer.find("Content-Length:");
+	if(string::npos == field || field > headerEnd)
+		field = buffer.find("content-length:");
+	if(string::npos != field && field < headerEnd)
+		contentLength = strtoul(buffer.c_str() + field + 15, NULL, 10);
+	
+	size_t requestLength = headerEnd + 4 + contentLength;
+	while(buffer.length() < requestLength) {
+		ssize_t bytesRead = read(fd, chunk, sizeof(chunk));
+		if(0 >= bytesRead)
+			return false;
+		buffer.append(chunk, bytesRead);
+	}
+	
+	buffer.erase(0, requestLength);
+	
+	return true;
+}
+
+static void *
+serve_connection(void *arg)
+{
+	int		fd			= (int)(long)arg;
+	int		noDelay		= 1;
+	string	buffer;
+	char	body [1024];
+	char	header [256];
+	
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	
+	snprintf(body, sizeof(body), 
+			 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			 "<metadata xmlns=\"http://musicbrainz.org/ns/mmd/1\">"
+			 "<track><title>%s</title><artist><name>%s</name></artist>"
+			 "<puid-list><puid id=\"%s\"/></puid-list></track></metadata>\n", 
+			 sTitle, sArtist, sPUID);
+	
+	size_t bodyLength = strlen(body);
+	snprintf(header, sizeof(header), 
+			 "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: %lu\r\n\r\n", 
+			 (unsigned long)bodyLength);
+	
+	while(read_request(fd, buffer)) {
+		// Split the document in the middle of an element
+		size_t split = bodyLength / 2;
+		if(!write_fully(fd, header, strlen(header)) || !write_fully(fd, body, split) || !write_fully(fd, body + split, bodyLength - split))
+			break;
+		
+		pthread_mutex_lock(&sMutex);
+		++sRequestsServed;
+		pthread_mutex_unlock(&sMutex);
+	}
+	
+	close(fd);
+	
+	return NULL;
+}
+
+static void *
+accept_connections(void *arg)
+{
+	int listener = (int)(long)arg;
+	
+	for(;;) {
+		int fd = accept(listener, NULL, NULL);
+		if(-1 == fd)
+			continue;
+		
+		pthread_mutex_lock(&sMutex);
+		++sConnectionsAccepted;
+		pthread_mutex_unlock(&sMutex);
+		
+		pthread_t thread;
+		if(0 == pthread_create(&thread, NULL, serve_connection, (void *)(long)fd))
+			pthread_detach(thread);
+		else
+			close(fd);
+	}
+	
+	return NULL;
+}
+
+// Returns the port the server is listening on, or 0 on failure
+static unsigned short
+start_server()
+{
+	struct sockaddr_in	address;
+	socklen_t			addressLength	= sizeof(address);
+	int					listener		= socket(AF_INET, SOCK_STREAM, 0);
+	
+	if(-1 == listener)
+		return 0;
+	
+	memset(&address, 0, sizeof(address));
+	address.sin_family		= AF_INET;
+	address.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	address.sin_port		= 0;
+	
+	if(-1 == bind(listener, (struct sockaddr *)&address, sizeof(address)) || -1 == listen(listener, 64) || -1 == getsockname(listener, (struct sockaddr *)&address, &addressLength)) {
+		close(listener);
+		return 0;
+	}
+	
+	pthread_t thread;
+	if(0 != pthread_create(&thread, NULL, accept_connections, (void *)(long)listener)) {
+		close(listener);
+		return 0;
+	}
+	pthread_detach(thread);
+	
+	return ntohs(address.sin_port);
+}
+
+// ========================================
+// Client
+// ========================================
+
+struct LookupTask {
+	string		url;
+	unsigned	failures;
+};
+
+static void *
+perform_lookups(void *arg)
+{
+	LookupTask	*task = (LookupTask *)arg;
+	unsigned	i;
+	
+	for(i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+		TrackInformation info;
+		
+		info.setPrint(string(756, 'A'));
+		info.setFormat("flac");
+		info.setLengthInMS(215000);
+		info.setArtist("unknown");
+		info.setTrack("unknown");
+		
+		if(!retrieve_metadata("00000000000000000000000000000000", "0.0", &info, true, task->url) 
+		   || info.getPUID() != sPUID || info.getTrack() != sTitle || info.getArtist() != sArtist)
+			++task->failures;
+	}
+	
+	return NULL;
+}
+
+static double
+current_time()
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + (now.tv_usec / 1000000.0);
+}
+
+int
+main()
+{
+	unsigned short port = start_server();
+	if(0 == port) {
+		fprintf(stderr, "Unable to start the mock server\n");
+		return 1;
+	}
+	
+	char url [64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/ofa/1/track", (unsigned)port);
+	
+	unsigned	failures = 0;
+	unsigned	threadCount;
+	
+	printf("%-8s %8s %12s %12s\n", "Threads", "Lookups", "Lookups/s", "Connections");
+	
+	for(threadCount = 1; threadCount <= MAXIMUM_THREADS; threadCount *= 2) {
+		pthread_t	threads [MAXIMUM_THREADS];
+		LookupTask	tasks [MAXIMUM_THREADS];
+		unsigned	i;
+		
+		pthread_mutex_lock(&sMutex);
+		unsigned connectionsBefore = sConnectionsAccepted;
+		pthread_mutex_unlock(&sMutex);
+		
+		double start = current_time();
+		
+		for(i = 0; i < threadCount; ++i) {
+			tasks[i].url		= url;
+			tasks[i].failures	= 0;
+			pthread_create(&threads[i], NULL, perform_lookups, &tasks[i]);
+		}
+		
+		for(i = 0; i < threadCount; ++i) {
+			pthread_join(threads[i], NULL);
+			failures += tasks[i].failures;
+		}
+		
+		double elapsed = current_time() - start;
+		
+		pthread_mutex_lock(&sMutex);
+		unsigned connections = sConnectionsAccepted - connectionsBefore;
+		pthread_mutex_unlock(&sMutex);
+		
+		printf("%-8u %8u %12.0f %12u\n", threadCount, threadCount * LOOKUPS_PER_THREAD, (threadCount * LOOKUPS_PER_THREAD) / elapsed, connections);
+	}
+	
+	if(0 < failures) {
+		fprintf(stderr, "%u lookups did not return the expected PUID, title and artist\n", failures);
+		return 1;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Measures THD+N and speed of the PolyphaseFilter used by ResamplingDecoder
+// THD+N is everything left after a least-squares fit of the test tone is removed
+// from the output, relative to the tone
+// Build and run with "make -C Tests benchmark"
+
+#include "PolyphaseFilter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define AUDIO_SECONDS		10
+#define AMPLITUDE			0.5
+#define OUTPUT_CHUNK		4096
+#define PASSES				3
+
+// Anything worse than this means the filter bank is broken, not just imperfect
+#define MAXIMUM_THD_N		-80.0
+
+typedef struct {
+	unsigned	sourceSampleRate;
+	unsigned	sampleRate;
+	double		frequency;
+} Conversion;
+
+static const Conversion sConversions [] = {
+	{ 44100,	48000,	1000 },
+	{ 44100,	48000,	15000 },
+	{ 48000,	44100,	1000 },
+	{ 48000,	44100,	15000 },
+	{ 96000,	44100,	1000 },
+	{ 96000,	44100,	15000 },
+	{ 44100,	96000,	1000 },
+	{ 44100,	96000,	15000 },
+};
+
+// Converts a sine at frequency, preceded by the filter history as silence
+// Returns the number of output frames, stored in *output, and the CPU time in *seconds
+static size_t
+convert_sine(const PolyphaseFilter *filter, unsigned sourceSampleRate, double frequency, float **output, double *seconds)
+{
+	size_t		historyFrames	= polyphase_filter_taps_per_phase(filter) - 1;
+	size_t		sourceFrames	= (size_t)AUDIO_SECONDS * sourceSampleRate;
+	size_t		inputFrames		= historyFrames + sourceFrames;
+	size_t		outputCapacity	= (sourceFrames * polyphase_filter_upsampling_factor(filter)) / polyphase_filter_downsampling_factor(filter) + 1;
+	float		*input			= calloc(inputFrames, sizeof(float));
+	size_t		i;
+	unsigned	pass;
+	
+	*output		= malloc(outputCapacity * sizeof(float));
+	*seconds	= 0;
+	
+	for(i = 0; i < sourceFrames; ++i)
+		input[historyFrames + i] = (float)(AMPLITUDE * sin(2.0 * M_PI * frequency * i / sourceSampleRate));
+	
+	size_t framesWritten = 0;
+	for(pass = 0; pass < PASSES; ++pass) {
+		size_t		inputIndex	= historyFrames;
+		unsigned	phase		= 0;
+		clock_t		start		= clock();
+		
+		framesWritten = 0;
+		for(;;) {
+			size_t frameCount = outputCapacity - framesWritten;
+			if(OUTPUT_CHUNK < frameCount)
+				frameCount = OUTPUT_CHUNK;
+			
+			size_t framesConverted = polyphase_filter_apply(filter, input, inputFrames, &inputIndex, &phase, *output + framesWritten, frameCount);
+			if(0 == framesConverted)
+				break;
+			
+			framesWritten += framesConverted;
+		}
+		
+		double passSeconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+		if(0 == pass || passSeconds < *seconds)
+			*seconds = passSeconds;
+	}
+	
+	free(input);
+	
+	return framesWritten;
+}
+
+// Fits a*sin + b*cos + c at the known frequency and returns the residual relative to the tone, in dB
+static double
+thd_n(const float *samples, size_t frameCount, double frequency, unsigned sampleRate)
+{
+	double	ss = 0, sc = 0, s1 = 0, cc = 0, c1 = 0, n = frameCount;
+	double	ys = 0, yc = 0, y1 = 0;
+	size_t	i;
+	
+	for(i = 0; i < frameCount; ++i) {
+		double w = 2.0 * M_PI * frequency * i / sampleRate;
+		double s = sin(w), c = cos(w), y = samples[i];
+		
+		ss += s * s;	sc += s * c;	s1 += s;
+		cc += c * c;	c1 += c;
+		ys += y * s;	yc += y * c;	y1 += y;
+	}
+	
+	// Solve the 3x3 normal equations by Cramer's rule
+	double det	= ss * (cc * n - c1 * c1) - sc * (sc * n - c1 * s1) + s1 * (sc * c1 - cc * s1);
+	double a	= (ys * (cc * n - c1 * c1) - sc * (yc * n - c1 * y1) + s1 * (yc * c1 - cc * y1)) / det;
+	double b	= (ss * (yc * n - y1 * c1) - ys * (sc * n - c1 * s1) + s1 * (sc * y1 - yc * s1)) / det;
+	double c	= (ss * (cc * y1 - c1 * yc) - sc * (sc * y1 - s1 * yc) + ys * (sc * c1 - cc * s1)) / det;
+	
+	double residual = 0;
+	for(i = 0; i < frameCount; ++i) {
+		double w = 2.0 * M_PI * frequency * i / sampleRate;
+		double e = samples[i] - (a * sin(w) + b * cos(w) + c);
+		residual += e * e;
+	}
+	
+	double tone = ((a * a) + (b * b)) / 2.0;
+	
+	return 10.0 * log10((residual / frameCount) / tone);
+}
+
+int
+main(void)
+{
+	unsigned	i;
+	int			failures = 0;
+	
+	printf("%-18s %8s %10s %12s\n", "Conversion", "Tone", "THD+N", "Speed");
+	
+	for(i = 0; i < sizeof(sConversions) / sizeof(sConversions[0]); ++i) {
+		const Conversion	*conversion		= sConversions + i;
+		PolyphaseFilter		*filter			= polyphase_filter_create(conversion->sourceSampleRate, conversion->sampleRate);
+		float				*output			= NULL;
+		double				seconds			= 0;
+		
+		if(NULL == filter) {
+			fprintf(stderr, "Unable to create a filter for %u -> %u Hz\n", conversion->sourceSampleRate, conversion->sampleRate);
+			return 1;
+		}
+		
+		size_t frameCount = convert_sine(filter, conversion->sourceSampleRate, conversion->frequency, &output, &seconds);
+		
+		// Skip the filter's start-up transient; the tone's phase is a free parameter of the fit
+		size_t	skip	= 2 * polyphase_filter_taps_per_phase(filter) * conversion->sampleRate / conversion->sourceSampleRate;
+		double	result	= thd_n(output + skip, frameCount - skip, conversion->frequency, conversion->sampleRate);
+		
+		printf("%6u -> %6u Hz %7.0f Hz %7.1f dB %9.0fx RT\n", conversion->sourceSampleRate, conversion->sampleRate, conversion->frequency, result, (0 < seconds ? AUDIO_SECONDS / seconds : 0));
+		
+		if(MAXIMUM_THD_N < result)
+			++failures;
+		
+		free(output);
+		polyphase_filter_destroy(filter);
+	}
+	
+	printf("Speed is one channel, as a multiple of real time\n");
+	
+	if(0 < failures) {
+		fprintf(stderr, "%d conversions were above %.0f dB THD+N\n", failures, MAXIMUM_THD_N);
+		return 1;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Measures in-place seek latency: the time from -seekRegionBeingScheduledToFrame: to the
+// first slice after the seek completing, as recorded in the scheduler's statistics
+// The output is a paced NullAudioOutput, so each measurement includes one slice of real time
+// Build and run with "make -C Tests benchmark" (Mac OS X only)
+
+#import "AudioScheduler.h"
+#import "ScheduledAudioRegion.h"
+#import "NullAudioOutput.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define SAMPLE_RATE			44100
+#define CHANNELS			2
+#define SLICES				20
+#define FRAMES_PER_SLICE	4096
+#define SEEKS				50
+
+// The scheduler's own work (reset, decoder seek, pre-roll, restart) must fit in this,
+// beyond the slice of audio the measurement includes
+#define MAXIMUM_OVERHEAD	0.050
+
+// ========================================
+// A decoder that generates an hour of sine wave, seeking instantly
+// ========================================
+@interface SineDecoder : NSObject <AudioDecoderMethods>
+{
+	SInt64		_currentFrame;
+}
+@end
+
+@implementation SineDecoder
+
+- (AudioStreamBasicDescription) format
+{
+	AudioStreamBasicDescription format = { 0 };
+	
+	format.mSampleRate			= SAMPLE_RATE;
+	format.mFormatID			= kAudioFormatLinearPCM;
+	format.mFormatFlags			= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	format.mBytesPerPacket		= sizeof(float);
+	format.mFramesPerPacket		= 1;
+	format.mBytesPerFrame		= sizeof(float);
+	format.mChannelsPerFrame	= CHANNELS;
+	format.mBitsPerChannel		= 8 * sizeof(float);
+	
+	return format;
+}
+
+- (NSString *)					formatDescription			{ return @"Sine"; }
+
+- (AudioChannelLayout) channelLayout
+{
+	AudioChannelLayout layout = { 0 };
+	layout.mChannelLayoutTag = kAudioChannelLayoutTag_Stereo;
+	return layout;
+}
+
+- (NSString *)					channelLayoutDescription	{ return @"Stereo"; }
+- (AudioStreamBasicDescription)	sourceFormat				{ return [self format]; }
+- (NSString *)					sourceFormatDescription		{ return [self formatDescription]; }
+
+- (SInt64)						totalFrames					{ return 3600 * SAMPLE_RATE; }
+- (SInt64)						currentFrame				{ return _currentFrame; }
+- (SInt64)						framesRemaining				{ return [self totalFrames] - _currentFrame; }
+- (BOOL)						supportsSeeking				{ return YES; }
+
+- (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	UInt32		framesToRead	= (UInt32)(frameCount < [self framesRemaining] ? frameCount : [self framesRemaining]);
+	UInt32		i, j;
+	
+	for(i = 0; i < bufferList->mNumberBuffers; ++i) {
+		float *buffer = bufferList->mBuffers[i].mData;
+		
+		for(j = 0; j < framesToRead; ++j)
+			buffer[j] = 0.25f * sinf(2 * M_PI * 440 * (_currentFrame + j) / SAMPLE_RATE);
+		
+		bufferList->mBuffers[i].mDataByteSize = framesToRead * sizeof(float);
+	}
+	
+	_currentFrame += framesToRead;
+	
+	return framesToRead;
+}
+
+- (SInt64) seekToFrame:(SInt64)frame
+{
+	_currentFrame = frame;
+	return _currentFrame;
+}
+
+@end
+
+static void
+runFor(NSTimeInterval interval)
+{
+	[[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+}
+
+int
+main(void)
+{
+	NSAutoreleasePool			*pool			= [[NSAutoreleasePool alloc] init];
+	AudioScheduler				*scheduler		= [[AudioScheduler alloc] initWithNumberOfSlices:SLICES framesPerSlice:FRAMES_PER_SLICE];
+	SineDecoder					*decoder		= [[SineDecoder alloc] init];
+	AudioSchedulerStatistics	statistics;
+	AudioTimeStamp				timeStamp		= { 0 };
+	double						sliceDuration	= (double)FRAMES_PER_SLICE / SAMPLE_RATE;
+	unsigned					i, j;
+	
+	[scheduler setOutput:[NullAudioOutput outputWithSampleRate:SAMPLE_RATE]];
+	[scheduler scheduleAudioRegion:[ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder]];
+	[scheduler startScheduling];
+	
+	timeStamp.mFlags		= kAudioTimeStampSampleTimeValid;
+	timeStamp.mSampleTime	= -1;
+	
+	[[scheduler output] setScheduleStartTimeStamp:timeStamp];
+	
+	// Seeks are only performed in place once the region is rendering
+	runFor(0.5);
+	[scheduler resetStatistics];
+	
+	srandom(1);
+	for(i = 0; i < SEEKS; ++i) {
+		[scheduler seekRegionBeingScheduledToFrame:random() % ([decoder totalFrames] - SAMPLE_RATE)];
+		
+		// Wait for the measurement, then let playback settle before the next seek
+		for(j = 0; j < 200; ++j) {
+			[scheduler getStatistics:&statistics];
+			if(i < statistics.seekLatency.count)
+				break;
+			runFor(0.01);
+		}
+		
+		runFor(0.1);
+	}
+	
+	[scheduler getStatistics:&statistics];
+	[scheduler stopScheduling];
+	
+	printf("%-28s %7s %10s %10s %10s %10s\n", "", "seeks", "median", "90%", "99%", "max");
+	printf("%-28s %7u %7.1f ms %7.1f ms %7.1f ms %7.1f ms\n", "seek latency", statistics.seekLatency.count,
+		   statistics.seekLatency.median / 1000.0, statistics.seekLatency.percentile90 / 1000.0,
+		   statistics.seekLatency.percentile99 / 1000.0, statistics.seekLatency.maximum / 1000.0);
+	printf("%-28s %7s %7.1f ms\n", "slice duration", "", sliceDuration * 1000);
+	printf("%-28s %7u\n", "underruns", statistics.underruns);
+	
+	BOOL passed = (SEEKS == statistics.seekLatency.count && statistics.seekLatency.median / 1000000.0 - sliceDuration < MAXIMUM_OVERHEAD);
+	if(NO == passed)
+		printf("Seek latency exceeds one slice plus %.0f ms, or seeks were not measured\n", MAXIMUM_OVERHEAD * 1000);
+	
+	[scheduler release];
+	[decoder release];
+	[pool release];
+	
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
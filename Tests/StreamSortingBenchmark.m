@@ -0,0 +1,183 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Compares getSortPermutationForStreams with -[NSArray sortedArrayUsingDescriptors:]
+// on a synthetic library, and checks that both produce the same order
+// Build and run with "make -C Tests benchmark" (Mac OS X only)
+
+#import "AudioStreamSorting.h"
+#include <stdlib.h>
+
+#define PASSES			3
+
+static NSString * const sArtists [] = {
+	@"The Beatles", @"beatles", @"Björk", @"Bjork", @"Sigur Rós", @"sigur ros",
+	@"Étienne Daho", @"etienne daho", @"Åsa Jinder", @"Zazie", @"ZZ Top", @"Ärzte"
+};
+
+static NSString * const sWords [] = {
+	@"Love", @"love", @"Night", @"Été", @"ete", @"Blue", @"blue", @"Straße", @"Strasse",
+	@"Café", @"Cafe", @"Über", @"uber", @"Rain", @"Song", @"Ñandú", @"Nandu", @"Ωmega"
+};
+
+#define COUNT_OF(array)		(sizeof(array) / sizeof(array[0]))
+
+// The stream table reads its sort keys with KVC, so dictionaries stand in for AudioStream
+// Every row has a distinct id so ties can't make two correct orders differ
+static NSArray *
+createLibrary(unsigned count)
+{
+	NSMutableArray	*library	= [[NSMutableArray alloc] initWithCapacity:count];
+	unsigned		i;
+	
+	srandom(1);
+	for(i = 0; i < count; ++i) {
+		NSString		*title	= [NSString stringWithFormat:@"%@ %@ %u", sWords[random() % COUNT_OF(sWords)], sWords[random() % COUNT_OF(sWords)], (unsigned)(random() % 100)];
+		NSMutableDictionary *row = [NSMutableDictionary dictionary];
+		
+		[row setObject:title forKey:@"title"];
+		[row setObject:sArtists[random() % COUNT_OF(sArtists)] forKey:@"artist"];
+		[row setObject:[NSString stringWithFormat:@"%@ %u", sWords[random() % COUNT_OF(sWords)], (unsigned)(random() % 50)] forKey:@"albumTitle"];
+		[row setObject:[NSNumber numberWithInt:1 + (random() % 20)] forKey:@"trackNumber"];
+		[row setObject:[NSNumber numberWithDouble:(random() % 600000) / 1000.0] forKey:@"duration"];
+		[row setObject:[NSDate dateWithTimeIntervalSinceReferenceDate:random() % 200000000] forKey:@"dateAdded"];
+		[row setObject:[NSNumber numberWithUnsignedInt:i] forKey:@"id"];
+		
+		// Some streams have no genre, which sorts first
+		if(0 != random() % 4)
+			[row setObject:sWords[random() % COUNT_OF(sWords)] forKey:@"genre"];
+		
+		[library addObject:row];
+	}
+	
+	// Start from a random order
+	for(i = count - 1; 0 < i; --i)
+		[library exchangeObjectAtIndex:i withObjectAtIndex:random() % (i + 1)];
+	
+	return library;
+}
+
+static NSSortDescriptor *
+descriptor(NSString *key, BOOL ascending, SEL selector)
+{
+	return [[[NSSortDescriptor alloc] initWithKey:key ascending:ascending selector:selector] autorelease];
+}
+
+// Returns NO if the orders differ
+static BOOL
+benchmark(NSArray *library, NSString *name, NSArray *sortDescriptors)
+{
+	unsigned		count				= [library count];
+	unsigned		*permutation		= malloc(count * sizeof(unsigned));
+	double			engineElapsed		= 0;
+	double			descriptorElapsed	= 0;
+	NSArray			*descriptorSorted	= nil;
+	BOOL			supported			= YES;
+	unsigned		pass, i;
+	
+	// Wall clock time, since the engine sorts on several threads
+	for(pass = 0; pass < PASSES; ++pass) {
+		NSAutoreleasePool	*pool	= [[NSAutoreleasePool alloc] init];
+		CFAbsoluteTime		start	= CFAbsoluteTimeGetCurrent();
+		
+		supported = getSortPermutationForStreams(library, sortDescriptors, permutation);
+		
+		double elapsed = CFAbsoluteTimeGetCurrent() - start;
+		if(0 == pass || elapsed < engineElapsed)
+			engineElapsed = elapsed;
+		
+		[pool release];
+	}
+	
+	for(pass = 0; pass < PASSES; ++pass) {
+		CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+		
+		[descriptorSorted release];
+		descriptorSorted = [[library sortedArrayUsingDescriptors:sortDescriptors] retain];
+		
+		double elapsed = CFAbsoluteTimeGetCurrent() - start;
+		if(0 == pass || elapsed < descriptorElapsed)
+			descriptorElapsed = elapsed;
+	}
+	
+	// Compare by identity; equal dictionaries in a different order would still be a different order
+	BOOL match = supported;
+	for(i = 0; match && i < count; ++i)
+		match = ([library objectAtIndex:permutation[i]] == [descriptorSorted objectAtIndex:i]);
+	
+	if(supported)
+		printf("%-28s %7u %10.4f s %10.4f s %7.1fx  %s\n", [name UTF8String], count, engineElapsed, descriptorElapsed, descriptorElapsed / engineElapsed, match ? "match" : "DIFFER");
+	else
+		printf("%-28s %7u not supported by the engine\n", [name UTF8String], count);
+	
+	[descriptorSorted release];
+	free(permutation);
+	
+	return match;
+}
+
+int
+main(void)
+{
+	NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+	unsigned			sizes []	= { 1000, 10000, 100000 };
+	unsigned			i;
+	int					failures	= 0;
+	
+	NSSortDescriptor	*byID		= descriptor(@"id", YES, @selector(compare:));
+	
+	NSArray *artistAlbumTrack = [NSArray arrayWithObjects:
+		descriptor(@"artist", YES, @selector(localizedCaseInsensitiveCompare:)),
+		descriptor(@"albumTitle", YES, @selector(localizedCaseInsensitiveCompare:)),
+		descriptor(@"trackNumber", YES, @selector(compare:)),
+		byID, nil];
+	NSArray *title = [NSArray arrayWithObjects:
+		descriptor(@"title", YES, @selector(caseInsensitiveCompare:)),
+		byID, nil];
+	NSArray *genreDuration = [NSArray arrayWithObjects:
+		descriptor(@"genre", NO, @selector(compare:)),
+		descriptor(@"duration", YES, @selector(compare:)),
+		byID, nil];
+	NSArray *dateAdded = [NSArray arrayWithObjects:
+		descriptor(@"dateAdded", NO, @selector(compare:)),
+		byID, nil];
+	
+	printf("%-28s %7s %12s %12s %8s\n", "Sort", "Streams", "Engine", "Descriptors", "Speedup");
+	
+	for(i = 0; i < COUNT_OF(sizes); ++i) {
+		NSArray *library = createLibrary(sizes[i]);
+		
+		failures += !benchmark(library, @"artist, album, track", artistAlbumTrack);
+		failures += !benchmark(library, @"title (case insensitive)", title);
+		failures += !benchmark(library, @"genre (descending), duration", genreDuration);
+		failures += !benchmark(library, @"date added (descending)", dateAdded);
+		
+		[library release];
+	}
+	
+	[pool release];
+	
+	if(0 < failures) {
+		fprintf(stderr, "%d sorts did not match sortedArrayUsingDescriptors:\n", failures);
+		return 1;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Measures how fast TruePeakMeter runs, as a multiple of real time, and checks
+// that it finds a peak that falls between samples
+// Build and run with "make -C Tests benchmark"
+
+#include "TruePeakMeter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SAMPLE_RATE		48000.0
+#define SLICE_FRAMES	4096
+#define AUDIO_SECONDS	60
+#define PASSES			5
+
+// Runs AUDIO_SECONDS of noise through a meter PASSES times and returns the best realtime factor
+static double
+realtime_factor(unsigned channelCount)
+{
+	size_t		frameCount	= (size_t)(AUDIO_SECONDS * SAMPLE_RATE);
+	float		**samples	= calloc(channelCount, sizeof(float *));
+	double		best		= 0;
+	unsigned	channel, pass;
+	size_t		i;
+	
+	srand(1);
+	for(channel = 0; channel < channelCount; ++channel) {
+		samples[channel] = malloc(frameCount * sizeof(float));
+		for(i = 0; i < frameCount; ++i)
+			samples[channel][i] = (2.0f * rand() / RAND_MAX) - 1.0f;
+	}
+	
+	for(pass = 0; pass < PASSES; ++pass) {
+		TruePeakMeter	*meter		= true_peak_meter_create(channelCount);
+		const float		*slice [8];
+		clock_t			start		= clock();
+		
+		for(i = 0; i < frameCount; i += SLICE_FRAMES) {
+			size_t sliceFrames = (frameCount - i < SLICE_FRAMES ? frameCount - i : SLICE_FRAMES);
+			for(channel = 0; channel < channelCount; ++channel)
+				slice[channel] = samples[channel] + i;
+			true_peak_meter_process(meter, slice, sliceFrames);
+		}
+		
+		double seconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+		if(0 < seconds && AUDIO_SECONDS / seconds > best)
+			best = AUDIO_SECONDS / seconds;
+		
+		true_peak_meter_destroy(meter);
+	}
+	
+	for(channel = 0; channel < channelCount; ++channel)
+		free(samples[channel]);
+	free(samples);
+	
+	return best;
+}
+
+// A full scale sine at a quarter of the sample rate, sampled 45 degrees off its peaks,
+// has a sample peak of -3 dBFS and a true peak of 0 dBFS
+static float
+intersample_peak(void)
+{
+	float			samples [SLICE_FRAMES];
+	const float		*channels [1] = { samples };
+	TruePeakMeter	*meter = true_peak_meter_create(1);
+	unsigned		i;
+	
+	for(i = 0; i < SLICE_FRAMES; ++i)
+		samples[i] = (float)sin((M_PI / 2.0) * i + (M_PI / 4.0));
+	
+	true_peak_meter_process(meter, channels, SLICE_FRAMES);
+	
+	float peak = true_peak_meter_peak(meter);
+	true_peak_meter_destroy(meter);
+	
+	return peak;
+}
+
+int
+main(void)
+{
+	float peak = intersample_peak();
+	
+	printf("Intersample peak: %.2f dBFS (sample peak -3.01 dBFS)\n", 20.0 * log10(peak));
+	printf("1 channel:  %.0fx real time\n", realtime_factor(1));
+	printf("2 channels: %.0fx real time\n", realtime_factor(2));
+	
+	// BS.1770 allows the 4x oversampled estimate to read up to 0.69 dB low
+	if(0.69 < fabs(20.0 * log10(peak))) {
+		fprintf(stderr, "The intersample peak was not found\n");
+		return 1;
+	}
+	
+	return 0;
+}
@@ -9,7 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
-#include <map>
+#include <string.h>
+#include <pthread.h>
 #include <expat/expat.h>
 #include <curl/curl.h>
 #include <curl/types.h>
@@ -19,7 +20,7 @@ using namespace std;
 
 #include "protocol.h"
 
-const char *url = "http://ofa.musicdns.org/ofa/1/track"; 
+const char *default_server_url = "http://ofa.musicdns.org/ofa/1/track"; 
 const char *userAgent = "libofa_example";
 const char *unknown = "unknown";
 
@@ -60,43 +61,6 @@ const char *request_format2 =
     "\r\n";
 
 
-// --------------------------------------------------------------------
-// HTTP POST support using standard curl calls
-// --------------------------------------------------------------------
-size_t data_callback(void *ptr, size_t size, size_t num, void *arg)
-{
-    string *str = (string *)arg;
-    (*str) += string((const char *)ptr, size * num);
-    return size * num;
-}
-
-long http_post(const string &url, const string &userAgent, const string &postData, string &doc)
-{
-  CURL              *curl;
-  long               ret = 0;
-  struct curl_slist *headerlist=NULL;
-
-  headerlist = curl_slist_append(headerlist, "Expect:"); 
-
-  curl_global_init(CURL_GLOBAL_ALL);
-  curl = curl_easy_init();
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&doc);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, data_callback);
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerlist);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, postData.length());
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postData.c_str());
-  curl_easy_setopt(curl, CURLOPT_POST, 1);
-  curl_easy_setopt(curl, CURLOPT_USERAGENT, userAgent.c_str());
-  curl_easy_perform(curl);
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-  curl_easy_cleanup(curl);
-
-  curl_slist_free_all (headerlist);
-
-  return ret;
-}
-
 // --------------------------------------------------------------------
 // XML Parsing support 
 // --------------------------------------------------------------------
@@ -110,71 +74,140 @@ struct ParseInfo
 
 void begin_element(void *data, const XML_Char *el, const XML_Char **attr)
 {
-    map<string, string> attrs;
-
-    for(; *attr;) {
-        string key = string((char *)*(attr++));
-	string value = string((char *)*(attr++));
-        attrs[key] = value;
+    ParseInfo *pinfo = (ParseInfo *)data;
+
+    pinfo->path += '/';
+    pinfo->path += (const char *)el;
+
+    // Attributes are only needed for one element, so scan them in place
+    if (pinfo->path == "/metadata/track/puid-list/puid") {
+        for (; *attr; attr += 2) {
+            if (0 == strcmp((const char *)attr[0], "id")) {
+                pinfo->info->setPUID((const char *)attr[1]);
+                break;
+            }
+        }
     }
 
-    ((ParseInfo *)data)->path += string("/") + string(el);
-    if (((ParseInfo *)data)->path == "/metadata/track/puid-list/puid")
-         ((ParseInfo *)data)->info->setPUID(attrs["id"]);
-
-    ((ParseInfo *)data)->pcdata = "";
+    pinfo->pcdata.clear();
 }
 
 void end_element(void *data, const XML_Char *el)
 {
+    ParseInfo *pinfo = (ParseInfo *)data;
     string::size_type pos;
 
-    if (((ParseInfo *)data)->path == "/metadata/track/title")
-         ((ParseInfo *)data)->info->setTrack(((ParseInfo *)data)->pcdata);
-    if (((ParseInfo *)data)->path == "/metadata/track/artist/name")
-         ((ParseInfo *)data)->info->setArtist(((ParseInfo *)data)->pcdata);
+    if (pinfo->path == "/metadata/track/title")
+         pinfo->info->setTrack(pinfo->pcdata);
+    if (pinfo->path == "/metadata/track/artist/name")
+         pinfo->info->setArtist(pinfo->pcdata);
 
-    pos = ((ParseInfo *)data)->path.rfind("/");
+    pos = pinfo->path.rfind('/');
     if (pos != string::npos)
-       ((ParseInfo *)data)->path = ((ParseInfo *)data)->path.substr(0, pos);
+       pinfo->path.erase(pos);
 }
 
 void pc_data(void *data, const XML_Char *charData, int len)
 {
-    char *temp;
+    ((ParseInfo *)data)->pcdata.append((const char *)charData, len);
+}
+
+// --------------------------------------------------------------------
+// HTTP POST support using a persistent curl handle per thread
+// --------------------------------------------------------------------
+
+// The response body is handed to expat as it arrives
+struct ResponseInfo
+{
+    CURL *curl;
+    XML_Parser parser;
+    bool started;       // true once the start of the XML document is seen
+    bool parseError;
+};
+
+static pthread_once_t curl_init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t curl_handle_key;
+static struct curl_slist *header_list = NULL;
 
-    temp = new char[len + 1];
-    strncpy(temp, (char *)charData, len);
-    temp[len] = 0;
-    ((ParseInfo *)data)->pcdata += string(temp);
-    delete temp;
+static void cleanup_curl_handle(void *handle)
+{
+    curl_easy_cleanup((CURL *)handle);
 }
 
-bool parse_xml(const string &doc, TrackInformation *info, string &err) 
+// curl_global_init is not thread safe, so perform it exactly once
+static void init_curl()
 {
-    ParseInfo pinfo;
+    curl_global_init(CURL_GLOBAL_ALL);
+    pthread_key_create(&curl_handle_key, cleanup_curl_handle);
+    header_list = curl_slist_append(header_list, "Expect:"); 
+}
 
-    err = "";
-    pinfo.info = info;
-    XML_Parser parser = XML_ParserCreate(NULL);
-    XML_SetUserData(parser, (void *)&pinfo);
-    XML_SetElementHandler(parser, ::begin_element, ::end_element);
-    XML_SetCharacterDataHandler(parser, ::pc_data);
-    int ret = XML_Parse(parser, doc.c_str(), doc.length(), 1);
+// Reusing the handle keeps the connection to the server alive between lookups
+static CURL *thread_curl_handle()
+{
+    pthread_once(&curl_init_once, init_curl);
+
+    CURL *curl = (CURL *)pthread_getspecific(curl_handle_key);
+    if (!curl) {
+        curl = curl_easy_init();
+        if (!curl)
+            return NULL;
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+        pthread_setspecific(curl_handle_key, curl);
+    }
+    return curl;
+}
 
-    if (ret)
-    {
-        XML_ParserFree(parser);
-        return true;
+size_t data_callback(void *ptr, size_t size, size_t num, void *arg)
+{
+    ResponseInfo *response = (ResponseInfo *)arg;
+    const char *bytes = (const char *)ptr;
+    size_t length = size * num;
+    long code = 0;
+
+    // Error documents aren't parsed
+    curl_easy_getinfo(response->curl, CURLINFO_RESPONSE_CODE, &code);
+    if (code != 200 || response->parseError)
+        return size * num;
+
+    // Skip anything preceding the XML document
+    if (!response->started) {
+        const char *start = (const char *)memchr(bytes, '<', length);
+        if (!start)
+            return size * num;
+        length -= start - bytes;
+        bytes = start;
+        response->started = true;
     }
 
-    err = string(XML_ErrorString(XML_GetErrorCode(parser)));
-    char num[10];
-    sprintf(num, "%d", XML_GetCurrentLineNumber(parser));
-    err += string(" on line ") + string(num);
-    XML_ParserFree(parser);
+    if (!XML_Parse(response->parser, bytes, length, 0))
+        response->parseError = true;
 
-    return false;
+    return size * num;
+}
+
+long http_post(const string &url, const string &userAgent, const string &postData, ResponseInfo *response)
+{
+  long ret = 0;
+
+  CURL *curl = thread_curl_handle();
+  if (!curl)
+      return 0;
+
+  response->curl = curl;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, data_callback);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, postData.length());
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postData.c_str());
+  curl_easy_setopt(curl, CURLOPT_POST, 1);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, userAgent.c_str());
+  curl_easy_perform(curl);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+
+  return ret;
 }
 
 // --------------------------------------------------------------------
@@ -183,7 +216,7 @@ bool parse_xml(const string &doc, TrackInformation *info, string &err)
 
 // Returns true on success
 bool retrieve_metadata(string client_key, string client_version,
-	TrackInformation *info, bool getMetadata) 
+	TrackInformation *info, bool getMetadata, string server_url) 
 {
     if (!info)
 	return false;
@@ -245,30 +278,40 @@ bool retrieve_metadata(string client_key, string client_version,
             (info->getYear().length() == 0) ? "0" : info->getYear().c_str(),
             info->getEncoding().c_str());
 
-    string response;
+    ParseInfo pinfo;
+    pinfo.info = info;
+
+    XML_Parser parser = XML_ParserCreate(NULL);
+    XML_SetUserData(parser, (void *)&pinfo);
+    XML_SetElementHandler(parser, ::begin_element, ::end_element);
+    XML_SetCharacterDataHandler(parser, ::pc_data);
+
+    ResponseInfo response;
+    response.curl = NULL;
+    response.parser = parser;
+    response.started = false;
+    response.parseError = false;
+
     // printf("request: '%s'\n", buf);
-    long ret = http_post(url, userAgent, buf, response);
+    long ret = http_post(server_url, userAgent, buf, &response);
     delete [] buf;
 
     if (ret != 200)
     {
         // printf("Error: %ld\n", ret);
-        // printf("response: %s\n\n", response.c_str());
+        XML_ParserFree(parser);
         return false;
     }
-    // printf("response: %s\n\n", response.c_str());
 
-    unsigned int q = response.find("<?xml");
-    if (q != string::npos) {
-        response = response.substr(q);
-    }
-    string err;
-    if (!parse_xml(response, info, err)) {
+    // Signal the end of the document
+    if (!response.started || response.parseError || !XML_Parse(parser, NULL, 0, 1)) {
         // Clears title if it wasn't returned
         info->setTrack("");
 
         // Clears artists if it wasn't returned
         info->setArtist("");
     }
+
+    XML_ParserFree(parser);
     return true;
 }
@@ -61,9 +61,14 @@ public:
     string getPUID() const { return puid; }
 };
 
+// The default MusicDNS lookup URL
+extern const char *default_server_url;
+
 // Get your unique key at http://www.musicdns.org
+// server_url may be used to direct requests to an alternate (e.g. local) server
 bool retrieve_metadata(string client_key, string client_verstion,
-	TrackInformation *info, bool getMetadata);
+	TrackInformation *info, bool getMetadata,
+	string server_url = default_server_url);
 
 class AudioData {
 private:
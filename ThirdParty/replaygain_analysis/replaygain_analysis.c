@@ -74,6 +74,13 @@
  *    fprintf ("Recommended dB change for whole album: %+6.2f dB\n", GetAlbumGain() );
  */
 
+/*
+ *  The functions above share a single static analysis. To analyze several
+ *  streams at once, give each its own GainAnalysis from CreateGainAnalysis()
+ *  and use the ...WithAnalysis() variants; GetAlbumGainForAnalyses() pools
+ *  the finished titles of several analyses into one album gain.
+ */
+
 /*
  *  So here's the main source of potential code confusion:
  *
@@ -121,25 +128,30 @@ float ReplayGainReferenceLoudness = 89.0; /* in dB SPL */
 #define MAX_SAMPLES_PER_WINDOW  (size_t) (MAX_SAMP_FREQ * RMS_WINDOW_TIME + 1.)   /* max. Samples per Time slice */
 #define PINK_REF                64.82 /* 298640883795 */                          /* calibration value */
 
-static float          linprebuf [MAX_ORDER * 2];
-static float*         linpre;                                          /* left input samples, with pre-buffer */
-static float          lstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static float*         lstep;                                           /* left "first step" (i.e. post first filter) samples */
-static float          loutbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static float*         lout;                                            /* left "out" (i.e. post second filter) samples */
-static float          rinprebuf [MAX_ORDER * 2];
-static float*         rinpre;                                          /* right input samples ... */
-static float          rstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static float*         rstep;
-static float          routbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static float*         rout;
-static unsigned int              sampleWindow;                           /* number of samples required to reach number of milliseconds required for RMS window */
-static unsigned long    totsamp;
-static double           lsum;
-static double           rsum;
-static int              freqindex;
-static uint32_t  A [(size_t)(STEPS_per_dB * MAX_dB)];
-static uint32_t  B [(size_t)(STEPS_per_dB * MAX_dB)];
+struct GainAnalysis {
+    float          linprebuf [MAX_ORDER * 2];
+    float*         linpre;                                          /* left input samples, with pre-buffer */
+    float          lstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    float*         lstep;                                           /* left "first step" (i.e. post first filter) samples */
+    float          loutbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    float*         lout;                                            /* left "out" (i.e. post second filter) samples */
+    float          rinprebuf [MAX_ORDER * 2];
+    float*         rinpre;                                          /* right input samples ... */
+    float          rstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    float*         rstep;
+    float          routbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    float*         rout;
+    unsigned int   sampleWindow;                                    /* number of samples required to reach number of milliseconds required for RMS window */
+    unsigned long  totsamp;
+    double         lsum;
+    double         rsum;
+    int            freqindex;
+    uint32_t       A [(size_t)(STEPS_per_dB * MAX_dB)];
+    uint32_t       B [(size_t)(STEPS_per_dB * MAX_dB)];
+};
+
+/* State used by the original single-instance interface */
+static GainAnalysis defaultAnalysis;
 
 /* for each filter:
    [0] 48 kHz, [1] 44.1 kHz, [2] 32 kHz, [3] 24 kHz, [4] 22050 Hz, [5] 16 kHz, [6] 12 kHz, [7] is 11025 Hz, [8] 8 kHz */
@@ -220,52 +232,52 @@ filter ( const float* input, float* output, size_t nSamples, const float* a, con
 /* returns a INIT_GAIN_ANALYSIS_OK if successful, INIT_GAIN_ANALYSIS_ERROR if not */
 
 int
-ResetSampleFrequency ( long samplefreq ) {
+ResetSampleFrequencyWithAnalysis ( GainAnalysis* ga, long samplefreq ) {
     int  i;
 
     /* zero out initial values */
     for ( i = 0; i < MAX_ORDER; i++ )
-        linprebuf[i] = lstepbuf[i] = loutbuf[i] = rinprebuf[i] = rstepbuf[i] = routbuf[i] = 0.;
+        ga->linprebuf[i] = ga->lstepbuf[i] = ga->loutbuf[i] = ga->rinprebuf[i] = ga->rstepbuf[i] = ga->routbuf[i] = 0.;
 
     switch ( (int)(samplefreq) ) {
-        case 48000: freqindex = 0; break;
-        case 44100: freqindex = 1; break;
-        case 32000: freqindex = 2; break;
-        case 24000: freqindex = 3; break;
-        case 22050: freqindex = 4; break;
-        case 16000: freqindex = 5; break;
-        case 12000: freqindex = 6; break;
-        case 11025: freqindex = 7; break;
-        case  8000: freqindex = 8; break;
+        case 48000: ga->freqindex = 0; break;
+        case 44100: ga->freqindex = 1; break;
+        case 32000: ga->freqindex = 2; break;
+        case 24000: ga->freqindex = 3; break;
+        case 22050: ga->freqindex = 4; break;
+        case 16000: ga->freqindex = 5; break;
+        case 12000: ga->freqindex = 6; break;
+        case 11025: ga->freqindex = 7; break;
+        case  8000: ga->freqindex = 8; break;
         default:    return INIT_GAIN_ANALYSIS_ERROR;
     }
 
-    sampleWindow = (int) ceil (samplefreq * RMS_WINDOW_TIME);
+    ga->sampleWindow = (int) ceil (samplefreq * RMS_WINDOW_TIME);
 
-    lsum         = 0.;
-    rsum         = 0.;
-    totsamp      = 0;
+    ga->lsum         = 0.;
+    ga->rsum         = 0.;
+    ga->totsamp      = 0;
 
-    memset ( A, 0, sizeof(A) );
+    memset ( ga->A, 0, sizeof(ga->A) );
 
 	return INIT_GAIN_ANALYSIS_OK;
 }
 
 int
-InitGainAnalysis ( long samplefreq )
+InitGainAnalysisWithAnalysis ( GainAnalysis* ga, long samplefreq )
 {
-	if (ResetSampleFrequency(samplefreq) != INIT_GAIN_ANALYSIS_OK) {
+	if (ResetSampleFrequencyWithAnalysis(ga, samplefreq) != INIT_GAIN_ANALYSIS_OK) {
 		return INIT_GAIN_ANALYSIS_ERROR;
 	}
 
-    linpre       = linprebuf + MAX_ORDER;
-    rinpre       = rinprebuf + MAX_ORDER;
-    lstep        = lstepbuf  + MAX_ORDER;
-    rstep        = rstepbuf  + MAX_ORDER;
-    lout         = loutbuf   + MAX_ORDER;
-    rout         = routbuf   + MAX_ORDER;
+    ga->linpre       = ga->linprebuf + MAX_ORDER;
+    ga->rinpre       = ga->rinprebuf + MAX_ORDER;
+    ga->lstep        = ga->lstepbuf  + MAX_ORDER;
+    ga->rstep        = ga->rstepbuf  + MAX_ORDER;
+    ga->lout         = ga->loutbuf   + MAX_ORDER;
+    ga->rout         = ga->routbuf   + MAX_ORDER;
 
-    memset ( B, 0, sizeof(B) );
+    memset ( ga->B, 0, sizeof(ga->B) );
 
     return INIT_GAIN_ANALYSIS_OK;
 }
@@ -273,7 +285,7 @@ InitGainAnalysis ( long samplefreq )
 /* returns GAIN_ANALYSIS_OK if successful, GAIN_ANALYSIS_ERROR if not */
 
 int
-AnalyzeSamples ( const float* left_samples, const float* right_samples, size_t num_samples, int num_channels )
+AnalyzeSamplesWithAnalysis ( GainAnalysis* ga, const float* left_samples, const float* right_samples, size_t num_samples, int num_channels )
 {
     const float*  curleft;
     const float*  curright;
@@ -295,19 +307,19 @@ AnalyzeSamples ( const float* left_samples, const float* right_samples, size_t n
     }
 
     if ( num_samples < MAX_ORDER ) {
-        memcpy ( linprebuf + MAX_ORDER, left_samples , num_samples * sizeof(float) );
-        memcpy ( rinprebuf + MAX_ORDER, right_samples, num_samples * sizeof(float) );
+        memcpy ( ga->linprebuf + MAX_ORDER, left_samples , num_samples * sizeof(float) );
+        memcpy ( ga->rinprebuf + MAX_ORDER, right_samples, num_samples * sizeof(float) );
     }
     else {
-        memcpy ( linprebuf + MAX_ORDER, left_samples,  MAX_ORDER   * sizeof(float) );
-        memcpy ( rinprebuf + MAX_ORDER, right_samples, MAX_ORDER   * sizeof(float) );
+        memcpy ( ga->linprebuf + MAX_ORDER, left_samples,  MAX_ORDER   * sizeof(float) );
+        memcpy ( ga->rinprebuf + MAX_ORDER, right_samples, MAX_ORDER   * sizeof(float) );
     }
 
     while ( batchsamples > 0 ) {
-        cursamples = batchsamples > (long)(sampleWindow-totsamp)  ?  (long)(sampleWindow - totsamp)  :  batchsamples;
+        cursamples = batchsamples > (long)(ga->sampleWindow-ga->totsamp)  ?  (long)(ga->sampleWindow - ga->totsamp)  :  batchsamples;
         if ( cursamplepos < MAX_ORDER ) {
-            curleft  = linpre+cursamplepos;
-            curright = rinpre+cursamplepos;
+            curleft  = ga->linpre+cursamplepos;
+            curright = ga->rinpre+cursamplepos;
             if (cursamples > MAX_ORDER - cursamplepos )
                 cursamples = MAX_ORDER - cursamplepos;
         }
@@ -316,45 +328,45 @@ AnalyzeSamples ( const float* left_samples, const float* right_samples, size_t n
             curright = right_samples + cursamplepos;
         }
 
-        filter ( curleft , lstep + totsamp, cursamples, AYule[freqindex], BYule[freqindex], YULE_ORDER );
-        filter ( curright, rstep + totsamp, cursamples, AYule[freqindex], BYule[freqindex], YULE_ORDER );
+        filter ( curleft , ga->lstep + ga->totsamp, cursamples, AYule[ga->freqindex], BYule[ga->freqindex], YULE_ORDER );
+        filter ( curright, ga->rstep + ga->totsamp, cursamples, AYule[ga->freqindex], BYule[ga->freqindex], YULE_ORDER );
 
-        filter ( lstep + totsamp, lout + totsamp, cursamples, AButter[freqindex], BButter[freqindex], BUTTER_ORDER );
-        filter ( rstep + totsamp, rout + totsamp, cursamples, AButter[freqindex], BButter[freqindex], BUTTER_ORDER );
+        filter ( ga->lstep + ga->totsamp, ga->lout + ga->totsamp, cursamples, AButter[ga->freqindex], BButter[ga->freqindex], BUTTER_ORDER );
+        filter ( ga->rstep + ga->totsamp, ga->rout + ga->totsamp, cursamples, AButter[ga->freqindex], BButter[ga->freqindex], BUTTER_ORDER );
 
         for ( i = 0; i < cursamples; i++ ) {             /* Get the squared values */
-            lsum += lout [totsamp+i] * lout [totsamp+i];
-            rsum += rout [totsamp+i] * rout [totsamp+i];
+            ga->lsum += ga->lout [ga->totsamp+i] * ga->lout [ga->totsamp+i];
+            ga->rsum += ga->rout [ga->totsamp+i] * ga->rout [ga->totsamp+i];
         }
 
         batchsamples -= cursamples;
         cursamplepos += cursamples;
-        totsamp      += cursamples;
-        if ( totsamp == sampleWindow ) {  /* Get the Root Mean Square (RMS) for this set of samples */
-            double  val  = STEPS_per_dB * 10. * log10 ( (lsum+rsum) / totsamp * 0.5 + 1.e-37 );
+        ga->totsamp      += cursamples;
+        if ( ga->totsamp == ga->sampleWindow ) {  /* Get the Root Mean Square (RMS) for this set of samples */
+            double  val  = STEPS_per_dB * 10. * log10 ( (ga->lsum+ga->rsum) / ga->totsamp * 0.5 + 1.e-37 );
             int     ival = (int) val;
             if ( ival <                     0 ) ival = 0;
-            if ( ival >= (int)(sizeof(A)/sizeof(*A)) ) ival = (int)(sizeof(A)/sizeof(*A)) - 1;
-            A [ival]++;
-            lsum = rsum = 0.;
-            memmove ( loutbuf , loutbuf  + totsamp, MAX_ORDER * sizeof(float) );
-            memmove ( routbuf , routbuf  + totsamp, MAX_ORDER * sizeof(float) );
-            memmove ( lstepbuf, lstepbuf + totsamp, MAX_ORDER * sizeof(float) );
-            memmove ( rstepbuf, rstepbuf + totsamp, MAX_ORDER * sizeof(float) );
-            totsamp = 0;
+            if ( ival >= (int)(sizeof(ga->A)/sizeof(*ga->A)) ) ival = (int)(sizeof(ga->A)/sizeof(*ga->A)) - 1;
+            ga->A [ival]++;
+            ga->lsum = ga->rsum = 0.;
+            memmove ( ga->loutbuf , ga->loutbuf  + ga->totsamp, MAX_ORDER * sizeof(float) );
+            memmove ( ga->routbuf , ga->routbuf  + ga->totsamp, MAX_ORDER * sizeof(float) );
+            memmove ( ga->lstepbuf, ga->lstepbuf + ga->totsamp, MAX_ORDER * sizeof(float) );
+            memmove ( ga->rstepbuf, ga->rstepbuf + ga->totsamp, MAX_ORDER * sizeof(float) );
+            ga->totsamp = 0;
         }
-        if ( totsamp > sampleWindow )   /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
+        if ( ga->totsamp > ga->sampleWindow )   /* somehow I really screwed up: Error in programming! Contact author about ga->totsamp > ga->sampleWindow */
             return GAIN_ANALYSIS_ERROR;
     }
     if ( num_samples < MAX_ORDER ) {
-        memmove ( linprebuf,                           linprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(float) );
-        memmove ( rinprebuf,                           rinprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(float) );
-        memcpy  ( linprebuf + MAX_ORDER - num_samples, left_samples,          num_samples             * sizeof(float) );
-        memcpy  ( rinprebuf + MAX_ORDER - num_samples, right_samples,         num_samples             * sizeof(float) );
+        memmove ( ga->linprebuf,                           ga->linprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(float) );
+        memmove ( ga->rinprebuf,                           ga->rinprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(float) );
+        memcpy  ( ga->linprebuf + MAX_ORDER - num_samples, left_samples,          num_samples             * sizeof(float) );
+        memcpy  ( ga->rinprebuf + MAX_ORDER - num_samples, right_samples,         num_samples             * sizeof(float) );
     }
     else {
-        memcpy  ( linprebuf, left_samples  + num_samples - MAX_ORDER, MAX_ORDER * sizeof(float) );
-        memcpy  ( rinprebuf, right_samples + num_samples - MAX_ORDER, MAX_ORDER * sizeof(float) );
+        memcpy  ( ga->linprebuf, left_samples  + num_samples - MAX_ORDER, MAX_ORDER * sizeof(float) );
+        memcpy  ( ga->rinprebuf, right_samples + num_samples - MAX_ORDER, MAX_ORDER * sizeof(float) );
     }
 
     return GAIN_ANALYSIS_OK;
@@ -385,31 +397,98 @@ analyzeResult ( uint32_t* Array, size_t len )
 
 
 float
-GetTitleGain ( void )
+GetTitleGainWithAnalysis ( GainAnalysis* ga )
 {
     float  retval;
     unsigned int    i;
 
-    retval = analyzeResult ( A, sizeof(A)/sizeof(*A) );
+    retval = analyzeResult ( ga->A, sizeof(ga->A)/sizeof(*ga->A) );
 
-    for ( i = 0; i < sizeof(A)/sizeof(*A); i++ ) {
-        B[i] += A[i];
-        A[i]  = 0;
+    for ( i = 0; i < sizeof(ga->A)/sizeof(*ga->A); i++ ) {
+        ga->B[i] += ga->A[i];
+        ga->A[i]  = 0;
     }
 
     for ( i = 0; i < MAX_ORDER; i++ )
-        linprebuf[i] = lstepbuf[i] = loutbuf[i] = rinprebuf[i] = rstepbuf[i] = routbuf[i] = 0.f;
+        ga->linprebuf[i] = ga->lstepbuf[i] = ga->loutbuf[i] = ga->rinprebuf[i] = ga->rstepbuf[i] = ga->routbuf[i] = 0.f;
 
-    totsamp = 0;
-    lsum    = rsum = 0.;
+    ga->totsamp = 0;
+    ga->lsum    = ga->rsum = 0.;
     return retval;
 }
 
 
 float
-GetAlbumGain ( void )
+GetAlbumGainWithAnalysis ( GainAnalysis* ga )
 {
+    return analyzeResult ( ga->B, sizeof(ga->B)/sizeof(*ga->B) );
+}
+
+/* Pools the titles finalized in several analyses, which may have used different sample frequencies */
+
+float
+GetAlbumGainForAnalyses ( GainAnalysis* const* analyses, size_t count )
+{
+    uint32_t  B [(size_t)(STEPS_per_dB * MAX_dB)];
+    size_t    i;
+    size_t    j;
+
+    memset ( B, 0, sizeof(B) );
+
+    for ( i = 0; i < count; i++ )
+        for ( j = 0; j < sizeof(B)/sizeof(*B); j++ )
+            B[j] += analyses[i]->B[j];
+
     return analyzeResult ( B, sizeof(B)/sizeof(*B) );
 }
 
+GainAnalysis*
+CreateGainAnalysis ( long samplefreq )
+{
+    GainAnalysis*  ga = (GainAnalysis*) calloc ( 1, sizeof(GainAnalysis) );
+
+    if ( ga != NULL && InitGainAnalysisWithAnalysis ( ga, samplefreq ) != INIT_GAIN_ANALYSIS_OK ) {
+        free ( ga );
+        ga = NULL;
+    }
+
+    return ga;
+}
+
+void
+DestroyGainAnalysis ( GainAnalysis* ga )
+{
+    free ( ga );
+}
+
+int
+InitGainAnalysis ( long samplefreq )
+{
+    return InitGainAnalysisWithAnalysis ( &defaultAnalysis, samplefreq );
+}
+
+int
+ResetSampleFrequency ( long samplefreq )
+{
+    return ResetSampleFrequencyWithAnalysis ( &defaultAnalysis, samplefreq );
+}
+
+int
+AnalyzeSamples ( const float* left_samples, const float* right_samples, size_t num_samples, int num_channels )
+{
+    return AnalyzeSamplesWithAnalysis ( &defaultAnalysis, left_samples, right_samples, num_samples, num_channels );
+}
+
+float
+GetTitleGain ( void )
+{
+    return GetTitleGainWithAnalysis ( &defaultAnalysis );
+}
+
+float
+GetAlbumGain ( void )
+{
+    return GetAlbumGainWithAnalysis ( &defaultAnalysis );
+}
+
 /* end of replaygain_analysis.c */
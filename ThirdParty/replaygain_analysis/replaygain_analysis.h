@@ -50,6 +50,19 @@ int		ResetSampleFrequency ( long samplefreq );
 float	GetTitleGain     ( void );
 float	GetAlbumGain     ( void );
 
+/* Reentrant interface: each GainAnalysis holds the state for one stream of titles */
+typedef struct GainAnalysis GainAnalysis;
+
+GainAnalysis*	CreateGainAnalysis ( long samplefreq );
+void	DestroyGainAnalysis ( GainAnalysis* ga );
+
+int     InitGainAnalysisWithAnalysis ( GainAnalysis* ga, long samplefreq );
+int     AnalyzeSamplesWithAnalysis   ( GainAnalysis* ga, const float* left_samples, const float* right_samples, size_t num_samples, int num_channels );
+int		ResetSampleFrequencyWithAnalysis ( GainAnalysis* ga, long samplefreq );
+float	GetTitleGainWithAnalysis     ( GainAnalysis* ga );
+float	GetAlbumGainWithAnalysis     ( GainAnalysis* ga );
+float	GetAlbumGainForAnalyses      ( GainAnalysis* const* analyses, size_t count );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,50 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+@class AudioStream;
+
+// Decodes embedded album art on demand and maintains an on-disk cache of thumbnails
+// Thumbnails are shared by all streams with identical art and are generated
+// in a fixed set of sizes (32, 64, 128, 256 and 512 pixels)
+@interface AlbumArtCache : NSObject
+{
+	NSString				*_cacheFolder;
+
+	NSMutableDictionary		*_thumbnails;
+	NSMutableArray			*_thumbnailKeys;
+}
+
++ (AlbumArtCache *) sharedCache;
+
+// The raw (encoded) album art, read from the location recorded by the metadata reader
+- (NSData *) albumArtDataForStream:(AudioStream *)stream;
+
+// The full-size album art
+- (NSImage *) albumArtForStream:(AudioStream *)stream;
+
+// A thumbnail no smaller than size pixels in its largest dimension (unless the album art itself is smaller)
+- (NSImage *) thumbnailForStream:(AudioStream *)stream size:(unsigned)size;
+
+// Remove all cached thumbnails from memory and disk
+- (void) removeAllThumbnails;
+
+@end
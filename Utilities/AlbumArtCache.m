@@ -0,0 +1,287 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AlbumArtCache.h"
+#import "AudioStream.h"
+#import "UtilityFunctions.h"
+
+// ========================================
+// Symbolic Constants
+// ========================================
+#define LOCAL_MAX(a, b)						((a) > (b) ? (a) : (b))
+#define LOCAL_MIN(a, b)						((a) < (b) ? (a) : (b))
+#define MAXIMUM_THUMBNAILS_IN_MEMORY		256
+
+static const unsigned sThumbnailSizes [] = { 32, 64, 128, 256, 512 };
+
+// ========================================
+// The singleton instance
+// ========================================
+static AlbumArtCache *albumArtCacheInstance = nil;
+
+@interface AlbumArtCache (Private)
+- (NSString *) cacheFolder;
+- (NSString *) pathForThumbnailWithHash:(NSString *)hash size:(unsigned)size;
+
+- (NSImage *) cachedThumbnailForKey:(NSString *)key;
+- (void) cacheThumbnail:(NSImage *)thumbnail forKey:(NSString *)key;
+
+- (NSImage *) createThumbnailFromImage:(NSImage *)image size:(unsigned)size;
+@end
+
+@implementation AlbumArtCache
+
++ (AlbumArtCache *) sharedCache
+{
+	@synchronized(self) {
+		if(nil == albumArtCacheInstance) {
+			// assignment not done here
+			[[self alloc] init];
+		}
+	}
+	return albumArtCacheInstance;
+}
+
++ (id) allocWithZone:(NSZone *)zone
+{
+    @synchronized(self) {
+        if(nil == albumArtCacheInstance) {
+			// assignment and return on first allocation
+            albumArtCacheInstance = [super allocWithZone:zone];
+			return albumArtCacheInstance;
+        }
+    }
+    return nil;
+}
+
+- (id) init
+{
+	if((self = [super init])) {
+		_thumbnails		= [[NSMutableDictionary alloc] init];
+		_thumbnailKeys	= [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_cacheFolder release], _cacheFolder = nil;
+	[_thumbnails release], _thumbnails = nil;
+	[_thumbnailKeys release], _thumbnailKeys = nil;
+
+	[super dealloc];
+}
+
+- (id) 			copyWithZone:(NSZone *)zone			{ return self; }
+- (id) 			retain								{ return self; }
+- (unsigned) 	retainCount							{ return UINT_MAX;  /* denotes an object that cannot be released */ }
+- (void) 		release								{ /* do nothing */ }
+- (id) 			autorelease							{ return self; }
+
+- (NSData *) albumArtDataForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+
+	NSNumber	*offset		= [stream valueForKey:MetadataAlbumArtOffsetKey];
+	NSNumber	*length		= [stream valueForKey:MetadataAlbumArtLengthKey];
+	NSString	*hash		= [stream valueForKey:MetadataAlbumArtHashKey];
+
+	if(nil == offset || nil == length || nil == hash || 0 == [length unsignedIntValue])
+		return nil;
+
+	NSFileHandle *file = [NSFileHandle fileHandleForReadingAtPath:[[stream valueForKey:StreamURLKey] path]];
+	if(nil == file)
+		return nil;
+
+	NSData *data = nil;
+	@try {
+		[file seekToFileOffset:[offset unsignedLongLongValue]];
+		data = [file readDataOfLength:[length unsignedIntValue]];
+	}
+
+	@catch(NSException *exception) {
+		data = nil;
+	}
+	
+	[file closeFile];
+
+	// The file may have been retagged since its metadata was read
+	if([data length] != [length unsignedIntValue] || NO == [getMD5DigestForBytes([data bytes], [data length]) isEqualToString:hash])
+		return nil;
+
+	return data;
+}
+
+- (NSImage *) albumArtForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+
+	NSData *data = [self albumArtDataForStream:stream];
+	if(nil == data)
+		return nil;
+
+	return [[[NSImage alloc] initWithData:data] autorelease];
+}
+
+- (NSImage *) thumbnailForStream:(AudioStream *)stream size:(unsigned)size
+{
+	NSParameterAssert(nil != stream);
+
+	NSString	*hash			= [stream valueForKey:MetadataAlbumArtHashKey];
+	unsigned	bucketSize		= 0;
+	unsigned	i;
+
+	if(nil == hash)
+		return nil;
+
+	// Round the requested size up to the nearest thumbnail size
+	for(i = 0; i < sizeof(sThumbnailSizes) / sizeof(sThumbnailSizes[0]); ++i) {
+		if(size <= sThumbnailSizes[i]) {
+			bucketSize = sThumbnailSizes[i];
+			break;
+		}
+	}
+
+	// Sizes larger than the largest thumbnail are served by the original art
+	if(0 == bucketSize)
+		return [self albumArtForStream:stream];
+
+	NSString	*key		= [NSString stringWithFormat:@"%u/%@", bucketSize, hash];
+	NSImage		*thumbnail	= [self cachedThumbnailForKey:key];
+
+	if(nil != thumbnail)
+		return thumbnail;
+
+	// Streams with identical art share the thumbnail on disk
+	NSString *thumbnailPath = [self pathForThumbnailWithHash:hash size:bucketSize];
+	if([[NSFileManager defaultManager] fileExistsAtPath:thumbnailPath])
+		thumbnail = [[[NSImage alloc] initWithContentsOfFile:thumbnailPath] autorelease];
+
+	if(nil == thumbnail) {
+		NSImage *image = [self albumArtForStream:stream];
+		if(nil == image)
+			return nil;
+
+		thumbnail = [self createThumbnailFromImage:image size:bucketSize];
+		if(nil == thumbnail)
+			return nil;
+
+		NSString *folder = [thumbnailPath stringByDeletingLastPathComponent];
+		if(NO == [[NSFileManager defaultManager] fileExistsAtPath:folder])
+			[[NSFileManager defaultManager] createDirectoryAtPath:folder withIntermediateDirectories:YES attributes:nil error:nil];
+
+		if(NO == [getPNGDataForImage(thumbnail) writeToFile:thumbnailPath atomically:YES])
+			NSLog(@"Unable to save the album art thumbnail for %@", stream);
+	}
+
+	[self cacheThumbnail:thumbnail forKey:key];
+
+	return thumbnail;
+}
+
+- (void) removeAllThumbnails
+{
+	@synchronized(self) {
+		[_thumbnails removeAllObjects];
+		[_thumbnailKeys removeAllObjects];
+	}
+
+	[[NSFileManager defaultManager] removeItemAtPath:[self cacheFolder] error:nil];
+}
+
+@end
+
+@implementation AlbumArtCache (Private)
+
+- (NSString *) cacheFolder
+{
+	@synchronized(self) {
+		if(nil == _cacheFolder) {
+			NSArray *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+			NSAssert(nil != paths, NSLocalizedStringFromTable(@"Unable to locate the \"Application Support\" folder.", @"Errors", @""));
+			
+			NSString *applicationName			= [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+			NSString *applicationSupportFolder	= [[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName];
+			
+			_cacheFolder = [[applicationSupportFolder stringByAppendingPathComponent:@"Album Art"] retain];
+		}
+	}
+	return _cacheFolder;
+}
+
+- (NSString *) pathForThumbnailWithHash:(NSString *)hash size:(unsigned)size
+{
+	NSParameterAssert(nil != hash);
+
+	NSString *folder = [[self cacheFolder] stringByAppendingPathComponent:[NSString stringWithFormat:@"%u", size]];
+	return [folder stringByAppendingPathComponent:[hash stringByAppendingPathExtension:@"png"]];
+}
+
+- (NSImage *) cachedThumbnailForKey:(NSString *)key
+{
+	@synchronized(self) {
+		return [[[_thumbnails objectForKey:key] retain] autorelease];
+	}
+	return nil;
+}
+
+- (void) cacheThumbnail:(NSImage *)thumbnail forKey:(NSString *)key
+{
+	NSParameterAssert(nil != thumbnail);
+	NSParameterAssert(nil != key);
+
+	@synchronized(self) {
+		if(nil != [_thumbnails objectForKey:key])
+			return;
+
+		// Discard the oldest thumbnails once the limit is reached
+		if(MAXIMUM_THUMBNAILS_IN_MEMORY <= [_thumbnailKeys count]) {
+			[_thumbnails removeObjectForKey:[_thumbnailKeys objectAtIndex:0]];
+			[_thumbnailKeys removeObjectAtIndex:0];
+		}
+
+		[_thumbnails setObject:thumbnail forKey:key];
+		[_thumbnailKeys addObject:key];
+	}
+}
+
+- (NSImage *) createThumbnailFromImage:(NSImage *)image size:(unsigned)size
+{
+	NSParameterAssert(nil != image);
+
+	NSSize imageSize = [image size];
+	if(0 == imageSize.width || 0 == imageSize.height)
+		return nil;
+
+	// Preserve the aspect ratio and never scale up
+	float	scale			= LOCAL_MIN(1, size / LOCAL_MAX(imageSize.width, imageSize.height));
+	NSSize	thumbnailSize	= NSMakeSize(roundf(imageSize.width * scale), roundf(imageSize.height * scale));
+
+	NSImage *thumbnail = [[NSImage alloc] initWithSize:thumbnailSize];
+	
+	[thumbnail lockFocus];
+	[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
+	[image drawInRect:NSMakeRect(0, 0, thumbnailSize.width, thumbnailSize.height) fromRect:NSZeroRect operation:NSCompositeCopy fraction:1.0];
+	[thumbnail unlockFocus];
+
+	return [thumbnail autorelease];
+}
+
+@end
@@ -0,0 +1,100 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#include <CoreAudio/CoreAudioTypes.h>
+
+@class AudioStream;
+
+// ========================================
+// An analyzer receives the decoded audio for one stream
+// A new instance is created for each stream, and all methods except the album
+// method are called on the worker thread decoding that stream
+// ========================================
+@protocol AudioAnalyzerMethods <NSObject>
+
+// Return NO if this analyzer can't handle the stream
+- (BOOL) beginAnalyzingStream:(AudioStream *)stream format:(AudioStreamBasicDescription)format;
+
+// bufferList holds deinterleaved 32-bit float samples; return NO once no more audio is needed
+- (BOOL) analyzeAudio:(const AudioBufferList *)bufferList frameCount:(UInt32)frameCount;
+
+// The returned values are set on the stream from the main thread
+- (NSDictionary *) finishAnalyzingStream:(AudioStream *)stream;
+
+@optional
+// Called on the main thread with the finished analyzers for every stream, if album values were requested
++ (NSDictionary *) albumValuesForAnalyzers:(NSArray *)analyzers;
+
+@end
+
+// ========================================
+// Decodes each stream once and passes the audio to a set of analyzers
+// Streams are distributed across one worker thread per processor; surround
+// streams are folded to stereo before analysis
+// ========================================
+@interface AudioAnalysisPipeline : NSObject
+{
+	NSArray				*_streams;
+	NSArray				*_analyzerClasses;
+	unsigned			_nextStreamIndex;
+	
+	NSMutableArray		*_results;
+	NSArray				*_finishedAnalyzers;
+	
+	BOOL				_calculatesAlbumValues;
+	id					_delegate;
+	
+	unsigned			_activeWorkers;
+	BOOL				_started;
+	BOOL				_cancelled;
+	BOOL				_albumValuesApplied;
+}
+
+- (id) initWithStreams:(NSArray *)streams analyzerClasses:(NSArray *)analyzerClasses;
+
+- (BOOL) calculatesAlbumValues;
+- (void) setCalculatesAlbumValues:(BOOL)calculatesAlbumValues;
+
+- (id) delegate;
+- (void) setDelegate:(id)delegate;
+
+// Spawn the worker threads and return immediately
+- (void) start;
+- (void) cancel;
+
+- (BOOL) isFinished;
+- (BOOL) isCancelled;
+
+// Set the values produced by finished streams (and the album values once all streams have finished); call from the main thread
+- (void) applyResults;
+
+// Analyze every stream, pumping the modal session for cancellation
+- (void) runWithModalSession:(NSModalSession)modalSession;
+
+@end
+
+// ========================================
+// Delegate methods
+// ========================================
+@interface NSObject (AudioAnalysisPipelineDelegateMethods)
+// Called on the worker thread as soon as a stream has been analyzed
+- (void) analysisPipeline:(AudioAnalysisPipeline *)pipeline didAnalyzeStream:(AudioStream *)stream withAnalyzers:(NSArray *)analyzers;
+@end
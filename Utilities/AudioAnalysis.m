@@ -0,0 +1,315 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioAnalysis.h"
+#import "AudioStream.h"
+#import "AudioDecoderMethods.h"
+#import "ChannelMixingDecoder.h"
+
+#include <CoreServices/CoreServices.h>
+
+#define LOCAL_MAX(a, b)			((a) > (b) ? (a) : (b))
+#define LOCAL_MIN(a, b)			((a) < (b) ? (a) : (b))
+#define BUFFER_LENGTH			4096
+
+@interface AudioAnalysisPipeline (Private)
+- (AudioStream *) nextStream;
+- (void) analyzeStream:(AudioStream *)stream bufferList:(AudioBufferList *)bufferList;
+- (void) analyzeInThread:(id)dummy;
+@end
+
+@implementation AudioAnalysisPipeline
+
+- (id) initWithStreams:(NSArray *)streams analyzerClasses:(NSArray *)analyzerClasses
+{
+	NSParameterAssert(nil != streams);
+	NSParameterAssert(nil != analyzerClasses);
+	
+	if((self = [super init])) {
+		_streams			= [streams copy];
+		_analyzerClasses	= [analyzerClasses copy];
+		_results			= [[NSMutableArray alloc] init];
+		
+		NSMutableArray *finishedAnalyzers = [NSMutableArray array];
+		unsigned i;
+		for(i = 0; i < [_analyzerClasses count]; ++i)
+			[finishedAnalyzers addObject:[NSMutableArray array]];
+		
+		_finishedAnalyzers	= [finishedAnalyzers copy];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_streams release], _streams = nil;
+	[_analyzerClasses release], _analyzerClasses = nil;
+	[_results release], _results = nil;
+	[_finishedAnalyzers release], _finishedAnalyzers = nil;
+	
+	[super dealloc];
+}
+
+- (BOOL)			calculatesAlbumValues									{ return _calculatesAlbumValues; }
+- (void)			setCalculatesAlbumValues:(BOOL)calculatesAlbumValues	{ _calculatesAlbumValues = calculatesAlbumValues; }
+
+- (id)				delegate												{ return _delegate; }
+- (void)			setDelegate:(id)delegate								{ _delegate = delegate; }
+
+- (void) start
+{
+	NSAssert(NO == _started, @"Attempt to start an AudioAnalysisPipeline twice");
+	
+	unsigned workerCount = LOCAL_MIN((unsigned)LOCAL_MAX(MPProcessors(), 1), [_streams count]);
+	unsigned i;
+	
+	_started		= YES;
+	_activeWorkers	= workerCount;
+	
+	// The worker threads retain the pipeline until they exit
+	for(i = 0; i < workerCount; ++i)
+		[NSThread detachNewThreadSelector:@selector(analyzeInThread:) toTarget:self withObject:nil];
+}
+
+- (void) cancel
+{
+	_cancelled = YES;
+}
+
+- (BOOL) isFinished
+{
+	@synchronized(self) {
+		return (_started && 0 == _activeWorkers);
+	}
+	
+	return NO;
+}
+
+- (BOOL) isCancelled
+{
+	return _cancelled;
+}
+
+- (void) applyResults
+{
+	NSArray *results = nil;
+	
+	@synchronized(_results) {
+		results = [[_results copy] autorelease];
+		[_results removeAllObjects];
+	}
+	
+	for(NSArray *result in results)
+		[[result objectAtIndex:0] setValuesForKeysWithDictionary:[result objectAtIndex:1]];
+	
+	if(NO == _calculatesAlbumValues || _albumValuesApplied || _cancelled || NO == [self isFinished])
+		return;
+	
+	unsigned i;
+	for(i = 0; i < [_analyzerClasses count]; ++i) {
+		Class		analyzerClass		= [_analyzerClasses objectAtIndex:i];
+		NSArray		*analyzers			= [_finishedAnalyzers objectAtIndex:i];
+		
+		if(0 == [analyzers count] || NO == [analyzerClass respondsToSelector:@selector(albumValuesForAnalyzers:)])
+			continue;
+		
+		NSDictionary *albumValues = [analyzerClass albumValuesForAnalyzers:analyzers];
+		for(NSString *key in albumValues)
+			[_streams setValue:[albumValues objectForKey:key] forKey:key];
+	}
+	
+	_albumValuesApplied = YES;
+}
+
+- (void) runWithModalSession:(NSModalSession)modalSession
+{
+#if DEBUG
+	NSDate *startTime = [NSDate date];
+#endif
+	
+	[self start];
+	
+	while(NO == [self isFinished]) {
+		[self applyResults];
+		
+		// Allow user cancellation
+		if(NO == _cancelled && NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
+			[self cancel];
+		
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+	}
+	
+	// Pick up anything posted after the last pass through the loop
+	[self applyResults];
+	
+#if DEBUG
+	NSLog(@"Analyzed %u streams in %f seconds", [_streams count], -[startTime timeIntervalSinceNow]);
+#endif
+}
+
+@end
+
+@implementation AudioAnalysisPipeline (Private)
+
+- (AudioStream *) nextStream
+{
+	AudioStream *stream = nil;
+	
+	@synchronized(self) {
+		if(NO == _cancelled && _nextStreamIndex < [_streams count])
+			stream = [_streams objectAtIndex:_nextStreamIndex++];
+	}
+	
+	return stream;
+}
+
+- (void) analyzeStream:(AudioStream *)stream bufferList:(AudioBufferList *)bufferList
+{
+	NSParameterAssert(nil != stream);
+	NSParameterAssert(NULL != bufferList);
+	
+	id <AudioDecoderMethods> decoder = [stream decoder:nil];
+	
+	// Skip this stream if any errors occurred
+	if(nil == decoder)
+		return;
+	
+	// Fold surround streams down to stereo so they can be analyzed too
+	if(2 < [decoder format].mChannelsPerFrame) {
+		decoder = [ChannelMixingDecoder decoderWithDecoder:decoder channelLayout:[ChannelMixingDecoder defaultChannelLayoutForChannelCount:2]];
+		if(nil == decoder)
+			return;
+	}
+	
+	AudioStreamBasicDescription		format				= [decoder format];
+	NSMutableArray					*analyzers			= [NSMutableArray array];
+	NSMutableArray					*activeAnalyzers	= [NSMutableArray array];
+	unsigned						i;
+	
+	for(Class analyzerClass in _analyzerClasses) {
+		id <AudioAnalyzerMethods> analyzer = [[analyzerClass alloc] init];
+		
+		if([analyzer beginAnalyzingStream:stream format:format]) {
+			[analyzers addObject:analyzer];
+			[activeAnalyzers addObject:analyzer];
+		}
+		else
+			[analyzers addObject:[NSNull null]];
+		
+		[analyzer release];
+	}
+	
+	// To avoid parameter errors from the decoders, set the number of buffer to the number of channels
+	bufferList->mNumberBuffers = format.mChannelsPerFrame;
+	
+	// Decode until every analyzer has seen as much of the stream as it needs
+	while(NO == _cancelled && 0 != [activeAnalyzers count]) {
+		
+		// Reset read parameters
+		for(i = 0; i < bufferList->mNumberBuffers; ++i)
+			bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
+		
+		// Read some audio
+		UInt32 framesRead = [decoder readAudio:bufferList frameCount:BUFFER_LENGTH];
+		if(0 == framesRead)
+			break;
+		
+		for(i = [activeAnalyzers count]; 0 < i; --i) {
+			if(NO == [[activeAnalyzers objectAtIndex:(i - 1)] analyzeAudio:bufferList frameCount:framesRead])
+				[activeAnalyzers removeObjectAtIndex:(i - 1)];
+		}
+	}
+	
+	if(_cancelled)
+		return;
+	
+	NSMutableDictionary *values = [NSMutableDictionary dictionary];
+	
+	for(i = 0; i < [analyzers count]; ++i) {
+		id analyzer = [analyzers objectAtIndex:i];
+		if([NSNull null] == analyzer)
+			continue;
+		
+		NSDictionary *analyzerValues = [analyzer finishAnalyzingStream:stream];
+		if(nil != analyzerValues)
+			[values addEntriesFromDictionary:analyzerValues];
+		
+		@synchronized(_finishedAnalyzers) {
+			[[_finishedAnalyzers objectAtIndex:i] addObject:analyzer];
+		}
+	}
+	
+	if(0 != [values count]) {
+		@synchronized(_results) {
+			[_results addObject:[NSArray arrayWithObjects:stream, values, nil]];
+		}
+	}
+	
+	if([_delegate respondsToSelector:@selector(analysisPipeline:didAnalyzeStream:withAnalyzers:)])
+		[_delegate analysisPipeline:self didAnalyzeStream:stream withAnalyzers:analyzers];
+}
+
+- (void) analyzeInThread:(id)dummy
+{
+	NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+	AudioStream			*stream		= nil;
+	unsigned			i;
+	
+	// Allocate the AudioBufferList for the decoder to use (2 channels regardless of channels in file)
+	// It is reused for every stream processed by this thread
+	AudioBufferList *bufferList = (AudioBufferList *)calloc(sizeof(AudioBufferList) + sizeof(AudioBuffer), 1);
+	NSAssert(NULL != bufferList, @"Unable to allocate memory");
+	
+	for(i = 0; i < 2; ++i) {
+		bufferList->mBuffers[i].mData = calloc(BUFFER_LENGTH, sizeof(float));
+		NSAssert(NULL != bufferList->mBuffers[i].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+		bufferList->mBuffers[i].mNumberChannels = 1;
+	}
+	
+	while(nil != (stream = [self nextStream])) {
+		NSAutoreleasePool *streamPool = [[NSAutoreleasePool alloc] init];
+		
+#if DEBUG
+		clock_t track_start = clock();
+#endif
+		
+		[self analyzeStream:stream bufferList:bufferList];
+		
+#if DEBUG
+		clock_t track_end = clock();
+		NSLog(@"Analyzed %@ in %f seconds", stream, (track_end - track_start) / (double)CLOCKS_PER_SEC);
+#endif
+		
+		[streamPool release];
+	}
+	
+	// Free allocated memory
+	for(i = 0; i < 2; ++i)
+		free(bufferList->mBuffers[i].mData);
+	free(bufferList);
+	
+	@synchronized(self) {
+		--_activeWorkers;
+	}
+	
+	[pool release];
+}
+
+@end
@@ -0,0 +1,300 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioAnalyzers.h"
+#import "AudioStream.h"
+
+#include <Accelerate/Accelerate.h>
+#include <math.h>
+
+@interface ReplayGainAnalyzer (Private)
+- (GainAnalysis *) analysis;
+@end
+
+@interface PeakAnalyzer (Private)
+- (float) samplePeak;
+- (float) truePeak;
+@end
+
+@interface LoudnessAnalyzer (Private)
+- (LoudnessMeter *) meter;
+@end
+
+@implementation ReplayGainAnalyzer
+
++ (NSDictionary *) albumValuesForAnalyzers:(NSArray *)analyzers
+{
+	NSParameterAssert(nil != analyzers);
+	
+	GainAnalysis **analyses = (GainAnalysis **)calloc([analyzers count], sizeof(GainAnalysis *));
+	NSAssert(NULL != analyses, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	size_t count = 0;
+	for(ReplayGainAnalyzer *analyzer in analyzers) {
+		if(NULL != [analyzer analysis])
+			analyses[count++] = [analyzer analysis];
+	}
+	
+	float albumGain = GetAlbumGainForAnalyses(analyses, count);
+	
+	free(analyses);
+	
+	if(GAIN_NOT_ENOUGH_SAMPLES == albumGain)
+		return nil;
+	
+	return [NSDictionary dictionaryWithObject:[NSNumber numberWithFloat:albumGain] forKey:ReplayGainAlbumGainKey];
+}
+
+- (void) dealloc
+{
+	DestroyGainAnalysis(_analysis), _analysis = NULL;
+	
+	free(_buffers[0]), _buffers[0] = NULL;
+	free(_buffers[1]), _buffers[1] = NULL;
+	
+	[super dealloc];
+}
+
+- (BOOL) beginAnalyzingStream:(AudioStream *)stream format:(AudioStreamBasicDescription)format
+{
+	// The RG analysis code only works on mono or stereo, at a few common sample rates
+	if(2 < format.mChannelsPerFrame)
+		return NO;
+	
+	_analysis = CreateGainAnalysis((long)format.mSampleRate);
+	if(NULL == _analysis)
+		return NO;
+	
+	_channelCount = format.mChannelsPerFrame;
+	
+	return YES;
+}
+
+- (BOOL) analyzeAudio:(const AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	float		scale		= (1L << (16 - 1));
+	unsigned	channel;
+	
+	// Grow the RG buffers if required
+	if(_bufferLength < frameCount) {
+		for(channel = 0; channel < _channelCount; ++channel) {
+			float *newBuffer = (float *)realloc(_buffers[channel], frameCount * sizeof(float));
+			NSAssert(NULL != newBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+			_buffers[channel] = newBuffer;
+		}
+		_bufferLength = frameCount;
+	}
+	
+	// The RG analysis code expects samples in the 16-bit range
+	for(channel = 0; channel < _channelCount; ++channel)
+		vDSP_vsmul((const float *)bufferList->mBuffers[channel].mData, 1, &scale, _buffers[channel], 1, frameCount);
+	
+	if(GAIN_ANALYSIS_OK != AnalyzeSamplesWithAnalysis(_analysis, _buffers[0], (1 == _channelCount ? NULL : _buffers[1]), frameCount, _channelCount)) {
+		_failed = YES;
+		return NO;
+	}
+	
+	return YES;
+}
+
+- (NSDictionary *) finishAnalyzingStream:(AudioStream *)stream
+{
+	if(_failed) {
+		DestroyGainAnalysis(_analysis), _analysis = NULL;
+		return nil;
+	}
+	
+	// This also folds the track into the analysis's album totals
+	float trackGain = GetTitleGainWithAnalysis(_analysis);
+	if(GAIN_NOT_ENOUGH_SAMPLES == trackGain)
+		return nil;
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithFloat:trackGain], ReplayGainTrackGainKey,
+		[NSNumber numberWithFloat:ReplayGainReferenceLoudness], ReplayGainReferenceLoudnessKey,
+		nil];
+}
+
+@end
+
+@implementation ReplayGainAnalyzer (Private)
+
+- (GainAnalysis *) analysis
+{
+	return _analysis;
+}
+
+@end
+
+@implementation PeakAnalyzer
+
++ (NSDictionary *) albumValuesForAnalyzers:(NSArray *)analyzers
+{
+	NSParameterAssert(nil != analyzers);
+	
+	float albumPeak			= 0;
+	float albumTruePeak		= 0;
+	for(PeakAnalyzer *analyzer in analyzers) {
+		if([analyzer samplePeak] > albumPeak)
+			albumPeak = [analyzer samplePeak];
+		if([analyzer truePeak] > albumTruePeak)
+			albumTruePeak = [analyzer truePeak];
+	}
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithFloat:albumPeak], ReplayGainAlbumPeakKey,
+		[NSNumber numberWithFloat:albumTruePeak], ReplayGainAlbumTruePeakKey,
+		nil];
+}
+
+- (void) dealloc
+{
+	true_peak_meter_destroy(_truePeakMeter), _truePeakMeter = NULL;
+	
+	[super dealloc];
+}
+
+- (BOOL) beginAnalyzingStream:(AudioStream *)stream format:(AudioStreamBasicDescription)format
+{
+	_truePeakMeter = true_peak_meter_create(format.mChannelsPerFrame);
+	_channelCount = format.mChannelsPerFrame;
+	
+	return (NULL != _truePeakMeter);
+}
+
+- (BOOL) analyzeAudio:(const AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	const float *channels [2] = { NULL, NULL };
+	
+	unsigned channel;
+	for(channel = 0; channel < _channelCount; ++channel) {
+		channels[channel] = (const float *)bufferList->mBuffers[channel].mData;
+		
+		float channelPeak = 0;
+		vDSP_maxmgv(channels[channel], 1, &channelPeak, frameCount);
+		
+		if(channelPeak > _samplePeak)
+			_samplePeak = channelPeak;
+	}
+	
+	true_peak_meter_process(_truePeakMeter, channels, frameCount);
+	
+	return YES;
+}
+
+- (NSDictionary *) finishAnalyzingStream:(AudioStream *)stream
+{
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithFloat:_samplePeak], ReplayGainTrackPeakKey,
+		[NSNumber numberWithFloat:[self truePeak]], ReplayGainTrackTruePeakKey,
+		nil];
+}
+
+@end
+
+@implementation PeakAnalyzer (Private)
+
+- (float) samplePeak
+{
+	return _samplePeak;
+}
+
+- (float) truePeak
+{
+	return true_peak_meter_peak(_truePeakMeter);
+}
+
+@end
+
+@implementation LoudnessAnalyzer
+
++ (NSDictionary *) albumValuesForAnalyzers:(NSArray *)analyzers
+{
+	NSParameterAssert(nil != analyzers);
+	
+	const LoudnessMeter **meters = (const LoudnessMeter **)calloc([analyzers count], sizeof(LoudnessMeter *));
+	NSAssert(NULL != meters, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	size_t count = 0;
+	for(LoudnessAnalyzer *analyzer in analyzers)
+		meters[count++] = [analyzer meter];
+	
+	double albumLoudness = loudness_meter_integrated_loudness_multiple(meters, count);
+	
+	free(meters);
+	
+	if(-HUGE_VAL == albumLoudness)
+		return nil;
+	
+	return [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:albumLoudness] forKey:LoudnessAlbumIntegratedKey];
+}
+
+- (void) dealloc
+{
+	loudness_meter_destroy(_meter), _meter = NULL;
+	
+	[super dealloc];
+}
+
+- (BOOL) beginAnalyzingStream:(AudioStream *)stream format:(AudioStreamBasicDescription)format
+{
+	_meter = loudness_meter_create(format.mSampleRate, format.mChannelsPerFrame);
+	_channelCount = format.mChannelsPerFrame;
+	
+	return (NULL != _meter);
+}
+
+- (BOOL) analyzeAudio:(const AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	const float *channels [2] = { NULL, NULL };
+	
+	unsigned channel;
+	for(channel = 0; channel < _channelCount; ++channel)
+		channels[channel] = (const float *)bufferList->mBuffers[channel].mData;
+	
+	loudness_meter_process(_meter, channels, frameCount);
+	
+	return YES;
+}
+
+- (NSDictionary *) finishAnalyzingStream:(AudioStream *)stream
+{
+	double integratedLoudness = loudness_meter_integrated_loudness(_meter);
+	
+	// Digital silence has no meaningful loudness
+	if(-HUGE_VAL == integratedLoudness)
+		return nil;
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithDouble:integratedLoudness], LoudnessTrackIntegratedKey,
+		[NSNumber numberWithDouble:loudness_meter_loudness_range(_meter)], LoudnessTrackRangeKey,
+		nil];
+}
+
+@end
+
+@implementation LoudnessAnalyzer (Private)
+
+- (LoudnessMeter *) meter
+{
+	return _meter;
+}
+
+@end
@@ -0,0 +1,109 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+@class AudioStream;
+
+// ========================================
+// Error Codes
+// ========================================
+extern NSString * const			AudioExportErrorDomain;
+
+enum {
+	AudioExportFileFormatNotSupportedError		= 0,
+	AudioExportInputOutputError					= 1
+};
+
+// ========================================
+// Output formats
+// ========================================
+enum {
+	kAudioExportFormatWAVE				= 0,
+	kAudioExportFormatFLAC				= 1,
+	kAudioExportFormatOggVorbis			= 2
+};
+typedef unsigned AudioExportFormat;
+
+// The file name extension used for the given format
+NSString * pathExtensionForAudioExportFormat(AudioExportFormat format);
+
+// ========================================
+// Decodes a set of streams (including cue sheet regions) and encodes each one
+// to a new file in the output directory, copying the tags to the new file
+// Streams are distributed across one worker thread per processor
+// ========================================
+@interface AudioExportJob : NSObject
+{
+	NSArray				*_streams;
+	NSURL				*_outputDirectory;
+	AudioExportFormat	_format;
+	unsigned			_nextStreamIndex;
+	NSArray				*_outputURLs;
+	
+	NSMutableArray		*_errors;
+	id					_delegate;
+	
+	double				_totalSeconds;
+	double				_exportedSeconds;
+	unsigned			_exportedStreams;
+	NSDate				*_startTime;
+	NSTimeInterval		_elapsedTime;
+	
+	unsigned			_activeWorkers;
+	BOOL				_started;
+	BOOL				_cancelled;
+}
+
+- (id) initWithStreams:(NSArray *)streams outputDirectory:(NSURL *)outputDirectory format:(AudioExportFormat)format;
+
+- (NSArray *) streams;
+- (NSURL *) outputDirectory;
+- (AudioExportFormat) format;
+
+- (id) delegate;
+- (void) setDelegate:(id)delegate;
+
+// Spawn the worker threads and return immediately
+- (void) start;
+- (void) cancel;
+
+- (BOOL) isFinished;
+- (BOOL) isCancelled;
+
+// The fraction of the total audio exported so far, from 0 to 1
+- (double) progress;
+- (unsigned) exportedStreamCount;
+
+// Seconds of audio exported per second of wall time
+- (double) realtimeFactor;
+
+// Errors from streams that could not be exported
+- (NSArray *) errors;
+
+@end
+
+// ========================================
+// Delegate methods
+// ========================================
+@interface NSObject (AudioExportJobDelegateMethods)
+// Called on the worker thread as soon as a stream has been exported
+- (void) exportJob:(AudioExportJob *)job didExportStream:(AudioStream *)stream toURL:(NSURL *)url;
+@end
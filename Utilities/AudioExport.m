@@ -0,0 +1,782 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioExport.h"
+#import "AudioStream.h"
+#import "AudioDecoderMethods.h"
+#import "AudioMetadataWriter.h"
+
+#include <CoreServices/CoreServices.h>
+#include <AudioToolbox/AudioToolbox.h>
+#include <FLAC/metadata.h>
+#include <FLAC/stream_encoder.h>
+#include <vorbis/vorbisenc.h>
+#include <unistd.h>
+
+#define LOCAL_MAX(a, b)			((a) > (b) ? (a) : (b))
+#define LOCAL_MIN(a, b)			((a) < (b) ? (a) : (b))
+#define BUFFER_LENGTH			4096
+#define MAX_CHANNELS			8
+
+NSString *const AudioExportErrorDomain = @"org.sbooth.Play.ErrorDomain.AudioExport";
+
+NSString *
+pathExtensionForAudioExportFormat(AudioExportFormat format)
+{
+	switch(format) {
+		case kAudioExportFormatWAVE:		return @"wav";
+		case kAudioExportFormatFLAC:		return @"flac";
+		case kAudioExportFormatOggVorbis:	return @"ogg";
+		default:							return nil;
+	}
+}
+
+static NSError *
+exportError(int code, NSString *description, NSString *reason, NSString *suggestion)
+{
+	NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+	
+	[errorDictionary setObject:description forKey:NSLocalizedDescriptionKey];
+	[errorDictionary setObject:reason forKey:NSLocalizedFailureReasonErrorKey];
+	[errorDictionary setObject:suggestion forKey:NSLocalizedRecoverySuggestionErrorKey];
+	
+	return [NSError errorWithDomain:AudioExportErrorDomain code:code userInfo:errorDictionary];
+}
+
+static NSError *
+exportWriteError(NSURL *url)
+{
+	return exportError(AudioExportInputOutputError,
+					   [NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" could not be written.", @"Errors", @""), [[url path] lastPathComponent]],
+					   NSLocalizedStringFromTable(@"Unable to write the file", @"Errors", @""),
+					   NSLocalizedStringFromTable(@"The disk may be full or the folder may not be writable.", @"Errors", @""));
+}
+
+// Lossless sources keep their resolution (16 or 24 bits), everything else is written as 16 bits
+static UInt32
+bitsPerChannelForSourceFormat(AudioStreamBasicDescription sourceFormat)
+{
+	if(kAudioFormatLinearPCM == sourceFormat.mFormatID && kAudioFormatFlagIsFloat & sourceFormat.mFormatFlags)
+		return 24;
+	
+	return (16 < sourceFormat.mBitsPerChannel ? 24 : 16);
+}
+
+// ========================================
+// Encoders accept the decoders' deinterleaved 32-bit float PCM
+// ========================================
+@interface AudioExportEncoder : NSObject
+{
+	NSURL							*_url;
+	AudioStreamBasicDescription		_format;
+	UInt32							_bitsPerChannel;
+}
+
++ (AudioExportEncoder *) encoderForFormat:(AudioExportFormat)exportFormat URL:(NSURL *)url format:(AudioStreamBasicDescription)format sourceFormat:(AudioStreamBasicDescription)sourceFormat error:(NSError **)error;
+
+- (id) initWithURL:(NSURL *)url format:(AudioStreamBasicDescription)format sourceFormat:(AudioStreamBasicDescription)sourceFormat;
+
+// Create the output file
+- (BOOL) open:(NSError **)error;
+- (BOOL) encodeAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount;
+- (BOOL) finish;
+@end
+
+@interface WAVEExportEncoder : AudioExportEncoder
+{
+	ExtAudioFileRef					_file;
+}
+@end
+
+@interface FLACExportEncoder : AudioExportEncoder
+{
+	FLAC__StreamEncoder				*_encoder;
+	FLAC__StreamMetadata			*_metadata [2];
+	FLAC__int32						*_buffer;
+}
+@end
+
+@interface OggVorbisExportEncoder : AudioExportEncoder
+{
+	FILE							*_file;
+	BOOL							_initialized;
+	
+	ogg_stream_state				_os;
+	vorbis_info						_vi;
+	vorbis_comment					_vc;
+	vorbis_dsp_state				_vd;
+	vorbis_block					_vb;
+}
+- (BOOL) writePages:(BOOL)flush;
+- (BOOL) encodeBlocks;
+@end
+
+@implementation AudioExportEncoder
+
++ (AudioExportEncoder *) encoderForFormat:(AudioExportFormat)exportFormat URL:(NSURL *)url format:(AudioStreamBasicDescription)format sourceFormat:(AudioStreamBasicDescription)sourceFormat error:(NSError **)error
+{
+	NSParameterAssert(nil != url);
+	
+	Class encoderClass = Nil;
+	switch(exportFormat) {
+		case kAudioExportFormatWAVE:		encoderClass = [WAVEExportEncoder class];			break;
+		case kAudioExportFormatFLAC:		encoderClass = [FLACExportEncoder class];			break;
+		case kAudioExportFormatOggVorbis:	encoderClass = [OggVorbisExportEncoder class];		break;
+	}
+	
+	if(Nil == encoderClass || MAX_CHANNELS < format.mChannelsPerFrame) {
+		if(nil != error)
+			*error = exportError(AudioExportFileFormatNotSupportedError,
+								 [NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" could not be created.", @"Errors", @""), [[url path] lastPathComponent]],
+								 NSLocalizedStringFromTable(@"File format not supported", @"Errors", @""),
+								 NSLocalizedStringFromTable(@"The audio can't be represented in the selected format.", @"Errors", @""));
+		return nil;
+	}
+	
+	AudioExportEncoder *encoder = [[encoderClass alloc] initWithURL:url format:format sourceFormat:sourceFormat];
+	if(NO == [encoder open:error]) {
+		[encoder release];
+		return nil;
+	}
+	
+	return [encoder autorelease];
+}
+
+- (id) initWithURL:(NSURL *)url format:(AudioStreamBasicDescription)format sourceFormat:(AudioStreamBasicDescription)sourceFormat
+{
+	NSParameterAssert(nil != url);
+	
+	if((self = [super init])) {
+		_url				= [url retain];
+		_format				= format;
+		_bitsPerChannel		= bitsPerChannelForSourceFormat(sourceFormat);
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_url release], _url = nil;
+	
+	[super dealloc];
+}
+
+- (BOOL)	open:(NSError **)error												{ return NO; }
+- (BOOL)	encodeAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount		{ return NO; }
+- (BOOL)	finish																{ return NO; }
+
+@end
+
+@implementation WAVEExportEncoder
+
+- (void) dealloc
+{
+	if(NULL != _file)
+		ExtAudioFileDispose(_file), _file = NULL;
+	
+	[super dealloc];
+}
+
+- (BOOL) open:(NSError **)error
+{
+	AudioStreamBasicDescription fileFormat;
+	
+	fileFormat.mFormatID			= kAudioFormatLinearPCM;
+	fileFormat.mFormatFlags			= kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+	fileFormat.mSampleRate			= _format.mSampleRate;
+	fileFormat.mChannelsPerFrame	= _format.mChannelsPerFrame;
+	fileFormat.mBitsPerChannel		= _bitsPerChannel;
+	fileFormat.mBytesPerFrame		= (_bitsPerChannel / 8) * fileFormat.mChannelsPerFrame;
+	fileFormat.mFramesPerPacket		= 1;
+	fileFormat.mBytesPerPacket		= fileFormat.mBytesPerFrame;
+	fileFormat.mReserved			= 0;
+	
+	OSStatus result = ExtAudioFileCreateWithURL((CFURLRef)_url, kAudioFileWAVEType, &fileFormat, NULL, kAudioFileFlags_EraseFile, &_file);
+	if(noErr == result) {
+		// ExtAudioFile converts from the decoders' format
+		result = ExtAudioFileSetProperty(_file, kExtAudioFileProperty_ClientDataFormat, sizeof(_format), &_format);
+	}
+	
+	if(noErr != result) {
+		if(nil != error)
+			*error = exportWriteError(_url);
+		return NO;
+	}
+	
+	return YES;
+}
+
+- (BOOL) encodeAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	return (noErr == ExtAudioFileWrite(_file, frameCount, bufferList));
+}
+
+- (BOOL) finish
+{
+	OSStatus result = ExtAudioFileDispose(_file);
+	_file = NULL;
+	
+	return (noErr == result);
+}
+
+@end
+
+@implementation FLACExportEncoder
+
+- (void) dealloc
+{
+	if(NULL != _encoder)
+		FLAC__stream_encoder_delete(_encoder), _encoder = NULL;
+	
+	unsigned i;
+	for(i = 0; i < 2; ++i) {
+		if(NULL != _metadata[i])
+			FLAC__metadata_object_delete(_metadata[i]), _metadata[i] = NULL;
+	}
+	
+	free(_buffer), _buffer = NULL;
+	
+	[super dealloc];
+}
+
+- (BOOL) open:(NSError **)error
+{
+	_encoder = FLAC__stream_encoder_new();
+	NSAssert(NULL != _encoder, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	_buffer = calloc(BUFFER_LENGTH * _format.mChannelsPerFrame, sizeof(FLAC__int32));
+	NSAssert(NULL != _buffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	// An empty Vorbis comment block and some padding let the tags be written without rewriting the file
+	_metadata[0] = FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
+	_metadata[1] = FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING);
+	NSAssert(NULL != _metadata[0] && NULL != _metadata[1], NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	_metadata[1]->length = 4096;
+	
+	unsigned compressionLevel = LOCAL_MIN((unsigned)[[NSUserDefaults standardUserDefaults] integerForKey:@"exportFLACCompressionLevel"], 8);
+	
+	FLAC__stream_encoder_set_channels(_encoder, _format.mChannelsPerFrame);
+	FLAC__stream_encoder_set_bits_per_sample(_encoder, _bitsPerChannel);
+	FLAC__stream_encoder_set_sample_rate(_encoder, (unsigned)_format.mSampleRate);
+	FLAC__stream_encoder_set_compression_level(_encoder, compressionLevel);
+	FLAC__stream_encoder_set_metadata(_encoder, _metadata, 2);
+	
+	if(FLAC__STREAM_ENCODER_INIT_STATUS_OK != FLAC__stream_encoder_init_file(_encoder, [[_url path] fileSystemRepresentation], NULL, NULL)) {
+		if(nil != error)
+			*error = exportWriteError(_url);
+		return NO;
+	}
+	
+	return YES;
+}
+
+- (BOOL) encodeAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(BUFFER_LENGTH >= frameCount);
+	
+	FLAC__int32		maxValue		= (1 << (_bitsPerChannel - 1)) - 1;
+	FLAC__int32		minValue		= -(1 << (_bitsPerChannel - 1));
+	float			scale			= (float)(1 << (_bitsPerChannel - 1));
+	unsigned		channels		= _format.mChannelsPerFrame;
+	unsigned		channel, frame;
+	
+	// Interleave and convert to integers, clipping out of range samples
+	for(channel = 0; channel < channels; ++channel) {
+		const float		*input		= (const float *)bufferList->mBuffers[channel].mData;
+		FLAC__int32		*output		= _buffer + channel;
+		
+		for(frame = 0; frame < frameCount; ++frame, output += channels) {
+			long sample = lrintf(input[frame] * scale);
+			*output = (FLAC__int32)LOCAL_MAX(LOCAL_MIN(sample, maxValue), minValue);
+		}
+	}
+	
+	return FLAC__stream_encoder_process_interleaved(_encoder, _buffer, frameCount);
+}
+
+- (BOOL) finish
+{
+	return FLAC__stream_encoder_finish(_encoder);
+}
+
+@end
+
+@implementation OggVorbisExportEncoder
+
+- (void) dealloc
+{
+	if(_initialized) {
+		ogg_stream_clear(&_os);
+		vorbis_block_clear(&_vb);
+		vorbis_dsp_clear(&_vd);
+		vorbis_comment_clear(&_vc);
+		vorbis_info_clear(&_vi);
+	}
+	
+	if(NULL != _file)
+		fclose(_file), _file = NULL;
+	
+	[super dealloc];
+}
+
+- (BOOL) open:(NSError **)error
+{
+	float quality = LOCAL_MAX(LOCAL_MIN([[NSUserDefaults standardUserDefaults] floatForKey:@"exportOggVorbisQuality"], 1.f), -0.1f);
+
+	vorbis_info_init(&_vi);
+	if(0 != vorbis_encode_init_vbr(&_vi, _format.mChannelsPerFrame, (long)_format.mSampleRate, quality)) {
+		vorbis_info_clear(&_vi);
+		
+		if(nil != error)
+			*error = exportError(AudioExportFileFormatNotSupportedError,
+								 [NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" could not be created.", @"Errors", @""), [[_url path] lastPathComponent]],
+								 NSLocalizedStringFromTable(@"File format not supported", @"Errors", @""),
+								 NSLocalizedStringFromTable(@"The audio can't be represented in the selected format.", @"Errors", @""));
+		return NO;
+	}
+	
+	vorbis_comment_init(&_vc);
+	vorbis_analysis_init(&_vd, &_vi);
+	vorbis_block_init(&_vd, &_vb);
+	ogg_stream_init(&_os, (int)random());
+	
+	_initialized = YES;
+	
+	_file = fopen([[_url path] fileSystemRepresentation], "w");
+	if(NULL == _file) {
+		if(nil != error)
+			*error = exportWriteError(_url);
+		return NO;
+	}
+	
+	ogg_packet header, headerComment, headerCodebooks;
+	vorbis_analysis_headerout(&_vd, &_vc, &header, &headerComment, &headerCodebooks);
+	
+	ogg_stream_packetin(&_os, &header);
+	ogg_stream_packetin(&_os, &headerComment);
+	ogg_stream_packetin(&_os, &headerCodebooks);
+
+	// The audio data must start on a new page
+	if(NO == [self writePages:YES]) {
+		if(nil != error)
+			*error = exportWriteError(_url);
+		return NO;
+	}
+	
+	return YES;
+}
+
+- (BOOL) writePages:(BOOL)flush
+{
+	ogg_page page;
+	
+	while(0 != (flush ? ogg_stream_flush(&_os, &page) : ogg_stream_pageout(&_os, &page))) {
+		if(1 != fwrite(page.header, page.header_len, 1, _file) || 1 != fwrite(page.body, page.body_len, 1, _file))
+			return NO;
+	}
+	
+	return YES;
+}
+
+- (BOOL) encodeBlocks
+{
+	ogg_packet packet;
+	
+	while(1 == vorbis_analysis_blockout(&_vd, &_vb)) {
+		vorbis_analysis(&_vb, NULL);
+		vorbis_bitrate_addblock(&_vb);
+		
+		while(vorbis_bitrate_flushpacket(&_vd, &packet)) {
+			ogg_stream_packetin(&_os, &packet);
+			
+			if(NO == [self writePages:NO])
+				return NO;
+		}
+	}
+	
+	return YES;
+}
+
+- (BOOL) encodeAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	float		**buffer		= vorbis_analysis_buffer(&_vd, frameCount);
+	unsigned	channel;
+	
+	for(channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+		memcpy(buffer[channel], bufferList->mBuffers[channel].mData, frameCount * sizeof(float));
+	
+	vorbis_analysis_wrote(&_vd, frameCount);
+	
+	return [self encodeBlocks];
+}
+
+- (BOOL) finish
+{
+	// Signal the end of the stream and write out the remaining packets
+	vorbis_analysis_wrote(&_vd, 0);
+	
+	BOOL result = ([self encodeBlocks] && [self writePages:YES]);
+	
+	if(0 != fclose(_file))
+		result = NO;
+	_file = NULL;
+	
+	return result;
+}
+
+@end
+
+// ========================================
+// The job
+// ========================================
+@interface AudioExportJob (Private)
+- (NSArray *) outputURLsForStreams;
+- (unsigned) nextStreamIndex;
+- (void) addError:(NSError *)error;
+- (void) exportStream:(AudioStream *)stream toURL:(NSURL *)url bufferList:(AudioBufferList *)bufferList;
+- (void) exportInThread:(id)dummy;
+@end
+
+@implementation AudioExportJob
+
+- (id) initWithStreams:(NSArray *)streams outputDirectory:(NSURL *)outputDirectory format:(AudioExportFormat)format
+{
+	NSParameterAssert(nil != streams);
+	NSParameterAssert(nil != outputDirectory);
+	NSParameterAssert([outputDirectory isFileURL]);
+	NSParameterAssert(nil != pathExtensionForAudioExportFormat(format));
+	
+	if((self = [super init])) {
+		_streams			= [streams copy];
+		_outputDirectory	= [outputDirectory retain];
+		_format				= format;
+		_errors				= [[NSMutableArray alloc] init];
+		
+		for(AudioStream *stream in _streams)
+			_totalSeconds += [[stream duration] doubleValue];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_streams release], _streams = nil;
+	[_outputDirectory release], _outputDirectory = nil;
+	[_outputURLs release], _outputURLs = nil;
+	[_errors release], _errors = nil;
+	[_startTime release], _startTime = nil;
+	
+	[super dealloc];
+}
+
+- (NSArray *)			streams										{ return [[_streams retain] autorelease]; }
+- (NSURL *)				outputDirectory								{ return [[_outputDirectory retain] autorelease]; }
+- (AudioExportFormat)	format										{ return _format; }
+
+- (id)					delegate									{ return _delegate; }
+- (void)				setDelegate:(id)delegate					{ _delegate = delegate; }
+
+- (void) start
+{
+	NSAssert(NO == _started, @"Attempt to start an AudioExportJob twice");
+	
+	unsigned workerCount = LOCAL_MIN((unsigned)LOCAL_MAX(MPProcessors(), 1), [_streams count]);
+	unsigned i;
+	
+	// File names are chosen up front so the workers can't collide
+	_outputURLs		= [[self outputURLsForStreams] retain];
+	_startTime		= [[NSDate alloc] init];
+	_started		= YES;
+	_activeWorkers	= workerCount;
+	
+	// The worker threads retain the job until they exit
+	for(i = 0; i < workerCount; ++i)
+		[NSThread detachNewThreadSelector:@selector(exportInThread:) toTarget:self withObject:nil];
+}
+
+- (void) cancel
+{
+	_cancelled = YES;
+}
+
+- (BOOL) isFinished
+{
+	@synchronized(self) {
+		return (_started && 0 == _activeWorkers);
+	}
+	
+	return NO;
+}
+
+- (BOOL) isCancelled
+{
+	return _cancelled;
+}
+
+- (double) progress
+{
+	@synchronized(self) {
+		if(0 == _totalSeconds)
+			return ([_streams count] ? (double)_exportedStreams / [_streams count] : 1);
+		
+		return LOCAL_MIN(_exportedSeconds / _totalSeconds, 1);
+	}
+	
+	return 0;
+}
+
+- (unsigned) exportedStreamCount
+{
+	@synchronized(self) {
+		return _exportedStreams;
+	}
+	
+	return 0;
+}
+
+- (double) realtimeFactor
+{
+	@synchronized(self) {
+		if(NO == _started)
+			return 0;
+		
+		NSTimeInterval elapsed = (0 == _activeWorkers ? _elapsedTime : -[_startTime timeIntervalSinceNow]);
+		return (0 < elapsed ? _exportedSeconds / elapsed : 0);
+	}
+	
+	return 0;
+}
+
+- (NSArray *) errors
+{
+	@synchronized(_errors) {
+		return [[_errors copy] autorelease];
+	}
+	
+	return nil;
+}
+
+@end
+
+@implementation AudioExportJob (Private)
+
+- (NSArray *) outputURLsForStreams
+{
+	NSMutableArray		*outputURLs			= [NSMutableArray array];
+	NSMutableSet		*reservedPaths		= [NSMutableSet set];
+	NSString			*directory			= [_outputDirectory path];
+	NSString			*pathExtension		= pathExtensionForAudioExportFormat(_format);
+	
+	for(AudioStream *stream in _streams) {
+		NSString	*title			= [stream valueForKey:MetadataTitleKey];
+		NSNumber	*trackNumber	= [stream valueForKey:MetadataTrackNumberKey];
+		NSString	*basename		= nil;
+		
+		if(nil != title && nil != trackNumber)
+			basename = [NSString stringWithFormat:@"%02i %@", [trackNumber intValue], title];
+		else if(nil != title)
+			basename = title;
+		else
+			basename = [[[stream valueForKey:StreamURLKey] path] lastPathComponent];
+		
+		// Strip characters that are illegal in file names
+		NSMutableString *filename = [[basename mutableCopy] autorelease];
+		[filename replaceOccurrencesOfString:@"/" withString:@"-" options:0 range:NSMakeRange(0, [filename length])];
+		[filename replaceOccurrencesOfString:@":" withString:@"-" options:0 range:NSMakeRange(0, [filename length])];
+		
+		// Tracks from a cue sheet or with the same title get a numeric suffix
+		NSString	*path		= [directory stringByAppendingPathComponent:[filename stringByAppendingPathExtension:pathExtension]];
+		unsigned	suffix		= 2;
+		while([reservedPaths containsObject:path] || [[NSFileManager defaultManager] fileExistsAtPath:path])
+			path = [directory stringByAppendingPathComponent:[[NSString stringWithFormat:@"%@ %u", filename, suffix++] stringByAppendingPathExtension:pathExtension]];
+		
+		[reservedPaths addObject:path];
+		[outputURLs addObject:[NSURL fileURLWithPath:path]];
+	}
+	
+	return outputURLs;
+}
+
+- (unsigned) nextStreamIndex
+{
+	@synchronized(self) {
+		if(NO == _cancelled && _nextStreamIndex < [_streams count])
+			return _nextStreamIndex++;
+	}
+	
+	return NSNotFound;
+}
+
+- (void) addError:(NSError *)error
+{
+	if(nil == error)
+		return;
+	
+	@synchronized(_errors) {
+		[_errors addObject:error];
+	}
+}
+
+- (void) exportStream:(AudioStream *)stream toURL:(NSURL *)url bufferList:(AudioBufferList *)bufferList
+{
+	NSParameterAssert(nil != stream);
+	NSParameterAssert(nil != url);
+	NSParameterAssert(NULL != bufferList);
+	
+	NSError						*error				= nil;
+	id <AudioDecoderMethods>	decoder				= [stream decoder:&error];
+	double						expectedSeconds		= [[stream duration] doubleValue];
+	double						streamSeconds		= 0;
+	
+	if(nil == decoder) {
+		[self addError:error];
+		goto account;
+	}
+	
+	AudioStreamBasicDescription		format		= [decoder format];
+	AudioExportEncoder				*encoder	= [AudioExportEncoder encoderForFormat:_format URL:url format:format sourceFormat:[decoder sourceFormat] error:&error];
+	
+	if(nil == encoder) {
+		[self addError:error];
+		unlink([[url path] fileSystemRepresentation]);
+		goto account;
+	}
+	
+	// To avoid parameter errors from the decoders, set the number of buffer to the number of channels
+	bufferList->mNumberBuffers = format.mChannelsPerFrame;
+	
+	BOOL		succeeded	= YES;
+	unsigned	i;
+	
+	while(NO == _cancelled) {
+		
+		// Reset read parameters
+		for(i = 0; i < bufferList->mNumberBuffers; ++i)
+			bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
+		
+		// Read some audio
+		UInt32 framesRead = [decoder readAudio:bufferList frameCount:BUFFER_LENGTH];
+		if(0 == framesRead)
+			break;
+		
+		if(NO == [encoder encodeAudio:bufferList frameCount:framesRead]) {
+			succeeded = NO;
+			break;
+		}
+		
+		double seconds = framesRead / format.mSampleRate;
+		streamSeconds += seconds;
+		
+		@synchronized(self) {
+			_exportedSeconds += seconds;
+		}
+	}
+	
+	if(NO == [encoder finish])
+		succeeded = NO;
+	
+	// Don't leave partial files behind
+	if(_cancelled || NO == succeeded) {
+		if(NO == _cancelled)
+			[self addError:exportWriteError(url)];
+		
+		unlink([[url path] fileSystemRepresentation]);
+		goto account;
+	}
+	
+	// Tags are copied using the same writers that save edited metadata; a format without a writer is exported untagged
+	AudioMetadataWriter *metadataWriter = [AudioMetadataWriter metadataWriterForURL:url error:nil];
+	if(nil != metadataWriter && NO == [metadataWriter writeMetadata:stream error:&error]) {
+#if DEBUG
+		NSLog(@"Unable to copy tags to %@: %@", [url path], error);
+#endif
+	}
+	
+	@synchronized(self) {
+		++_exportedStreams;
+	}
+	
+	if([_delegate respondsToSelector:@selector(exportJob:didExportStream:toURL:)])
+		[_delegate exportJob:self didExportStream:stream toURL:url];
+	
+account:
+	// Count skipped or short streams as finished so progress reaches completion
+	if(expectedSeconds > streamSeconds) {
+		@synchronized(self) {
+			_totalSeconds -= (expectedSeconds - streamSeconds);
+		}
+	}
+}
+
+- (void) exportInThread:(id)dummy
+{
+	NSAutoreleasePool	*pool			= [[NSAutoreleasePool alloc] init];
+	unsigned			streamIndex;
+	unsigned			i;
+	
+	// Allocate the AudioBufferList for the decoder to use, large enough for any supported channel count
+	// It is reused for every stream processed by this thread
+	AudioBufferList *bufferList = (AudioBufferList *)calloc(sizeof(AudioBufferList) + ((MAX_CHANNELS - 1) * sizeof(AudioBuffer)), 1);
+	NSAssert(NULL != bufferList, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	for(i = 0; i < MAX_CHANNELS; ++i) {
+		bufferList->mBuffers[i].mData = calloc(BUFFER_LENGTH, sizeof(float));
+		NSAssert(NULL != bufferList->mBuffers[i].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+		bufferList->mBuffers[i].mNumberChannels = 1;
+	}
+	
+	while(NSNotFound != (streamIndex = [self nextStreamIndex])) {
+		NSAutoreleasePool	*streamPool		= [[NSAutoreleasePool alloc] init];
+		AudioStream			*stream			= [_streams objectAtIndex:streamIndex];
+		
+#if DEBUG
+		NSDate *streamStart = [NSDate date];
+#endif
+		
+		[self exportStream:stream toURL:[_outputURLs objectAtIndex:streamIndex] bufferList:bufferList];
+		
+#if DEBUG
+		NSTimeInterval elapsed = -[streamStart timeIntervalSinceNow];
+		NSLog(@"Exported %@ in %f seconds (%.1fx realtime)", stream, elapsed, (0 < elapsed ? [[stream duration] doubleValue] / elapsed : 0));
+#endif
+		
+		[streamPool release];
+	}
+	
+	// Free allocated memory
+	for(i = 0; i < MAX_CHANNELS; ++i)
+		free(bufferList->mBuffers[i].mData);
+	free(bufferList);
+	
+	@synchronized(self) {
+		if(0 == --_activeWorkers) {
+			_elapsedTime = -[_startTime timeIntervalSinceNow];
+			
+#if DEBUG
+			NSLog(@"Exported %u of %u streams in %f seconds (%.1fx realtime)", _exportedStreams, [_streams count], _elapsedTime, (0 < _elapsedTime ? _exportedSeconds / _elapsedTime : 0));
+#endif
+		}
+	}
+	
+	[pool release];
+}
+
+@end
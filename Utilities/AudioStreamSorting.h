@@ -0,0 +1,42 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// ========================================
+	// Sorts streams by extracting the value for each sort descriptor once per stream
+	// Strings become collation keys and numbers and dates become raw integers or doubles, which
+	// are then ordered with a stable, multithreaded merge sort
+	// ========================================
+
+	// On return permutation[i] is the index in streams of the i-th stream in sorted order; permutation must hold [streams count] entries
+	// Returns NO if a sort descriptor uses a comparison selector or value type that isn't supported
+	BOOL getSortPermutationForStreams(NSArray *streams, NSArray *sortDescriptors, unsigned *permutation);
+
+	// Falls back to -[NSArray sortedArrayUsingDescriptors:] if the streams can't be sorted with getSortPermutationForStreams
+	NSArray * sortStreamsUsingDescriptors(NSArray *streams, NSArray *sortDescriptors);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,605 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioStreamSorting.h"
+#include <pthread.h>
+
+// Arrays smaller than this are sorted on the calling thread
+#define PARALLEL_SORT_THRESHOLD		16384
+
+// Runs shorter than this are insertion sorted
+#define INSERTION_SORT_THRESHOLD	16
+
+#define LOCAL_MIN(a, b)				((a) < (b) ? (a) : (b))
+#define LOCAL_MAX(a, b)				((a) > (b) ? (a) : (b))
+
+// ========================================
+// Sort key storage
+// ========================================
+enum {
+	eSortKeyTypeNone				= 0,
+	eSortKeyTypeInteger				= 1,
+	eSortKeyTypeDouble				= 2,
+	eSortKeyTypeDate				= 3,
+	eSortKeyTypeCharacters			= 4,
+	eSortKeyTypeCollationKey		= 5
+};
+
+enum {
+	eStringComparisonLiteral					= 0,
+	eStringComparisonCaseInsensitive			= 1,
+	eStringComparisonLocalized					= 2,
+	eStringComparisonLocalizedCaseInsensitive	= 3
+};
+
+typedef union {
+	int64_t		integer;
+	double		real;
+} SortValue;
+
+typedef struct {
+	int					type;
+	int					stringComparison;
+	BOOL				ascending;
+	
+	uint8_t				*isNil;
+	SortValue			*values;
+	
+	// String keys are stored end to end; the key for row i is [keyOffsets[i], keyOffsets[i + 1])
+	void				*keys;
+	size_t				*keyOffsets;
+	size_t				keyCapacity;
+	size_t				keySize;
+	
+	CollatorRef			collator;
+} SortColumn;
+
+typedef struct {
+	const SortColumn	*columns;
+	unsigned			columnCount;
+} SortContext;
+
+typedef struct {
+	const SortContext	*context;
+	uint32_t			*indexes;
+	uint32_t			*scratch;
+	unsigned			count;
+	const uint32_t		*right;
+	unsigned			rightCount;
+	uint32_t			*output;
+} SortTask;
+
+#pragma mark Key extraction
+
+static BOOL
+reserveKeyCapacity(SortColumn *column, size_t capacity)
+{
+	if(capacity <= column->keyCapacity)
+		return YES;
+	
+	size_t newCapacity = LOCAL_MAX(capacity, 2 * column->keyCapacity);
+	void *newKeys = realloc(column->keys, newCapacity * column->keySize);
+	if(NULL == newKeys)
+		return NO;
+	
+	column->keys		= newKeys;
+	column->keyCapacity	= newCapacity;
+	
+	return YES;
+}
+
+static BOOL
+appendStringKey(SortColumn *column, unsigned row, NSString *string)
+{
+	size_t		offset		= column->keyOffsets[row];
+	CFIndex		length		= 0;
+	
+	if(eSortKeyTypeCharacters == column->type) {
+		CFMutableStringRef key = CFStringCreateMutableCopy(kCFAllocatorDefault, 0, (CFStringRef)string);
+		if(NULL == key)
+			return NO;
+		
+		if(eStringComparisonCaseInsensitive == column->stringComparison)
+			CFStringFold(key, kCFCompareCaseInsensitive, NULL);
+		CFStringNormalize(key, kCFStringNormalizationFormD);
+		
+		length = CFStringGetLength(key);
+		if(NO == reserveKeyCapacity(column, offset + length)) {
+			CFRelease(key);
+			return NO;
+		}
+		
+		CFStringGetCharacters(key, CFRangeMake(0, length), (UniChar *)column->keys + offset);
+		CFRelease(key);
+	}
+	else {
+		CFIndex		characterCount	= CFStringGetLength((CFStringRef)string);
+		UniChar		*characters		= malloc(characterCount * sizeof(UniChar));
+		ItemCount	keyLength		= 0;
+		OSStatus	result;
+		
+		if(NULL == characters)
+			return NO;
+		
+		CFStringGetCharacters((CFStringRef)string, CFRangeMake(0, characterCount), characters);
+		
+		// Collation keys are usually a little longer than the text
+		do {
+			if(NO == reserveKeyCapacity(column, offset + (2 * characterCount) + 16)) {
+				free(characters);
+				return NO;
+			}
+			
+			result = UCGetCollationKey(column->collator, characters, characterCount, column->keyCapacity - offset, &keyLength, (UCCollationValue *)column->keys + offset);
+			if(kCollateBufferTooSmall == result && NO == reserveKeyCapacity(column, 2 * column->keyCapacity)) {
+				free(characters);
+				return NO;
+			}
+		} while(kCollateBufferTooSmall == result);
+		
+		free(characters);
+		
+		if(noErr != result)
+			return NO;
+		
+		length = keyLength;
+	}
+	
+	column->keyOffsets[row + 1] = offset + length;
+	
+	return YES;
+}
+
+// Returns NO if the descriptor or the values it yields can't be handled
+static BOOL
+extractSortColumn(SortColumn *column, NSArray *streams, NSSortDescriptor *descriptor)
+{
+	SEL			selector		= [descriptor selector];
+	NSString	*key			= [descriptor key];
+	unsigned	count			= [streams count];
+	unsigned	row, i;
+	
+	if(@selector(compare:) == selector)
+		column->stringComparison = eStringComparisonLiteral;
+	else if(@selector(caseInsensitiveCompare:) == selector)
+		column->stringComparison = eStringComparisonCaseInsensitive;
+	else if(@selector(localizedCompare:) == selector)
+		column->stringComparison = eStringComparisonLocalized;
+	else if(@selector(localizedCaseInsensitiveCompare:) == selector)
+		column->stringComparison = eStringComparisonLocalizedCaseInsensitive;
+	else
+		return NO;
+	
+	column->type		= eSortKeyTypeNone;
+	column->ascending	= [descriptor ascending];
+	column->isNil		= calloc(count, sizeof(uint8_t));
+	column->values		= calloc(count, sizeof(SortValue));
+	column->keyOffsets	= calloc(count + 1, sizeof(size_t));
+	
+	if(NULL == column->isNil || NULL == column->values || NULL == column->keyOffsets)
+		return NO;
+	
+	row = 0;
+	for(id stream in streams) {
+		id value = [stream valueForKeyPath:key];
+		
+		if(nil == value || [NSNull null] == value) {
+			column->isNil[row] = 1;
+			column->keyOffsets[row + 1] = column->keyOffsets[row];
+		}
+		else if([value isKindOfClass:[NSString class]]) {
+			if(eSortKeyTypeNone == column->type) {
+				if(eStringComparisonLocalized <= column->stringComparison) {
+					UCCollateOptions options = kUCCollateStandardOptions;
+					if(eStringComparisonLocalizedCaseInsensitive == column->stringComparison)
+						options |= kUCCollateCaseInsensitiveMask;
+					
+					// A NULL locale uses the current locale
+					if(noErr != UCCreateCollator(NULL, 0, options, &column->collator))
+						return NO;
+					
+					column->type	= eSortKeyTypeCollationKey;
+					column->keySize	= sizeof(UCCollationValue);
+				}
+				else {
+					column->type	= eSortKeyTypeCharacters;
+					column->keySize	= sizeof(UniChar);
+				}
+			}
+			else if(eSortKeyTypeCharacters != column->type && eSortKeyTypeCollationKey != column->type)
+				return NO;
+			
+			if(NO == appendStringKey(column, row, value))
+				return NO;
+		}
+		else if([value isKindOfClass:[NSNumber class]]) {
+			if(eStringComparisonLiteral != column->stringComparison)
+				return NO;
+			
+			const char *objCType = [value objCType];
+			BOOL isReal = ('f' == *objCType || 'd' == *objCType);
+			
+			if(eSortKeyTypeNone == column->type)
+				column->type = (isReal ? eSortKeyTypeDouble : eSortKeyTypeInteger);
+			else if(eSortKeyTypeInteger == column->type && isReal) {
+				// Promote the values seen so far
+				for(i = 0; i < row; ++i) {
+					if(0 == column->isNil[i])
+						column->values[i].real = (double)column->values[i].integer;
+				}
+				column->type = eSortKeyTypeDouble;
+			}
+			else if(eSortKeyTypeInteger != column->type && eSortKeyTypeDouble != column->type)
+				return NO;
+			
+			if(eSortKeyTypeDouble == column->type)
+				column->values[row].real = [value doubleValue];
+			else
+				column->values[row].integer = [value longLongValue];
+			
+			column->keyOffsets[row + 1] = column->keyOffsets[row];
+		}
+		else if([value isKindOfClass:[NSDate class]]) {
+			if(eStringComparisonLiteral != column->stringComparison)
+				return NO;
+			
+			if(eSortKeyTypeNone == column->type)
+				column->type = eSortKeyTypeDate;
+			else if(eSortKeyTypeDate != column->type)
+				return NO;
+			
+			column->values[row].real = [value timeIntervalSinceReferenceDate];
+			column->keyOffsets[row + 1] = column->keyOffsets[row];
+		}
+		else
+			return NO;
+		
+		++row;
+	}
+	
+	return YES;
+}
+
+static void
+freeSortColumn(SortColumn *column)
+{
+	free(column->isNil);
+	free(column->values);
+	free(column->keys);
+	free(column->keyOffsets);
+	
+	if(NULL != column->collator)
+		UCDisposeCollator(&column->collator);
+}
+
+#pragma mark Comparison
+
+static inline int
+compareCharacters(const UniChar *a, size_t aLength, const UniChar *b, size_t bLength)
+{
+	size_t length = LOCAL_MIN(aLength, bLength);
+	size_t i;
+	
+	for(i = 0; i < length; ++i) {
+		if(a[i] != b[i])
+			return (a[i] < b[i] ? -1 : 1);
+	}
+	
+	return (aLength < bLength ? -1 : (aLength > bLength ? 1 : 0));
+}
+
+static int
+compareRows(const SortContext *context, uint32_t a, uint32_t b)
+{
+	unsigned i;
+	
+	for(i = 0; i < context->columnCount; ++i) {
+		const SortColumn	*column		= context->columns + i;
+		int					result		= 0;
+		
+		// nil sorts before everything else
+		if(column->isNil[a] || column->isNil[b])
+			result = (int)column->isNil[b] - (int)column->isNil[a];
+		else {
+			switch(column->type) {
+				case eSortKeyTypeInteger:
+					result = (column->values[a].integer < column->values[b].integer ? -1 : (column->values[a].integer > column->values[b].integer ? 1 : 0));
+					break;
+					
+				case eSortKeyTypeDouble:
+				case eSortKeyTypeDate:
+					result = (column->values[a].real < column->values[b].real ? -1 : (column->values[a].real > column->values[b].real ? 1 : 0));
+					break;
+					
+				case eSortKeyTypeCharacters:
+					result = compareCharacters((const UniChar *)column->keys + column->keyOffsets[a], column->keyOffsets[a + 1] - column->keyOffsets[a],
+											   (const UniChar *)column->keys + column->keyOffsets[b], column->keyOffsets[b + 1] - column->keyOffsets[b]);
+					break;
+					
+				case eSortKeyTypeCollationKey:
+				{
+					Boolean		equivalent	= false;
+					SInt32		order		= 0;
+					
+					UCCompareCollationKeys((const UCCollationValue *)column->keys + column->keyOffsets[a], column->keyOffsets[a + 1] - column->keyOffsets[a],
+										   (const UCCollationValue *)column->keys + column->keyOffsets[b], column->keyOffsets[b + 1] - column->keyOffsets[b],
+										   &equivalent, &order);
+					result = (0 > order ? -1 : (0 < order ? 1 : 0));
+					break;
+				}
+			}
+		}
+		
+		if(0 != result)
+			return (column->ascending ? result : -result);
+	}
+	
+	return 0;
+}
+
+#pragma mark Merge sort
+
+// Ties take from the left run, which keeps the sort stable
+static void
+mergeRuns(const SortContext *context, const uint32_t *left, unsigned leftCount, const uint32_t *right, unsigned rightCount, uint32_t *output)
+{
+	const uint32_t *leftEnd		= left + leftCount;
+	const uint32_t *rightEnd	= right + rightCount;
+	
+	while(left < leftEnd && right < rightEnd)
+		*output++ = (0 >= compareRows(context, *left, *right) ? *left++ : *right++);
+	
+	while(left < leftEnd)
+		*output++ = *left++;
+	
+	while(right < rightEnd)
+		*output++ = *right++;
+}
+
+static void
+mergeSort(const SortContext *context, uint32_t *indexes, uint32_t *scratch, unsigned count)
+{
+	if(INSERTION_SORT_THRESHOLD >= count) {
+		unsigned i, j;
+		for(i = 1; i < count; ++i) {
+			uint32_t index = indexes[i];
+			for(j = i; 0 < j && 0 < compareRows(context, indexes[j - 1], index); --j)
+				indexes[j] = indexes[j - 1];
+			indexes[j] = index;
+		}
+		return;
+	}
+	
+	unsigned half = count / 2;
+	
+	mergeSort(context, indexes, scratch, half);
+	mergeSort(context, indexes + half, scratch + half, count - half);
+	
+	// The runs may already be in order
+	if(0 >= compareRows(context, indexes[half - 1], indexes[half]))
+		return;
+	
+	memcpy(scratch, indexes, count * sizeof(uint32_t));
+	mergeRuns(context, scratch, half, scratch + half, count - half, indexes);
+}
+
+static void *
+sortTaskEntry(void *arg)
+{
+	SortTask *task = (SortTask *)arg;
+	mergeSort(task->context, task->indexes, task->scratch, task->count);
+	return NULL;
+}
+
+static void *
+mergeTaskEntry(void *arg)
+{
+	SortTask *task = (SortTask *)arg;
+	mergeRuns(task->context, task->indexes, task->count, task->right, task->rightCount, task->output);
+	return NULL;
+}
+
+// Runs all but the last task on their own threads and the last on the calling thread
+static void
+runSortTasks(SortTask *tasks, unsigned taskCount, void * (*entry)(void *))
+{
+	pthread_t	*threads	= calloc(taskCount, sizeof(pthread_t));
+	BOOL		*started	= calloc(taskCount, sizeof(BOOL));
+	unsigned	i;
+	
+	for(i = 0; i + 1 < taskCount; ++i) {
+		started[i] = (NULL != threads && NULL != started && 0 == pthread_create(threads + i, NULL, entry, tasks + i));
+		if(NO == started[i])
+			entry(tasks + i);
+	}
+	
+	entry(tasks + taskCount - 1);
+	
+	for(i = 0; i + 1 < taskCount; ++i) {
+		if(started[i])
+			pthread_join(threads[i], NULL);
+	}
+	
+	free(threads);
+	free(started);
+}
+
+static BOOL
+sortIndexes(const SortContext *context, uint32_t *indexes, unsigned count)
+{
+	if(2 > count)
+		return YES;
+	
+	uint32_t	*scratch		= malloc(count * sizeof(uint32_t));
+	unsigned	workerCount		= (PARALLEL_SORT_THRESHOLD > count ? 1 : (unsigned)LOCAL_MAX(MPProcessors(), 1));
+	
+	if(NULL == scratch)
+		return NO;
+	
+	if(1 == workerCount) {
+		mergeSort(context, indexes, scratch, count);
+		free(scratch);
+		return YES;
+	}
+	
+	SortTask	*tasks			= calloc(workerCount, sizeof(SortTask));
+	unsigned	*boundaries		= calloc(workerCount + 1, sizeof(unsigned));
+	unsigned	runCount		= workerCount;
+	uint32_t	*source			= indexes;
+	uint32_t	*destination	= scratch;
+	unsigned	i;
+	
+	if(NULL == tasks || NULL == boundaries) {
+		free(tasks);
+		free(boundaries);
+		free(scratch);
+		return NO;
+	}
+	
+	// Sort one run per processor
+	for(i = 0; i <= workerCount; ++i)
+		boundaries[i] = (unsigned)(((uint64_t)count * i) / workerCount);
+	
+	for(i = 0; i < workerCount; ++i) {
+		tasks[i].context	= context;
+		tasks[i].indexes	= indexes + boundaries[i];
+		tasks[i].scratch	= scratch + boundaries[i];
+		tasks[i].count		= boundaries[i + 1] - boundaries[i];
+	}
+	
+	runSortTasks(tasks, workerCount, sortTaskEntry);
+	
+	// Then merge pairs of runs in parallel until one is left
+	while(1 < runCount) {
+		unsigned mergeCount = runCount / 2;
+		
+		for(i = 0; i < mergeCount; ++i) {
+			tasks[i].context	= context;
+			tasks[i].indexes	= source + boundaries[2 * i];
+			tasks[i].count		= boundaries[(2 * i) + 1] - boundaries[2 * i];
+			tasks[i].right		= source + boundaries[(2 * i) + 1];
+			tasks[i].rightCount	= boundaries[(2 * i) + 2] - boundaries[(2 * i) + 1];
+			tasks[i].output		= destination + boundaries[2 * i];
+		}
+		
+		runSortTasks(tasks, mergeCount, mergeTaskEntry);
+		
+		// An odd run out is carried over unchanged
+		if(runCount & 1)
+			memcpy(destination + boundaries[runCount - 1], source + boundaries[runCount - 1], (count - boundaries[runCount - 1]) * sizeof(uint32_t));
+		
+		for(i = 0; i < mergeCount; ++i)
+			boundaries[i] = boundaries[2 * i];
+		if(runCount & 1)
+			boundaries[mergeCount] = boundaries[runCount - 1];
+		
+		runCount = mergeCount + (runCount & 1);
+		boundaries[runCount] = count;
+		
+		uint32_t *swap	= source;
+		source			= destination;
+		destination		= swap;
+	}
+	
+	if(source != indexes)
+		memcpy(indexes, source, count * sizeof(uint32_t));
+	
+	free(tasks);
+	free(boundaries);
+	free(scratch);
+	
+	return YES;
+}
+
+#pragma mark Public interface
+
+BOOL
+getSortPermutationForStreams(NSArray *streams, NSArray *sortDescriptors, unsigned *permutation)
+{
+	NSCParameterAssert(nil != streams);
+	NSCParameterAssert(nil != sortDescriptors);
+	NSCParameterAssert(NULL != permutation);
+	
+	unsigned		count			= [streams count];
+	unsigned		columnCount		= [sortDescriptors count];
+	SortColumn		*columns		= calloc(LOCAL_MAX(columnCount, 1), sizeof(SortColumn));
+	uint32_t		*indexes		= malloc(LOCAL_MAX(count, 1) * sizeof(uint32_t));
+	BOOL			result			= (NULL != columns && NULL != indexes);
+	unsigned		i;
+	
+	for(i = 0; result && i < columnCount; ++i)
+		result = extractSortColumn(columns + i, streams, [sortDescriptors objectAtIndex:i]);
+	
+	if(result) {
+		SortContext context = { columns, columnCount };
+		
+		for(i = 0; i < count; ++i)
+			indexes[i] = i;
+		
+		result = sortIndexes(&context, indexes, count);
+		
+		for(i = 0; result && i < count; ++i)
+			permutation[i] = indexes[i];
+	}
+	
+	for(i = 0; NULL != columns && i < columnCount; ++i)
+		freeSortColumn(columns + i);
+	
+	free(columns);
+	free(indexes);
+	
+	return result;
+}
+
+NSArray *
+sortStreamsUsingDescriptors(NSArray *streams, NSArray *sortDescriptors)
+{
+	NSCParameterAssert(nil != streams);
+	
+	unsigned count = [streams count];
+	
+	if(0 == [sortDescriptors count] || 2 > count)
+		return [NSArray arrayWithArray:streams];
+	
+	NSArray		*sortedStreams		= nil;
+	unsigned	*permutation		= malloc(count * sizeof(unsigned));
+	id			*objects			= malloc(count * sizeof(id));
+	id			*sortedObjects		= malloc(count * sizeof(id));
+	
+	NSCAssert(NULL != permutation && NULL != objects && NULL != sortedObjects, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	if(getSortPermutationForStreams(streams, sortDescriptors, permutation)) {
+		unsigned i;
+		
+		[streams getObjects:objects range:NSMakeRange(0, count)];
+		for(i = 0; i < count; ++i)
+			sortedObjects[i] = objects[permutation[i]];
+		
+		sortedStreams = [NSArray arrayWithObjects:sortedObjects count:count];
+	}
+	else
+		sortedStreams = [streams sortedArrayUsingDescriptors:sortDescriptors];
+	
+	free(permutation);
+	free(objects);
+	free(sortedObjects);
+	
+	return sortedStreams;
+}
@@ -24,76 +24,307 @@
 #import "AudioPropertiesReader.h"
 #import "AudioMetadataReader.h"
 
-BOOL 
-scanPossiblyQuotedString(NSScanner		*scanner, 
-						 NSString		**string)
-{
-	NSCParameterAssert(nil != scanner);
+#include <strings.h>
 
-	// Consume leading whitespace (manually)
-	NSCharacterSet *whitespaceCharacterSet = [NSCharacterSet whitespaceCharacterSet];
-	while([[scanner string] length] > [scanner scanLocation] && [whitespaceCharacterSet characterIsMember:[[scanner string] characterAtIndex:[scanner scanLocation]]])
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
+#define IS_BLANK(c)				(' ' == (c) || '\t' == (c))
+#define IS_NEWLINE(c)			('\r' == (c) || '\n' == (c))
 
-	if([[scanner string] length] == [scanner scanLocation])
-		return NO;
-	
-	// Handle quoted strings
-	BOOL quotedString = (0x0022 == [[scanner string] characterAtIndex:[scanner scanLocation]]);
+// Start and INDEX positions for one track, gathered while parsing
+typedef struct {
+	BOOL			hasIndex1;
+	unsigned		fileIndex;				// The file containing INDEX 01
+	long long		index1Sector;
 	
-	if(quotedString) {
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
+	BOOL			hasIndex0;
+	unsigned		pregapFileIndex;		// The file containing INDEX 00
+	long long		index0Sector;
+} CueSheetTrackIndexes;
 
-		if(NO == [scanner scanUpToString:@"\"" intoString:string])
+#pragma mark Encoding Detection
+
+// Only checks the structure of multibyte sequences, which is enough to tell UTF-8 from legacy encodings
+static BOOL
+isValidUTF8(const uint8_t		*bytes,
+			size_t				length)
+{
+	size_t i = 0;
+	
+	while(i < length) {
+		uint8_t		c					= bytes[i];
+		unsigned	continuationBytes	= 0;
+		unsigned	j;
+		
+		if(0x80 > c) {
+			++i;
+			continue;
+		}
+		else if(0xC2 <= c && 0xDF >= c)
+			continuationBytes = 1;
+		else if(0xE0 <= c && 0xEF >= c)
+			continuationBytes = 2;
+		else if(0xF0 <= c && 0xF4 >= c)
+			continuationBytes = 3;
+		else
 			return NO;
 		
-		// Ensure string is terminated
-		if([[scanner string] length] > [scanner scanLocation] && 0x0022 == [[scanner string] characterAtIndex:[scanner scanLocation]])
-			[scanner setScanLocation:(1 + [scanner scanLocation])];
-		else {
-			*string = NULL;
+		if(i + continuationBytes >= length)
 			return NO;
+		
+		for(j = 1; j <= continuationBytes; ++j) {
+			if(0x80 != (0xC0 & bytes[i + j]))
+				return NO;
 		}
+		
+		i += 1 + continuationBytes;
 	}
-	else if(NO == [scanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:string])
-		return NO;
-
+	
 	return YES;
 }
 
-BOOL 
-scanMSF(NSScanner		*scanner, 
-		int				*minute,
-		int				*second,
-		int				*frame)
+// Every high byte must be part of a valid double-byte character, and most of those characters
+// must look like Japanese text: runs of characters, or trail bytes outside the ASCII range.
+// Isolated Latin-1 accented letters followed by ASCII would otherwise pass as Shift-JIS.
+static BOOL
+looksLikeShiftJIS(const uint8_t		*bytes,
+				  size_t			length)
 {
-	NSCParameterAssert(nil != scanner);
+	size_t		i						= 0;
+	unsigned	characters				= 0;
+	unsigned	japaneseCharacters		= 0;
+	BOOL		previousWasCharacter	= NO;
 	
-	if(NO == [scanner scanInt:minute])
-		return NO;
+	while(i < length) {
+		uint8_t c = bytes[i];
+		
+		// ASCII and half-width katakana are single bytes
+		if(0x80 > c || (0xA1 <= c && 0xDF >= c)) {
+			previousWasCharacter = NO;
+			++i;
+			continue;
+		}
+		
+		if(((0x81 <= c && 0x9F >= c) || (0xE0 <= c && 0xFC >= c)) && i + 1 < length) {
+			uint8_t trail = bytes[i + 1];
+			
+			if((0x40 <= trail && 0x7E >= trail) || (0x80 <= trail && 0xFC >= trail)) {
+				++characters;
+				if(previousWasCharacter || 0x80 <= trail || (i + 2 < length && 0x80 <= bytes[i + 2]))
+					++japaneseCharacters;
+				
+				previousWasCharacter = YES;
+				i += 2;
+				continue;
+			}
+		}
 		
-	if([[scanner string] length] > [scanner scanLocation] && 0x003A == [[scanner string] characterAtIndex:[scanner scanLocation]])
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
-	else
 		return NO;
+	}
+	
+	return (0 != characters && 2 * japaneseCharacters >= characters);
+}
+
+// Returns the encoding of the cue sheet and the length of any byte order mark
+static NSStringEncoding
+detectCueSheetEncoding(const uint8_t		*bytes,
+					   size_t				length,
+					   size_t				*byteOrderMarkLength)
+{
+	*byteOrderMarkLength = 0;
+	
+	if(3 <= length && 0xEF == bytes[0] && 0xBB == bytes[1] && 0xBF == bytes[2]) {
+		*byteOrderMarkLength = 3;
+		return NSUTF8StringEncoding;
+	}
+	
+	if(2 <= length && ((0xFF == bytes[0] && 0xFE == bytes[1]) || (0xFE == bytes[0] && 0xFF == bytes[1])))
+		return NSUnicodeStringEncoding;
+	
+	if(isValidUTF8(bytes, length))
+		return NSUTF8StringEncoding;
+	
+	if(looksLikeShiftJIS(bytes, length))
+		return CFStringConvertEncodingToNSStringEncoding(kCFStringEncodingDOSJapanese);
+	
+	// Cue sheets written on Windows in Western locales
+	return NSWindowsCP1252StringEncoding;
+}
 
-	if(NO == [scanner scanInt:second])
+#pragma mark Tokenizing
+
+// Returns the next quoted or whitespace-delimited token on the line, advancing the cursor past it
+static BOOL
+nextToken(const uint8_t			**cursor,
+		  const uint8_t			*lineEnd,
+		  const uint8_t			**token,
+		  size_t				*tokenLength)
+{
+	const uint8_t *p = *cursor;
+	
+	while(p < lineEnd && IS_BLANK(*p))
+		++p;
+	
+	*cursor = p;
+	
+	if(p == lineEnd)
 		return NO;
+	
+	if('"' == *p) {
+		const uint8_t *start = ++p;
+		
+		while(p < lineEnd && '"' != *p)
+			++p;
+		
+		// Ensure string is terminated
+		if(p == lineEnd)
+			return NO;
+		
+		*token			= start;
+		*tokenLength	= p - start;
+		*cursor			= p + 1;
+		
+		return YES;
+	}
+	
+	const uint8_t *start = p;
+	
+	while(p < lineEnd && NO == IS_BLANK(*p))
+		++p;
+	
+	*token			= start;
+	*tokenLength	= p - start;
+	*cursor			= p;
+	
+	return YES;
+}
+
+static BOOL
+tokenIsKeyword(const uint8_t		*token,
+			   size_t				tokenLength,
+			   const char			*keyword)
+{
+	size_t keywordLength = strlen(keyword);
+	return (tokenLength == keywordLength && 0 == strncasecmp((const char *)token, keyword, keywordLength));
+}
 
-	if([[scanner string] length] > [scanner scanLocation] && 0x003A == [[scanner string] characterAtIndex:[scanner scanLocation]])
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
-	else
+static BOOL
+parseUnsigned(const uint8_t		*token,
+			  size_t			tokenLength,
+			  unsigned			*value)
+{
+	size_t i;
+	
+	if(0 == tokenLength || 9 < tokenLength)
 		return NO;
 	
-	if(NO == [scanner scanInt:frame])
+	*value = 0;
+	for(i = 0; i < tokenLength; ++i) {
+		if('0' > token[i] || '9' < token[i])
+			return NO;
+		
+		*value = (10 * *value) + (token[i] - '0');
+	}
+	
+	return YES;
+}
+
+// Parses mm:ss:ff into a count of CD sectors (75 per second)
+static BOOL
+parseMSF(const uint8_t		*token,
+		 size_t				tokenLength,
+		 long long			*sector)
+{
+	unsigned	msf [3];
+	unsigned	field	= 0;
+	size_t		start	= 0;
+	size_t		i;
+	
+	for(i = 0; i <= tokenLength; ++i) {
+		if(i < tokenLength && ':' != token[i])
+			continue;
+		
+		if(3 == field || NO == parseUnsigned(token + start, i - start, &msf[field]))
+			return NO;
+		
+		++field;
+		start = i + 1;
+	}
+	
+	if(3 != field)
 		return NO;
 	
+	*sector = (((60 * (long long)msf[0]) + msf[1]) * 75) + msf[2];
+	
 	return YES;
 }
 
+// Returns a token as a string in the cue sheet's encoding
+static NSString *
+stringForToken(const uint8_t		*token,
+			   size_t				tokenLength,
+			   NSStringEncoding		encoding)
+{
+	NSString *string = [[NSString alloc] initWithBytes:token length:tokenLength encoding:encoding];
+	
+	// A few bytes are undefined in Windows Latin 1
+	if(nil == string && NSWindowsCP1252StringEncoding == encoding)
+		string = [[NSString alloc] initWithBytes:token length:tokenLength encoding:NSISOLatin1StringEncoding];
+	
+	return [string autorelease];
+}
+
+// Quoted strings are returned without the quotes, and an unquoted string runs to the end of the line
+// The trailing file type is dropped from unquoted FILE names
+static NSString *
+nextString(const uint8_t			**cursor,
+		   const uint8_t			*lineEnd,
+		   NSStringEncoding			encoding,
+		   BOOL						dropLastWord)
+{
+	const uint8_t	*token			= NULL;
+	size_t			tokenLength		= 0;
+	const uint8_t	*p				= *cursor;
+	
+	while(p < lineEnd && IS_BLANK(*p))
+		++p;
+	
+	if(p == lineEnd)
+		return nil;
+	
+	if('"' == *p) {
+		if(NO == nextToken(cursor, lineEnd, &token, &tokenLength))
+			return nil;
+		
+		return stringForToken(token, tokenLength, encoding);
+	}
+	
+	const uint8_t *valueEnd = lineEnd;
+	
+	while(valueEnd > p && IS_BLANK(valueEnd[-1]))
+		--valueEnd;
+	
+	if(dropLastWord) {
+		const uint8_t *lastWord = valueEnd;
+		
+		while(lastWord > p && NO == IS_BLANK(lastWord[-1]))
+			--lastWord;
+		
+		if(lastWord > p) {
+			valueEnd = lastWord;
+			
+			while(valueEnd > p && IS_BLANK(valueEnd[-1]))
+				--valueEnd;
+		}
+	}
+	
+	*cursor = lineEnd;
+	
+	return stringForToken(p, valueEnd - p, encoding);
+}
+
 @interface CueSheetParser (Private)
 
 - (BOOL) parse:(NSError **)error;
+- (BOOL) readFile:(NSURL *)fileURL properties:(NSDictionary **)properties metadata:(NSDictionary **)metadata error:(NSError **)error;
 
 @end
 
@@ -137,198 +368,266 @@ scanMSF(NSScanner		*scanner,
 
 @implementation CueSheetParser (Private)
 
-// Since cue sheets are simple, just use NSScanner in lieu of a full-blown lemon parser
+// Cue sheets are tokenized directly from the file's bytes in a single pass; strings are only created for values that are kept
 // This is a bare-bones implementation that ignores many commands we're not interested in
 // This is also an extremely lenient parser, ignoring most "rules" from http://digitalx.org/cuesheetsyntax.php
 - (BOOL) parse:(NSError **)error
 {
-	// Attempt to read the cue sheet as a string for parsing
-	NSString *fileContents = [NSString stringWithContentsOfURL:_URL encoding:NSUTF8StringEncoding error:error];
-	if(nil == fileContents)
-		return NO;		
+	NSData *data = [NSData dataWithContentsOfURL:_URL options:NSMappedRead error:error];
+	if(nil == data)
+		return NO;
+	
+	const uint8_t		*bytes					= [data bytes];
+	size_t				length					= [data length];
+	size_t				byteOrderMarkLength		= 0;
+	NSStringEncoding	encoding				= detectCueSheetEncoding(bytes, length, &byteOrderMarkLength);
+	
+	// UTF-16 cue sheets are converted to UTF-8 so the tokenizer only has to handle ASCII-compatible encodings
+	if(NSUnicodeStringEncoding == encoding) {
+		NSString *fileContents = [[[NSString alloc] initWithData:data encoding:NSUnicodeStringEncoding] autorelease];
+		if(nil == fileContents)
+			return NO;
+		
+		data		= [fileContents dataUsingEncoding:NSUTF8StringEncoding];
+		bytes		= [data bytes];
+		length		= [data length];
+		encoding	= NSUTF8StringEncoding;
+	}
 	
 	NSMutableDictionary		*cueSheet			= [NSMutableDictionary dictionary];
 	NSMutableArray			*cueSheetTracks		= [NSMutableArray array];
+	NSMutableData			*trackIndexes		= [NSMutableData data];
 	NSMutableDictionary		*currentTrack		= nil;
-
-	// The current file
-	NSURL					*fileURL			= nil;
-	AudioPropertiesReader	*propertiesReader	= nil;
-	AudioMetadataReader		*metadataReader		= nil;
 	
-	// Create a newline character set
-	unichar			rawNewlineCharacters []		= { 0x000D, 0x000A, 0x0085 };
-	NSString		*newlineCharacters			= [NSString stringWithCharacters:rawNewlineCharacters length:3];
-	NSCharacterSet	*newlineCharacterSet		= [NSCharacterSet characterSetWithCharactersInString:newlineCharacters];
+	// Each file is listed once, no matter how many FILE commands refer to it
+	NSMutableArray			*fileURLs			= [NSMutableArray array];
+	NSUInteger				currentFileIndex	= NSNotFound;
+	
+	const uint8_t			*end				= bytes + length;
+	const uint8_t			*nextLine			= bytes + byteOrderMarkLength;
 	
 	// Parse the cue sheet one line at a time
-	NSScanner	*fileScanner	= [NSScanner scannerWithString:fileContents];
-	NSString	*line			= nil;
-
-	while(NO == [fileScanner isAtEnd] && [fileScanner scanUpToCharactersFromSet:newlineCharacterSet intoString:&line]) {
-		// Parse the line
-		NSScanner	*lineScanner	= [NSScanner scannerWithString:line];
-		NSString	*command		= nil;
+	while(nextLine < end) {
+		const uint8_t *lineStart	= nextLine;
+		const uint8_t *lineEnd		= lineStart;
+		
+		while(lineEnd < end && NO == IS_NEWLINE(*lineEnd))
+			++lineEnd;
+		
+		nextLine = lineEnd;
+		while(nextLine < end && IS_NEWLINE(*nextLine))
+			++nextLine;
+		
+		const uint8_t	*cursor			= lineStart;
+		const uint8_t	*command		= NULL;
+		size_t			commandLength	= 0;
+		const uint8_t	*token			= NULL;
+		size_t			tokenLength		= 0;
 		
 		// Grab the cue sheet command
-		if(NO == [lineScanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:&command])
+		if(NO == nextToken(&cursor, lineEnd, &command, &commandLength))
 			continue;
 		
 		// Handle each cue sheet command
-		if([command isEqualToString:@"CATALOG"]) {
-			NSString *mcn = nil;
-			if([lineScanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:&mcn])
-				[cueSheet setValue:mcn forKey:MetadataMCNKey];
+		if(tokenIsKeyword(command, commandLength, "CATALOG")) {
+			if(nextToken(&cursor, lineEnd, &token, &tokenLength))
+				[cueSheet setValue:stringForToken(token, tokenLength, encoding) forKey:MetadataMCNKey];
 		}
-		else if([command isEqualToString:@"CDTEXTFILE"])
+		else if(tokenIsKeyword(command, commandLength, "CDTEXTFILE"))
 			;
-		else if([command isEqualToString:@"FILE"]) {
-			NSString *filename = nil;
+		else if(tokenIsKeyword(command, commandLength, "FILE")) {
+			NSString *filename = nextString(&cursor, lineEnd, encoding, YES);
+			if(nil == filename)
+				return NO;
 			
-			if(scanPossiblyQuotedString(lineScanner, &filename)) {
-				// If the file doesn't exist as an absolute path attempt to resolve it
-				if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filename]) {
-					NSString	*cueSheetPath	= [[_URL path] stringByDeletingLastPathComponent];
-					NSString	*filenamePath	= [cueSheetPath stringByAppendingPathComponent:filename];
-
-					if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filenamePath])
-						return NO;
-					else
-						filename = filenamePath;
-				}
-				
-				fileURL = [NSURL fileURLWithPath:filename];
-				
-				// Read the properties for the file
-				propertiesReader = [AudioPropertiesReader propertiesReaderForURL:fileURL error:error];
-				if(nil == propertiesReader)
-					return NO;
-				
-				if(NO == [propertiesReader readProperties:error])
-					return NO;
+			// If the file doesn't exist as an absolute path attempt to resolve it
+			if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filename]) {
+				NSString	*cueSheetPath	= [[_URL path] stringByDeletingLastPathComponent];
+				NSString	*filenamePath	= [cueSheetPath stringByAppendingPathComponent:filename];
 				
-				metadataReader = [AudioMetadataReader metadataReaderForURL:fileURL error:error];
-				if(nil == metadataReader)
-					return NO;
-				
-				if(NO == [metadataReader readMetadata:error])
+				if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filenamePath])
 					return NO;
+				else
+					filename = filenamePath;
+			}
+			
+			NSURL *fileURL = [NSURL fileURLWithPath:filename];
+			
+			currentFileIndex = [fileURLs indexOfObject:fileURL];
+			if(NSNotFound == currentFileIndex) {
+				currentFileIndex = [fileURLs count];
+				[fileURLs addObject:fileURL];
 			}
-			else
-				return NO;
 			
-			// Ignore anything after the filename; we don't care what type it is or the format
+			// The properties aren't read until the whole sheet is parsed, and only for files containing tracks
 		}
-		else if([command isEqualToString:@"FLAGS"])
+		else if(tokenIsKeyword(command, commandLength, "FLAGS"))
 			;
-		else if([command isEqualToString:@"INDEX"]) {
+		else if(tokenIsKeyword(command, commandLength, "INDEX")) {
 			if(nil == currentTrack)
 				continue;
 			
-			int indexNumber = 0;
-			if(NO == [lineScanner scanInt:&indexNumber])
+			unsigned	indexNumber		= 0;
+			long long	sector			= 0;
+			
+			if(NO == nextToken(&cursor, lineEnd, &token, &tokenLength) || NO == parseUnsigned(token, tokenLength, &indexNumber))
 				continue;
 			
-			// Index 0 is pregap (ignored)
-			if(1 == indexNumber) {
-				int minute = 0, second = 0, frame = 0;
-				if(NO == scanMSF(lineScanner, &minute, &second, &frame))
-					continue;
-				
-				unsigned	framesPerSector		= [[[propertiesReader properties] valueForKey:PropertiesSampleRateKey] floatValue] / 75;
-				unsigned	startingSector		= (((60 * minute) + second) * 75) + frame;
-				long long	startingFrame		= startingSector * framesPerSector;
-				long long	totalFrames			= [[[propertiesReader properties] valueForKey:PropertiesTotalFramesKey] longLongValue];
-				
-				// Sanity check
-				if(startingFrame >= totalFrames)
-					continue;
-				
-				[currentTrack setValue:[NSNumber numberWithLongLong:startingFrame] forKey:StreamStartingFrameKey];
+			if(NO == nextToken(&cursor, lineEnd, &token, &tokenLength) || NO == parseMSF(token, tokenLength, &sector))
+				continue;
+			
+			CueSheetTrackIndexes *indexes = (CueSheetTrackIndexes *)[trackIndexes mutableBytes] + ([cueSheetTracks count] - 1);
+			
+			// Index 0 is the pregap, index 1 starts the track and any others are subindexes (ignored)
+			if(0 == indexNumber) {
+				indexes->hasIndex0			= YES;
+				indexes->pregapFileIndex	= currentFileIndex;
+				indexes->index0Sector		= sector;
+			}
+			else if(1 == indexNumber) {
+				indexes->hasIndex1			= YES;
+				indexes->fileIndex			= currentFileIndex;
+				indexes->index1Sector		= sector;
 			}
 		}
-		else if([command isEqualToString:@"ISRC"]) {
+		else if(tokenIsKeyword(command, commandLength, "ISRC")) {
 			if(nil == currentTrack)
 				continue;
-
-			NSString *isrc = nil;
-			if([lineScanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:&isrc])
-				[currentTrack setValue:isrc forKey:MetadataISRCKey];
+			
+			if(nextToken(&cursor, lineEnd, &token, &tokenLength))
+				[currentTrack setValue:stringForToken(token, tokenLength, encoding) forKey:MetadataISRCKey];
 		}
-		else if([command isEqualToString:@"PERFORMER"]) {
-			NSString *performer = nil;
-			if(scanPossiblyQuotedString(lineScanner, &performer)) {
+		else if(tokenIsKeyword(command, commandLength, "PERFORMER")) {
+			NSString *performer = nextString(&cursor, lineEnd, encoding, NO);
+			if(nil != performer) {
 				if(nil == currentTrack)
 					[cueSheet setValue:performer forKey:MetadataArtistKey];
 				else
 					[currentTrack setValue:performer forKey:MetadataArtistKey];
 			}
 		}
-		else if([command isEqualToString:@"POSTGAP"])
+		else if(tokenIsKeyword(command, commandLength, "POSTGAP"))
 			;
-		else if([command isEqualToString:@"PREGAP"])
+		else if(tokenIsKeyword(command, commandLength, "PREGAP"))
 			;
-		else if([command isEqualToString:@"REM"])
+		else if(tokenIsKeyword(command, commandLength, "REM"))
 			;
-		else if([command isEqualToString:@"SONGWRITER"]) {
-			NSString *songwriter = nil;
-			if(scanPossiblyQuotedString(lineScanner, &songwriter)) {
+		else if(tokenIsKeyword(command, commandLength, "SONGWRITER")) {
+			NSString *songwriter = nextString(&cursor, lineEnd, encoding, NO);
+			if(nil != songwriter) {
 				if(nil == currentTrack)
 					[cueSheet setValue:songwriter forKey:MetadataComposerKey];
 				else
 					[currentTrack setValue:songwriter forKey:MetadataComposerKey];
 			}
 		}
-		else if([command isEqualToString:@"TITLE"]) {
-			NSString *title = nil;
-			
-			if(scanPossiblyQuotedString(lineScanner, &title)) {
+		else if(tokenIsKeyword(command, commandLength, "TITLE")) {
+			NSString *title = nextString(&cursor, lineEnd, encoding, NO);
+			if(nil != title) {
 				if(nil == currentTrack)
 					[cueSheet setValue:title forKey:MetadataAlbumTitleKey];
 				else
 					[currentTrack setValue:title forKey:MetadataTitleKey];
 			}
 		}
-		else if([command isEqualToString:@"TRACK"]) {
+		else if(tokenIsKeyword(command, commandLength, "TRACK")) {
 			currentTrack = nil;
 			
-			if(nil == fileURL)
+			if(NSNotFound == currentFileIndex)
 				continue;
 			
-			int trackNumber = 0;
-			if(NO == [lineScanner scanInt:&trackNumber])
+			unsigned trackNumber = 0;
+			if(NO == nextToken(&cursor, lineEnd, &token, &tokenLength) || NO == parseUnsigned(token, tokenLength, &trackNumber))
 				continue;
-
-			NSString *trackType = nil;			
-			if(NO == scanPossiblyQuotedString(lineScanner, &trackType) || NO == [trackType isEqualToString:@"AUDIO"])
+			
+			if(NO == nextToken(&cursor, lineEnd, &token, &tokenLength) || NO == tokenIsKeyword(token, tokenLength, "AUDIO"))
 				continue;
-				
-			currentTrack = [NSMutableDictionary dictionaryWithObject:fileURL forKey:StreamURLKey];
-
-			[currentTrack setValue:[NSNumber numberWithInt:trackNumber] forKey:MetadataTrackNumberKey];
-			[currentTrack addEntriesFromDictionary:[propertiesReader properties]];
-			[currentTrack addEntriesFromDictionary:[metadataReader metadata]];
 			
+			currentTrack = [NSMutableDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInt:trackNumber] forKey:MetadataTrackNumberKey];
 			[cueSheetTracks addObject:currentTrack];
+			
+			CueSheetTrackIndexes indexes;
+			bzero(&indexes, sizeof(indexes));
+			[trackIndexes appendBytes:&indexes length:sizeof(indexes)];
 		}
 		else
-			NSLog(@"Unknown cue sheet command: \"%@\"", command);
+			NSLog(@"Unknown cue sheet command: \"%@\"", stringForToken(command, commandLength, encoding));
+	}
+	
+	// Read the properties and metadata once for each file containing the start of a track
+	const CueSheetTrackIndexes	*indexes			= (const CueSheetTrackIndexes *)[trackIndexes bytes];
+	NSMutableArray				*fileProperties		= [NSMutableArray array];
+	NSMutableArray				*fileMetadata		= [NSMutableArray array];
+	unsigned					i;
+	
+	for(i = 0; i < [fileURLs count]; ++i) {
+		[fileProperties addObject:[NSNull null]];
+		[fileMetadata addObject:[NSNull null]];
+	}
+	
+	for(i = 0; i < [cueSheetTracks count]; ++i) {
+		if(NO == indexes[i].hasIndex1 || [NSNull null] != [fileProperties objectAtIndex:indexes[i].fileIndex])
+			continue;
+		
+		NSDictionary	*properties		= nil;
+		NSDictionary	*metadata		= nil;
+		
+		if(NO == [self readFile:[fileURLs objectAtIndex:indexes[i].fileIndex] properties:&properties metadata:&metadata error:error])
+			return NO;
 		
-		// Consume any newlines in preparation for scanning the next line
-		[fileScanner scanCharactersFromSet:newlineCharacterSet intoString:NULL];
+		[fileProperties replaceObjectAtIndex:indexes[i].fileIndex withObject:properties];
+		[fileMetadata replaceObjectAtIndex:indexes[i].fileIndex withObject:metadata];
 	}
 	
-	// Iterate through the tracks and update the frame counts
-	unsigned i;
+	// Build the tracks, starting each one at INDEX 01 of the file containing it
+	NSMutableArray	*tracks					= [NSMutableArray array];
+	NSUInteger		previousFileIndex		= NSNotFound;
+	
 	for(i = 0; i < [cueSheetTracks count]; ++i) {
-		NSMutableDictionary *thisTrack = [cueSheetTracks objectAtIndex:i];
-
-		[thisTrack addEntriesFromDictionary:cueSheet];
+		if(NO == indexes[i].hasIndex1)
+			continue;
+		
+		NSDictionary	*properties			= [fileProperties objectAtIndex:indexes[i].fileIndex];
+		unsigned		framesPerSector		= [[properties valueForKey:PropertiesSampleRateKey] floatValue] / 75;
+		long long		totalFrames			= [[properties valueForKey:PropertiesTotalFramesKey] longLongValue];
+		long long		startingFrame		= indexes[i].index1Sector * framesPerSector;
+		unsigned		pregapFrameCount	= 0;
+		
+		// A pregap at the start of a file can't be appended to the previous track, so it is played with its own track
+		// The track still starts at INDEX 01, since streams are identified by their location
+		if(indexes[i].hasIndex0 && indexes[i].pregapFileIndex == indexes[i].fileIndex && indexes[i].index0Sector < indexes[i].index1Sector && previousFileIndex != indexes[i].fileIndex)
+			pregapFrameCount = (indexes[i].index1Sector - indexes[i].index0Sector) * framesPerSector;
+		
+		// Sanity check
+		if(startingFrame >= totalFrames)
+			continue;
+		
+		// Values from the cue sheet take precedence over the file's tags, and track values over album values
+		NSMutableDictionary *track = [NSMutableDictionary dictionaryWithObject:[fileURLs objectAtIndex:indexes[i].fileIndex] forKey:StreamURLKey];
+		
+		[track addEntriesFromDictionary:properties];
+		[track addEntriesFromDictionary:[fileMetadata objectAtIndex:indexes[i].fileIndex]];
+		[track addEntriesFromDictionary:cueSheet];
+		[track addEntriesFromDictionary:[cueSheetTracks objectAtIndex:i]];
+		[track setValue:[NSNumber numberWithLongLong:startingFrame] forKey:StreamStartingFrameKey];
+		
+		if(0 != pregapFrameCount)
+			[track setValue:[NSNumber numberWithUnsignedInt:pregapFrameCount] forKey:StreamPregapFrameCountKey];
+		
+		[tracks addObject:track];
+		
+		previousFileIndex = indexes[i].fileIndex;
+	}
+	
+	// Iterate through the tracks and update the frame counts
+	// The arithmetic is unchanged so tracks already in the library are still recognized
+	for(i = 0; i < [tracks count]; ++i) {
+		NSMutableDictionary *thisTrack = [tracks objectAtIndex:i];
 		
 		NSMutableDictionary *previousTrack = nil;
 		if(0 != i)
-			previousTrack = [cueSheetTracks objectAtIndex:(i - 1)];
-
+			previousTrack = [tracks objectAtIndex:(i - 1)];
+		
 		// Fill in frame counts
 		if(nil != previousTrack && [[previousTrack valueForKey:StreamURLKey] isEqual:[thisTrack valueForKey:StreamURLKey]]) {
 			unsigned frameCount = ([[thisTrack valueForKey:StreamStartingFrameKey] longLongValue] - 1) - [[previousTrack valueForKey:StreamStartingFrameKey] longLongValue];
@@ -336,7 +635,7 @@ scanMSF(NSScanner		*scanner,
 			[previousTrack setValue:[NSNumber numberWithUnsignedInt:frameCount] forKey:StreamFrameCountKey];
 		}
 		
-		// Special handling for last tracks
+		// Special handling for the last track in each file
 		if(nil == [thisTrack valueForKey:StreamFrameCountKey]) {
 			unsigned frameCount = [[thisTrack valueForKey:PropertiesTotalFramesKey] unsignedIntValue] - [[thisTrack valueForKey:StreamStartingFrameKey] longLongValue] + 1;
 			
@@ -344,7 +643,41 @@ scanMSF(NSScanner		*scanner,
 		}
 	}
 	
-	_cueSheetTracks = [cueSheetTracks copy];
+	_cueSheetTracks = [tracks copy];
+	
+	return YES;
+}
+
+- (BOOL) readFile:(NSURL *)fileURL properties:(NSDictionary **)properties metadata:(NSDictionary **)metadata error:(NSError **)error
+{
+	NSParameterAssert(nil != fileURL);
+	NSParameterAssert(NULL != properties);
+	NSParameterAssert(NULL != metadata);
+	
+	AudioPropertiesReader *propertiesReader = [AudioPropertiesReader propertiesReaderForURL:fileURL error:error];
+	if(nil == propertiesReader)
+		return NO;
+	
+	if(NO == [propertiesReader readProperties:error])
+		return NO;
+	
+	*properties = [propertiesReader properties];
+	
+	// Some properties readers supply the metadata from the same pass over the file
+	if(nil != [propertiesReader metadata]) {
+		*metadata = [propertiesReader metadata];
+		return YES;
+	}
+	
+	AudioMetadataReader *metadataReader = [AudioMetadataReader metadataReaderForURL:fileURL error:error];
+	if(nil == metadataReader)
+		return NO;
+	
+	if(NO == [metadataReader readMetadata:error])
+		return NO;
+	
+	// Readers for formats without metadata succeed without supplying any
+	*metadata = (nil == [metadataReader metadata] ? [NSDictionary dictionary] : [metadataReader metadata]);
 	
 	return YES;
 }
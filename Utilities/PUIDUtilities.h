@@ -30,6 +30,9 @@ extern "C" {
 
 	void calculateFingerprintAndRequestPUID(AudioStream *stream, NSModalSession modalSession);
 	void calculateFingerprintsAndRequestPUIDs(NSArray *streams, NSModalSession modalSession);
+
+	// Fingerprint the streams and calculate their ReplayGain and loudness in a single decode
+	void analyzeStreamsAndRequestPUIDs(NSArray *streams, BOOL calculateAlbumGain, NSModalSession modalSession);
 	
 #ifdef __cplusplus
 }
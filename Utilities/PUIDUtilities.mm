@@ -20,23 +20,177 @@
 
 #import "PUIDUtilities.h"
 #import "AudioStream.h"
+#import "AudioAnalysis.h"
+#import "ReplayGainUtilities.h"
 
 #include <ofa1/ofa.h>
 #include "protocol.h"
 
 #include <SystemConfiguration/SCNetwork.h>
+#include <CoreServices/CoreServices.h>
+#include <mach/mach.h>
+#include <pthread.h>
 
 #define LOCAL_MAX(a, b)			((a) > (b) ? (a) : (b))
 #define LOCAL_MIN(a, b)			((a) < (b) ? (a) : (b))
-#define BUFFER_LENGTH			4096
 #define SECONDS_TO_PROCESS		135
 #define PLAY_CLIENT_ID			"79245705acce76cd5e0e2143fce6a8a1"
 
+#define MAX_LOOKUP_ATTEMPTS		3
+#define LOOKUP_RETRY_DELAY		2.0
+
+// ========================================
+// A fingerprint awaiting a PUID lookup
+// ========================================
+@interface PUIDLookup : NSObject
+{
+	AudioStream		*_stream;
+	NSString		*_fingerprint;
+	NSString		*_format;
+	long			_milliseconds;
+	unsigned		_attempts;
+	NSDate			*_notBefore;
+}
+- (id) initWithStream:(AudioStream *)stream fingerprint:(NSString *)fingerprint format:(NSString *)format milliseconds:(long)milliseconds;
+
+- (AudioStream *) stream;
+- (NSString *) fingerprint;
+- (NSString *) format;
+- (long) milliseconds;
+
+- (unsigned) attempts;
+- (void) failedAttempt;
+
+- (BOOL) isReady;
+@end
+
+// ========================================
+// The libofa sample buffer for each analysis worker thread
+// Analyzers are created for each stream, so the buffer belongs to the thread
+// and is reused for every stream the thread analyzes
+// ========================================
+struct FingerprintSampleBuffer {
+	int16_t		*samples;
+	size_t		capacity;
+};
+
+static pthread_once_t	sSampleBufferKeyOnce	= PTHREAD_ONCE_INIT;
+static pthread_key_t	sSampleBufferKey;
+
+static void
+destroySampleBuffer(void *arg)
+{
+	struct FingerprintSampleBuffer *buffer = (struct FingerprintSampleBuffer *)arg;
+	
+	free(buffer->samples);
+	free(buffer);
+}
+
+static void
+createSampleBufferKey()
+{
+	pthread_key_create(&sSampleBufferKey, destroySampleBuffer);
+}
+
+// Returns room for sampleCount samples on the calling thread, or NULL
+static int16_t *
+threadSampleBuffer(size_t sampleCount)
+{
+	pthread_once(&sSampleBufferKeyOnce, createSampleBufferKey);
+	
+	struct FingerprintSampleBuffer *buffer = (struct FingerprintSampleBuffer *)pthread_getspecific(sSampleBufferKey);
+	if(NULL == buffer) {
+		buffer = (struct FingerprintSampleBuffer *)calloc(1, sizeof(struct FingerprintSampleBuffer));
+		if(NULL == buffer || 0 != pthread_setspecific(sSampleBufferKey, buffer)) {
+			free(buffer);
+			return NULL;
+		}
+	}
+	
+	// Sized for stereo at the highest rate seen so far, so it is normally allocated once
+	if(buffer->capacity < sampleCount) {
+		int16_t *samples = (int16_t *)realloc(buffer->samples, sampleCount * sizeof(int16_t));
+		if(NULL == samples)
+			return NULL;
+		
+		buffer->samples		= samples;
+		buffer->capacity	= sampleCount;
+	}
+	
+	return buffer->samples;
+}
+
+// ========================================
+// Collects the first SECONDS_TO_PROCESS seconds of a stream for libofa
+// ========================================
+@interface FingerprintAnalyzer : NSObject <AudioAnalyzerMethods>
+{
+	int16_t				*_samples;
+	UInt32				_channelCount;
+	UInt32				_framesToProcess;
+	UInt32				_framesProcessed;
+	Float64				_sampleRate;
+
+	NSString			*_fingerprint;
+	long				_milliseconds;
+}
+- (NSString *) fingerprint;
+- (long) milliseconds;
+@end
+
+// ========================================
+// The fingerprint and lookup pipeline
+// ========================================
+@interface PUIDPipeline : NSObject
+{
+	NSArray				*_streams;
+	AudioAnalysisPipeline	*_analysis;
+
+	NSMutableArray		*_lookups;
+	NSMutableArray		*_results;
+	NSMutableDictionary	*_cache;
+
+	NSString			*_serverURL;
+	NSString			*_clientVersion;
+
+	unsigned			_activeLookups;
+	BOOL				_cancelled;
+
+	semaphore_t			_semaphore;
+}
+- (id) initWithStreams:(NSArray *)streams analyzerClasses:(NSArray *)analyzerClasses;
+
+- (AudioAnalysisPipeline *) analysis;
+
+- (void) runWithModalSession:(NSModalSession)modalSession;
+@end
+
+@interface PUIDPipeline (Private)
++ (NSString *) cachePath;
+
+- (PUIDLookup *) nextLookup;
+- (BOOL) lookupsRemain;
+
+- (void) enqueueLookup:(PUIDLookup *)lookup;
+- (void) postPUID:(NSString *)PUID forStream:(AudioStream *)stream fingerprint:(NSString *)fingerprint;
+- (void) applyResults;
+
+- (void) lookupInThread:(id)dummy;
+
+- (void) analysisPipeline:(AudioAnalysisPipeline *)pipeline didAnalyzeStream:(AudioStream *)stream withAnalyzers:(NSArray *)analyzers;
+@end
+
 BOOL
 canConnectToMusicDNS()
 {
-	SCNetworkConnectionFlags flags;
-	if(SCNetworkCheckReachabilityByName("ofa.musicdns.org", &flags)) {
+	NSString					*serverURL	= [[NSUserDefaults standardUserDefaults] stringForKey:@"musicDNSServerURL"];
+	NSString					*host		= (nil == serverURL ? nil : [[NSURL URLWithString:serverURL] host]);
+	SCNetworkConnectionFlags	flags;
+
+	if(nil == host)
+		host = @"ofa.musicdns.org";
+
+	if(SCNetworkCheckReachabilityByName([host UTF8String], &flags)) {
 		if(kSCNetworkFlagsReachable & flags && !(kSCNetworkFlagsConnectionRequired & flags))
 			return YES;
 	}
@@ -56,149 +210,428 @@ void
 calculateFingerprintsAndRequestPUIDs(NSArray *streams, NSModalSession modalSession)
 {
 	NSCParameterAssert(nil != streams);
-	
+
+	if(0 == [streams count])
+		return;
+
+	PUIDPipeline *pipeline = [[PUIDPipeline alloc] initWithStreams:streams analyzerClasses:nil];
+	if(nil == pipeline)
+		return;
+
+	[pipeline runWithModalSession:modalSession];
+	[pipeline release];
+}
+
+void 
+analyzeStreamsAndRequestPUIDs(NSArray *streams, BOOL calculateAlbumGain, NSModalSession modalSession)
+{
+	NSCParameterAssert(nil != streams);
+
+	if(0 == [streams count])
+		return;
+
+	// The fingerprint is taken from the same decode used for ReplayGain and loudness
+	PUIDPipeline *pipeline = [[PUIDPipeline alloc] initWithStreams:streams analyzerClasses:replayGainAnalyzerClasses()];
+	if(nil == pipeline)
+		return;
+
+	[[pipeline analysis] setCalculatesAlbumValues:calculateAlbumGain];
+	[pipeline runWithModalSession:modalSession];
+	[pipeline release];
+}
+
+@implementation PUIDLookup
+
+- (id) initWithStream:(AudioStream *)stream fingerprint:(NSString *)fingerprint format:(NSString *)format milliseconds:(long)milliseconds
+{
+	NSParameterAssert(nil != stream);
+	NSParameterAssert(nil != fingerprint);
+
+	if((self = [super init])) {
+		_stream			= [stream retain];
+		_fingerprint	= [fingerprint copy];
+		_format			= [format copy];
+		_milliseconds	= milliseconds;
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	[_stream release], _stream = nil;
+	[_fingerprint release], _fingerprint = nil;
+	[_format release], _format = nil;
+	[_notBefore release], _notBefore = nil;
+
+	[super dealloc];
+}
+
+- (AudioStream *)	stream					{ return _stream; }
+- (NSString *)		fingerprint				{ return _fingerprint; }
+- (NSString *)		format					{ return _format; }
+- (long)			milliseconds			{ return _milliseconds; }
+- (unsigned)		attempts				{ return _attempts; }
+
+- (void) failedAttempt
+{
+	++_attempts;
+
+	// Back off a little more after each failure
+	[_notBefore release];
+	_notBefore = [[NSDate alloc] initWithTimeIntervalSinceNow:(LOOKUP_RETRY_DELAY * _attempts)];
+}
+
+- (BOOL) isReady
+{
+	return (nil == _notBefore || 0 >= [_notBefore timeIntervalSinceNow]);
+}
+
+@end
+
+@implementation FingerprintAnalyzer
+
+- (void) dealloc
+{
+	// _samples belongs to the worker thread
+	_samples = NULL;
+	[_fingerprint release], _fingerprint = nil;
+
+	[super dealloc];
+}
+
+- (NSString *)		fingerprint				{ return _fingerprint; }
+- (long)			milliseconds			{ return _milliseconds; }
+
+- (BOOL) beginAnalyzingStream:(AudioStream *)stream format:(AudioStreamBasicDescription)format
+{
+	if(2 < format.mChannelsPerFrame)
+		return NO;
+
+	_channelCount		= format.mChannelsPerFrame;
+	_sampleRate			= format.mSampleRate;
+	_framesToProcess	= (UInt32)(SECONDS_TO_PROCESS * format.mSampleRate);
+
+	_samples = threadSampleBuffer(2 * _framesToProcess);
+	return (NULL != _samples);
+}
+
+- (BOOL) analyzeAudio:(const AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
 	float		scale				= (1L << (16 - 1));
-	int16_t		*fingerprintBuffer	= NULL;
-	
-	// Allocate the AudioBufferList for the decoder to use (2 channels regardless of channels in file)
-	AudioBufferList *bufferList = (AudioBufferList *)calloc(sizeof(AudioBufferList) + sizeof(AudioBuffer), 1);
-	NSCAssert(NULL != bufferList, @"Unable to allocate memory");
-	
-	bufferList->mNumberBuffers = 2;
-	
+	UInt32		framesToProcess		= LOCAL_MIN(frameCount, _framesToProcess - _framesProcessed);
+	int16_t		*sampleAlias		= _samples + (_channelCount * _framesProcessed);
+
+	// Interleave the samples and convert to 16-bit sample size for processing
+	unsigned channel, sample;
+	for(sample = 0; sample < framesToProcess; ++sample) {
+		for(channel = 0; channel < _channelCount; ++channel) {
+			float *floatBuffer = (float *)bufferList->mBuffers[channel].mData;
+			*sampleAlias++ = floatBuffer[sample] * scale;
+		}
+	}
+
+	_framesProcessed += framesToProcess;
+
+	// Only the first SECONDS_TO_PROCESS seconds are needed
+	return (_framesProcessed < _framesToProcess);
+}
+
+- (NSDictionary *) finishAnalyzingStream:(AudioStream *)stream
+{
+	// libofa makes no guarantees about reentrancy, so only one thread may create a fingerprint at a time
+	@synchronized([FingerprintAnalyzer class]) {
+#if __BIG_ENDIAN__
+		const char *print = ofa_create_print((unsigned char *)_samples, 
+											 OFA_BIG_ENDIAN, 
+											 (_channelCount * _framesProcessed),
+											 _sampleRate, 
+											 (2 == _channelCount));
+#else
+		const char *print = ofa_create_print((unsigned char *)_samples, 
+											 OFA_LITTLE_ENDIAN, 
+											 (_channelCount * _framesProcessed),
+											 _sampleRate, 
+											 (2 == _channelCount));
+#endif
+		if(NULL != print)
+			_fingerprint = [[NSString alloc] initWithCString:print encoding:NSASCIIStringEncoding];
+	}
+
+	_samples = NULL;
+
+	SInt64 totalFrames = ([stream isPartOfCueSheet] ? [[stream valueForKey:StreamFrameCountKey] longLongValue] : [[stream valueForKey:PropertiesTotalFramesKey] longLongValue]);
+	_milliseconds = totalFrames / (_sampleRate / 1000);
+
+	return nil;
+}
+
+@end
+
+@implementation PUIDPipeline
+
+- (id) initWithStreams:(NSArray *)streams analyzerClasses:(NSArray *)analyzerClasses
+{
+	NSParameterAssert(nil != streams);
+
+	if((self = [super init])) {
+		kern_return_t result = semaphore_create(mach_task_self(), &_semaphore, SYNC_POLICY_FIFO, 0);		
+		if(KERN_SUCCESS != result) {
+			mach_error("Couldn't create semaphore", result);
+			[self release];
+			return nil;
+		}
+
+		NSMutableArray *classes = [NSMutableArray arrayWithObject:[FingerprintAnalyzer class]];
+		if(nil != analyzerClasses)
+			[classes addObjectsFromArray:analyzerClasses];
+
+		_streams		= [streams copy];
+		_analysis		= [[AudioAnalysisPipeline alloc] initWithStreams:streams analyzerClasses:classes];
+		_lookups		= [[NSMutableArray alloc] init];
+		_results		= [[NSMutableArray alloc] init];
+
+		_cache			= [[NSMutableDictionary alloc] initWithContentsOfFile:[[self class] cachePath]];
+		if(nil == _cache)
+			_cache = [[NSMutableDictionary alloc] init];
+
+		_serverURL		= [[[NSUserDefaults standardUserDefaults] stringForKey:@"musicDNSServerURL"] copy];
+		if(nil == _serverURL)
+			_serverURL = [[NSString alloc] initWithUTF8String:default_server_url];
+
+		_clientVersion	= [[[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"] copy];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	semaphore_destroy(mach_task_self(), _semaphore);
+
+	[_streams release], _streams = nil;
+	[_analysis release], _analysis = nil;
+	[_lookups release], _lookups = nil;
+	[_results release], _results = nil;
+	[_cache release], _cache = nil;
+	[_serverURL release], _serverURL = nil;
+	[_clientVersion release], _clientVersion = nil;
+
+	[super dealloc];
+}
+
+- (AudioAnalysisPipeline *) analysis
+{
+	return _analysis;
+}
+
+- (void) runWithModalSession:(NSModalSession)modalSession
+{
+	unsigned lookupCount	= LOCAL_MAX([[NSUserDefaults standardUserDefaults] integerForKey:@"maximumConcurrentMusicDNSLookups"], 1);
 	unsigned i;
-	for(i = 0; i < bufferList->mNumberBuffers; ++i) {
-		bufferList->mBuffers[i].mData = calloc(BUFFER_LENGTH, sizeof(float));
-		NSCAssert(NULL != bufferList->mBuffers[i].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
-		bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
-		bufferList->mBuffers[i].mNumberChannels = 1;
+
+#if DEBUG
+	NSDate *startTime = [NSDate date];
+#endif
+
+	_activeLookups		= lookupCount;
+
+	// Fingerprints are handed to the lookup threads as each stream is analyzed
+	[_analysis setDelegate:self];
+	[_analysis start];
+
+	for(i = 0; i < lookupCount; ++i)
+		[NSThread detachNewThreadSelector:@selector(lookupInThread:) toTarget:self withObject:nil];
+
+	// Stream metadata is only modified on the main thread, as the workers complete
+	for(;;) {
+		[_analysis applyResults];
+		[self applyResults];
+
+		@synchronized(self) {
+			if([_analysis isFinished] && 0 == _activeLookups)
+				break;
+		}
+
+		// Allow user cancellation
+		if(NO == _cancelled && NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession]) {
+			_cancelled = YES;
+			[_analysis cancel];
+			semaphore_signal_all(_semaphore);
+		}
+
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
 	}
-	
-	for(AudioStream *stream in streams) {
-		
+
+	// Pick up anything posted after the last pass through the loop
+	[_analysis applyResults];
+	[self applyResults];
+
+	[_analysis setDelegate:nil];
+
+	@synchronized(_cache) {
+		if(NO == [_cache writeToFile:[[self class] cachePath] atomically:YES])
+			NSLog(@"Unable to save the MusicDNS PUID cache");
+	}
+
 #if DEBUG
-		clock_t track_start = clock();
+	NSLog(@"Calculated PUIDs for %u streams in %f seconds (%u lookups)", [_streams count], -[startTime timeIntervalSinceNow], lookupCount);
 #endif
-		
-		id <AudioDecoderMethods> decoder = [stream decoder:nil];
-		
-		// Skip this stream if any errors occurred
-		if(nil == decoder)
-			continue;
-		
-		// Also skip this stream if it is not mono or stereo
-		if(1 != [decoder format].mChannelsPerFrame && 2 != [decoder format].mChannelsPerFrame)
-			continue;
-		
-		// To avoid parameter errors from the decoders, set the number of buffer to the number of channels
-		bufferList->mNumberBuffers = [decoder format].mChannelsPerFrame;
-		
-		AudioStreamBasicDescription		asbd				= [decoder format];
-		UInt32							channelsToProcess	= LOCAL_MIN(asbd.mChannelsPerFrame, bufferList->mNumberBuffers);
-		UInt32							framesToRead		= SECONDS_TO_PROCESS * asbd.mSampleRate;
-		UInt32							framesRemaining		= framesToRead;
-		
-		// Allocate the OFA fingerprint buffer
-		fingerprintBuffer = (int16_t *)calloc(channelsToProcess * framesToRead, sizeof(int16_t));
-		NSCAssert(NULL != fingerprintBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
-		
-		int16_t *fingerprintAlias = fingerprintBuffer;
-		
-		// Process the first SECONDS_TO_PROCESS seconds of the file
-		for(;;) {
-			
-			// Reset read parameters
-			for(i = 0; i < bufferList->mNumberBuffers; ++i)
-				bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
-			
-			// Read some audio
-			UInt32 framesRead = [decoder readAudio:bufferList frameCount:BUFFER_LENGTH];
-			if(0 == framesRead)
+}
+
+@end
+
+@implementation PUIDPipeline (Private)
+
++ (NSString *) cachePath
+{
+	NSArray *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+	NSAssert(nil != paths, NSLocalizedStringFromTable(@"Unable to locate the \"Application Support\" folder.", @"Errors", @""));
+
+	NSString *applicationName			= [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+	NSString *applicationSupportFolder	= [[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName];
+
+	return [applicationSupportFolder stringByAppendingPathComponent:@"PUIDCache.plist"];
+}
+
+- (PUIDLookup *) nextLookup
+{
+	PUIDLookup *lookup = nil;
+
+	@synchronized(_lookups) {
+		for(PUIDLookup *candidate in _lookups) {
+			if([candidate isReady]) {
+				lookup = [[candidate retain] autorelease];
 				break;
-			
-			UInt32 framesToProcess = LOCAL_MIN(framesRead, framesRemaining);
-			
-			// Interleave the samples and convert to 16-bit sample size for processing
-			unsigned channel, sample;
-			for(sample = 0; sample < framesToProcess; ++sample) {
-				for(channel = 0; channel < channelsToProcess; ++channel) {
-					float *floatBuffer = (float *)bufferList->mBuffers[channel].mData;
-					*fingerprintAlias++ = floatBuffer[sample] * scale;
-				}
 			}
-			
-			framesRemaining -= framesToProcess;
-			
-			// Terminate loop if no frames remain to be read
-			if(0 == framesRemaining)
-				break;
-			
-			// Allow user cancellation
-			if(NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
-				goto cleanup;
 		}
 
-		// Query MusicDNS for the PUID matching this fingerprint
-		AudioData	*trackData		= new AudioData();
-		NSString	*pathExtension	= [[[stream valueForKey:StreamURLKey] path] pathExtension];
-		int			milliseconds	= [decoder totalFrames] / (asbd.mSampleRate / 1000);
-		
-#if __BIG_ENDIAN__
-/*		const char *fingerprint = ofa_create_print((unsigned char *)fingerprintBuffer, 
-												   OFA_BIG_ENDIAN, 
-												   (channelsToProcess * (framesToRead - framesRemaining)),
-												   asbd.mSampleRate, 
-												   (2 == channelsToProcess));*/
-		trackData->setData((unsigned char *)fingerprintBuffer, 
-						   OFA_BIG_ENDIAN, 
-						   (channelsToProcess * (framesToRead - framesRemaining)), 
-						   asbd.mSampleRate, 
-						   (2 == channelsToProcess), 
-						   milliseconds, 
-						   [pathExtension UTF8String]);
-#else
-/*		const char *fingerprint = ofa_create_print((unsigned char *)fingerprintBuffer, 
-												   OFA_LITTLE_ENDIAN, 
-												   (channelsToProcess * (framesToRead - framesRemaining)),
-												   asbd.mSampleRate, 
-												   (2 == channelsToProcess));*/
-		trackData->setData((unsigned char *)fingerprintBuffer, 
-						   OFA_LITTLE_ENDIAN, 
-						   (channelsToProcess * (framesToRead - framesRemaining)), 
-						   asbd.mSampleRate, 
-						   (2 == channelsToProcess), 
-						   milliseconds, 
-						   [pathExtension UTF8String]);
-#endif
+		if(nil != lookup)
+			[_lookups removeObjectIdenticalTo:lookup];
+	}
+
+	return lookup;
+}
+
+- (BOOL) lookupsRemain
+{
+	// Lookups may still be queued as streams are analyzed
+	if(NO == [_analysis isFinished])
+		return YES;
+
+	@synchronized(_lookups) {
+		return (0 != [_lookups count]);
+	}
+
+	return NO;
+}
+
+- (void) enqueueLookup:(PUIDLookup *)lookup
+{
+	NSParameterAssert(nil != lookup);
+
+	@synchronized(_lookups) {
+		[_lookups addObject:lookup];
+	}
+
+	semaphore_signal(_semaphore);
+}
+
+- (void) postPUID:(NSString *)PUID forStream:(AudioStream *)stream fingerprint:(NSString *)fingerprint
+{
+	NSParameterAssert(nil != PUID);
+	NSParameterAssert(nil != stream);
+
+	if(nil != fingerprint) {
+		@synchronized(_cache) {
+			[_cache setObject:PUID forKey:fingerprint];
+		}
+	}
+
+	@synchronized(_results) {
+		[_results addObject:[NSArray arrayWithObjects:stream, PUID, nil]];
+	}
+}
 
-		// Create the audio fingerprint
-		if(false == trackData->createPrint()) {
-			delete trackData;
+- (void) applyResults
+{
+	NSArray *results = nil;
+
+	@synchronized(_results) {
+		results = [[_results copy] autorelease];
+		[_results removeAllObjects];
+	}
+
+	for(NSArray *result in results)
+		[[result objectAtIndex:0] setValue:[result objectAtIndex:1] forKey:MetadataMusicDNSPUIDKey];
+}
+
+- (void) analysisPipeline:(AudioAnalysisPipeline *)pipeline didAnalyzeStream:(AudioStream *)stream withAnalyzers:(NSArray *)analyzers
+{
+	FingerprintAnalyzer *analyzer = [analyzers objectAtIndex:0];
+
+	// The stream couldn't be fingerprinted
+	if([NSNull null] == (id)analyzer || nil == [analyzer fingerprint])
+		return;
+
+	NSString *fingerprint	= [analyzer fingerprint];
+	NSString *PUID			= nil;
+
+	@synchronized(_cache) {
+		PUID = [[[_cache objectForKey:fingerprint] retain] autorelease];
+	}
+
+	// Only query MusicDNS for fingerprints that haven't been seen before
+	if(nil != PUID)
+		[self postPUID:PUID forStream:stream fingerprint:nil];
+	else {
+		NSString *pathExtension = [[[stream valueForKey:StreamURLKey] path] pathExtension];
+		[self enqueueLookup:[[[PUIDLookup alloc] initWithStream:stream fingerprint:fingerprint format:pathExtension milliseconds:[analyzer milliseconds]] autorelease]];
+	}
+}
+
+- (void) lookupInThread:(id)dummy
+{
+	NSAutoreleasePool	*pool		= [[NSAutoreleasePool alloc] init];
+	mach_timespec_t		timeout		= { 0, 250000000 };
+	
+	while(NO == _cancelled && [self lookupsRemain]) {
+		NSAutoreleasePool	*lookupPool		= [[NSAutoreleasePool alloc] init];
+		PUIDLookup			*lookup			= [self nextLookup];
+
+		// Sleep until a fingerprint is queued or a retry comes due
+		if(nil == lookup) {
+			semaphore_timedwait(_semaphore, timeout);
+			[lookupPool release];
 			continue;
 		}
 
-		// Get the PUID
-		NSString *bundleVersion = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"];
-		TrackInformation *trackInfo = trackData->getMetadata(PLAY_CLIENT_ID, [bundleVersion UTF8String], true);
-		if(NULL != trackInfo) {
-			std::string PUID = trackInfo->getPUID();
+		TrackInformation trackInfo;
+		
+		trackInfo.setPrint([[lookup fingerprint] UTF8String]);
+		trackInfo.setFormat([[lookup format] UTF8String]);
+		trackInfo.setLengthInMS([lookup milliseconds]);
+
+		if(retrieve_metadata(PLAY_CLIENT_ID, [_clientVersion UTF8String], &trackInfo, true, [_serverURL UTF8String])) {
+			std::string PUID = trackInfo.getPUID();
 			if(0 < PUID.length())
-				[stream setValue:[NSString stringWithCString:PUID.c_str() encoding:NSASCIIStringEncoding] forKey:MetadataMusicDNSPUIDKey];			
+				[self postPUID:[NSString stringWithCString:PUID.c_str() encoding:NSASCIIStringEncoding] forStream:[lookup stream] fingerprint:[lookup fingerprint]];
 		}
-		else
-			NSLog(@"Unable to retrieve MusicDNS metadata");
-		
-		delete trackData;
+		else {
+			[lookup failedAttempt];
 
-#if DEBUG
-		clock_t track_end = clock();
-		NSLog(@"Calculated PUID for %@ in %f seconds", stream, (track_end - track_start) / (double)CLOCKS_PER_SEC);
-#endif		
+			if(MAX_LOOKUP_ATTEMPTS > [lookup attempts])
+				[self enqueueLookup:lookup];
+			else
+				NSLog(@"Unable to retrieve MusicDNS metadata for %@", [lookup stream]);
+		}
+
+		[lookupPool release];
 	}
-		
-	// Free allocated memory
-cleanup:
-	for(i = 0; i < bufferList->mNumberBuffers; ++i)
-		free(bufferList->mBuffers[i].mData);
-	free(bufferList);
+
+	@synchronized(self) {
+		--_activeLookups;
+	}
+
+	[pool release];
 }
+
+@end
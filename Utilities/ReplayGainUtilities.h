@@ -24,6 +24,9 @@
 extern "C" {
 #endif
 
+	// The analyzers run by calculateReplayGain, for combining with others in a single pass
+	NSArray * replayGainAnalyzerClasses();
+
 	void calculateReplayGain(NSArray *streams, BOOL calculateAlbumGain, NSModalSession modalSession);
 
 #ifdef __cplusplus
@@ -20,6 +20,7 @@
 
 #import "SQLiteUtilityFunctions.h"
 #import "DatabaseObject.h"
+#import "StringInterning.h"
 
 // ========================================
 // Bind a parameter in an SQL statement to a KVC object value
@@ -87,6 +88,9 @@ bindParameter(sqlite3_stmt		*statement,
 			case eObjectTypePredicate:	
 				result = sqlite3_bind_text(statement, parameterIndex, [[value predicateFormat] UTF8String], -1, SQLITE_TRANSIENT);	
 				break;
+			case eObjectTypeData:	
+				result = sqlite3_bind_blob(statement, parameterIndex, [value bytes], [value length], SQLITE_TRANSIENT);	
+				break;
 			default:
 				result = SQLITE_ERROR;
 				break;
@@ -165,6 +169,9 @@ bindNamedParameter(sqlite3_stmt		*statement,
 			case eObjectTypePredicate:	
 				result = sqlite3_bind_text(statement, parameterIndex, [[value predicateFormat] UTF8String], -1, SQLITE_TRANSIENT);	
 				break;
+			case eObjectTypeData:	
+				result = sqlite3_bind_blob(statement, parameterIndex, [value bytes], [value length], SQLITE_TRANSIENT);	
+				break;
 			default:
 				result = SQLITE_ERROR;
 				break;
@@ -199,8 +206,11 @@ getColumnValue(sqlite3_stmt		*statement,
 			[object initValue:[NSURL URLWithString:[NSString stringWithCString:(const char *)sqlite3_column_text(statement, columnIndex) encoding:NSUTF8StringEncoding]] forKey:key];
 			break;
 		case eObjectTypeString:	
-			[object initValue:[NSString stringWithCString:(const char *)sqlite3_column_text(statement, columnIndex) encoding:NSUTF8StringEncoding] forKey:key];
+		{
+			NSString *value = [NSString stringWithCString:(const char *)sqlite3_column_text(statement, columnIndex) encoding:NSUTF8StringEncoding];
+			[object initValue:(isInternedStreamKey(key) ? internString(value) : value) forKey:key];
 			break;
+		}
 		case eObjectTypeDate:
 			[object initValue:[NSDate dateWithTimeIntervalSinceReferenceDate:sqlite3_column_double(statement, columnIndex)] forKey:key];
 			break;
@@ -240,6 +250,9 @@ getColumnValue(sqlite3_stmt		*statement,
 		case eObjectTypePredicate:	
 			[object initValue:[NSPredicate predicateWithFormat:[NSString stringWithCString:(const char *)sqlite3_column_text(statement, columnIndex) encoding:NSUTF8StringEncoding]] forKey:key];
 			break;
+		case eObjectTypeData:	
+			[object initValue:[NSData dataWithBytes:sqlite3_column_blob(statement, columnIndex) length:sqlite3_column_bytes(statement, columnIndex)] forKey:key];
+			break;
 		default:
 			break;
 	}
@@ -0,0 +1,79 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Produces a shuffled sequence of indexes in [0, count) using the SFMT generator
+// In uniform mode every index is returned once before any index repeats; the
+// permutation is materialized lazily in blocks so large collections cost nothing
+// until they are used.  In weighted mode indexes are drawn from an alias table,
+// and recently returned indexes are avoided.
+// All operations except rebuilding the alias table are O(1)
+// ========================================
+@interface ShuffleEngine : NSObject
+{
+	unsigned		_count;
+	unsigned		_capacity;
+	
+	uint32_t		*_permutation;			// Indexes [0, _remaining) have not been returned this cycle
+	uint32_t		*_positions;			// The inverse of _permutation
+	uint8_t			*_materializedBlocks;
+	unsigned		_remaining;
+	unsigned		_lastIndex;
+	
+	BOOL			_weighted;
+	float			*_weights;
+	float			*_tableWeights;			// The weights the alias table was built with
+	float			*_probabilities;
+	uint32_t		*_aliases;
+	unsigned		_tableCount;
+	double			_tableTotalWeight;
+	unsigned		_staleWeightCount;
+	
+	uint32_t		*_pickSerials;
+	uint32_t		_serial;
+}
+
+- (id) initWithCount:(unsigned)count;
+
+- (unsigned) count;
+- (void) setCount:(unsigned)count;
+
+// Appends a new index, which is eligible for the remainder of the current cycle
+- (unsigned) addIndex;
+
+// Removes index; the last index is renumbered to take its place (as with swapping and removing the last element of an array)
+- (void) removeIndex:(unsigned)index;
+
+// Starts a new cycle
+- (void) reset;
+
+- (BOOL) weighted;
+- (void) setWeighted:(BOOL)weighted;
+
+- (float) weightForIndex:(unsigned)index;
+- (void) setWeight:(float)weight forIndex:(unsigned)index;
+
+// Returns NSNotFound if count is 0
+- (unsigned) nextIndex;
+- (unsigned) nextIndexExcludingIndex:(unsigned)index;
+
+@end
@@ -0,0 +1,456 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ShuffleEngine.h"
+#include "SFMT.h"
+
+// The permutation is materialized in blocks of this many indexes
+#define BLOCK_SHIFT					12
+#define BLOCK_SIZE					(1 << BLOCK_SHIFT)
+
+// Weighted picks returned within this many picks are rejected
+#define MAXIMUM_REPEAT_WINDOW		64
+
+// Give up and pick uniformly after this many rejected weighted picks
+#define MAXIMUM_REJECTIONS			32
+
+// ========================================
+// Uniform random integer in [0, n)
+// ========================================
+static inline uint32_t
+randomIndexLessThan(uint32_t n)
+{
+	return (uint32_t)(genrand_real2() * n);
+}
+
+@interface ShuffleEngine (Private)
+- (void) ensureCapacity:(unsigned)capacity;
+- (void) materializeBlockContainingIndex:(unsigned)index;
+- (unsigned) positionOfIndex:(unsigned)index;
+- (void) swapPosition:(unsigned)a withPosition:(unsigned)b;
+- (unsigned) nextUniformIndexExcludingIndex:(unsigned)index;
+- (unsigned) nextWeightedIndexExcludingIndex:(unsigned)index;
+- (void) buildAliasTable;
+@end
+
+@implementation ShuffleEngine
+
+- (id) init
+{
+	return [self initWithCount:0];
+}
+
+- (id) initWithCount:(unsigned)count
+{
+	if((self = [super init])) {
+		_lastIndex = NSNotFound;
+		[self setCount:count];
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	free(_permutation), _permutation = NULL;
+	free(_positions), _positions = NULL;
+	free(_materializedBlocks), _materializedBlocks = NULL;
+	free(_weights), _weights = NULL;
+	free(_tableWeights), _tableWeights = NULL;
+	free(_probabilities), _probabilities = NULL;
+	free(_aliases), _aliases = NULL;
+	free(_pickSerials), _pickSerials = NULL;
+	
+	[super dealloc];
+}
+
+- (unsigned) count
+{
+	return _count;
+}
+
+- (void) setCount:(unsigned)count
+{
+	if(count < _count) {
+		_count		= 0;
+		_tableCount	= 0;
+		[self reset];
+	}
+	
+	[self ensureCapacity:count];
+
+	while(_count < count)
+		[self addIndex];
+}
+
+- (unsigned) addIndex
+{
+	[self ensureCapacity:_count + 1];
+	
+	unsigned index = _count++;
+	
+	// Positions past the end may hold stale values if the block was already materialized
+	if(_materializedBlocks[index >> BLOCK_SHIFT]) {
+		_permutation[index]	= index;
+		_positions[index]	= index;
+	}
+	
+	// Make the new index eligible for the current cycle
+	[self swapPosition:index withPosition:_remaining];
+	++_remaining;
+	
+	_weights[index]			= 1;
+	_pickSerials[index]		= 0;
+	++_staleWeightCount;
+	
+	// A renumbered index keeps the bucket (and table weight) it had before removal; a new index
+	// gets its own bucket, which carries the average table weight
+	if(0 != _tableCount && index == _tableCount) {
+		_probabilities[index]	= 1;
+		_aliases[index]			= index;
+		_tableWeights[index]	= (float)(_tableTotalWeight / _tableCount);
+		_tableTotalWeight		+= _tableWeights[index];
+		++_tableCount;
+	}
+	else if(0 == _tableCount)
+		_tableWeights[index] = 0;
+	
+	return index;
+}
+
+- (void) removeIndex:(unsigned)index
+{
+	NSParameterAssert(index < _count);
+	
+	unsigned last		= _count - 1;
+	unsigned position	= [self positionOfIndex:index];
+	
+	// Move index out of the unpicked region, then to the end
+	if(position < _remaining) {
+		[self swapPosition:position withPosition:_remaining - 1];
+		--_remaining;
+	}
+	
+	[self swapPosition:[self positionOfIndex:index] withPosition:last];
+	--_count;
+
+	// Renumber the last index
+	if(index != last) {
+		position				= [self positionOfIndex:last];
+		_permutation[position]	= index;
+		_positions[index]		= position;
+
+		_weights[index]			= _weights[last];
+		_tableWeights[index]	= _tableWeights[last];
+		_pickSerials[index]		= _pickSerials[last];
+	}
+	
+	if(_lastIndex == index)
+		_lastIndex = NSNotFound;
+	else if(_lastIndex == last)
+		_lastIndex = index;
+	
+	++_staleWeightCount;
+}
+
+- (void) reset
+{
+	if(NULL != _materializedBlocks)
+		memset(_materializedBlocks, 0, _capacity >> BLOCK_SHIFT);
+	
+	_remaining	= _count;
+	_lastIndex	= NSNotFound;
+	
+	// Move all previous picks out of the repeat window
+	_serial		+= MAXIMUM_REPEAT_WINDOW;
+}
+
+- (BOOL) weighted
+{
+	return _weighted;
+}
+
+- (void) setWeighted:(BOOL)weighted
+{
+	_weighted = weighted;
+}
+
+- (float) weightForIndex:(unsigned)index
+{
+	NSParameterAssert(index < _count);
+	
+	return _weights[index];
+}
+
+- (void) setWeight:(float)weight forIndex:(unsigned)index
+{
+	NSParameterAssert(index < _count);
+	NSParameterAssert(0 <= weight);
+	
+	// Decreases are handled exactly by rejection, but a large decrease wastes picks
+	if(weight > _tableWeights[index] || weight < _tableWeights[index] / 4)
+		++_staleWeightCount;
+	
+	_weights[index] = weight;
+}
+
+- (unsigned) nextIndex
+{
+	return [self nextIndexExcludingIndex:NSNotFound];
+}
+
+- (unsigned) nextIndexExcludingIndex:(unsigned)index
+{
+	if(0 == _count)
+		return NSNotFound;
+	
+	if([self weighted])
+		return [self nextWeightedIndexExcludingIndex:index];
+	else
+		return [self nextUniformIndexExcludingIndex:index];
+}
+
+@end
+
+@implementation ShuffleEngine (Private)
+
+- (void) ensureCapacity:(unsigned)capacity
+{
+	if(capacity <= _capacity)
+		return;
+	
+	unsigned newCapacity = (2 * _capacity > capacity ? 2 * _capacity : capacity);
+	newCapacity = (newCapacity + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+	
+	_permutation		= realloc(_permutation, newCapacity * sizeof(uint32_t));
+	_positions			= realloc(_positions, newCapacity * sizeof(uint32_t));
+	_materializedBlocks	= realloc(_materializedBlocks, newCapacity >> BLOCK_SHIFT);
+	_weights			= realloc(_weights, newCapacity * sizeof(float));
+	_tableWeights		= realloc(_tableWeights, newCapacity * sizeof(float));
+	_probabilities		= realloc(_probabilities, newCapacity * sizeof(float));
+	_aliases			= realloc(_aliases, newCapacity * sizeof(uint32_t));
+	_pickSerials		= realloc(_pickSerials, newCapacity * sizeof(uint32_t));
+	
+	NSAssert(NULL != _permutation && NULL != _positions && NULL != _materializedBlocks && NULL != _weights && NULL != _tableWeights && NULL != _probabilities && NULL != _aliases && NULL != _pickSerials, 
+			 NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	memset(_materializedBlocks + (_capacity >> BLOCK_SHIFT), 0, (newCapacity - _capacity) >> BLOCK_SHIFT);
+	
+	_capacity = newCapacity;
+}
+
+// Until a block is materialized every position in it holds its own index
+- (void) materializeBlockContainingIndex:(unsigned)index
+{
+	unsigned block = index >> BLOCK_SHIFT;
+	
+	if(_materializedBlocks[block])
+		return;
+	
+	unsigned i;
+	for(i = block << BLOCK_SHIFT; i < (block + 1) << BLOCK_SHIFT; ++i) {
+		_permutation[i]		= i;
+		_positions[i]		= i;
+	}
+	
+	_materializedBlocks[block] = 1;
+}
+
+- (unsigned) positionOfIndex:(unsigned)index
+{
+	[self materializeBlockContainingIndex:index];
+	return _positions[index];
+}
+
+- (void) swapPosition:(unsigned)a withPosition:(unsigned)b
+{
+	[self materializeBlockContainingIndex:a];
+	[self materializeBlockContainingIndex:b];
+
+	if(a == b)
+		return;
+	
+	uint32_t indexA		= _permutation[a];
+	uint32_t indexB		= _permutation[b];
+	
+	_permutation[a]		= indexB;
+	_permutation[b]		= indexA;
+	_positions[indexA]	= b;
+	_positions[indexB]	= a;
+}
+
+// Fisher-Yates, one step per pick
+- (unsigned) nextUniformIndexExcludingIndex:(unsigned)index
+{
+	unsigned candidates, position, result;
+	
+	for(;;) {
+		// Start a new cycle
+		if(0 == _remaining)
+			_remaining = _count;
+		
+		candidates = _remaining;
+		
+		// Set aside the excluded index, and at the start of a cycle the previous cycle's last index
+		// These remain eligible for later picks in this cycle
+		if(1 < _count) {
+			if(index < _count && (position = [self positionOfIndex:index]) < candidates)
+				[self swapPosition:position withPosition:--candidates];
+			
+			if(_remaining == _count && 1 < candidates && _lastIndex < _count && _lastIndex != index && (position = [self positionOfIndex:_lastIndex]) < candidates)
+				[self swapPosition:position withPosition:--candidates];
+		}
+		
+		// Only the excluded index was left in this cycle
+		if(0 == candidates) {
+			_remaining = 0;
+			continue;
+		}
+		
+		position	= randomIndexLessThan(candidates);
+		
+		[self swapPosition:position withPosition:--_remaining];
+		result		= _permutation[_remaining];
+		
+		_lastIndex = result;
+		return result;
+	}
+}
+
+// Alias method, with rejection for weights that changed since the table was built
+- (unsigned) nextWeightedIndexExcludingIndex:(unsigned)index
+{
+	unsigned	window, attempt, bucket, candidate, result;
+	float		tableWeight;
+	
+	if(_staleWeightCount > _count / 32)
+		[self buildAliasTable];
+	
+	window	= (_count / 2 < MAXIMUM_REPEAT_WINDOW ? _count / 2 : MAXIMUM_REPEAT_WINDOW);
+	result	= NSNotFound;
+	
+	for(attempt = 0; 0 != _tableCount && attempt < MAXIMUM_REJECTIONS; ++attempt) {
+		bucket		= randomIndexLessThan(_tableCount);
+		candidate	= (genrand_real2() < _probabilities[bucket] ? bucket : _aliases[bucket]);
+		
+		if(candidate >= _count || candidate == index)
+			continue;
+		
+		tableWeight = _tableWeights[candidate];
+		if(0 >= tableWeight || (_weights[candidate] < tableWeight && genrand_real2() * tableWeight >= _weights[candidate]))
+			continue;
+		
+		if(0 != _pickSerials[candidate] && _serial - _pickSerials[candidate] < window)
+			continue;
+		
+		result = candidate;
+		break;
+	}
+	
+	// All weights are zero, or the picks kept hitting recent or excluded indexes
+	if(NSNotFound == result)
+		result = [self nextUniformIndexExcludingIndex:index];
+	
+	if(0 == ++_serial)
+		_serial = 1;
+	
+	_pickSerials[result]	= _serial;
+	_lastIndex				= result;
+	
+	return result;
+}
+
+// Vose's alias method
+- (void) buildAliasTable
+{
+	unsigned	i, small, large, smallCount, largeCount;
+	double		totalWeight;
+	double		*scaledWeights;
+	uint32_t	*worklist;
+	
+#if DEBUG
+	clock_t start = clock();
+#endif
+	
+	_staleWeightCount	= 0;
+	_tableCount			= 0;
+	_tableTotalWeight	= 0;
+	
+	totalWeight = 0;
+	for(i = 0; i < _count; ++i) {
+		_tableWeights[i] = _weights[i];
+		totalWeight += _weights[i];
+	}
+	
+	if(0 >= totalWeight)
+		return;
+
+	scaledWeights	= malloc(_count * sizeof(double));
+	worklist		= malloc(_count * sizeof(uint32_t));
+	NSAssert(NULL != scaledWeights && NULL != worklist, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	// Small entries are stacked from the front of the worklist and large entries from the back
+	smallCount = largeCount = 0;
+	for(i = 0; i < _count; ++i) {
+		scaledWeights[i] = _weights[i] * _count / totalWeight;
+		if(1 > scaledWeights[i])
+			worklist[smallCount++] = i;
+		else
+			worklist[_count - ++largeCount] = i;
+	}
+	
+	while(0 != smallCount && 0 != largeCount) {
+		small	= worklist[--smallCount];
+		large	= worklist[_count - largeCount--];
+		
+		_probabilities[small]	= (float)scaledWeights[small];
+		_aliases[small]			= large;
+		
+		scaledWeights[large] = (scaledWeights[large] + scaledWeights[small]) - 1;
+		if(1 > scaledWeights[large])
+			worklist[smallCount++] = large;
+		else
+			worklist[_count - ++largeCount] = large;
+	}
+	
+	// Anything left is 1 up to rounding error
+	while(0 != largeCount) {
+		large					= worklist[_count - largeCount--];
+		_probabilities[large]	= 1;
+		_aliases[large]			= large;
+	}
+	
+	while(0 != smallCount) {
+		small					= worklist[--smallCount];
+		_probabilities[small]	= 1;
+		_aliases[small]			= small;
+	}
+	
+	free(scaledWeights);
+	free(worklist);
+	
+	_tableCount			= _count;
+	_tableTotalWeight	= totalWeight;
+	
+#if DEBUG
+	NSLog(@"Built shuffle alias table for %u indexes in %f seconds", _tableCount, (clock() - start) / (double)CLOCKS_PER_SEC);
+#endif
+}
+
+@end
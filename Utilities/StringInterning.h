@@ -0,0 +1,47 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// ========================================
+	// Shared instances for AudioStream values that repeat across thousands of streams
+	// (artists, albums, genres, formats), so equal values are one object and compare by pointer
+	// Interned strings live for the lifetime of the application
+	// ========================================
+
+	// Returns the shared instance of a string equal to string
+	NSString * internString(NSString *string);
+
+	// Returns YES if values for key are interned by the loaders and readers
+	BOOL isInternedStreamKey(NSString *key);
+
+	// Returns values with the strings for interned keys replaced by their shared instances
+	NSDictionary * internStreamValues(NSDictionary *values);
+
+	// Distinct strings held, duplicates replaced, and the bytes those duplicates occupied
+	void getStringInterningStatistics(unsigned *stringCount, unsigned *duplicateCount, unsigned long long *bytesSaved);
+
+#ifdef __cplusplus
+}
+#endif
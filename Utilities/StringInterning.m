@@ -0,0 +1,111 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "StringInterning.h"
+#import "AudioStream.h"
+
+#include <malloc/malloc.h>
+
+static NSMutableSet			*sInternedStrings		= nil;
+static NSSet				*sInternedKeys			= nil;
+static unsigned				sDuplicateCount			= 0;
+static unsigned long long	sBytesSaved				= 0;
+
+static NSMutableSet *
+internedStrings()
+{
+	@synchronized([NSString class]) {
+		if(nil == sInternedStrings)
+			sInternedStrings = [[NSMutableSet alloc] initWithCapacity:4096];
+	}
+	return sInternedStrings;
+}
+
+NSString *
+internString(NSString *string)
+{
+	if(nil == string)
+		return nil;
+	
+	NSMutableSet	*strings	= internedStrings();
+	NSString		*result		= nil;
+	
+	@synchronized(strings) {
+		result = [strings member:string];
+		if(nil == result) {
+			// Mutable strings could change underneath other streams
+			result = [string copy];
+			[strings addObject:result];
+			[result release];
+		}
+		else if(result != string) {
+			++sDuplicateCount;
+			sBytesSaved += malloc_size(string);
+		}
+	}
+	
+	return result;
+}
+
+BOOL
+isInternedStreamKey(NSString *key)
+{
+	@synchronized([NSString class]) {
+		if(nil == sInternedKeys)
+			sInternedKeys = [[NSSet alloc] initWithObjects:
+				MetadataArtistKey, MetadataAlbumArtistKey, MetadataAlbumTitleKey, MetadataGenreKey, MetadataComposerKey,
+				PropertiesFileTypeKey, PropertiesDataFormatKey, PropertiesFormatDescriptionKey,
+				nil];
+	}
+	
+	return [sInternedKeys containsObject:key];
+}
+
+NSDictionary *
+internStreamValues(NSDictionary *values)
+{
+	if(nil == values)
+		return nil;
+	
+	NSMutableDictionary *result = [NSMutableDictionary dictionaryWithDictionary:values];
+	
+	for(NSString *key in values) {
+		id value = [values objectForKey:key];
+		if([value isKindOfClass:[NSString class]] && isInternedStreamKey(key))
+			[result setObject:internString(value) forKey:key];
+	}
+	
+	return result;
+}
+
+void
+getStringInterningStatistics(unsigned *stringCount, unsigned *duplicateCount, unsigned long long *bytesSaved)
+{
+	NSMutableSet *strings = internedStrings();
+	
+	@synchronized(strings) {
+		if(NULL != stringCount)
+			*stringCount = [strings count];
+		if(NULL != duplicateCount)
+			*duplicateCount = sDuplicateCount;
+		if(NULL != bytesSaved)
+			*bytesSaved = sBytesSaved;
+	}
+}
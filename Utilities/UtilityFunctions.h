@@ -43,6 +43,13 @@ extern "C" {
 
 	NSData * getPNGDataForImage(NSImage *image);
 	NSData * getBitmapDataForImage(NSImage *image, NSBitmapImageFileType type);
+
+	// Hex-encoded MD5 digest, used to identify identical album art
+	NSString * getMD5DigestForBytes(const void *bytes, unsigned length);
+
+	// File offset of an embedded picture's data within the ID3v2 tag of an MP3, AIFF or WAVE file, or -1
+	// The data can't be located in tags that use unsynchronisation or compression
+	off_t getID3v2PictureOffset(NSString *path, const void *picture, unsigned length);
 	
 #if MAC_OS_X_VERSION_MIN_REQUIRED > MAC_OS_X_VERSION_10_4
 	NSTreeNode * treeNodeForRepresentedObject(NSTreeNode *root, id representedObject);
@@ -22,6 +22,7 @@
 
 #include <AudioToolbox/AudioFile.h>
 #include <ogg/ogg.h>
+#include <CommonCrypto/CommonDigest.h>
 
 static NSArray		*sBuiltinExtensions		= nil;
 static NSArray		*sCoreAudioExtensions	= nil;
@@ -216,6 +217,115 @@ getBitmapDataForImage(NSImage					*image,
 	return [bitmapRep representationUsingType:type properties:nil]; 
 }
 
+NSString *
+getMD5DigestForBytes(const void		*bytes,
+					 unsigned		length)
+{
+	NSCParameterAssert(NULL != bytes);
+	
+	unsigned char	digest [CC_MD5_DIGEST_LENGTH];
+	char			hex [(2 * CC_MD5_DIGEST_LENGTH) + 1];
+	unsigned		i;
+	
+	CC_MD5(bytes, length, digest);
+	
+	for(i = 0; i < CC_MD5_DIGEST_LENGTH; ++i)
+		snprintf(hex + (2 * i), 3, "%02x", digest[i]);
+	
+	return [NSString stringWithCString:hex encoding:NSASCIIStringEncoding];
+}
+
+// ID3v2 tags are at the start of MP3 files and in an "ID3 " chunk of AIFF and WAVE files
+static off_t
+getID3v2TagOffset(NSFileHandle *file)
+{
+	NSData				*header			= [file readDataOfLength:12];
+	const unsigned char	*bytes			= [header bytes];
+	BOOL				bigEndian;
+	unsigned long long	offset, chunkSize;
+
+	if(3 <= [header length] && 0 == memcmp(bytes, "ID3", 3))
+		return 0;
+	
+	if(12 != [header length])
+		return -1;
+	
+	if(0 == memcmp(bytes, "FORM", 4))
+		bigEndian = YES;
+	else if(0 == memcmp(bytes, "RIFF", 4))
+		bigEndian = NO;
+	else
+		return -1;
+	
+	for(offset = 12; ; offset += 8 + chunkSize + (chunkSize & 1)) {
+		[file seekToFileOffset:offset];
+		header = [file readDataOfLength:8];
+		if(8 != [header length])
+			return -1;
+		
+		bytes		= [header bytes];
+		chunkSize	= (bigEndian 
+					   ? ((unsigned long long)bytes[4] << 24) | (bytes[5] << 16) | (bytes[6] << 8) | bytes[7]
+					   : ((unsigned long long)bytes[7] << 24) | (bytes[6] << 16) | (bytes[5] << 8) | bytes[4]);
+		
+		if(0 == memcmp(bytes, "ID3 ", 4) || 0 == memcmp(bytes, "id3 ", 4))
+			return offset + 8;
+	}
+}
+
+off_t
+getID3v2PictureOffset(NSString		*path,
+					  const void	*picture,
+					  unsigned		length)
+{
+	NSCParameterAssert(nil != path);
+	NSCParameterAssert(NULL != picture);
+	
+	NSFileHandle	*file		= [NSFileHandle fileHandleForReadingAtPath:path];
+	off_t			result		= -1;
+	
+	if(nil == file || 0 == length)
+		return -1;
+	
+	@try {
+		off_t tagOffset = getID3v2TagOffset(file);
+		if(-1 == tagOffset)
+			return -1;
+		
+		[file seekToFileOffset:tagOffset];
+		NSData *header = [file readDataOfLength:10];
+		if(10 != [header length])
+			return -1;
+		
+		// Unsynchronised tags don't store the picture verbatim
+		const unsigned char *bytes = [header bytes];
+		if(0 != memcmp(bytes, "ID3", 3) || (0x80 & bytes[5]))
+			return -1;
+		
+		unsigned	tagSize		= ((bytes[6] & 0x7F) << 21) | ((bytes[7] & 0x7F) << 14) | ((bytes[8] & 0x7F) << 7) | (bytes[9] & 0x7F);
+		NSData		*tag		= [file readDataOfLength:tagSize];
+		const char	*start		= [tag bytes];
+		const char	*end		= start + [tag length];
+		const char	*match;
+		
+		for(match = start; NULL != match && length <= (unsigned)(end - match); ++match) {
+			match = memchr(match, *(const char *)picture, (end - match) - length + 1);
+			if(NULL != match && 0 == memcmp(match, picture, length)) {
+				result = tagOffset + 10 + (match - start);
+				break;
+			}
+		}
+	}
+	
+	@catch(NSException *exception) {
+		result = -1;
+	}
+	
+	[file closeFile];
+	
+	return result;
+}
+
 //#if MAC_OS_X_VERSION_MIN_REQUIRED > MAC_OS_X_VERSION_10_4
 NSTreeNode * 
 treeNodeForRepresentedObject(NSTreeNode *root, id representedObject)